@@ -61,6 +61,7 @@ dependencies = [
 	'ext/common/agents/HelperAgent/RequestHandler.h',
 	'ext/common/agents/HelperAgent/RequestHandler.cpp',
 	'ext/common/agents/HelperAgent/ScgiRequestParser.h',
+	'ext/common/Utils/HttpHeaderNames.h',
 	'ext/common/Constants.h',
 	'ext/common/StaticString.h',
 	'ext/common/Account.h',
@@ -78,6 +79,7 @@ dependencies = [
 	'ext/common/ApplicationPool2/Process.h',
 	'ext/common/ApplicationPool2/Session.h',
 	'ext/common/ApplicationPool2/Options.h',
+	'ext/common/ApplicationPool2/RequestRateTracker.h',
 	'ext/common/ApplicationPool2/PipeWatcher.h',
 	'ext/common/ApplicationPool2/Spawner.h',
 	'ext/common/ApplicationPool2/SpawnerFactory.h',
@@ -38,7 +38,8 @@ APACHE2_MODULE_INPUT_FILES = {
 		ext/common/agents/LoggingAgent/FilterSupport.h),
 	APACHE2_OUTPUT_DIR + 'Bucket.o' => %w(
 		ext/apache2/Bucket.cpp
-		ext/apache2/Bucket.h),
+		ext/apache2/Bucket.h
+		ext/common/Utils/Dechunker.h),
 	APACHE2_OUTPUT_DIR + 'Hooks.o' => %w(
 		ext/apache2/Hooks.cpp
 		ext/apache2/Hooks.h
@@ -50,8 +51,10 @@ APACHE2_MODULE_INPUT_FILES = {
 		ext/common/Exceptions.h
 		ext/common/Logging.h
 		ext/common/RandomGenerator.h
+		ext/common/RequestRing.h
 		ext/common/ServerInstanceDir.h
 		ext/common/Utils.h
+		ext/common/Utils/Dechunker.h
 		ext/common/Utils/Timer.h)
 }
 APACHE2_MODULE_OBJECTS = APACHE2_MODULE_INPUT_FILES.keys
@@ -65,11 +65,24 @@ TEST_CXX_OBJECTS = {
 		ext/common/ApplicationPool2/Socket.h
 		ext/common/ApplicationPool2/Spawner.h
 		ext/common/ApplicationPool2/SmartSpawner.h),
+	'test/cxx/ApplicationPool2/RequestRateTrackerTest.o' => %w(
+		test/cxx/ApplicationPool2/RequestRateTrackerTest.cpp
+		ext/common/ApplicationPool2/RequestRateTracker.h),
 	'test/cxx/ApplicationPool2/ProcessTest.o' => %w(
 		test/cxx/ApplicationPool2/ProcessTest.cpp
 		ext/common/ApplicationPool2/Process.h
 		ext/common/ApplicationPool2/Socket.h
 		ext/common/ApplicationPool2/Session.h),
+	'test/cxx/ApplicationPool2/AdoptingSpawnerTest.o' => %w(
+		test/cxx/ApplicationPool2/AdoptingSpawnerTest.cpp
+		ext/common/ApplicationPool2/Process.h
+		ext/common/ApplicationPool2/Socket.h
+		ext/common/ApplicationPool2/Spawner.h
+		ext/common/ApplicationPool2/SpawnerFactory.h
+		ext/common/ApplicationPool2/AdoptingSpawner.h
+		ext/common/ApplicationPool2/ProcessHandoff.h
+		ext/common/ApplicationPool2/DummySpawner.h
+		ext/common/agents/HotRestartHandoff.h),
 	'test/cxx/ApplicationPool2/PoolTest.o' => %w(
 		test/cxx/ApplicationPool2/PoolTest.cpp
 		ext/common/ApplicationPool2/SuperGroup.h
@@ -139,6 +152,8 @@ TEST_CXX_OBJECTS = {
 	'test/cxx/RequestHandlerTest.o' => %w(
 		test/cxx/RequestHandlerTest.cpp
 		ext/common/agents/HelperAgent/RequestHandler.h
+		ext/common/RequestRing.h
+		ext/common/Utils/HttpHeaderNames.h
 		ext/common/agents/HelperAgent/FileBackedPipe.h
 		ext/common/agents/HelperAgent/ScgiRequestParser.h
 		ext/common/agents/HelperAgent/AgentOptions.h
@@ -174,6 +189,12 @@ TEST_CXX_OBJECTS = {
 		test/cxx/CachedFileStatTest.cpp
 		ext/common/Utils/CachedFileStat.hpp
 		ext/common/Utils/CachedFileStat.cpp),
+	'test/cxx/LatencyHistogramTest.o' => %w(
+		test/cxx/LatencyHistogramTest.cpp
+		ext/common/Utils/LatencyHistogram.h),
+	'test/cxx/HttpHeaderNamesTest.o' => %w(
+		test/cxx/HttpHeaderNamesTest.cpp
+		ext/common/Utils/HttpHeaderNames.h),
 	'test/cxx/BufferedIOTest.o' => %w(
 		test/cxx/BufferedIOTest.cpp
 		ext/common/Utils/BufferedIO.h
@@ -182,6 +203,18 @@ TEST_CXX_OBJECTS = {
 		test/cxx/MessageIOTest.cpp
 		ext/common/Utils/MessageIO.h
 		ext/common/Utils/IOUtils.h),
+	'test/cxx/HotRestartHandoffTest.o' => %w(
+		test/cxx/HotRestartHandoffTest.cpp
+		ext/common/agents/HotRestartHandoff.h
+		ext/common/ApplicationPool2/ProcessHandoff.h
+		ext/common/ApplicationPool2/Socket.h
+		ext/common/Utils/MessageIO.h
+		ext/common/Utils/IOUtils.h),
+	'test/cxx/RequestRingTest.o' => %w(
+		test/cxx/RequestRingTest.cpp
+		ext/common/RequestRing.h
+		ext/common/FileDescriptor.h
+		ext/common/Utils/IOUtils.h),
 	'test/cxx/MessagePassingTest.o' => %w(
 		test/cxx/MessagePassingTest.cpp
 		ext/common/Utils/MessagePassing.h),
@@ -272,3 +305,37 @@ TEST_CXX_OBJECTS.each_pair do |target, sources|
 		compile_cxx sources[0], "-o #{target} -include test/cxx/TestSupport.h #{TEST_CXX_CFLAGS}"
 	end
 end
+
+
+### C++ benchmarks ###
+
+TEST_CXX_BENCHMARKS = {
+	'test/benchmark/ProcessMetricsCollectorBenchmark' => %w(
+		test/benchmark/ProcessMetricsCollectorBenchmark.cpp
+		ext/common/Utils/ProcessMetricsCollector.h),
+	'test/benchmark/FilterSupportBenchmark' => %w(
+		test/benchmark/FilterSupportBenchmark.cpp
+		ext/common/agents/LoggingAgent/FilterSupport.h),
+	'test/benchmark/HttpHeaderNamesBenchmark' => %w(
+		test/benchmark/HttpHeaderNamesBenchmark.cpp
+		ext/common/Utils/HttpHeaderNames.h)
+}
+
+TEST_CXX_BENCHMARKS.each_pair do |target, sources|
+	dependencies = [
+		sources,
+		TEST_BOOST_OXT_LIBRARY,
+		TEST_COMMON_LIBRARY.link_objects,
+		'ext/common/Constants.h'
+	].flatten.compact
+	file(target => dependencies) do
+		create_executable(target, sources[0], "#{TEST_CXX_CFLAGS} #{TEST_CXX_LDFLAGS}")
+	end
+end
+
+desc "Run benchmarks for the C++ components"
+task 'test:cxx:benchmark' => TEST_CXX_BENCHMARKS.keys do
+	TEST_CXX_BENCHMARKS.each_key do |target|
+		sh "cd test && ./#{target.sub(/^test\//, '')}"
+	end
+end
@@ -35,6 +35,7 @@ task 'test:clean' do
 	sh("rm -rf test/oxt/oxt_test_main test/oxt/*.o test/cxx/*.dSYM test/cxx/CxxTestMain")
 	sh("rm -f test/cxx/*.o test/cxx/*/*.o test/cxx/*.gch")
 	sh("rm -f test/support/allocate_memory")
+	sh("rm -f test/benchmark/*Benchmark")
 end
 
 task :clean => 'test:clean'
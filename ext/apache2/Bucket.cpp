@@ -24,6 +24,8 @@
  */
 
 #include <boost/make_shared.hpp>
+#include <cstring>
+#include <cerrno>
 #include "Bucket.h"
 
 namespace Passenger {
@@ -48,6 +50,98 @@ struct BucketData {
 	bool bufferResponse;
 };
 
+struct UnframeContext {
+	PassengerBucketState *state;
+	char *output;
+	size_t size;
+};
+
+static void
+unframe_chunk_data(const char *data, size_t size, void *userData) {
+	UnframeContext *ctx = (UnframeContext *) userData;
+	// The output never overtakes the input, but they may overlap.
+	memmove(ctx->output + ctx->size, data, size);
+	ctx->size += size;
+}
+
+static void
+unframe_chunk_end(void *userData) {
+	UnframeContext *ctx = (UnframeContext *) userData;
+	ctx->state->responseEndReached = true;
+}
+
+/**
+ * Removes the keep-alive framing from data that has just been read,
+ * in-place. The response header is passed through as-is, the response
+ * body is dechunked. Returns the size of the remaining data.
+ */
+static size_t
+unframe(PassengerBucketState *state, char *buf, size_t size) {
+	static const char headerEnd[] = "\r\n\r\n";
+	size_t pos = 0;
+	
+	while (!state->headerSeen && pos < size) {
+		char c = buf[pos++];
+		if (c == headerEnd[state->headerEndMatched]) {
+			state->headerEndMatched++;
+			state->headerSeen = state->headerEndMatched == sizeof(headerEnd) - 1;
+		} else {
+			state->headerEndMatched = (c == '\r') ? 1 : 0;
+		}
+	}
+	
+	if (pos < size) {
+		UnframeContext ctx;
+		ctx.state  = state;
+		ctx.output = buf + pos;
+		ctx.size   = 0;
+		state->dechunker.onData   = unframe_chunk_data;
+		state->dechunker.onEnd    = unframe_chunk_end;
+		state->dechunker.userData = &ctx;
+		state->dechunker.feed(buf + pos, size - pos);
+		state->dechunker.userData = NULL;
+		return pos + ctx.size;
+	} else {
+		return pos;
+	}
+}
+
+static ssize_t
+read_connection(PassengerBucketState *state, char *buf, size_t size) {
+	ssize_t ret;
+	do {
+		ret = read(state->connection, buf, size);
+	} while (ret == -1 && errno == EINTR);
+	return ret;
+}
+
+/**
+ * Like read(), but for keep-alive connections: it returns 0 when the end
+ * of the response has been reached, and never returns 0 before that
+ * unless the helper agent closed the connection.
+ */
+static ssize_t
+read_keepalive_response(PassengerBucketState *state, char *buf, size_t size) {
+	ssize_t ret;
+	size_t len;
+	
+	do {
+		if (state->responseEndReached) {
+			return 0;
+		}
+		ret = read_connection(state, buf, size);
+		if (ret <= 0) {
+			return ret;
+		}
+		len = unframe(state, buf, ret);
+		if (state->dechunker.hasError()) {
+			errno = EPROTO;
+			return -1;
+		}
+	} while (len == 0);
+	return len;
+}
+
 static void
 bucket_destroy(void *data) {
 	BucketData *bucket_data = (BucketData *) data;
@@ -91,9 +185,11 @@ bucket_read(apr_bucket *bucket, const char **str, apr_size_t *len, apr_read_type
 		return APR_ENOMEM;
 	}
 	
-	do {
-		ret = read(data->state->connection, buf, APR_BUCKET_BUFF_SIZE);
-	} while (ret == -1 && errno == EINTR);
+	if (data->state->keepAlive) {
+		ret = read_keepalive_response(data->state.get(), buf, APR_BUCKET_BUFF_SIZE);
+	} else {
+		ret = read_connection(data->state.get(), buf, APR_BUCKET_BUFF_SIZE);
+	}
 	
 	if (ret > 0) {
 		apr_bucket_heap *h;
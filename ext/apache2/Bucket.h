@@ -28,6 +28,7 @@
 #include <boost/shared_ptr.hpp>
 #include <apr_buckets.h>
 #include <FileDescriptor.h>
+#include <Utils/Dechunker.h>
 
 namespace Passenger {
 
@@ -54,11 +55,31 @@ struct PassengerBucketState {
 	/** Connection to the helper agent. */
 	FileDescriptor connection;
 	
-	PassengerBucketState(const FileDescriptor &conn) {
+	/** Whether the connection is a keep-alive connection. On such
+	 * connections the helper agent frames the response body with the
+	 * chunked transfer encoding, which the PassengerBucket removes.
+	 */
+	bool keepAlive;
+	
+	/** Whether the end of the keep-alive response has been reached.
+	 * If so, the connection can be used for another request.
+	 */
+	bool responseEndReached;
+	
+	/** Keep-alive response parsing state. */
+	bool headerSeen;
+	unsigned int headerEndMatched;
+	Dechunker dechunker;
+	
+	PassengerBucketState(const FileDescriptor &conn, bool _keepAlive = false) {
 		bytesRead  = 0;
 		completed  = false;
 		errorCode  = 0;
 		connection = conn;
+		keepAlive  = _keepAlive;
+		responseEndReached = false;
+		headerSeen = false;
+		headerEndMatched = 0;
 	}
 };
 
@@ -81,6 +102,9 @@ typedef boost::shared_ptr<PassengerBucketState> PassengerBucketStatePtr;
  * - It ignores the APR_NONBLOCK_READ flag because that's known to cause
  *   strange I/O problems.
  * - It can store its current state in a PassengerBucketState data structure.
+ * - It can read responses from keep-alive connections, in which case it
+ *   completes when the end of the response has been reached instead of
+ *   at end-of-stream.
  */
 apr_bucket *passenger_bucket_create(const PassengerBucketStatePtr &state,
                                     apr_bucket_alloc_t *list,
@@ -256,6 +256,7 @@ DEFINE_SERVER_INT_CONFIG_SETTER(cmd_passenger_max_pool_size, maxPoolSize, unsign
 DEFINE_SERVER_INT_CONFIG_SETTER(cmd_passenger_max_instances_per_app, maxInstancesPerApp, unsigned int, 0)
 DEFINE_SERVER_INT_CONFIG_SETTER(cmd_passenger_pool_idle_time, poolIdleTime, unsigned int, 0)
 DEFINE_SERVER_BOOLEAN_CONFIG_SETTER(cmd_passenger_user_switching, userSwitching)
+DEFINE_SERVER_BOOLEAN_CONFIG_SETTER(cmd_passenger_request_ring, requestRing)
 DEFINE_SERVER_STR_CONFIG_SETTER(cmd_passenger_default_user, defaultUser)
 DEFINE_SERVER_STR_CONFIG_SETTER(cmd_passenger_default_group, defaultGroup)
 DEFINE_SERVER_STR_CONFIG_SETTER(cmd_passenger_temp_dir, tempDir)
@@ -263,6 +264,8 @@ DEFINE_SERVER_STR_CONFIG_SETTER(cmd_union_station_gateway_address, unionStationG
 DEFINE_SERVER_INT_CONFIG_SETTER(cmd_union_station_gateway_port, unionStationGatewayPort, int, 1)
 DEFINE_SERVER_STR_CONFIG_SETTER(cmd_union_station_gateway_cert, unionStationGatewayCert)
 DEFINE_SERVER_STR_CONFIG_SETTER(cmd_union_station_proxy_address, unionStationProxyAddress)
+DEFINE_SERVER_INT_CONFIG_SETTER(cmd_passenger_union_station_batch_size, unionStationBatchSize, unsigned int, 0)
+DEFINE_SERVER_INT_CONFIG_SETTER(cmd_passenger_union_station_batch_delay, unionStationBatchDelay, unsigned int, 0)
 DEFINE_SERVER_STR_CONFIG_SETTER(cmd_passenger_analytics_log_user, analyticsLogUser)
 DEFINE_SERVER_STR_CONFIG_SETTER(cmd_passenger_analytics_log_group, analyticsLogGroup)
 
@@ -462,6 +465,11 @@ const command_rec passenger_commands[] = {
 		NULL,
 		RSRC_CONF,
 		"Whether to enable user switching support."),
+	AP_INIT_FLAG("PassengerRequestRing",
+		(FlagFunc) cmd_passenger_request_ring,
+		NULL,
+		RSRC_CONF,
+		"Whether to pass small requests to the helper agent through shared memory."),
 	AP_INIT_TAKE1("PassengerDefaultUser",
 		(Take1Func) cmd_passenger_default_user,
 		NULL,
@@ -502,6 +510,16 @@ const command_rec passenger_commands[] = {
 		NULL,
 		RSRC_CONF,
 		"The address of the proxy that should be used for sending data to Union Station."),
+	AP_INIT_TAKE1("PassengerUnionStationBatchSize",
+		(Take1Func) cmd_passenger_union_station_batch_size,
+		NULL,
+		RSRC_CONF,
+		"The number of bytes of Union Station log data to buffer before sending it to the logging agent."),
+	AP_INIT_TAKE1("PassengerUnionStationBatchDelay",
+		(Take1Func) cmd_passenger_union_station_batch_delay,
+		NULL,
+		RSRC_CONF,
+		"The maximum number of milliseconds that Union Station log data may be buffered."),
 	AP_INIT_TAKE1("PassengerAnalyticsLogUser",
 		(Take1Func) cmd_passenger_analytics_log_user,
 		NULL,
@@ -283,6 +283,10 @@ struct ServerConfig {
 	/** Whether user switching support is enabled. */
 	bool userSwitching;
 	
+	/** Whether to pass small requests to the helper agent through a
+	 * shared memory request ring. */
+	bool requestRing;
+	
 	/** See PoolOptions for more info. */
 	string defaultUser;
 	/** See PoolOptions for more info. */
@@ -295,6 +299,10 @@ struct ServerConfig {
 	int unionStationGatewayPort;
 	string unionStationGatewayCert;
 	string unionStationProxyAddress;
+	/** Batch size (in bytes) and delay (in milliseconds) for Union Station
+	 * log messages. A batch size of 0 disables batching. */
+	unsigned int unionStationBatchSize;
+	unsigned int unionStationBatchDelay;
 	
 	/** Directory in which analytics logs should be saved. */
 	string analyticsLogUser;
@@ -311,12 +319,15 @@ struct ServerConfig {
 		maxInstancesPerApp = DEFAULT_MAX_INSTANCES_PER_APP;
 		poolIdleTime       = DEFAULT_POOL_IDLE_TIME;
 		userSwitching      = true;
+		requestRing        = false;
 		defaultUser        = DEFAULT_WEB_APP_USER;
 		tempDir            = getSystemTempDir();
 		unionStationGatewayAddress = DEFAULT_UNION_STATION_GATEWAY_ADDRESS;
 		unionStationGatewayPort    = DEFAULT_UNION_STATION_GATEWAY_PORT;
 		unionStationGatewayCert    = string();
 		unionStationProxyAddress   = string();
+		unionStationBatchSize      = DEFAULT_UNION_STATION_BATCH_SIZE;
+		unionStationBatchDelay     = DEFAULT_UNION_STATION_BATCH_DELAY;
 		analyticsLogUser   = DEFAULT_ANALYTICS_LOG_USER;
 		analyticsLogGroup  = DEFAULT_ANALYTICS_LOG_GROUP;
 	}
@@ -63,6 +63,24 @@
 		OR_LIMIT | ACCESS_CONF | RSRC_CONF,
 		"The minimum number of application instances to keep when cleaning idle instances."),
 
+	AP_INIT_TAKE1("PassengerSpawnConcurrency",
+		(Take1Func) cmd_passenger_spawn_concurrency,
+		NULL,
+		OR_LIMIT | ACCESS_CONF | RSRC_CONF,
+		"The maximum number of application processes to spawn in parallel."),
+
+	AP_INIT_FLAG("PassengerPredictiveSpawning",
+		(FlagFunc) cmd_passenger_predictive_spawning,
+		NULL,
+		OR_LIMIT | ACCESS_CONF | RSRC_CONF,
+		"Whether to spawn application processes ahead of predicted demand."),
+
+	AP_INIT_TAKE1("PassengerLoadBalancing",
+		(Take1Func) cmd_passenger_load_balancing,
+		NULL,
+		OR_LIMIT | ACCESS_CONF | RSRC_CONF,
+		"How to choose the application process that handles a request: 'utilization' or 'latency'."),
+
 	AP_INIT_TAKE1("PassengerUser",
 		(Take1Func) cmd_passenger_user,
 		NULL,
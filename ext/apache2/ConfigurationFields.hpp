@@ -48,18 +48,24 @@
 	Threeway highPerformance;
 	/** Whether to load environment variables from the shell before running the application. */
 	Threeway loadShellEnvvars;
+	/** Whether to spawn application processes ahead of predicted demand. */
+	Threeway predictiveSpawning;
 	/** The maximum number of queued requests. */
 	int maxRequestQueueSize;
 	/** The maximum number of requests that an application instance may process. */
 	int maxRequests;
 	/** The minimum number of application instances to keep when cleaning idle instances. */
 	int minInstances;
+	/** The maximum number of application processes to spawn in parallel. */
+	int spawnConcurrency;
 	/** A timeout for application startup. */
 	int startTimeout;
 	/** Force specific application type. */
 	const char *appType;
 	/** The group that Ruby applications must run as. */
 	const char *group;
+	/** How to choose the application process that handles a request: 'utilization' or 'latency'. */
+	const char *loadBalancing;
 	/** The Node.js command to use. */
 	const char *nodejs;
 	/** The Python interpreter to use. */
@@ -97,6 +97,59 @@
 		}
 	
 	
+		static const char *
+		cmd_passenger_spawn_concurrency(cmd_parms *cmd, void *pcfg, const char *arg) {
+			DirConfig *config = (DirConfig *) pcfg;
+			char *end;
+			long result;
+
+			result = strtol(arg, &end, 10);
+			if (*end != '\0') {
+				string message = "Invalid number specified for ";
+				message.append(cmd->directive->directive);
+				message.append(".");
+
+				char *messageStr = (char *) apr_palloc(cmd->temp_pool,
+					message.size() + 1);
+				memcpy(messageStr, message.c_str(), message.size() + 1);
+				return messageStr;
+			
+				} else if (result < 1) {
+					string message = "Value for ";
+					message.append(cmd->directive->directive);
+					message.append(" must be greater than or equal to 1.");
+
+					char *messageStr = (char *) apr_palloc(cmd->temp_pool,
+						message.size() + 1);
+					memcpy(messageStr, message.c_str(), message.size() + 1);
+					return messageStr;
+			
+			} else {
+				config->spawnConcurrency = (int) result;
+				return NULL;
+			}
+		}
+	
+	
+		static const char *
+		cmd_passenger_predictive_spawning(cmd_parms *cmd, void *pcfg, const char *arg) {
+			DirConfig *config = (DirConfig *) pcfg;
+			config->predictiveSpawning =
+				arg ?
+				DirConfig::ENABLED :
+				DirConfig::DISABLED;
+			return NULL;
+		}
+	
+	
+		static const char *
+		cmd_passenger_load_balancing(cmd_parms *cmd, void *pcfg, const char *arg) {
+			DirConfig *config = (DirConfig *) pcfg;
+			config->loadBalancing = arg;
+			return NULL;
+		}
+	
+	
 		static const char *
 		cmd_passenger_user(cmd_parms *cmd, void *pcfg, const char *arg) {
 			DirConfig *config = (DirConfig *) pcfg;
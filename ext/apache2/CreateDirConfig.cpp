@@ -42,6 +42,9 @@
 				config->python = NULL;
 				config->nodejs = NULL;
 				config->minInstances = UNSET_INT_VALUE;
+				config->spawnConcurrency = UNSET_INT_VALUE;
+				config->predictiveSpawning = DirConfig::UNSET;
+				config->loadBalancing = NULL;
 				config->user = NULL;
 				config->group = NULL;
 				config->errorOverride = DirConfig::UNSET;
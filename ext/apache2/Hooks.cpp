@@ -44,6 +44,7 @@
 #include <exception>
 #include <cstdio>
 #include <unistd.h>
+#include <poll.h>
 
 #include <oxt/initialize.hpp>
 #include <oxt/macros.hpp>
@@ -57,6 +58,7 @@
 #include "Utils/Timer.h"
 #include "Logging.h"
 #include "AgentsStarter.h"
+#include "RequestRing.h"
 #include "DirectoryMapper.h"
 #include "Constants.h"
 
@@ -95,6 +97,18 @@ extern "C" module AP_MODULE_DECLARE_DATA passenger_module;
  */
 #define LARGE_UPLOAD_THRESHOLD 1024 * 8
 
+/**
+ * The maximum number of idle keep-alive connections to the helper agent
+ * that each Apache process keeps around.
+ */
+#define MAX_IDLE_HELPER_AGENT_CONNECTIONS 32
+
+/**
+ * After failing to register a request ring with the helper agent, an Apache
+ * process uses plain sockets for this many seconds before trying again.
+ */
+#define REQUEST_RING_RETRY_INTERVAL 60
+
 
 #if HTTP_VERSION(AP_SERVER_MAJORVERSION_NUMBER, AP_SERVER_MINORVERSION_NUMBER) > 2002
 	// Apache > 2.2.x
@@ -210,6 +224,30 @@ private:
 	CachedFileStat cstat;
 	AgentsStarter agentsStarter;
 	
+	/** An authenticated keep-alive connection to the helper agent. */
+	struct HelperAgentConnection {
+		FileDescriptor fd;
+		/** The request ring through which the next request on this
+		 * connection may be sent, or NULL if the helper agent hasn't
+		 * confirmed one for this connection. */
+		RequestRingPtr requestRing;
+	};
+	
+	/** Keep-alive connections to the helper agent that are not currently
+	 * used by any request. */
+	boost::mutex idleConnectionsLock;
+	vector<HelperAgentConnection> idleConnections;
+	
+	/** This Apache process's request ring. See getRequestRing(). */
+	boost::mutex requestRingLock;
+	RequestRingPtr requestRing;
+	/** Our end of the socket pair whose other end the helper agent holds
+	 * for as long as it uses requestRing. */
+	FileDescriptor requestRingLifetime;
+	string requestRingId;
+	pid_t requestRingPid;
+	time_t requestRingRetryTime;
+	
 	inline DirConfig *getDirConfig(request_rec *r) {
 		return (DirConfig *) ap_get_module_config(r->per_dir_config, &passenger_module);
 	}
@@ -291,6 +329,174 @@ private:
 		return conn;
 	}
 	
+	/**
+	 * Returns an idle keep-alive connection to the helper agent, or a new
+	 * connection if there are none. <em>reused</em> is set to whether
+	 * the connection was used before.
+	 */
+	HelperAgentConnection checkoutHelperAgentConnection(bool &reused) {
+		TRACE_POINT();
+		boost::unique_lock<boost::mutex> l(idleConnectionsLock);
+		while (!idleConnections.empty()) {
+			HelperAgentConnection conn = idleConnections.back();
+			idleConnections.pop_back();
+			
+			/* An idle connection must not be readable. If it is, then
+			 * the helper agent has closed it, e.g. because it has been
+			 * restarted.
+			 */
+			if (!isReadable(conn.fd)) {
+				reused = true;
+				return conn;
+			}
+		}
+		l.unlock();
+		
+		HelperAgentConnection conn;
+		reused = false;
+		conn.fd = connectToHelperAgent();
+		return conn;
+	}
+	
+	/**
+	 * Puts a keep-alive connection whose last response has been fully read
+	 * back into the idle connection pool.
+	 */
+	void checkinHelperAgentConnection(const HelperAgentConnection &conn) {
+		boost::lock_guard<boost::mutex> l(idleConnectionsLock);
+		if (idleConnections.size() < MAX_IDLE_HELPER_AGENT_CONNECTIONS) {
+			idleConnections.push_back(conn);
+		}
+	}
+	
+	static bool isReadable(int fd) {
+		struct pollfd pfd;
+		int ret;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		do {
+			ret = poll(&pfd, 1, 0);
+		} while (ret == -1 && errno == EINTR);
+		return ret != 0;
+	}
+	
+	/**
+	 * Returns this Apache process's request ring, registering a new one with
+	 * the helper agent if necessary. <em>id</em> is set to the ID that the
+	 * helper agent assigned to it. Returns NULL if request rings are disabled
+	 * or if the ring cannot be registered, in which case requests are sent
+	 * over the connections as usual.
+	 *
+	 * Every Apache process has its own ring because the ring can only be
+	 * shared with the helper agent that registered it: it notices that the
+	 * helper agent has gone away when the other end of requestRingLifetime
+	 * is closed.
+	 */
+	RequestRingPtr getRequestRing(string &id) {
+		TRACE_POINT();
+		if (!serverConfig.requestRing) {
+			return RequestRingPtr();
+		}
+		
+		boost::lock_guard<boost::mutex> l(requestRingLock);
+		if (requestRing != NULL && requestRingPid == getpid()
+		 && !isReadable(requestRingLifetime))
+		{
+			id = requestRingId;
+			return requestRing;
+		}
+		
+		requestRing.reset();
+		requestRingLifetime.close();
+		if (time(NULL) < requestRingRetryTime) {
+			return RequestRingPtr();
+		}
+		
+		try {
+			RequestRingPtr ring = RequestRing::create();
+			SocketPair lifetime = createUnixSocketPair();
+			MessageClient client;
+			vector<string> args;
+			
+			client.connect(agentsStarter.getHelperAgentAdminSocketAddress(),
+				"_web_server", agentsStarter.getHelperAgentExitPassword());
+			client.write("register_request_ring", NULL);
+			if (!client.read(args) || args[0] != "Passed security") {
+				throw IOException("the helper agent did not accept the "
+					"register_request_ring command");
+			}
+			client.writeFileDescriptor(ring->getMemoryFd());
+			client.writeFileDescriptor(ring->getNotifyFd());
+			client.writeFileDescriptor(lifetime[1]);
+			if (!client.read(args)) {
+				throw IOException("the helper agent closed the connection");
+			} else if (args.size() != 2 || args[0] != "ok") {
+				throw IOException("the helper agent refused the request ring: " +
+					(args.size() == 2 ? args[1] : args[0]));
+			}
+			
+			requestRing = ring;
+			requestRingLifetime = lifetime[0];
+			requestRingId = args[1];
+			requestRingPid = getpid();
+			id = requestRingId;
+			return requestRing;
+		} catch (const tracable_exception &e) {
+			P_WARN("Cannot register a request ring with the helper agent, "
+				"so requests will be sent over sockets for the next " <<
+				REQUEST_RING_RETRY_INTERVAL << " seconds: " << e.what());
+			requestRingRetryTime = time(NULL) + REQUEST_RING_RETRY_INTERVAL;
+			return RequestRingPtr();
+		}
+	}
+	
+	/**
+	 * Checks whether the helper agent still consumes the given request ring.
+	 * It closes its end of requestRingLifetime when it stops doing so, e.g.
+	 * because it exited or found the ring corrupted, after which
+	 * getRequestRing() registers a new ring.
+	 */
+	bool isCurrentRequestRing(const RequestRingPtr &ring) {
+		boost::lock_guard<boost::mutex> l(requestRingLock);
+		return ring == requestRing && requestRingPid == getpid()
+			&& !isReadable(requestRingLifetime);
+	}
+	
+	/**
+	 * Tries to send the request for a keep-alive connection through the
+	 * connection's request ring. Returns whether this succeeded; if not, the
+	 * request must be sent over the connection.
+	 */
+	bool sendThroughRequestRing(HelperAgentConnection &conn,
+		const vector<StaticString> &requestData)
+	{
+		if (conn.requestRing == NULL) {
+			return false;
+		} else if (!isCurrentRequestRing(conn.requestRing)) {
+			conn.requestRing.reset();
+			return false;
+		}
+		
+		size_t size = 0;
+		vector<StaticString>::const_iterator it;
+		for (it = requestData.begin(); it != requestData.end(); it++) {
+			size += it->size();
+		}
+		if (size > RequestRing::MAX_ENTRY_SIZE) {
+			return false;
+		}
+		
+		string entry;
+		entry.reserve(size);
+		for (it = requestData.begin(); it != requestData.end(); it++) {
+			entry.append(it->data(), it->size());
+		}
+		// The connection's file descriptor number identifies it in the
+		// ring. The helper agent learned it from the announcement.
+		return conn.requestRing->push(conn.fd, entry);
+	}
+	
 	bool hasModRewrite() {
 		if (m_hasModRewrite == UNKNOWN) {
 			if (ap_find_linked_module("mod_rewrite.c")) {
@@ -596,10 +802,38 @@ private:
 			char sizeString[16];
 			int ret;
 			
-			requestData.reserve(3);
+			/* The connection can only be kept alive if the helper agent
+			 * can tell where the request body ends, i.e. if it's either
+			 * absent or buffered and accompanied by a Content-Length.
+			 */
+			bool keepAlive = !expectingUploadData || shouldBufferUploads;
+			
+			HelperAgentConnection conn;
+			bool reused = false;
+			string ringAnnouncement;
+			RequestRingPtr announcedRing;
+			if (keepAlive) {
+				conn = checkoutHelperAgentConnection(reused);
+				if (!reused) {
+					/* Offer to send the next requests on this connection
+					 * through our request ring. The helper agent confirms
+					 * this in the response if it knows the ring.
+					 */
+					string ringId;
+					announcedRing = getRequestRing(ringId);
+					if (announcedRing != NULL) {
+						ringAnnouncement = ringId + ":" + toString((int) conn.fd);
+					}
+				}
+			} else {
+				conn.fd = connectToHelperAgent();
+			}
+			
+			requestData.reserve(5);
 			headerData.reserve(1024 * 2);
 			requestData.push_back(StaticString());
-			size = constructHeaders(r, config, requestData, mapper, headerData);
+			size = constructHeaders(r, config, requestData, mapper, headerData,
+				keepAlive, ringAnnouncement);
 			requestData.push_back(",");
 			
 			ret = snprintf(sizeString, sizeof(sizeString) - 1, "%u:", size);
@@ -610,27 +844,52 @@ private:
 				requestData.push_back(uploadDataMemory);
 			}
 			
-			FileDescriptor conn = connectToHelperAgent();
-			gatheredWrite(conn, &requestData[0], requestData.size());
+			if (reused) {
+				// Every request on a keep-alive connection starts
+				// with the connect password. connectToHelperAgent()
+				// already sent it for new connections.
+				requestData.insert(requestData.begin(),
+					StaticString(agentsStarter.getRequestSocketPassword()));
+				if (uploadDataFile != NULL || !sendThroughRequestRing(conn, requestData)) {
+					try {
+						gatheredWrite(conn.fd, &requestData[0], requestData.size());
+					} catch (const SystemException &e) {
+						if (e.code() != EPIPE && e.code() != ECONNRESET) {
+							throw;
+						}
+						// The helper agent closed the idle connection
+						// in the mean time, so use a new one.
+						UPDATE_TRACE_POINT();
+						requestData.erase(requestData.begin());
+						conn = HelperAgentConnection();
+						conn.fd = connectToHelperAgent();
+						gatheredWrite(conn.fd, &requestData[0], requestData.size());
+					}
+				}
+			} else {
+				gatheredWrite(conn.fd, &requestData[0], requestData.size());
+			}
 			
 			if (expectingUploadData) {
 				if (shouldBufferUploads && uploadDataFile != NULL) {
-					sendRequestBody(conn, uploadDataFile);
+					sendRequestBody(conn.fd, uploadDataFile);
 					uploadDataFile.reset();
 				} else if (!shouldBufferUploads) {
-					sendRequestBody(conn, r);
+					sendRequestBody(conn.fd, r);
 				}
 			}
 			
-			do {
-				ret = shutdown(conn, SHUT_WR);
-			} while (ret == -1 && errno == EINTR);
-			if (ret == -1 && errno != ENOTCONN) {
-				// FreeBSD has a kernel bug which causes shutdown()
-				// to harmlessly return ENOTCONN sometimes. See comment
-				// in safelyClose().
-				int e = errno;
-				throw SystemException("Cannot shutdown(SHUT_WR) HelperAgent connection", e);
+			if (!keepAlive) {
+				do {
+					ret = shutdown(conn.fd, SHUT_WR);
+				} while (ret == -1 && errno == EINTR);
+				if (ret == -1 && errno != ENOTCONN) {
+					// FreeBSD has a kernel bug which causes shutdown()
+					// to harmlessly return ENOTCONN sometimes. See comment
+					// in safelyClose().
+					int e = errno;
+					throw SystemException("Cannot shutdown(SHUT_WR) HelperAgent connection", e);
+				}
 			}
 			
 
@@ -645,7 +904,7 @@ private:
 			/* Setup the bucket brigade. */
 			bb = apr_brigade_create(r->connection->pool, r->connection->bucket_alloc);
 			
-			bucketState = boost::make_shared<PassengerBucketState>(conn);
+			bucketState = boost::make_shared<PassengerBucketState>(conn.fd, keepAlive);
 			b = passenger_bucket_create(bucketState, r->connection->bucket_alloc, config->getBufferResponse());
 			APR_BRIGADE_INSERT_TAIL(bb, b);
 			
@@ -684,6 +943,15 @@ private:
 				}
 				apr_table_setn(r->headers_out, "Status", r->status_line);
 				
+				if (announcedRing != NULL
+				 && (apr_table_get(r->headers_out, "X-Passenger-Request-Ring") != NULL
+				  || apr_table_get(r->err_headers_out, "X-Passenger-Request-Ring") != NULL))
+				{
+					conn.requestRing = announcedRing;
+				}
+				apr_table_unset(r->headers_out, "X-Passenger-Request-Ring");
+				apr_table_unset(r->err_headers_out, "X-Passenger-Request-Ring");
+				
 				UPDATE_TRACE_POINT();
 				if (config->errorOverride == DirConfig::ENABLED
 				 && ap_is_HTTP_ERROR(r->status))
@@ -699,6 +967,9 @@ private:
 				} if (ap_pass_brigade(r->output_filters, bb) == APR_SUCCESS) {
 					apr_brigade_cleanup(bb);
 				}
+				if (bucketState->responseEndReached) {
+					checkinHelperAgentConnection(conn);
+				}
 				return OK;
 			} else {
 				// HelperAgent sent an empty response, or an invalid response.
@@ -853,7 +1124,7 @@ private:
 	
 	unsigned int constructHeaders(request_rec *r, DirConfig *config,
 		vector<StaticString> &requestData, DirectoryMapper &mapper,
-		string &output)
+		string &output, bool keepAlive, const string &ringAnnouncement)
 	{
 		const char *baseURI = mapper.getBaseURI();
 		
@@ -964,6 +1235,12 @@ private:
 		addHeader(output, "PASSENGER_RESTART_DIR", config->getRestartDir());
 		addHeader(output, "PASSENGER_FRIENDLY_ERROR_PAGES",
 			config->showFriendlyErrorPages() ? "true" : "false");
+		if (keepAlive) {
+			addHeader(output, "PASSENGER_KEEPALIVE", "true");
+		}
+		if (!ringAnnouncement.empty()) {
+			addHeader(output, "PASSENGER_REQUEST_RING", ringAnnouncement.c_str());
+		}
 		if (config->useUnionStation() && !config->unionStationKey.empty()) {
 			addHeader(output, "UNION_STATION_SUPPORT", "true");
 			addHeader(output, "UNION_STATION_KEY", config->unionStationKey);
@@ -1257,6 +1534,8 @@ public:
 		m_hasModDir = UNKNOWN;
 		m_hasModAutoIndex = UNKNOWN;
 		m_hasModXsendfile = UNKNOWN;
+		requestRingPid = 0;
+		requestRingRetryTime = 0;
 		
 		P_DEBUG("Initializing Phusion Passenger...");
 		ap_add_version_component(pconf, "Phusion_Passenger/" PASSENGER_VERSION);
@@ -1289,6 +1568,8 @@ public:
 			.setInt ("union_station_gateway_port", serverConfig.unionStationGatewayPort)
 			.set    ("union_station_gateway_cert", serverConfig.unionStationGatewayCert)
 			.set    ("union_station_proxy_address", serverConfig.unionStationProxyAddress)
+			.setInt ("union_station_batch_size", serverConfig.unionStationBatchSize)
+			.setInt ("union_station_batch_delay", serverConfig.unionStationBatchDelay)
 			.setStrSet("prestart_urls", serverConfig.prestartURLs);
 		
 		serverConfig.ctl.addTo(params);
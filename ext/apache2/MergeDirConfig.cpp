@@ -68,6 +68,27 @@
 	
 
 	
+		config->spawnConcurrency =
+			(add->spawnConcurrency == UNSET_INT_VALUE) ?
+			base->spawnConcurrency :
+			add->spawnConcurrency;
+	
+
+	
+		config->predictiveSpawning =
+			(add->predictiveSpawning == DirConfig::UNSET) ?
+			base->predictiveSpawning :
+			add->predictiveSpawning;
+	
+
+	
+		config->loadBalancing =
+			(add->loadBalancing == NULL) ?
+			base->loadBalancing :
+			add->loadBalancing;
+	
+
+	
 		config->user =
 			(add->user == NULL) ?
 			base->user :
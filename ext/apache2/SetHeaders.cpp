@@ -56,6 +56,18 @@
 	
 
 	
+		addHeader(r, output, "PASSENGER_SPAWN_CONCURRENCY", config->spawnConcurrency);
+	
+
+	
+		addHeader(r, output, "PASSENGER_PREDICTIVE_SPAWNING", config->predictiveSpawning);
+	
+
+	
+		addHeader(output, "PASSENGER_LOAD_BALANCING", config->loadBalancing);
+	
+
+	
 		addHeader(output, "PASSENGER_USER", config->user);
 	
 
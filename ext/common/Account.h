@@ -72,6 +72,8 @@ public:
 		// HelperAgent admin rights.
 		INSPECT_REQUESTS          = 1 << 8,
 		INSPECT_BACKTRACES        = 1 << 9,
+		REGISTER_REQUEST_RING     = 1 << 10,
+		HOT_RESTART               = 1 << 11,
 		
 		// Other rights.
 		EXIT                      = 1 << 31
@@ -114,6 +116,8 @@ public:
 				result |= INSPECT_REQUESTS;
 			} else if (*it == "inspect_backtraces") {
 				result |= INSPECT_BACKTRACES;
+			} else if (*it == "hot_restart") {
+				result |= HOT_RESTART;
 				
 			} else if (*it == "exit") {
 				result |= EXIT;
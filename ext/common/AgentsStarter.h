@@ -340,6 +340,10 @@ public:
 		return requestSocketPassword;
 	}
 	
+	string getHelperAgentAdminSocketAddress() const {
+		return helperAgentAdminSocketAddress;
+	}
+	
 	string getHelperAgentAdminSocketFilename() const {
 		return parseUnixSocketAddress(helperAgentAdminSocketAddress);
 	}
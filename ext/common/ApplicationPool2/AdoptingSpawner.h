@@ -0,0 +1,133 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2013 Phusion
+ *
+ *  "Phusion Passenger" is a trademark of Hongli Lai & Ninh Bui.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_APPLICATION_POOL2_ADOPTING_SPAWNER_H_
+#define _PASSENGER_APPLICATION_POOL2_ADOPTING_SPAWNER_H_
+
+#include <deque>
+#include <cerrno>
+#include <signal.h>
+#include <ApplicationPool2/Spawner.h>
+#include <ApplicationPool2/ProcessHandoff.h>
+#include <Logging.h>
+
+namespace Passenger {
+namespace ApplicationPool2 {
+
+using namespace std;
+using namespace boost;
+using namespace oxt;
+
+
+/**
+ * A Spawner which, instead of spawning new processes, first hands out the
+ * processes that the previous HelperAgent instance handed over during a hot
+ * restart. Once those are used up (or have exited in the mean time), it
+ * delegates to the real Spawner.
+ *
+ * Adopted processes that are never handed out are shut down by
+ * discardProcesses(), or when this Spawner is destroyed: that closes their
+ * admin sockets, which makes them exit gracefully.
+ */
+class AdoptingSpawner: public Spawner {
+private:
+	SpawnerPtr spawner;
+	SafeLibevPtr libev;
+	boost::mutex lock;
+	deque<ProcessHandoff> processes;
+
+	static bool osProcessExists(pid_t pid) {
+		return syscalls::kill(pid, 0) == 0 || errno == EPERM;
+	}
+
+public:
+	AdoptingSpawner(const ResourceLocator &resourceLocator,
+		const SpawnerPtr &_spawner,
+		const SafeLibevPtr &_libev,
+		const SpawnerConfigPtr &_config,
+		const deque<ProcessHandoff> &_processes)
+		: Spawner(resourceLocator),
+		  spawner(_spawner),
+		  libev(_libev),
+		  processes(_processes)
+	{
+		config = _config;
+	}
+
+	virtual ProcessPtr spawn(const Options &options) {
+		TRACE_POINT();
+		boost::unique_lock<boost::mutex> l(lock);
+		while (!processes.empty()) {
+			ProcessHandoff handoff = processes.front();
+			processes.pop_front();
+			if (osProcessExists(handoff.pid)) {
+				P_INFO("Adopting process " << handoff.pid << " (" <<
+					handoff.appGroupName << ") from the previous helper agent");
+				return boost::make_shared<Process>(libev, handoff.pid,
+					handoff.gupid, handoff.connectPassword,
+					handoff.adminSocket, handoff.errorPipe,
+					handoff.sockets, handoff.spawnerCreationTime,
+					handoff.spawnStartTime, config);
+			} else {
+				P_DEBUG("Process " << handoff.pid << " from the previous helper agent "
+					"has exited; not adopting it");
+			}
+		}
+		l.unlock();
+
+		UPDATE_TRACE_POINT();
+		return spawner->spawn(options);
+	}
+
+	/**
+	 * Shuts down all adopted processes that haven't been handed out yet.
+	 * Returns the number of such processes.
+	 */
+	unsigned int discardProcesses() {
+		boost::lock_guard<boost::mutex> l(lock);
+		unsigned int count = processes.size();
+		processes.clear();
+		return count;
+	}
+
+	virtual bool cleanable() const {
+		return spawner->cleanable();
+	}
+
+	virtual void cleanup() {
+		spawner->cleanup();
+	}
+
+	virtual unsigned long long lastUsed() const {
+		return spawner->lastUsed();
+	}
+};
+
+typedef boost::shared_ptr<AdoptingSpawner> AdoptingSpawnerPtr;
+
+
+} // namespace ApplicationPool2
+} // namespace Passenger
+
+#endif /* _PASSENGER_APPLICATION_POOL2_ADOPTING_SPAWNER_H_ */
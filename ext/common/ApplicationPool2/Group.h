@@ -43,10 +43,12 @@
 #include <ApplicationPool2/SpawnerFactory.h>
 #include <ApplicationPool2/Process.h>
 #include <ApplicationPool2/Options.h>
+#include <ApplicationPool2/RequestRateTracker.h>
 #include <Utils.h>
 #include <Utils/CachedFileStat.hpp>
 #include <Utils/FileChangeChecker.h>
 #include <Utils/SmallVector.h>
+#include <Utils/LatencyHistogram.h>
 
 namespace Passenger {
 namespace ApplicationPool2 {
@@ -84,6 +86,23 @@ private:
 	 * Protects `m_shuttingDown`.
 	 */
 	mutable boost::mutex lifetimeSyncher;
+	/**
+	 * Latencies of the requests served by this Group, per stage. Updated by
+	 * the RequestHandlers through recordRequestLatencies(), without holding
+	 * the pool lock, so protected by `latencySyncher` instead.
+	 */
+	mutable boost::mutex latencySyncher;
+	struct {
+		/** From the start of the session checkout until a session was
+		 * checked out, including time spent on getWaitlist. */
+		LatencyHistogram queueWait;
+		/** From checkout until connected to the process. */
+		LatencyHistogram connect;
+		/** From connected until the first response byte. */
+		LatencyHistogram timeToFirstByte;
+		/** From the first request byte until the last response byte from the process. */
+		LatencyHistogram total;
+	} latencies;
 	/**
 	 * A back reference to the containing SuperGroup. Should never
 	 * be NULL because a SuperGroup should outlive all its containing
@@ -95,6 +114,22 @@ private:
 	FileChangeChecker fileChangeChecker;
 	string restartFile;
 	string alwaysRestartFile;
+	/**
+	 * Whether the restart files have already been checked, outside the pool lock,
+	 * for the get() action that is currently being processed. If so,
+	 * <tt>restartFilesChanged</tt> contains the result of that check, and
+	 * needsRestart() uses it instead of checking the files again. Only set
+	 * for the duration of a single get() action, within the pool lock.
+	 * See Pool::asyncGet() and setRestartFilesCheckResult().
+	 */
+	bool restartFilesChecked;
+	bool restartFilesChanged;
+
+	/** Only updated if options.predictiveSpawning is on. */
+	RequestRateTracker rateTracker;
+
+	/** Whether options.loadBalancing is "latency". See findProcessToCheckout(). */
+	bool balanceByLatency;
 
 	/** Number of times a restart has been initiated so far. This is incremented immediately
 	 * in Group::restart(), and is used to abort the restarter thread that was active at the
@@ -102,9 +137,11 @@ private:
 	 */
 	unsigned int restartsInitiated;
 	/**
-	 * Whether process(es) are being spawned right now.
+	 * The number of spawn loop threads that are active right now. Each one
+	 * occupies one unit of pool capacity while it's spawning a process.
+	 * There are at most options.spawnConcurrency of them.
 	 */
-	bool m_spawning;
+	unsigned int m_spawning;
 	/** Whether a non-rolling restart is in progress (i.e. whether spawnThreadRealMain()
 	 * is at work). While it is in progress, it is not possible to signal the desire to
 	 * spawn new process. If spawning was already in progress when the restart was initiated,
@@ -281,6 +318,7 @@ private:
 		options.persist(newOptions);
 		options.clearPerRequestFields();
 		options.groupSecret = secret;
+		balanceByLatency = options.loadBalancing == "latency";
 	}
 	
 	/**
@@ -291,6 +329,8 @@ private:
 		options.minProcesses     = other.minProcesses;
 		options.statThrottleRate = other.statThrottleRate;
 		options.maxPreloaderIdleTime = other.maxPreloaderIdleTime;
+		options.spawnConcurrency = other.spawnConcurrency;
+		options.predictiveSpawning = other.predictiveSpawning;
 	}
 	
 	static void runAllActions(const vector<Callback> &actions) {
@@ -313,13 +353,75 @@ private:
 		session->onInitiateFailure = _onSessionInitiateFailure;
 		session->onClose   = _onSessionClose;
 		if (process->enabled == Process::ENABLED) {
-			assert(process == pqueue.top());
-			pqueue.pop();
+			if (process == pqueue.top()) {
+				pqueue.pop();
+			} else {
+				pqueue.erase(process->pqHandle);
+			}
 			process->pqHandle = pqueue.push(process, process->utilization());
 		}
 		return session;
 	}
 
+	/**
+	 * Returns the enabled process that the next session should be checked out
+	 * from, or NULL if all enabled processes are at full utilization.
+	 *
+	 * By default this is the process with the lowest utilization. If
+	 * options.loadBalancing is "latency", it is the process with the lowest
+	 * Process::expectedLatency() instead, so that processes that respond
+	 * slowly receive fewer requests than fast ones. Processes that haven't
+	 * served a request yet are assumed to be as fast as the average of the
+	 * others. Ties are broken by utilization.
+	 */
+	Process *findProcessToCheckout() const {
+		Process *top = pqueue.top();
+		if (top == NULL || top->atFullUtilization()) {
+			return NULL;
+		} else if (!balanceByLatency) {
+			return top;
+		}
+
+		double defaultResponseTime = getMeanResponseTime();
+		Process *result = top;
+		double resultLatency = top->expectedLatency(defaultResponseTime);
+		ProcessList::const_iterator it, end = enabledProcesses.end();
+		for (it = enabledProcesses.begin(); it != end; it++) {
+			Process *process = it->get();
+			if (process == top || process->atFullUtilization()) {
+				continue;
+			}
+			double latency = process->expectedLatency(defaultResponseTime);
+			if (latency < resultLatency
+			 || (latency == resultLatency && process->utilization() < result->utilization()))
+			{
+				result = process;
+				resultLatency = latency;
+			}
+		}
+		return result;
+	}
+
+	/** The mean average response time of the enabled processes that have
+	 * served a request, or 0 if none have. */
+	double getMeanResponseTime() const {
+		double total = 0;
+		unsigned int count = 0;
+		ProcessList::const_iterator it, end = enabledProcesses.end();
+		for (it = enabledProcesses.begin(); it != end; it++) {
+			const Process *process = it->get();
+			if (process->averageResponseTime != 0) {
+				total += process->averageResponseTime;
+				count++;
+			}
+		}
+		if (count == 0) {
+			return 0;
+		} else {
+			return total / count;
+		}
+	}
+
 	bool pushGetWaiter(const Options &newOptions, const GetCallback &callback) {
 		if (OXT_LIKELY(!testOverflowRequestQueue()
 			&& (newOptions.maxRequestQueueSize == 0
@@ -412,10 +514,11 @@ private:
 		// Checkout sessions from enabled processes, or if there are none,
 		// from disabling processes.
 		if (enabledCount > 0) {
-			while (!getWaitlist.empty() && pqueue.top() != NULL && !pqueue.top()->atFullUtilization()) {
+			Process *process;
+			while (!getWaitlist.empty() && (process = findProcessToCheckout()) != NULL) {
 				GetAction action;
 				action.callback = getWaitlist.front().callback;
-				action.session  = newSession();
+				action.session  = newSession(process);
 				getWaitlist.pop();
 				actions.push_back(action);
 			}
@@ -447,9 +550,10 @@ private:
 	
 	void assignSessionsToGetWaiters(vector<Callback> &postLockActions) {
 		if (enabledCount > 0) {
-			while (!getWaitlist.empty() && pqueue.top() != NULL && !pqueue.top()->atFullUtilization()) {
+			Process *process;
+			while (!getWaitlist.empty() && (process = findProcessToCheckout()) != NULL) {
 				postLockActions.push_back(boost::bind(
-					getWaitlist.front().callback, newSession(),
+					getWaitlist.front().callback, newSession(process),
 					ExceptionPtr()));
 				getWaitlist.pop();
 			}
@@ -709,6 +813,9 @@ public:
 	SessionPtr get(const Options &newOptions, const GetCallback &callback) {
 		assert(isAlive());
 
+		if (OXT_UNLIKELY(options.predictiveSpawning && !newOptions.noop)) {
+			rateTracker.recordArrival(SystemTime::getUsec());
+		}
 		if (OXT_LIKELY(!restarting())) {
 			if (OXT_UNLIKELY(needsRestart(newOptions))) {
 				restart(newOptions);
@@ -760,9 +867,8 @@ public:
 			}
 			return SessionPtr();
 		} else {
-			Process *process = pqueue.top();
-			assert(process != NULL);
-			if (process->atFullUtilization()) {
+			Process *process = findProcessToCheckout();
+			if (process == NULL) {
 				/* Looks like all processes are at full utilization.
 				 * Wait until a new one has been spawned or until
 				 * resources have become free.
@@ -773,7 +879,7 @@ public:
 				return SessionPtr();
 			} else {
 				P_DEBUG("Session checked out from process " << process->inspect());
-				return newSession();
+				return newSession(process);
 			}
 		}
 	}
@@ -1005,11 +1111,7 @@ public:
 	}
 
 	unsigned int utilization() const {
-		int result = enabledCount;
-		if (spawning()) {
-			result++;
-		}
-		return result;
+		return enabledCount + m_spawning;
 	}
 	
 	bool garbageCollectable(unsigned long long now = 0) const {
@@ -1033,40 +1135,103 @@ public:
 	bool shouldSpawnForGetAction() const;
 	/** Whether a new process is allowed to be spawned for this group. */
 	bool allowSpawn() const;
+	/** The number of processes needed to handle the demand predicted by
+	 * <tt>rateTracker</tt>, or 0 if predictive spawning is off or no
+	 * prediction can be made.
+	 */
+	unsigned int predictedProcessesNeeded() const;
+	/** The number of processes that the spawn loop should strive for. */
+	unsigned long desiredProcessCount() const;
+	/** Whether the garbage collector should refrain from shutting down idle
+	 * processes because predictive spawning expects them to be needed soon.
+	 */
+	bool shouldKeepIdleProcesses(unsigned long long now) const;
+	
+	/** Whether another spawn loop thread should be started in addition to the
+	 * ones that are already active.
+	 */
+	bool shouldAddSpawnThread() const;
+	
+	void createSpawnThread() {
+		interruptableThreads.create_thread(
+			boost::bind(&Group::spawnThreadMain,
+				this, shared_from_this(), spawner,
+				options.copyAndPersist().clearPerRequestFields(),
+				restartsInitiated),
+			"Group process spawner: " + name,
+			POOL_HELPER_THREAD_STACK_SIZE);
+		m_spawning++;
+	}
 	
 	/** Start spawning a new process in the background, in case this
 	 * isn't already happening and the group isn't being restarted.
 	 * Will ensure that at least options.minProcesses processes are spawned.
+	 * If more processes are needed and pool capacity allows it, then up to
+	 * options.spawnConcurrency processes are spawned in parallel.
 	 */
 	void spawn() {
 		assert(isAlive());
-		if (!spawning() && !restarting()) {
+		if (restarting()) {
+			return;
+		}
+		if (!spawning()) {
 			P_DEBUG("Requested spawning of new process for group " << name);
-			interruptableThreads.create_thread(
-				boost::bind(&Group::spawnThreadMain,
-					this, shared_from_this(), spawner,
-					options.copyAndPersist().clearPerRequestFields(),
-					restartsInitiated),
-				"Group process spawner: " + name,
-				POOL_HELPER_THREAD_STACK_SIZE);
-			m_spawning = true;
+			createSpawnThread();
+		}
+		while (shouldAddSpawnThread()) {
+			P_DEBUG("Spawning an additional process in parallel for group " << name);
+			createSpawnThread();
 		}
 	}
 	
 	bool needsRestart(const Options &options) {
 		if (m_restarting) {
 			return false;
+		} else if (restartFilesChecked) {
+			restartFilesChecked = false;
+			return restartFilesChanged;
 		} else {
-			struct stat buf;
-			return cstat.stat(alwaysRestartFile, &buf, options.statThrottleRate) == 0 ||
-			       fileChangeChecker.changed(restartFile, options.statThrottleRate);
+			return checkRestartFiles(options);
 		}
 	}
+
+	/**
+	 * Checks whether always_restart.txt exists or whether restart.txt has changed.
+	 * This involves stat() calls, but may be called without holding the pool lock:
+	 * <tt>cstat</tt> and <tt>fileChangeChecker</tt> are thread-safe, and the
+	 * filenames never change after construction.
+	 */
+	bool checkRestartFiles(const Options &options) {
+		struct stat buf;
+		return cstat.stat(alwaysRestartFile, &buf, options.statThrottleRate) == 0 ||
+		       fileChangeChecker.changed(restartFile, options.statThrottleRate);
+	}
+
+	/**
+	 * Remembers the result of a checkRestartFiles() call that was made outside
+	 * the pool lock, so that the next needsRestart() call doesn't have to check
+	 * the files again. The result is discarded if a restart is already in progress.
+	 */
+	void setRestartFilesCheckResult(bool changed) {
+		if (!m_restarting) {
+			restartFilesChecked = true;
+			restartFilesChanged = changed;
+		}
+	}
+
+	/**
+	 * Discards the result passed to setRestartFilesCheckResult(), if needsRestart()
+	 * hasn't consumed it yet. Must be called within the same critical section,
+	 * so that the result is never applied to a later, unrelated get() action.
+	 */
+	void clearRestartFilesCheckResult() {
+		restartFilesChecked = false;
+	}
 	
 	void restart(const Options &options);
 	
 	bool spawning() const {
-		return m_spawning;
+		return m_spawning > 0;
 	}
 
 	bool restarting() const {
@@ -1087,11 +1252,35 @@ public:
 	 */
 	bool isWaitingForCapacity() const {
 		return enabledProcesses.empty()
-			&& !m_spawning
+			&& !spawning()
 			&& !m_restarting
 			&& !getWaitlist.empty();
 	}
 
+	/**
+	 * Records the per-stage latencies of a completed request, in microseconds.
+	 * Thread-safe; may be called without holding the pool lock.
+	 */
+	void recordRequestLatencies(unsigned long long queueWait, unsigned long long connect,
+		unsigned long long timeToFirstByte, unsigned long long total)
+	{
+		boost::lock_guard<boost::mutex> l(latencySyncher);
+		latencies.queueWait.record(queueWait);
+		latencies.connect.record(connect);
+		latencies.timeToFirstByte.record(timeToFirstByte);
+		latencies.total.record(total);
+	}
+
+	/** Thread-safe. */
+	template<typename Stream>
+	void inspectLatencies(Stream &stream) const {
+		boost::lock_guard<boost::mutex> l(latencySyncher);
+		stream << "  Queue wait   : " << latencies.queueWait.inspect() << "\n";
+		stream << "  Connect      : " << latencies.connect.inspect() << "\n";
+		stream << "  First byte   : " << latencies.timeToFirstByte.inspect() << "\n";
+		stream << "  Total        : " << latencies.total.inspect() << "\n";
+	}
+
 	template<typename Stream>
 	void inspectXml(Stream &stream, bool includeSecrets = true) const {
 		ProcessList::const_iterator it;
@@ -1134,6 +1323,24 @@ public:
 		options.toXml(stream, getResourceLocator());
 		stream << "</options>";
 
+		{
+			boost::lock_guard<boost::mutex> l(latencySyncher);
+			stream << "<latencies>";
+			stream << "<queue_wait>";
+			latencies.queueWait.toXml(stream);
+			stream << "</queue_wait>";
+			stream << "<connect>";
+			latencies.connect.toXml(stream);
+			stream << "</connect>";
+			stream << "<time_to_first_byte>";
+			latencies.timeToFirstByte.toXml(stream);
+			stream << "</time_to_first_byte>";
+			stream << "<total>";
+			latencies.total.toXml(stream);
+			stream << "</total>";
+			stream << "</latencies>";
+		}
+
 		stream << "<processes>";
 		
 		for (it = enabledProcesses.begin(); it != enabledProcesses.end(); it++) {
@@ -24,6 +24,7 @@
  */
 #include <typeinfo>
 #include <algorithm>
+#include <cmath>
 #include <boost/make_shared.hpp>
 #include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <oxt/backtrace.hpp>
@@ -325,9 +326,11 @@ Group::Group(const SuperGroupPtr &_superGroup, const Options &options, const Com
 	disabledCount  = 0;
 	spawner        = getPool()->spawnerFactory->create(options);
 	restartsInitiated = 0;
-	m_spawning     = false;
+	m_spawning     = 0;
 	m_restarting   = false;
 	lifeStatus     = ALIVE;
+	restartFilesChecked = false;
+	restartFilesChanged = false;
 	if (options.restartDir.empty()) {
 		restartFile = options.appRoot + "/tmp/restart.txt";
 		alwaysRestartFile = options.appRoot + "/tmp/always_restart.txt";
@@ -394,6 +397,12 @@ Group::onSessionClose(const ProcessPtr &process, Session *session) {
 	
 	/* Update statistics. */
 	process->sessionClosed(session);
+	if (options.predictiveSpawning && session->checkoutTime != 0) {
+		unsigned long long now = SystemTime::getUsec();
+		if (now > session->checkoutTime) {
+			rateTracker.recordServiceTime(now - session->checkoutTime);
+		}
+	}
 	assert(process->getLifeStatus() == Process::ALIVE);
 	assert(process->enabled == Process::ENABLED
 		|| process->enabled == Process::DISABLING
@@ -855,15 +864,19 @@ Group::spawnThreadRealMain(const SpawnerPtr &spawner, const Options &options, un
 			done = true;
 		}
 
-		// Temporarily mark this Group as 'not spawning' so
+		// Temporarily remove this thread from the spawning count so
 		// that pool->utilization() doesn't take this thread's spawning
-		// state into account.
-		m_spawning = false;
+		// state into account. Processes that other spawn threads are
+		// still working on do count towards minProcesses.
+		m_spawning--;
 		
 		done = done
-			|| ((unsigned long) getProcessCount() >= options.minProcesses && getWaitlist.empty())
+			|| ((unsigned long) (getProcessCount() + m_spawning) >= desiredProcessCount()
+				&& getWaitlist.empty())
 			|| pool->atFullCapacity(false);
-		m_spawning = !done;
+		if (!done) {
+			m_spawning++;
+		}
 		if (done) {
 			P_DEBUG("Spawn loop done");
 		} else {
@@ -889,6 +902,7 @@ Group::shouldSpawn() const {
 		&& (
 			(unsigned long) getProcessCount() < options.minProcesses
 			|| (enabledCount > 0 && pqueue.top()->atFullCapacity())
+			|| (unsigned long) getProcessCount() < predictedProcessesNeeded()
 		);
 }
 
@@ -902,6 +916,49 @@ Group::allowSpawn() const {
 	return isAlive() && !poolAtFullCapacity();
 }
 
+bool
+Group::shouldAddSpawnThread() const {
+	// Spawn threads already count towards the pool's utilization, so
+	// allowSpawn() ensures that parallel spawning never exceeds max_pool_size.
+	return m_spawning < std::max(options.spawnConcurrency, 1u)
+		&& allowSpawn()
+		&& (
+			(unsigned long) (getProcessCount() + m_spawning) < desiredProcessCount()
+			|| getWaitlist.size() > m_spawning
+		);
+}
+
+unsigned int
+Group::predictedProcessesNeeded() const {
+	if (!options.predictiveSpawning || enabledCount == 0) {
+		return 0;
+	}
+
+	// Processes with unlimited concurrency can absorb any amount of
+	// traffic on their own.
+	int concurrency = pqueue.top()->concurrency;
+	if (concurrency <= 0) {
+		return 0;
+	}
+
+	// Leave some headroom so that a process is ready by the time the
+	// predicted demand arrives.
+	double demand = rateTracker.predictedConcurrency(SystemTime::getUsec()) * 1.25;
+	return (unsigned int) ceil(demand / concurrency);
+}
+
+unsigned long
+Group::desiredProcessCount() const {
+	return std::max<unsigned long>(options.minProcesses, predictedProcessesNeeded());
+}
+
+bool
+Group::shouldKeepIdleProcesses(unsigned long long now) const {
+	return options.predictiveSpawning
+		&& (rateTracker.isRising(now)
+			|| (unsigned long) getProcessCount() <= predictedProcessesNeeded());
+}
+
 void
 Group::restart(const Options &options) {
 	vector<Callback> actions;
@@ -913,8 +970,9 @@ Group::restart(const Options &options) {
 	// the following tells them to abort their current work as soon as possible.
 	restartsInitiated++;
 
-	m_spawning = false;
+	m_spawning = 0;
 	m_restarting = true;
+	restartFilesChecked = false;
 	detachAll(actions);
 	getPool()->interruptableThreads.create_thread(
 		boost::bind(&Group::finalizeRestart, this, shared_from_this(),
@@ -89,6 +89,7 @@ private:
 		result.push_back(&environment);
 		result.push_back(&baseURI);
 		result.push_back(&spawnMethod);
+		result.push_back(&loadBalancing);
 		
 		result.push_back(&user);
 		result.push_back(&group);
@@ -216,6 +217,14 @@ public:
 	 * Spawning method, either "smart" or "direct".
 	 */
 	StaticString spawnMethod;
+
+	/**
+	 * How the Group chooses the process that handles a request: "utilization"
+	 * picks the process with the fewest open sessions relative to its
+	 * concurrency, "latency" picks the process with the lowest
+	 * Process::expectedLatency(). Unknown values mean "utilization".
+	 */
+	StaticString loadBalancing;
 	
 	/** See overview. */
 	StaticString user;
@@ -311,6 +320,19 @@ public:
 	 */
 	unsigned int maxOutOfBandWorkInstances;
 
+	/**
+	 * The maximum number of processes inside a group that may be spawned
+	 * at the same time. Must be at least 1.
+	 */
+	unsigned int spawnConcurrency;
+
+	/**
+	 * Whether to spawn processes ahead of the demand that is predicted from
+	 * the group's recent request rate and service time, and to keep idle
+	 * processes around while traffic is rising. See RequestRateTracker.
+	 */
+	bool predictiveSpawning;
+
 	/**
 	 * The maximum number of requests that may live in the Group.getWaitlist queue.
 	 * A value of 0 means unlimited.
@@ -390,6 +412,7 @@ public:
 		environment             = "production";
 		baseURI                 = "/";
 		spawnMethod             = "smart";
+		loadBalancing           = "utilization";
 		defaultUser             = "nobody";
 		ruby                    = DEFAULT_RUBY;
 		python                  = DEFAULT_PYTHON;
@@ -403,6 +426,8 @@ public:
 		minProcesses            = 1;
 		maxPreloaderIdleTime    = -1;
 		maxOutOfBandWorkInstances = 1;
+		spawnConcurrency        = 1;
+		predictiveSpawning      = false;
 		maxRequestQueueSize     = 100;
 		
 		statThrottleRate        = 0;
@@ -554,6 +579,9 @@ public:
 			appendKeyValue3(vec, "min_processes",       minProcesses);
 			appendKeyValue2(vec, "max_preloader_idle_time", maxPreloaderIdleTime);
 			appendKeyValue3(vec, "max_out_of_band_work_instances", maxOutOfBandWorkInstances);
+			appendKeyValue3(vec, "spawn_concurrency",  spawnConcurrency);
+			appendKeyValue4(vec, "predictive_spawning", predictiveSpawning);
+			appendKeyValue (vec, "load_balancing",     loadBalancing);
 		}
 		
 		/*********************************/
@@ -45,6 +45,7 @@
 #include <ApplicationPool2/SuperGroup.h>
 #include <ApplicationPool2/Session.h>
 #include <ApplicationPool2/SpawnerFactory.h>
+#include <ApplicationPool2/ProcessHandoff.h>
 #include <ApplicationPool2/Options.h>
 #include <UnionStation.h>
 #include <Logging.h>
@@ -135,6 +136,11 @@ public:
 	
 	boost::condition_variable garbageCollectionCond;
 	
+	/** Only used by the analytics collection thread. Kept around so that its
+	 * buffers are reused between collection runs.
+	 */
+	ProcessMetricsCollector processMetricsCollector;
+	
 	/**
 	 * Code can register background threads in one of these dynamic thread groups
 	 * to ensure that threads are interrupted and/or joined properly upon Pool
@@ -535,6 +541,41 @@ public:
 		return superGroups.get(options.getAppGroupName()).get();
 	}
 
+	/**
+	 * Checks the restart files of the given SuperGroup's default group, which a
+	 * get() action with the given options is about to use, while temporarily
+	 * releasing the pool lock. Otherwise every get() action would perform file
+	 * system I/O inside the pool lock, serializing all get() actions on it, even
+	 * those for unrelated applications.
+	 *
+	 * This is only worth releasing the lock for if the stat() calls actually hit
+	 * the file system. With a non-zero stat throttle rate they are usually served
+	 * from cache, so in that case nothing is checked here and the lock is held
+	 * throughout, as before.
+	 *
+	 * Must be called with the pool lock held. Returns the Group whose restart
+	 * files were checked, or NULL if nothing was checked (and the lock was not
+	 * released). Because the lock may have been released, the caller must look
+	 * up the SuperGroup again, and must pass the result to
+	 * Group::setRestartFilesCheckResult() if the Group is still the SuperGroup's
+	 * default group, and clear it again before releasing the lock.
+	 */
+	GroupPtr checkRestartFilesOutsideLock(SuperGroup *superGroup, const Options &options,
+		DynamicScopedLock &lock, bool &changed)
+	{
+		if (options.statThrottleRate > 0 || superGroup->defaultGroup == NULL
+		 || superGroup->defaultGroup->restarting())
+		{
+			return GroupPtr();
+		}
+
+		GroupPtr group = superGroup->defaultGroup->shared_from_this();
+		lock.unlock();
+		changed = group->checkRestartFiles(options);
+		lock.lock();
+		return group;
+	}
+
 	struct GarbageCollectorState {
 		unsigned long long now;
 		unsigned long long nextGcRunTime;
@@ -579,6 +620,13 @@ public:
 		 && state.now >= processGcTime
 		 && (unsigned long) group->getProcessCount() > group->options.minProcesses)
 		{
+			if (group->shouldKeepIdleProcesses(state.now)) {
+				// Traffic is expected to pick up, so check again later.
+				P_DEBUG("Not garbage collecting idle process " << process->inspect() <<
+					" because group " << group->name << " expects more traffic");
+				maybeUpdateNextGcRuntime(state, state.now + RequestRateTracker::BUCKET_SIZE * 5);
+				return;
+			}
 			ProcessList::iterator prev = p_it;
 			prev--;
 			P_DEBUG("Garbage collect idle process: " << process->inspect() <<
@@ -758,9 +806,9 @@ public:
 			// Now collect the process metrics and store them in the
 			// data structures, and log the state into the analytics logs.
 			UPDATE_TRACE_POINT();
-			allMetrics = ProcessMetricsCollector().collect(pids);
+			allMetrics = processMetricsCollector.collect(pids);
 		} catch (const ProcessMetricsCollector::ParseException &) {
-			P_WARN("Unable to collect process metrics: cannot parse 'ps' output.");
+			P_WARN("Unable to collect process metrics: cannot parse process information.");
 			goto end;
 		}
 
@@ -948,11 +996,28 @@ public:
 		P_TRACE(2, "asyncGet(appRoot=" << options.appRoot << ")");
 		
 		SuperGroup *existingSuperGroup = findMatchingSuperGroup(options);
+		GroupPtr checkedGroup;
+		bool restartFilesChanged = false;
+		if (lockNow && existingSuperGroup != NULL) {
+			checkedGroup = checkRestartFilesOutsideLock(existingSuperGroup,
+				options, lock, restartFilesChanged);
+			if (checkedGroup != NULL) {
+				existingSuperGroup = findMatchingSuperGroup(options);
+			}
+		}
 		if (OXT_LIKELY(existingSuperGroup != NULL)) {
 			/* Best case: the app super group is already in the pool. Let's use it. */
 			P_TRACE(2, "Found existing SuperGroup");
+			bool useCheckedGroup = checkedGroup != NULL
+				&& existingSuperGroup->defaultGroup == checkedGroup.get();
+			if (useCheckedGroup) {
+				checkedGroup->setRestartFilesCheckResult(restartFilesChanged);
+			}
 			existingSuperGroup->verifyInvariants();
 			SessionPtr session = existingSuperGroup->get(options, callback);
+			if (useCheckedGroup) {
+				checkedGroup->clearRestartFilesCheckResult();
+			}
 			existingSuperGroup->verifyInvariants();
 			verifyInvariants();
 			P_TRACE(2, "asyncGet() finished");
@@ -1204,6 +1269,37 @@ public:
 		return SuperGroupPtr();
 	}
 	
+	/**
+	 * Describes all live application processes, so that they can be handed
+	 * over to a new HelperAgent during a hot restart.
+	 */
+	vector<ProcessHandoff> getProcessHandoffs() const {
+		ScopedLock l(syncher);
+		vector<ProcessPtr> processes = getProcesses(false);
+		vector<ProcessPtr>::const_iterator it, end = processes.end();
+		vector<ProcessHandoff> result;
+
+		for (it = processes.begin(); it != end; it++) {
+			const ProcessPtr &process = *it;
+			if (process->dummy || process->adminSocket == -1) {
+				continue;
+			}
+
+			ProcessHandoff handoff;
+			handoff.appGroupName = process->getSuperGroup()->name;
+			handoff.pid = process->pid;
+			handoff.gupid = process->gupid;
+			handoff.connectPassword = process->connectPassword;
+			handoff.adminSocket = process->adminSocket;
+			handoff.errorPipe = process->errorPipe;
+			handoff.sockets = process->sockets;
+			handoff.spawnerCreationTime = process->spawnerCreationTime;
+			handoff.spawnStartTime = process->spawnStartTime;
+			result.push_back(handoff);
+		}
+		return result;
+	}
+
 	ProcessPtr findProcessByGupid(const string &gupid, bool lock = true) const {
 		vector<ProcessPtr> processes = getProcesses(lock);
 		vector<ProcessPtr>::const_iterator it, end = processes.end();
@@ -1461,6 +1557,30 @@ public:
 		return result.str();
 	}
 
+	/**
+	 * Returns a human-readable summary of the request latency histograms
+	 * of all groups. See Group::recordRequestLatencies().
+	 */
+	string inspectLatencies(const InspectOptions &options = InspectOptions(), bool lock = true) const {
+		DynamicScopedLock l(syncher, lock);
+		stringstream result;
+		const char *headerColor = maybeColorize(options, ANSI_COLOR_YELLOW ANSI_COLOR_BLUE_BG ANSI_COLOR_BOLD);
+		const char *resetColor  = maybeColorize(options, ANSI_COLOR_RESET);
+
+		result << headerColor << "----------- Request latencies -----------" << resetColor << endl;
+		SuperGroupMap::const_iterator sg_it, sg_end = superGroups.end();
+		for (sg_it = superGroups.begin(); sg_it != sg_end; sg_it++) {
+			const SuperGroupPtr &superGroup = sg_it->second;
+			const Group *group = superGroup->defaultGroup;
+			if (group != NULL) {
+				result << group->name << ":" << endl;
+				group->inspectLatencies(result);
+				result << endl;
+			}
+		}
+		return result.str();
+	}
+
 	string toXml(bool includeSecrets = true, bool lock = true) const {
 		DynamicScopedLock l(syncher, lock);
 		stringstream result;
@@ -214,6 +214,9 @@ public:
 	string connectPassword;
 	/** Admin socket, see class description. */
 	FileDescriptor adminSocket;
+	/** Pipe on which this process outputs errors. See the constructor. Kept
+	 * around so that it can be handed over during a hot restart. */
+	FileDescriptor errorPipe;
 	/** The sockets that this Process listens on for connections. */
 	SocketListPtr sockets;
 	/** Time at which the Spawner that created this process was created.
@@ -254,6 +257,10 @@ public:
 	int sessions;
 	/** Number of sessions opened so far. */
 	unsigned int processed;
+	/** Moving average of the time between opening and closing a session,
+	 * in microseconds. 0 if no session has been closed yet.
+	 */
+	double averageResponseTime;
 	/** Do not access directly, always use `isAlive()`/`isDead()`/`getLifeStatus()` or
 	 * through `lifetimeSyncher`. */
 	enum LifeStatus {
@@ -329,6 +336,7 @@ public:
 		  gupid(_gupid),
 		  connectPassword(_connectPassword),
 		  adminSocket(_adminSocket),
+		  errorPipe(_errorPipe),
 		  sockets(_sockets),
 		  spawnerCreationTime(_spawnerCreationTime),
 		  spawnStartTime(_spawnStartTime),
@@ -337,6 +345,7 @@ public:
 		  requiresShutdown(true),
 		  sessions(0),
 		  processed(0),
+		  averageResponseTime(0),
 		  lifeStatus(ALIVE),
 		  enabled(ENABLED),
 		  oobwStatus(OOBW_NOT_ACTIVE),
@@ -463,6 +472,12 @@ public:
 		assert(canCleanup());
 
 		P_TRACE(2, "Cleaning up process " << inspect());
+		if (OXT_LIKELY(sockets != NULL)) {
+			SocketList::iterator it, end = sockets->end();
+			for (it = sockets->begin(); it != end; it++) {
+				it->closeIdleConnections();
+			}
+		}
 		if (!dummy) {
 			if (OXT_LIKELY(sockets != NULL)) {
 				SocketList::const_iterator it, end = sockets->end();
@@ -540,6 +555,30 @@ public:
 	bool atFullUtilization() const {
 		return concurrency != 0 && sessions >= concurrency;
 	}
+
+	/**
+	 * An estimate of how long a new request would take if it were sent to
+	 * this process: the average response time, multiplied by the number of
+	 * requests that would then be in progress. Until this process has served
+	 * a request, `defaultResponseTime` is used as its average response time,
+	 * so that its open sessions still count against it.
+	 * Used by Group for latency-aware load balancing.
+	 */
+	double expectedLatency(double defaultResponseTime) const {
+		if (averageResponseTime == 0) {
+			return (sessions + 1) * defaultResponseTime;
+		} else {
+			return (sessions + 1) * averageResponseTime;
+		}
+	}
+
+	void recordResponseTime(unsigned long long usec) {
+		if (averageResponseTime == 0) {
+			averageResponseTime = usec;
+		} else {
+			averageResponseTime += 0.2 * ((double) usec - averageResponseTime);
+		}
+	}
 	
 	/**
 	 * Create a new communication session with this process. This will connect to one
@@ -559,7 +598,7 @@ public:
 			this->sessions++;
 			socket->pqHandle = sessionSockets.push(socket, socket->utilization());
 			lastUsed = SystemTime::getUsec();
-			return boost::make_shared<Session>(shared_from_this(), socket);
+			return boost::make_shared<Session>(shared_from_this(), socket, lastUsed);
 		}
 	}
 	
@@ -573,6 +612,12 @@ public:
 		this->sessions--;
 		processed++;
 		sessionSockets.decrease(socket->pqHandle, socket->utilization());
+		if (session->checkoutTime != 0) {
+			unsigned long long now = SystemTime::getUsec();
+			if (now > session->checkoutTime) {
+				recordResponseTime(now - session->checkoutTime);
+			}
+		}
 		assert(!atFullUtilization());
 	}
 
@@ -594,6 +639,7 @@ public:
 		stream << "<sessions>" << sessions << "</sessions>";
 		stream << "<utilization>" << utilization() << "</utilization>";
 		stream << "<processed>" << processed << "</processed>";
+		stream << "<average_response_time>" << (unsigned long long) averageResponseTime << "</average_response_time>";
 		stream << "<spawner_creation_time>" << spawnerCreationTime << "</spawner_creation_time>";
 		stream << "<spawn_start_time>" << spawnStartTime << "</spawn_start_time>";
 		stream << "<spawn_end_time>" << spawnEndTime << "</spawn_end_time>";
@@ -641,17 +687,19 @@ public:
 			stream << "<command>" << escapeForXml(metrics.command) << "</command>";
 		}
 		if (includeSockets) {
-			SocketList::const_iterator it;
+			SocketList::iterator it;
 
 			stream << "<sockets>";
 			for (it = sockets->begin(); it != sockets->end(); it++) {
-				const Socket &socket = *it;
+				Socket &socket = *it;
 				stream << "<socket>";
 				stream << "<name>" << escapeForXml(socket.name) << "</name>";
 				stream << "<address>" << escapeForXml(socket.address) << "</address>";
 				stream << "<protocol>" << escapeForXml(socket.protocol) << "</protocol>";
 				stream << "<concurrency>" << socket.concurrency << "</concurrency>";
 				stream << "<sessions>" << socket.sessions << "</sessions>";
+				stream << "<connection_pool_limit>" << socket.connectionPoolLimit << "</connection_pool_limit>";
+				stream << "<idle_connections>" << socket.getIdleConnectionCount() << "</idle_connections>";
 				stream << "</socket>";
 			}
 			stream << "</sockets>";
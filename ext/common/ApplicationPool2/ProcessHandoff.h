@@ -0,0 +1,152 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2013 Phusion
+ *
+ *  "Phusion Passenger" is a trademark of Hongli Lai & Ninh Bui.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_APPLICATION_POOL2_PROCESS_HANDOFF_H_
+#define _PASSENGER_APPLICATION_POOL2_PROCESS_HANDOFF_H_
+
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <boost/make_shared.hpp>
+#include <agents/HotRestartHandoff.h>
+#include <ApplicationPool2/Socket.h>
+#include <FileDescriptor.h>
+#include <Exceptions.h>
+#include <Utils/StrIntUtils.h>
+
+namespace Passenger {
+namespace ApplicationPool2 {
+
+using namespace std;
+
+
+/**
+ * Describes a live application process that a HelperAgent hands over to its
+ * successor during a hot restart, so that the successor can adopt it instead
+ * of spawning a new one. See AdoptingSpawner.
+ */
+struct ProcessHandoff {
+	/** The app group name of the SuperGroup that the process belonged to. */
+	string appGroupName;
+	pid_t pid;
+	string gupid;
+	string connectPassword;
+	FileDescriptor adminSocket;
+	/** -1 if the process has no separate error pipe. */
+	FileDescriptor errorPipe;
+	SocketListPtr sockets;
+	unsigned long long spawnerCreationTime;
+	unsigned long long spawnStartTime;
+
+	ProcessHandoff()
+		: pid(0),
+		  spawnerCreationTime(0),
+		  spawnStartTime(0)
+		{ }
+
+	/**
+	 * Adds this process's file descriptors and a message that describes it
+	 * to the given handoff.
+	 */
+	void addTo(HotRestartHandoff &handoff) const {
+		vector<string> message;
+		message.push_back("process");
+		message.push_back(appGroupName);
+		message.push_back(toString(pid));
+		message.push_back(gupid);
+		message.push_back(connectPassword);
+		message.push_back(toString(spawnerCreationTime));
+		message.push_back(toString(spawnStartTime));
+		message.push_back(toString(handoff.addFd(adminSocket)));
+		if (errorPipe != -1) {
+			message.push_back(toString(handoff.addFd(errorPipe)));
+		} else {
+			message.push_back("-1");
+		}
+
+		SocketList::const_iterator it;
+		for (it = sockets->begin(); it != sockets->end(); it++) {
+			message.push_back(it->name);
+			message.push_back(it->address);
+			message.push_back(it->protocol);
+			message.push_back(toString(it->concurrency));
+		}
+		handoff.messages.push_back(message);
+	}
+
+	/**
+	 * Extracts all process descriptions from the given handoff.
+	 *
+	 * @throws IOException The handoff contains a malformed process description.
+	 */
+	static vector<ProcessHandoff> extractFrom(const HotRestartHandoff &handoff) {
+		vector<ProcessHandoff> result;
+		vector< vector<string> >::const_iterator it;
+
+		for (it = handoff.messages.begin(); it != handoff.messages.end(); it++) {
+			const vector<string> &message = *it;
+			if (message.empty() || message[0] != "process") {
+				continue;
+			}
+			if (message.size() < 9 || (message.size() - 9) % 4 != 0) {
+				throw IOException("Malformed process description in hot restart handoff");
+			}
+
+			ProcessHandoff process;
+			process.appGroupName = message[1];
+			process.pid = (pid_t) atoi(message[2].c_str());
+			process.gupid = message[3];
+			process.connectPassword = message[4];
+			process.spawnerCreationTime = stringToULL(message[5]);
+			process.spawnStartTime = stringToULL(message[6]);
+			process.adminSocket = getFd(handoff, message[7]);
+			process.errorPipe = getFd(handoff, message[8]);
+			process.sockets = boost::make_shared<SocketList>();
+			for (unsigned int i = 9; i < message.size(); i += 4) {
+				process.sockets->add(message[i], message[i + 1], message[i + 2],
+					atoi(message[i + 3].c_str()));
+			}
+			result.push_back(process);
+		}
+		return result;
+	}
+
+private:
+	static FileDescriptor getFd(const HotRestartHandoff &handoff, const string &index) {
+		int i = atoi(index.c_str());
+		if (i == -1) {
+			return FileDescriptor();
+		} else if (i < 0 || i >= (int) handoff.fds.size()) {
+			throw IOException("Invalid file descriptor index in hot restart handoff");
+		} else {
+			return handoff.fds[i];
+		}
+	}
+};
+
+
+} // namespace ApplicationPool2
+} // namespace Passenger
+
+#endif /* _PASSENGER_APPLICATION_POOL2_PROCESS_HANDOFF_H_ */
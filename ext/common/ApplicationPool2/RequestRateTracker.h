@@ -0,0 +1,172 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2013 Phusion
+ *
+ *  "Phusion Passenger" is a trademark of Hongli Lai & Ninh Bui.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_APPLICATION_POOL2_REQUEST_RATE_TRACKER_H_
+#define _PASSENGER_APPLICATION_POOL2_REQUEST_RATE_TRACKER_H_
+
+#include <cmath>
+
+namespace Passenger {
+namespace ApplicationPool2 {
+
+
+/**
+ * Keeps track of the rate at which requests arrive at a Group and of how
+ * long they take to be served, as exponentially weighted moving averages.
+ * Used for predictive spawning; see Group::predictedProcessesNeeded().
+ *
+ * Arrivals are counted per bucket of BUCKET_SIZE microseconds. Whenever a
+ * bucket is complete, its rate is folded into a short-term average (which
+ * mostly reflects the last 5 seconds) and a long-term average (which mostly
+ * reflects the last minute). Traffic is considered to be rising when the
+ * short-term average is significantly higher than the long-term average.
+ * The bucket that is still being filled is not taken into account, so a
+ * handful of requests arriving within a fraction of a second does not
+ * count as a traffic ramp.
+ *
+ * All times are in microseconds, as returned by SystemTime::getUsec().
+ * Not thread-safe.
+ */
+class RequestRateTracker {
+public:
+	static const unsigned int BUCKET_SIZE = 1000000;
+
+private:
+	unsigned long long bucketStart;
+	unsigned int bucketArrivals;
+	/** In requests per second. */
+	double shortTermRate;
+	double longTermRate;
+	/** In seconds. */
+	double serviceTime;
+	bool hasServiceTime;
+
+	/* Smoothing factors for a one second bucket: 1 - e^(-1/5) and 1 - e^(-1/60). */
+	static double shortTermAlpha() {
+		return 0.1813;
+	}
+
+	static double longTermAlpha() {
+		return 0.0165;
+	}
+
+	void advance(unsigned long long now) {
+		if (bucketStart == 0 || now < bucketStart) {
+			// First use, or the clock went backwards.
+			bucketStart = now;
+			return;
+		} else if (now - bucketStart < BUCKET_SIZE) {
+			return;
+		}
+
+		unsigned long long buckets = (now - bucketStart) / BUCKET_SIZE;
+		double rate = bucketArrivals * (1000000.0 / BUCKET_SIZE);
+		shortTermRate += shortTermAlpha() * (rate - shortTermRate);
+		longTermRate  += longTermAlpha() * (rate - longTermRate);
+		if (buckets > 1) {
+			// All buckets after the one we just folded were empty.
+			shortTermRate *= pow(1 - shortTermAlpha(), (double) (buckets - 1));
+			longTermRate  *= pow(1 - longTermAlpha(), (double) (buckets - 1));
+		}
+		bucketStart += buckets * BUCKET_SIZE;
+		bucketArrivals = 0;
+	}
+
+	bool rising() const {
+		return shortTermRate > longTermRate * 1.2;
+	}
+
+	RequestRateTracker advancedTo(unsigned long long now) const {
+		RequestRateTracker result(*this);
+		result.advance(now);
+		return result;
+	}
+
+public:
+	RequestRateTracker()
+		: bucketStart(0),
+		  bucketArrivals(0),
+		  shortTermRate(0),
+		  longTermRate(0),
+		  serviceTime(0),
+		  hasServiceTime(false)
+		{ }
+
+	void recordArrival(unsigned long long now) {
+		advance(now);
+		bucketArrivals++;
+	}
+
+	/**
+	 * Records how long a request took to be served, from the moment a
+	 * session was checked out until it was closed.
+	 */
+	void recordServiceTime(unsigned long long usec) {
+		double sample = usec / 1000000.0;
+		if (hasServiceTime) {
+			serviceTime += 0.1 * (sample - serviceTime);
+		} else {
+			serviceTime = sample;
+			hasServiceTime = true;
+		}
+	}
+
+	double getShortTermRate(unsigned long long now) const {
+		return advancedTo(now).shortTermRate;
+	}
+
+	double getLongTermRate(unsigned long long now) const {
+		return advancedTo(now).longTermRate;
+	}
+
+	double getServiceTime() const {
+		return serviceTime;
+	}
+
+	bool isRising(unsigned long long now) const {
+		return advancedTo(now).rising();
+	}
+
+	/**
+	 * The number of requests that are expected to be in progress at the same
+	 * time in the near future, according to Little's law (arrival rate times
+	 * service time). While traffic is rising, the rate is extrapolated by
+	 * the difference between the short-term and the long-term average, so
+	 * that processes are spawned before the demand actually materializes.
+	 */
+	double predictedConcurrency(unsigned long long now) const {
+		RequestRateTracker current(advancedTo(now));
+		double rate = current.shortTermRate;
+		if (current.rising()) {
+			rate += current.shortTermRate - current.longTermRate;
+		}
+		return rate * current.serviceTime;
+	}
+};
+
+
+} // namespace ApplicationPool2
+} // namespace Passenger
+
+#endif /* _PASSENGER_APPLICATION_POOL2_REQUEST_RATE_TRACKER_H_ */
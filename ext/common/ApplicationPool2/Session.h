@@ -60,9 +60,30 @@ private:
 	
 	Connection connection;
 	FileDescriptor theFd;
+	/** Non-NULL while a non-blocking connection attempt is in progress. */
+	NConnect_State *connectState;
 	bool closed;
 	
+	bool hasConnection() const {
+		return connection.fd != -1;
+	}
+	
+	void releaseConnectState() {
+		if (connectState != NULL) {
+			// The file descriptor is owned by 'connection'.
+			connectState->fd().detach();
+			delete connectState;
+			connectState = NULL;
+		}
+	}
+	
+	void failConnecting() {
+		deinitiate(false);
+		callOnInitiateFailure();
+	}
+	
 	void deinitiate(bool success) {
+		releaseConnectState();
 		connection.fail = !success;
 		socket->checkinConnection(connection);
 		connection.fd = -1;
@@ -85,19 +106,24 @@ private:
 public:
 	Callback onInitiateFailure;
 	Callback onClose;
+	/** The time at which this session was checked out, or 0 if unknown. */
+	const unsigned long long checkoutTime;
 	
-	Session(const ProcessPtr &_process, Socket *_socket)
+	Session(const ProcessPtr &_process, Socket *_socket,
+		unsigned long long _checkoutTime = 0)
 		: process(_process),
 		  socket(_socket),
+		  connectState(NULL),
 		  closed(false),
 		  onInitiateFailure(NULL),
-		  onClose(NULL)
+		  onClose(NULL),
+		  checkoutTime(_checkoutTime)
 		{ }
 	
 	~Session() {
 		TRACE_POINT();
 		// If user doesn't close() explicitly, we penalize performance.
-		if (OXT_LIKELY(initiated())) {
+		if (OXT_LIKELY(hasConnection())) {
 			deinitiate(false);
 		}
 		if (OXT_LIKELY(!closed)) {
@@ -142,19 +168,111 @@ public:
 		g.clear();
 	}
 	
+	/**
+	 * Non-blocking version of initiate(). Reuses an idle connection to the
+	 * socket if possible, otherwise begins connecting without blocking.
+	 * Returns whether the session has been fully initiated. If not, then
+	 * a connection attempt is in progress on fd() and the caller must call
+	 * continueInitiate() until it returns true. For TCP sockets one should
+	 * wait until fd() becomes writable before doing so. Unix domain sockets
+	 * only return "in progress" when the server's backlog is full and never
+	 * signal writability, so they should be retried after a short delay.
+	 *
+	 * If connecting fails then an exception is thrown and the session is
+	 * no longer initiated, just like with initiate().
+	 *
+	 * @throws RuntimeException
+	 * @throws SystemException
+	 * @throws IOException
+	 */
+	bool initiateNonBlocking() {
+		assert(!closed);
+		assert(!hasConnection());
+		ScopeGuard g(boost::bind(&Session::callOnInitiateFailure, this));
+		bool connected;
+		
+		connectState = new NConnect_State();
+		try {
+			connection = socket->checkoutConnection(*connectState, connected);
+		} catch (...) {
+			delete connectState;
+			connectState = NULL;
+			throw;
+		}
+		connection.fail = true;
+		theFd = FileDescriptor(connection.fd, false);
+		g.clear();
+		
+		if (connected) {
+			releaseConnectState();
+		}
+		return connected;
+	}
+	
+	/**
+	 * Continues a connection attempt started by initiateNonBlocking().
+	 * Returns whether the session has been fully initiated.
+	 *
+	 * @pre connecting()
+	 * @throws RuntimeException
+	 * @throws SystemException
+	 * @throws IOException
+	 */
+	bool continueInitiate() {
+		assert(connecting());
+		ScopeGuard g(boost::bind(&Session::failConnecting, this));
+		bool connected = connectToServer(*connectState);
+		g.clear();
+		if (connected) {
+			releaseConnectState();
+		}
+		return connected;
+	}
+	
+	/**
+	 * Aborts a connection attempt started by initiateNonBlocking(), e.g.
+	 * because it took too long. The session is no longer initiated afterwards.
+	 *
+	 * @pre connecting()
+	 */
+	void abortInitiate() {
+		assert(connecting());
+		failConnecting();
+	}
+	
+	/**
+	 * Whether a non-blocking connection attempt is in progress.
+	 */
+	bool connecting() const {
+		return connectState != NULL;
+	}
+	
+	/**
+	 * Whether the session is connected to the socket. Not true while
+	 * a non-blocking connection attempt is still in progress.
+	 */
 	bool initiated() const {
-		return connection.fd != -1;
+		return hasConnection() && !connecting();
 	}
 	
 	const FileDescriptor &fd() const {
 		return theFd;
 	}
 	
+	/**
+	 * Whether the connection is returned to the socket's connection pool
+	 * for reuse when the session is closed successfully. If not, then it
+	 * is closed.
+	 */
+	bool connectionIsPersistent() const {
+		return connection.persistent;
+	}
+	
 	/**
 	 * This Session object becomes fully unsable after closing.
 	 */
 	void close(bool success) {
-		if (OXT_LIKELY(initiated())) {
+		if (OXT_LIKELY(hasConnection())) {
 			deinitiate(success);
 		}
 		if (OXT_LIKELY(!closed)) {
@@ -77,9 +77,11 @@ private:
 	map<string, string> preloaderAnnotations;
 	Options options;
 	
-	// Protects m_lastUsed and pid.
+	// Protects m_lastUsed, pid and preloaderAnnotations.
 	mutable boost::mutex simpleFieldSyncher;
-	// Protects everything else.
+	// Protects everything else. Only held while starting or stopping the
+	// preloader and while sending it a spawn command, so that multiple
+	// threads can negotiate with their newly forked processes in parallel.
 	mutable boost::mutex syncher;
 
 	// Preloader information.
@@ -299,7 +301,11 @@ private:
 			watcher->initialize();
 			watcher->start();
 			
-			preloaderAnnotations = debugDir->readAll();
+			map<string, string> annotations = debugDir->readAll();
+			{
+				boost::lock_guard<boost::mutex> l(simpleFieldSyncher);
+				preloaderAnnotations = annotations;
+			}
 			P_INFO("Preloader for " << options.appRoot <<
 				" started on PID " << pid <<
 				", listening on " << socketAddress);
@@ -703,7 +709,12 @@ private:
 protected:
 	virtual void annotateAppSpawnException(SpawnException &e, NegotiationDetails &details) {
 		Spawner::annotateAppSpawnException(e, details);
-		e.addAnnotations(preloaderAnnotations);
+		map<string, string> annotations;
+		{
+			boost::lock_guard<boost::mutex> l(simpleFieldSyncher);
+			annotations = preloaderAnnotations;
+		}
+		e.addAnnotations(annotations);
 	}
 
 public:
@@ -750,25 +761,34 @@ public:
 			boost::lock_guard<boost::mutex> l(simpleFieldSyncher);
 			m_lastUsed = SystemTime::getUsec();
 		}
-		UPDATE_TRACE_POINT();
-		boost::lock_guard<boost::mutex> l(syncher);
-		if (!preloaderStarted()) {
-			UPDATE_TRACE_POINT();
-			startPreloader();
-		}
-		
 		UPDATE_TRACE_POINT();
 		SpawnResult result;
-		try {
-			result = sendSpawnCommand(options);
-		} catch (const SystemException &e) {
-			result = sendSpawnCommandAgain(e, options);
-		} catch (const IOException &e) {
-			result = sendSpawnCommandAgain(e, options);
-		} catch (const SpawnException &e) {
-			result = sendSpawnCommandAgain(e, options);
+		SpawnPreparationInfo preparation;
+		{
+			boost::lock_guard<boost::mutex> l(syncher);
+			if (!preloaderStarted()) {
+				UPDATE_TRACE_POINT();
+				startPreloader();
+			}
+			
+			UPDATE_TRACE_POINT();
+			try {
+				result = sendSpawnCommand(options);
+			} catch (const SystemException &e) {
+				result = sendSpawnCommandAgain(e, options);
+			} catch (const IOException &e) {
+				result = sendSpawnCommandAgain(e, options);
+			} catch (const SpawnException &e) {
+				result = sendSpawnCommandAgain(e, options);
+			}
+			// Another thread may restart the preloader while we're
+			// negotiating, so work with a copy.
+			preparation = this->preparation;
 		}
 		
+		// The preloader is done with us as soon as it has forked, so the
+		// (much slower) startup of the new process happens without holding
+		// the lock.
 		UPDATE_TRACE_POINT();
 		NegotiationDetails details;
 		details.preparation = &preparation;
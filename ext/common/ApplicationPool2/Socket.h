@@ -32,6 +32,9 @@
 #include <boost/weak_ptr.hpp>
 #include <climits>
 #include <cassert>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/socket.h>
 #include <Logging.h>
 #include <Utils/PriorityQueue.h>
 #include <Utils/IOUtils.h>
@@ -76,8 +79,35 @@ private:
 	int totalConnections;
 	vector<Connection> idleConnections;
 	
-	int connectionPoolLimit() const {
-		return concurrency;
+	/**
+	 * Checks whether an idle connection can still be used. The application
+	 * may have closed it in the mean time (e.g. because of a keep-alive
+	 * timeout), and it must not have sent anything while it was idle.
+	 */
+	static bool stillUsable(const Connection &connection) {
+		char buf;
+		ssize_t ret = recv(connection.fd, &buf, 1, MSG_PEEK | MSG_DONTWAIT);
+		return ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+	}
+	
+	/**
+	 * Returns an idle connection that is still usable, or a Connection with
+	 * fd == -1 if there is none. Unusable idle connections are closed.
+	 * Must be called with connectionPoolLock held.
+	 */
+	Connection checkoutIdleConnection() {
+		while (!idleConnections.empty()) {
+			Connection connection = idleConnections.back();
+			idleConnections.pop_back();
+			if (stillUsable(connection)) {
+				return connection;
+			} else {
+				P_TRACE(3, "Discarding stale idle connection to " << address);
+				totalConnections--;
+				connection.close();
+			}
+		}
+		return Connection();
 	}
 	
 	Connection connect() const {
@@ -93,6 +123,9 @@ public:
 	string address;
 	string protocol;
 	int concurrency;
+	/** The maximum number of connections to this socket that are kept open
+	 * for reuse. Defaults to 'concurrency'. */
+	int connectionPoolLimit;
 	
 	/** The handle inside the associated Process's 'sessionSockets' priority queue.
 	 * Guaranteed to be valid as long as the Process is alive.
@@ -103,15 +136,18 @@ public:
 	int sessions;
 	
 	Socket()
-		: concurrency(0)
+		: concurrency(0),
+		  connectionPoolLimit(0)
 		{ }
 	
-	Socket(const string &_name, const string &_address, const string &_protocol, int _concurrency)
+	Socket(const string &_name, const string &_address, const string &_protocol, int _concurrency,
+		int _connectionPoolLimit = -1)
 		: totalConnections(0),
 		  name(_name),
 		  address(_address),
 		  protocol(_protocol),
 		  concurrency(_concurrency),
+		  connectionPoolLimit(_connectionPoolLimit >= 0 ? _connectionPoolLimit : _concurrency),
 		  sessions(0)
 		{ }
 	
@@ -122,6 +158,7 @@ public:
 		  address(other.address),
 		  protocol(other.protocol),
 		  concurrency(other.concurrency),
+		  connectionPoolLimit(other.connectionPoolLimit),
 		  pqHandle(other.pqHandle),
 		  sessions(other.sessions)
 		{ }
@@ -133,6 +170,7 @@ public:
 		address = other.address;
 		protocol = other.protocol;
 		concurrency = other.concurrency;
+		connectionPoolLimit = other.connectionPoolLimit;
 		pqHandle = other.pqHandle;
 		sessions = other.sessions;
 		return *this;
@@ -146,13 +184,12 @@ public:
 	 */
 	Connection checkoutConnection() {
 		boost::lock_guard<boost::mutex> l(connectionPoolLock);
+		Connection connection = checkoutIdleConnection();
 		
-		if (!idleConnections.empty()) {
-			Connection connection = idleConnections.back();
-			idleConnections.pop_back();
+		if (connection.fd != -1) {
 			return connection;
-		} else if (totalConnections < connectionPoolLimit()) {
-			Connection connection = connect();
+		} else if (totalConnections < connectionPoolLimit) {
+			connection = connect();
 			connection.persistent = true;
 			totalConnections++;
 			return connection;
@@ -161,6 +198,50 @@ public:
 		}
 	}
 	
+	/**
+	 * Non-blocking version of checkoutConnection(). Reuses an idle connection
+	 * if possible. Otherwise, a non-blocking connect to this socket is started
+	 * with the help of the given state structure. <tt>connected</tt> is set to
+	 * whether the connection is ready to be used. If it isn't, then the caller
+	 * must finish connecting through <tt>connectToServer(state)</tt>, and
+	 * must detach <tt>state.fd()</tt> once it's done with the state structure
+	 * because the returned Connection owns the file descriptor.
+	 *
+	 * One MUST call checkinConnection() when one's done using the Connection,
+	 * even if connecting failed.
+	 *
+	 * @throws RuntimeException
+	 * @throws SystemException
+	 * @throws IOException
+	 */
+	Connection checkoutConnection(NConnect_State &state, bool &connected) {
+		boost::unique_lock<boost::mutex> l(connectionPoolLock);
+		Connection connection = checkoutIdleConnection();
+		
+		if (connection.fd != -1) {
+			connected = true;
+			return connection;
+		} else if (totalConnections < connectionPoolLimit) {
+			connection.persistent = true;
+			totalConnections++;
+		}
+		l.unlock();
+		
+		try {
+			P_TRACE(3, "Connecting to " << address << " (non-blocking)");
+			setupNonBlockingSocket(state, address);
+			connected = connectToServer(state);
+		} catch (...) {
+			if (connection.persistent) {
+				l.lock();
+				totalConnections--;
+			}
+			throw;
+		}
+		connection.fd = state.fd();
+		return connection;
+	}
+	
 	void checkinConnection(Connection connection) {
 		boost::unique_lock<boost::mutex> l(connectionPoolLock);
 		
@@ -178,6 +259,28 @@ public:
 		}
 	}
 	
+	/**
+	 * Closes all idle connections. Connections that are currently checked
+	 * out are closed when they're checked in.
+	 */
+	void closeIdleConnections() {
+		boost::unique_lock<boost::mutex> l(connectionPoolLock);
+		vector<Connection> connections;
+		connections.swap(idleConnections);
+		totalConnections -= (int) connections.size();
+		l.unlock();
+		
+		vector<Connection>::iterator it, end = connections.end();
+		for (it = connections.begin(); it != end; it++) {
+			it->close();
+		}
+	}
+	
+	int getIdleConnectionCount() {
+		boost::lock_guard<boost::mutex> l(connectionPoolLock);
+		return (int) idleConnections.size();
+	}
+	
 	
 	bool idle() const {
 		return sessions == 0;
@@ -212,8 +315,10 @@ public:
 
 class SocketList: public vector<Socket> {
 public:
-	void add(const string &name, const string &address, const string &protocol, int concurrency) {
-		push_back(Socket(name, address, protocol, concurrency));
+	void add(const string &name, const string &address, const string &protocol, int concurrency,
+		int connectionPoolLimit = -1)
+	{
+		push_back(Socket(name, address, protocol, concurrency, connectionPoolLimit));
 	}
 
 	const Socket *findSocketWithName(const StaticString &name) const {
@@ -473,13 +473,13 @@ private:
 			string key = line.substr(0, pos);
 			string value = line.substr(pos + 2, line.size() - pos - 3);
 			if (key == "socket") {
-				// socket: <name>;<address>;<protocol>;<concurrency>
+				// socket: <name>;<address>;<protocol>;<concurrency>[;<connection pool limit>]
 				// TODO: in case of TCP sockets, check whether it points to localhost
 				// TODO: in case of unix sockets, check whether filename is absolute
 				// and whether owner is correct
 				vector<string> args;
 				split(value, ';', args);
-				if (args.size() == 4) {
+				if (args.size() == 4 || args.size() == 5) {
 					string error = validateSocketAddress(details, args[1]);
 					if (!error.empty()) {
 						throwAppSpawnException(
@@ -490,7 +490,8 @@ private:
 					sockets->add(args[0],
 						fixupSocketAddress(*details.options, args[1]),
 						args[2],
-						atoi(args[3]));
+						atoi(args[3]),
+						(args.size() == 5) ? atoi(args[4]) : -1);
 				} else {
 					throwAppSpawnException("An error occurred while starting the "
 						"web application. It reported a wrongly formatted 'socket'"
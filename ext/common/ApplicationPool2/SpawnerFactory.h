@@ -29,6 +29,11 @@
 #include <ApplicationPool2/SmartSpawner.h>
 #include <ApplicationPool2/DirectSpawner.h>
 #include <ApplicationPool2/DummySpawner.h>
+#include <ApplicationPool2/AdoptingSpawner.h>
+#include <ApplicationPool2/ProcessHandoff.h>
+#include <deque>
+#include <map>
+#include <vector>
 
 namespace Passenger {
 namespace ApplicationPool2 {
@@ -47,6 +52,11 @@ private:
 	boost::mutex syncher;
 	SpawnerConfigPtr config;
 	DummySpawnerPtr dummySpawner;
+	/** Processes handed over by the previous HelperAgent during a hot restart,
+	 * by app group name, which haven't been claimed by a Group yet. */
+	map< string, deque<ProcessHandoff> > adoptableProcesses;
+	/** AdoptingSpawners that adoptable processes have been moved to. */
+	vector< boost::weak_ptr<AdoptingSpawner> > adoptingSpawners;
 	
 	SpawnerPtr tryCreateSmartSpawner(const Options &options) {
 		string dir = resourceLocator.getHelperScriptsDir();
@@ -83,6 +93,22 @@ public:
 	virtual ~SpawnerFactory() { }
 	
 	virtual SpawnerPtr create(const Options &options) {
+		SpawnerPtr spawner = createSpawner(options);
+		boost::lock_guard<boost::mutex> l(syncher);
+		map< string, deque<ProcessHandoff> >::iterator it =
+			adoptableProcesses.find(options.getAppGroupName());
+		if (it == adoptableProcesses.end()) {
+			return spawner;
+		} else {
+			AdoptingSpawnerPtr result = boost::make_shared<AdoptingSpawner>(resourceLocator,
+				spawner, libev, config, it->second);
+			adoptableProcesses.erase(it);
+			adoptingSpawners.push_back(result);
+			return result;
+		}
+	}
+
+	SpawnerPtr createSpawner(const Options &options) {
 		if (options.spawnMethod == "smart" || options.spawnMethod == "smart-lv2") {
 			SpawnerPtr spawner = tryCreateSmartSpawner(options);
 			if (spawner == NULL) {
@@ -102,6 +128,46 @@ public:
 		}
 	}
 
+	/**
+	 * Registers processes that the previous HelperAgent handed over during a
+	 * hot restart. The first Spawner created for the corresponding app group
+	 * hands them out before spawning new processes.
+	 */
+	void addAdoptableProcesses(const vector<ProcessHandoff> &processes) {
+		boost::lock_guard<boost::mutex> l(syncher);
+		vector<ProcessHandoff>::const_iterator it;
+		for (it = processes.begin(); it != processes.end(); it++) {
+			adoptableProcesses[it->appGroupName].push_back(*it);
+		}
+	}
+
+	/**
+	 * Shuts down all handed over processes that haven't been claimed yet,
+	 * by closing our side of their admin sockets. This includes processes
+	 * that were moved to an AdoptingSpawner, but that its Group hasn't asked
+	 * for. Returns the number of such processes.
+	 */
+	unsigned int discardAdoptableProcesses() {
+		boost::lock_guard<boost::mutex> l(syncher);
+		map< string, deque<ProcessHandoff> >::const_iterator it;
+		vector< boost::weak_ptr<AdoptingSpawner> >::const_iterator s_it;
+		unsigned int count = 0;
+
+		for (it = adoptableProcesses.begin(); it != adoptableProcesses.end(); it++) {
+			count += it->second.size();
+		}
+		adoptableProcesses.clear();
+
+		for (s_it = adoptingSpawners.begin(); s_it != adoptingSpawners.end(); s_it++) {
+			AdoptingSpawnerPtr spawner = s_it->lock();
+			if (spawner != NULL) {
+				count += spawner->discardProcesses();
+			}
+		}
+		adoptingSpawners.clear();
+		return count;
+	}
+
 	/**
 	 * SpawnerFactory always returns the same DummyFactory object upon
 	 * creating a dummy spawner. This allows unit tests to easily
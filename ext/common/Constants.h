@@ -44,6 +44,8 @@
 
 	#define DEFAULT_ANALYTICS_LOG_USER "nobody"
 
+	#define DEFAULT_CLIENT_FREELIST_SIZE 128
+
 	#define DEFAULT_CONCURRENCY_MODEL "process"
 
 	#define DEFAULT_LOG_LEVEL 0
@@ -64,14 +66,22 @@
 
 	#define DEFAULT_THREAD_COUNT 1
 
+	#define DEFAULT_UNION_STATION_BATCH_DELAY 1000
+
+	#define DEFAULT_UNION_STATION_BATCH_SIZE 0
+
 	#define DEFAULT_UNION_STATION_GATEWAY_ADDRESS "gateway.unionstationapp.com"
 
 	#define DEFAULT_UNION_STATION_GATEWAY_PORT 443
 
+	#define DEFAULT_UPSTREAM_KEEPALIVE 32
+
 	#define DEFAULT_WEB_APP_USER "nobody"
 
 	#define FEEDBACK_FD 3
 
+	#define HELPER_AGENT_HOT_RESTART_EXIT_CODE 3
+
 	#define INDEX_DOC_URL "http://www.modrails.com/documentation/Users%20guide.html"
 
 	#define MESSAGE_SERVER_MAX_PASSWORD_SIZE 100
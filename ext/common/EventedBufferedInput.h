@@ -27,6 +27,7 @@
 
 #include <cstdio>
 #include <cstddef>
+#include <cstring>
 #include <cassert>
 
 #include <sstream>
@@ -411,6 +412,33 @@ public:
 		onReadable(watcher, 0);
 	}
 
+	/**
+	 * Emits `data` as if it had just been read from the socket. This is
+	 * for data that arrives through another channel than the socket but
+	 * belongs to the same stream. Returns false, without doing anything,
+	 * if this EventedBufferedInput is not started, if it still has
+	 * unprocessed data, or if `data` is empty or doesn't fit in the buffer.
+	 */
+	bool feed(const StaticString &data) {
+		if (state != LIVE || paused || processingBuffer || !buffer.empty()
+		 || data.empty() || data.size() > bufferSize)
+		{
+			return false;
+		}
+
+		// Keep 'this' alive until function exit.
+		boost::shared_ptr< EventedBufferedInput<bufferSize> > self = EventedBufferedInput<bufferSize>::shared_from_this();
+
+		EBI_TRACE("feed " << data.size() << " bytes");
+		verifyInvariants();
+		assert(!socketPaused);
+		memcpy(bufferData, data.data(), data.size());
+		buffer = StaticString(bufferData, data.size());
+		processBuffer();
+		verifyInvariants();
+		return true;
+	}
+
 	const FileDescriptor &getFd() const {
 		return fd;
 	}
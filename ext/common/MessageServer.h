@@ -517,15 +517,25 @@ public:
 	 *                       should be listening.
 	 * @param accountsDatabase An accounts database for this server, used for
 	 *                         authenticating clients.
+	 * @param serverFd An already listening server socket for <tt>socketFilename</tt>,
+	 *                 e.g. one inherited from a previous helper agent during a hot
+	 *                 restart. If -1, a new server socket is created. The
+	 *                 MessageServer takes ownership of it.
 	 * @throws RuntimeException Something went wrong while setting up the server socket.
 	 * @throws SystemException Something went wrong while setting up the server socket.
 	 * @throws boost::thread_interrupted
 	 */
-	MessageServer(const string &socketFilename, AccountsDatabasePtr accountsDatabase) {
+	MessageServer(const string &socketFilename, AccountsDatabasePtr accountsDatabase,
+		int serverFd = -1)
+	{
 		this->socketFilename   = socketFilename;
 		this->accountsDatabase = accountsDatabase;
 		loginTimeout = 2000000;
-		startListening();
+		if (serverFd == -1) {
+			startListening();
+		} else {
+			this->serverFd = serverFd;
+		}
 	}
 	
 	~MessageServer() {
@@ -537,6 +547,10 @@ public:
 	string getSocketFilename() const {
 		return socketFilename;
 	}
+
+	int getServerFd() const {
+		return serverFd;
+	}
 	
 	/**
 	 * Starts the server main loop. This method will loop forever until some
@@ -0,0 +1,457 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2013 Phusion
+ *
+ *  "Phusion Passenger" is a trademark of Hongli Lai & Ninh Bui.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_REQUEST_RING_H_
+#define _PASSENGER_REQUEST_RING_H_
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/cstdint.hpp>
+#include <oxt/system_calls.hpp>
+
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+	#include <sys/syscall.h>
+#endif
+
+#include <FileDescriptor.h>
+#include <StaticString.h>
+#include <Exceptions.h>
+#include <Utils/IOUtils.h>
+#include <Utils/StrIntUtils.h>
+
+namespace Passenger {
+
+using namespace std;
+using namespace oxt;
+
+// These are missing from the headers of older glibc versions.
+#ifdef __linux__
+	#ifndef MFD_CLOEXEC
+		#define MFD_CLOEXEC 0x0001U
+	#endif
+	#ifndef MFD_ALLOW_SEALING
+		#define MFD_ALLOW_SEALING 0x0002U
+	#endif
+	#ifndef F_ADD_SEALS
+		#define F_ADD_SEALS 1033
+		#define F_GET_SEALS 1034
+		#define F_SEAL_SEAL 0x0001
+		#define F_SEAL_SHRINK 0x0002
+		#define F_SEAL_GROW 0x0004
+	#endif
+#endif
+
+class RequestRing;
+typedef boost::shared_ptr<RequestRing> RequestRingPtr;
+
+/**
+ * A ring buffer in shared memory through which a web server process can
+ * pass small requests to the helper agent, instead of writing them to a
+ * request socket connection. This saves the write() on the web server side,
+ * the read() on the helper agent side and the copies through the kernel's
+ * socket buffers.
+ *
+ * The ring lives in an anonymous memory file (memfd) that both processes
+ * mmap(). The producer seals its size before handing it to the consumer, so
+ * that it can't truncate the file under the consumer's mapping and crash it
+ * with SIGBUS. Request rings are therefore only supported on Linux. Every entry
+ * carries a token that the web server has associated with one of its request
+ * socket connections. The helper agent processes the entry as if it had been
+ * read from that connection, and writes the response to that connection as
+ * usual. So the ring only replaces the request direction of the connection.
+ *
+ * The consumer sleeps on a notification file descriptor: an eventfd on Linux,
+ * a pipe elsewhere. The producer only writes to it if the consumer has
+ * announced that it's about to sleep, so under load no notification system
+ * calls are made at all.
+ *
+ * Multiple threads in the web server process may push() (pushes are
+ * serialized by a mutex), but only one thread in the helper agent may pop().
+ * The consumer does not trust the contents of the shared memory: corrupted
+ * entries cause pop() to throw instead of reading out of bounds.
+ *
+ * <h2>Layout</h2>
+ * The file starts with a Header, followed by `capacity` bytes of entries.
+ * `head` and `tail` are offsets that only ever increase (modulo 2^32); the
+ * position in the entry area is the offset modulo `capacity`. Every entry is
+ * a 32-bit size, a 32-bit token and the data, padded to 8 bytes. If an entry
+ * doesn't fit in the remainder of the entry area then the producer writes a
+ * wrap marker there and continues at the beginning.
+ */
+class RequestRing: public boost::noncopyable {
+public:
+	/** The maximum size of a single entry. Equal to the size of the request
+	 * handler's client input buffer, so that an entry can be fed into it in
+	 * one go. */
+	static const unsigned int MAX_ENTRY_SIZE = 1024 * 8;
+	static const unsigned int DEFAULT_CAPACITY = 1024 * 256;
+	static const unsigned int MIN_CAPACITY = MAX_ENTRY_SIZE * 4;
+
+private:
+	static const boost::uint32_t MAGIC = 0x50524e47;
+	static const boost::uint32_t WRAP_MARKER = 0xFFFFFFFF;
+	static const unsigned int ENTRY_HEADER_SIZE = 8;
+	static const unsigned int CACHE_LINE_SIZE = 64;
+
+	/** `head`, `tail` and `consumerWaiting` live on separate cache lines
+	 * so that the producer and the consumer don't bounce one line between
+	 * their CPUs. */
+	struct Header {
+		boost::uint32_t magic;
+		boost::uint32_t capacity;
+		char padding0[CACHE_LINE_SIZE - 8];
+		/** Only written by the producer. */
+		volatile boost::uint32_t head;
+		char padding1[CACHE_LINE_SIZE - 4];
+		/** Only written by the consumer. */
+		volatile boost::uint32_t tail;
+		char padding2[CACHE_LINE_SIZE - 4];
+		/** Set by the consumer when it's about to sleep on the notification
+		 * file descriptor. */
+		volatile boost::uint32_t consumerWaiting;
+		char padding3[CACHE_LINE_SIZE - 4];
+	};
+
+	FileDescriptor memoryFd;
+	FileDescriptor notifyReader;
+	FileDescriptor notifyWriter;
+	Header *header;
+	char *entries;
+	boost::uint32_t capacity;
+	size_t mappedSize;
+	boost::mutex pushLock;
+
+	RequestRing()
+		: header(NULL),
+		  entries(NULL),
+		  capacity(0),
+		  mappedSize(0)
+		{ }
+
+	static bool isValidCapacity(unsigned long long capacity) {
+		return capacity >= MIN_CAPACITY
+			&& capacity <= (1u << 30)
+			&& (capacity & (capacity - 1)) == 0;
+	}
+
+	static boost::uint32_t alignEntrySize(boost::uint32_t size) {
+		return ENTRY_HEADER_SIZE + ((size + 7) & ~((boost::uint32_t) 7));
+	}
+
+	void map(int prot) {
+		void *memory = mmap(NULL, mappedSize, prot, MAP_SHARED, memoryFd, 0);
+		if (memory == MAP_FAILED) {
+			int e = errno;
+			throw SystemException("Cannot map the request ring into memory", e);
+		}
+		header = (Header *) memory;
+		entries = (char *) memory + sizeof(Header);
+	}
+
+	boost::uint32_t readUint32(boost::uint32_t pos) const {
+		return *((const volatile boost::uint32_t *) (entries + pos));
+	}
+
+	void writeUint32(boost::uint32_t pos, boost::uint32_t value) {
+		*((volatile boost::uint32_t *) (entries + pos)) = value;
+	}
+
+	/** Creates an anonymous memory file of the given size, and seals it
+	 * so that its size can't be changed anymore. */
+	static FileDescriptor createSealedMemoryFile(size_t size) {
+		#if defined(__linux__) && defined(__NR_memfd_create)
+			int fd = syscall(__NR_memfd_create, "passenger-request-ring",
+				MFD_CLOEXEC | MFD_ALLOW_SEALING);
+			if (fd == -1) {
+				int e = errno;
+				throw SystemException("Cannot create a request ring memory file", e);
+			}
+			FileDescriptor result(fd);
+
+			int ret;
+			do {
+				ret = ftruncate(fd, size);
+			} while (ret == -1 && errno == EINTR);
+			if (ret == -1) {
+				int e = errno;
+				throw SystemException("Cannot resize the request ring memory file", e);
+			}
+			if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1) {
+				int e = errno;
+				throw SystemException("Cannot seal the request ring memory file", e);
+			}
+			return result;
+		#else
+			throw RuntimeException("Request rings are not supported on this platform");
+		#endif
+	}
+
+	static void throwCorrupted(const char *reason) {
+		throw IOException(string("The request ring is corrupted: ") + reason);
+	}
+
+public:
+	/**
+	 * Creates a new ring, for the producer. The ring lives in a memory file
+	 * whose size is sealed.
+	 *
+	 * @throws ArgumentException `capacity` is not a power of two between
+	 *    MIN_CAPACITY and 1 GB.
+	 * @throws RuntimeException This platform doesn't support sealed memory files.
+	 * @throws SystemException
+	 */
+	static RequestRingPtr create(unsigned int capacity = DEFAULT_CAPACITY) {
+		if (!isValidCapacity(capacity)) {
+			throw ArgumentException("The request ring capacity must be a power of two, "
+				"at least " + toString(MIN_CAPACITY) + " bytes");
+		}
+
+		RequestRingPtr ring(new RequestRing());
+		ring->capacity = capacity;
+		ring->mappedSize = sizeof(Header) + capacity;
+		ring->memoryFd = createSealedMemoryFile(ring->mappedSize);
+		ring->map(PROT_READ | PROT_WRITE);
+		ring->header->magic = MAGIC;
+		ring->header->capacity = capacity;
+		ring->header->head = 0;
+		ring->header->tail = 0;
+		// The consumer isn't attached yet, so make sure that it
+		// gets a notification about the first entry.
+		ring->header->consumerWaiting = 1;
+
+		Pipe channel = createNotificationChannel();
+		ring->notifyReader = channel[0];
+		ring->notifyWriter = channel[1];
+		return ring;
+	}
+
+	/**
+	 * Attaches to a ring that was created by another process, for the
+	 * consumer. `memoryFd` and `notifyFd` are the file descriptors returned by
+	 * the producer's getMemoryFd() and getNotifyFd().
+	 *
+	 * @throws IOException The file is not a valid request ring, or its size
+	 *    is not sealed.
+	 * @throws SystemException
+	 */
+	static RequestRingPtr attach(const FileDescriptor &memoryFd, const FileDescriptor &notifyFd) {
+		#ifdef __linux__
+			// The size must be sealed before we check it.
+			int seals = fcntl(memoryFd, F_GET_SEALS);
+			if (seals == -1 || (seals & (F_SEAL_SHRINK | F_SEAL_GROW))
+				!= (F_SEAL_SHRINK | F_SEAL_GROW))
+			{
+				throw IOException("The request ring file's size is not sealed");
+			}
+		#else
+			throw IOException("Request rings are not supported on this platform");
+		#endif
+
+		struct stat buf;
+		if (fstat(memoryFd, &buf) == -1) {
+			int e = errno;
+			throw SystemException("Cannot stat the request ring file", e);
+		}
+		if (!S_ISREG(buf.st_mode) || buf.st_size < (off_t) sizeof(Header)
+		 || !isValidCapacity(buf.st_size - sizeof(Header)))
+		{
+			throw IOException("The request ring file has an invalid size");
+		}
+
+		RequestRingPtr ring(new RequestRing());
+		ring->memoryFd = memoryFd;
+		ring->notifyReader = notifyFd;
+		ring->capacity = buf.st_size - sizeof(Header);
+		ring->mappedSize = buf.st_size;
+		ring->map(PROT_READ | PROT_WRITE);
+		if (ring->header->magic != MAGIC || ring->header->capacity != ring->capacity) {
+			throw IOException("The request ring file has an invalid header");
+		}
+		setNonBlocking(notifyFd);
+		return ring;
+	}
+
+	~RequestRing() {
+		if (header != NULL) {
+			munmap(header, mappedSize);
+		}
+	}
+
+	/** The file descriptor of the shared memory file. */
+	const FileDescriptor &getMemoryFd() const {
+		return memoryFd;
+	}
+
+	/** The file descriptor that the consumer waits on for new entries. */
+	const FileDescriptor &getNotifyFd() const {
+		return notifyReader;
+	}
+
+	unsigned int getCapacity() const {
+		return capacity;
+	}
+
+	/**
+	 * Appends an entry to the ring, and wakes up the consumer if it's
+	 * sleeping. Returns false if `data` is empty or larger than
+	 * MAX_ENTRY_SIZE, or if the ring is full; the caller should then
+	 * send the request over the socket instead.
+	 *
+	 * @throws SystemException The consumer could not be notified.
+	 */
+	bool push(unsigned int token, const StaticString &data) {
+		if (data.empty() || data.size() > MAX_ENTRY_SIZE) {
+			return false;
+		}
+
+		boost::uint32_t total = alignEntrySize(data.size());
+		boost::lock_guard<boost::mutex> l(pushLock);
+		boost::uint32_t head = header->head;
+		boost::uint32_t tail = header->tail;
+		// Don't write into the space that tail describes as free
+		// before the consumer is done reading it.
+		__sync_synchronize();
+		boost::uint32_t used = head - tail;
+		boost::uint32_t pos = head & (capacity - 1);
+		boost::uint32_t skip = 0;
+
+		if (capacity - pos < total) {
+			skip = capacity - pos;
+		}
+		if (used > capacity || capacity - used < skip + total) {
+			return false;
+		}
+		if (skip > 0) {
+			writeUint32(pos, WRAP_MARKER);
+			pos = 0;
+		}
+		writeUint32(pos, data.size());
+		writeUint32(pos + 4, token);
+		memcpy(entries + pos + ENTRY_HEADER_SIZE, data.data(), data.size());
+
+		// Publish the entry before the new head...
+		__sync_synchronize();
+		header->head = head + skip + total;
+		// ...and the new head before checking whether the consumer sleeps.
+		// The consumer does the opposite in prepareToWait(), so either it
+		// sees the new head or we see that it's waiting.
+		__sync_synchronize();
+		if (header->consumerWaiting) {
+			notifyChannel(notifyWriter);
+		}
+		return true;
+	}
+
+	/**
+	 * Removes the oldest entry from the ring. Returns false if the ring
+	 * is empty.
+	 *
+	 * @throws IOException The ring contains invalid data.
+	 */
+	bool pop(unsigned int &token, string &data) {
+		boost::uint32_t tail = header->tail;
+		while (true) {
+			boost::uint32_t head = header->head;
+			// Don't read entry contents that are older than head.
+			__sync_synchronize();
+			boost::uint32_t available = head - tail;
+			if (available == 0) {
+				return false;
+			} else if (available > capacity || available % 8 != 0) {
+				throwCorrupted("invalid head offset");
+			}
+
+			boost::uint32_t pos = tail & (capacity - 1);
+			boost::uint32_t size = readUint32(pos);
+			if (size == WRAP_MARKER) {
+				if (capacity - pos > available) {
+					throwCorrupted("wrap marker beyond head");
+				}
+				tail += capacity - pos;
+				header->tail = tail;
+				continue;
+			} else if (size == 0 || size > MAX_ENTRY_SIZE) {
+				throwCorrupted("invalid entry size");
+			}
+
+			boost::uint32_t total = alignEntrySize(size);
+			if (total > available || total > capacity - pos) {
+				throwCorrupted("entry extends beyond head");
+			}
+			token = readUint32(pos + 4);
+			data.assign(entries + pos + ENTRY_HEADER_SIZE, size);
+
+			// Don't let the producer overwrite the entry before
+			// we're done copying it.
+			__sync_synchronize();
+			header->tail = tail + total;
+			return true;
+		}
+	}
+
+	/**
+	 * Must be called by the consumer after it has woken up because the
+	 * notification file descriptor became readable, before it pops
+	 * entries. Drains the notification file descriptor.
+	 */
+	void clearNotification() {
+		header->consumerWaiting = 0;
+		char buf[64];
+		ssize_t ret;
+		do {
+			ret = syscalls::read(notifyReader, buf, sizeof(buf));
+		} while (ret > 0);
+	}
+
+	/**
+	 * Must be called by the consumer after pop() has returned false, before
+	 * it sleeps on the notification file descriptor. Returns false if new
+	 * entries have arrived in the mean time, in which case the consumer
+	 * should pop() again instead of sleeping.
+	 */
+	bool prepareToWait() {
+		header->consumerWaiting = 1;
+		__sync_synchronize();
+		if (header->head != header->tail) {
+			header->consumerWaiting = 0;
+			return false;
+		} else {
+			return true;
+		}
+	}
+};
+
+
+} // namespace Passenger
+
+#endif /* _PASSENGER_REQUEST_RING_H_ */
@@ -236,6 +236,18 @@ private:
 	const ExceptionHandlingMode exceptionHandlingMode;
 	bool shouldFlushToDiskAfterClose;
 	
+	/**
+	 * When batching is enabled, log messages are serialized into this
+	 * buffer instead of being written to the logging agent immediately.
+	 * The buffer is written out in a single system call once it grows
+	 * beyond maxBatchSize bytes, once the oldest message in it is older
+	 * than maxBatchDelay microseconds, or when the transaction is closed.
+	 */
+	const unsigned int maxBatchSize;
+	const unsigned long long maxBatchDelay;
+	string batch;
+	unsigned long long batchStartTime;
+	
 	/**
 	 * Buffer must be at least txnId.size() + 1 + INT64_STR_BUFSIZE + 1 bytes.
 	 */
@@ -264,6 +276,91 @@ private:
 		return buffer;
 	}
 	
+	static void appendUint16(string &buffer, uint16_t value) {
+		uint16_t l = htons(value);
+		buffer.append((const char *) &l, sizeof(uint16_t));
+	}
+	
+	static void appendUint32(string &buffer, uint32_t value) {
+		uint32_t l = htonl(value);
+		buffer.append((const char *) &l, sizeof(uint32_t));
+	}
+	
+	/**
+	 * Appends an array message, in the same format as writeArrayMessage()
+	 * writes it, to the batch buffer.
+	 */
+	void appendArrayMessageToBatch(const StaticString args[], unsigned int nargs) {
+		uint16_t bodySize = 0;
+		unsigned int i;
+		
+		for (i = 0; i < nargs; i++) {
+			bodySize += args[i].size() + 1;
+		}
+		appendUint16(batch, bodySize);
+		for (i = 0; i < nargs; i++) {
+			batch.append(args[i].data(), args[i].size());
+			batch.append(1, '\0');
+		}
+	}
+	
+	void appendLogMessageToBatch(const char *timestamp, const StaticString &text) {
+		if (batch.empty()) {
+			batchStartTime = SystemTime::getUsec();
+		}
+		
+		StaticString args[] = { "log", txnId, timestamp };
+		appendArrayMessageToBatch(args, sizeof(args) / sizeof(StaticString));
+		appendUint32(batch, text.size());
+		batch.append(text.data(), text.size());
+	}
+	
+	bool batchShouldBeFlushed() const {
+		return batch.size() >= maxBatchSize
+			|| SystemTime::getUsec() - batchStartTime >= maxBatchDelay;
+	}
+	
+	/**
+	 * Writes out the batch buffer. The caller must hold the connection lock
+	 * and must have checked that the connection is connected.
+	 */
+	void writeBatch(unsigned long long *timeout) {
+		if (!batch.empty()) {
+			writeExact(connection->fd, batch.data(), batch.size(), timeout);
+			batch.clear();
+		}
+	}
+	
+	void flushBatch() {
+		TRACE_POINT();
+		ConnectionLock l(connection);
+		if (!connection->connected()) {
+			batch.clear();
+			return;
+		}
+		
+		UPDATE_TRACE_POINT();
+		ConnectionGuard guard(connection);
+		try {
+			unsigned long long timeout = IO_TIMEOUT;
+			writeBatch(&timeout);
+			guard.clear();
+		} catch (const std::exception &e) {
+			string errorResponse;
+			
+			UPDATE_TRACE_POINT();
+			guard.clear();
+			batch.clear();
+			if (connection->disconnect(errorResponse)) {
+				handleException(IOException(
+					"Logging agent disconnected with error: " +
+					errorResponse));
+			} else {
+				handleException(e);
+			}
+		}
+	}
+	
 	template<typename ExceptionType>
 	void handleException(const ExceptionType &e) {
 		switch (exceptionHandlingMode) {
@@ -286,7 +383,9 @@ private:
 	
 public:
 	Logger()
-		: exceptionHandlingMode(PRINT)
+		: exceptionHandlingMode(PRINT),
+		  maxBatchSize(0),
+		  maxBatchDelay(0)
 		{ }
 	
 	Logger(const LoggerFactoryPtr &_loggerFactory,
@@ -295,7 +394,9 @@ public:
 		const string &_groupName,
 		const string &_category,
 		const string &_unionStationKey,
-		ExceptionHandlingMode _exceptionHandlingMode = PRINT)
+		ExceptionHandlingMode _exceptionHandlingMode = PRINT,
+		unsigned int _maxBatchSize = 0,
+		unsigned long long _maxBatchDelay = 0)
 		: loggerFactory(_loggerFactory),
 		  connection(_connection),
 		  txnId(_txnId),
@@ -303,7 +404,10 @@ public:
 		  category(_category),
 		  unionStationKey(_unionStationKey),
 		  exceptionHandlingMode(_exceptionHandlingMode),
-		  shouldFlushToDiskAfterClose(false)
+		  shouldFlushToDiskAfterClose(false),
+		  maxBatchSize(_maxBatchSize),
+		  maxBatchDelay(_maxBatchDelay),
+		  batchStartTime(0)
 		{ }
 	
 	~Logger() {
@@ -324,11 +428,17 @@ public:
 		ConnectionGuard guard(connection);
 		try {
 			unsigned long long timeout = IO_TIMEOUT;
-			writeArrayMessage(connection->fd, &timeout,
-				"closeTransaction",
-				txnId.c_str(),
-				timestamp,
-				NULL);
+			if (batch.empty()) {
+				writeArrayMessage(connection->fd, &timeout,
+					"closeTransaction",
+					txnId.c_str(),
+					timestamp,
+					NULL);
+			} else {
+				StaticString args[] = { "closeTransaction", txnId, timestamp };
+				appendArrayMessageToBatch(args, sizeof(args) / sizeof(StaticString));
+				writeBatch(&timeout);
+			}
 			
 			if (shouldFlushToDiskAfterClose) {
 				UPDATE_TRACE_POINT();
@@ -361,6 +471,17 @@ public:
 			P_TRACE(3, "[Union Station log to null] " << text);
 			return;
 		}
+		if (maxBatchSize > 0) {
+			char timestamp[2 * sizeof(unsigned long long) + 1];
+			integerToHexatri<unsigned long long>(SystemTime::getUsec(), timestamp);
+			P_TRACE(3, "[Union Station log] " << txnId << " " << timestamp << " " << text);
+			appendLogMessageToBatch(timestamp, text);
+			if (batchShouldBeFlushed()) {
+				flushBatch();
+			}
+			return;
+		}
+		
 		ConnectionLock l(connection);
 		if (!connection->connected()) {
 			P_TRACE(3, "[Union Station log to null] " << text);
@@ -409,6 +530,10 @@ public:
 		return connection == NULL;
 	}
 	
+	bool isBatching() const {
+		return maxBatchSize > 0;
+	}
+	
 	const string &getTxnId() const {
 		return txnId;
 	}
@@ -568,6 +693,8 @@ private:
 	 */
 	mutable boost::mutex syncher;
 	vector<ConnectionPtr> connectionPool;
+	unsigned int maxBatchSize;
+	unsigned long long maxBatchDelay;
 	unsigned int maxConnectTries;
 	unsigned long long reconnectTimeout;
 	unsigned long long nextReconnectTime;
@@ -640,8 +767,27 @@ private:
 		return boost::make_shared<Connection>(fd);
 	}
 	
+	LoggerPtr createLogger(const ConnectionPtr &connection, const string &txnId,
+		const string &groupName, const string &category,
+		const string &unionStationKey)
+	{
+		unsigned int batchSize;
+		unsigned long long batchDelay;
+		{
+			boost::lock_guard<boost::mutex> l(syncher);
+			batchSize  = maxBatchSize;
+			batchDelay = maxBatchDelay;
+		}
+		return boost::make_shared<Logger>(shared_from_this(),
+			connection, txnId, groupName, category,
+			unionStationKey, PRINT, batchSize, batchDelay);
+	}
+	
 public:
-	LoggerFactory() {
+	LoggerFactory()
+		: maxBatchSize(0),
+		  maxBatchDelay(0)
+	{
 		nullLogger = boost::make_shared<Logger>();
 	}
 	
@@ -650,7 +796,9 @@ public:
 		: serverAddress(_serverAddress),
 		  username(_username),
 		  password(_password),
-		  nodeName(determineNodeName(_nodeName))
+		  nodeName(determineNodeName(_nodeName)),
+		  maxBatchSize(0),
+		  maxBatchDelay(0)
 	{
 		nullLogger = boost::make_shared<Logger>();
 		if (!_serverAddress.empty() && isLocalSocketAddress(_serverAddress)) {
@@ -808,11 +956,8 @@ public:
 			}
 			
 			guard.clear();
-			return boost::make_shared<Logger>(shared_from_this(),
-				connection,
-				string(txnId, end - txnId),
-				groupName, category,
-				unionStationKey);
+			return createLogger(connection, string(txnId, end - txnId),
+				groupName, category, unionStationKey);
 			
 		} catch (const TimeoutException &) {
 			boost::lock_guard<boost::mutex> l(syncher);
@@ -881,9 +1026,7 @@ public:
 				"true",
 				NULL);
 			guard.clear();
-			return boost::make_shared<Logger>(shared_from_this(),
-				connection,
-				txnId, groupName, category,
+			return createLogger(connection, txnId, groupName, category,
 				unionStationKey);
 			
 		} catch (const TimeoutException &) {
@@ -930,6 +1073,20 @@ public:
 		reconnectTimeout = usec;
 	}
 	
+	/**
+	 * Enables or disables client-side batching for Loggers created from now on.
+	 * A batching Logger buffers its messages and sends them to the logging
+	 * agent in a single write once <em>size</em> bytes have accumulated, once
+	 * the oldest buffered message is <em>delay</em> microseconds old, or when
+	 * the transaction is closed. The delay is only checked when a new message
+	 * is logged. A size of 0 disables batching.
+	 */
+	void setBatching(unsigned int size, unsigned long long delay) {
+		boost::lock_guard<boost::mutex> l(syncher);
+		maxBatchSize  = size;
+		maxBatchDelay = delay;
+	}
+	
 	bool isNull() const {
 		return serverAddress.empty();
 	}
@@ -54,4 +54,25 @@ pp_cached_file_stat_perform(PP_CachedFileStat *cstat,
 	}
 }
 
+int
+pp_cached_file_stat_enable_inotify(PP_CachedFileStat *cstat,
+                                   unsigned int max_watches)
+{
+	return ((Passenger::CachedFileStat *) cstat)->enableInotify(max_watches);
+}
+
+void
+pp_cached_file_stat_disable_inotify(PP_CachedFileStat *cstat) {
+	((Passenger::CachedFileStat *) cstat)->disableInotify();
+}
+
+void
+pp_cached_file_stat_process_inotify_events(PP_CachedFileStat *cstat) {
+	try {
+		((Passenger::CachedFileStat *) cstat)->processInotifyEvents();
+	} catch (const boost::thread_interrupted &) {
+		// Do nothing; the remaining events will be processed next time.
+	}
+}
+
 } // extern "C"
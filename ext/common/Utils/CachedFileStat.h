@@ -42,6 +42,10 @@ int  pp_cached_file_stat_perform(PP_CachedFileStat *cstat,
                                  const char *filename,
                                  struct stat *buf,
                                  unsigned int throttle_rate);
+int  pp_cached_file_stat_enable_inotify(PP_CachedFileStat *cstat,
+                                        unsigned int max_watches);
+void pp_cached_file_stat_disable_inotify(PP_CachedFileStat *cstat);
+void pp_cached_file_stat_process_inotify_events(PP_CachedFileStat *cstat);
 
 
 #ifdef __cplusplus
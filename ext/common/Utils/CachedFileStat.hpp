@@ -30,9 +30,15 @@
 #include <unistd.h>
 #include <time.h>
 
+#ifdef __linux__
+	#include <sys/inotify.h>
+#endif
+
 #include <cerrno>
 #include <cassert>
 #include <string>
+#include <list>
+#include <map>
 #include <boost/shared_ptr.hpp>
 #include <boost/make_shared.hpp>
 #include <oxt/system_calls.hpp>
@@ -56,6 +62,8 @@ using namespace boost;
  * file that wasn't in the cache is being stat()ed, and the cache is full,
  * then the oldest cache entry will be removed.
  *
+ * On Linux, the cache can optionally be backed by inotify; see enableInotify().
+ *
  * This class is fully thread-safe.
  */
 class CachedFileStat {
@@ -95,6 +103,19 @@ public:
 		/** This entry's filename. */
 		string filename;
 		
+		/**
+		 * Whether the directories leading to this file are being watched
+		 * with inotify. If so, the cached information stays valid until
+		 * an inotify event invalidates it, regardless of the throttle rate.
+		 */
+		bool watched;
+		
+		/** Whether an earlier attempt to watch this file failed. */
+		bool unwatchable;
+		
+		/** The normalized form of `filename`, set if `watched` is true. */
+		string watchedPath;
+		
 		/**
 		 * Creates a new Entry object. The file will not be
 		 * stat()ted until you call refresh().
@@ -108,6 +129,8 @@ public:
 			last_result = -1;
 			last_errno = 0;
 			last_time = 0;
+			watched = false;
+			unwatchable = false;
 		}
 		
 		/**
@@ -129,7 +152,10 @@ public:
 		int refresh(unsigned int throttleRate) {
 			time_t currentTime;
 
-			if (expired(last_time, throttleRate, currentTime)) {
+			if (watched) {
+				errno = last_errno;
+				return last_result;
+			} else if (expired(last_time, throttleRate, currentTime)) {
 				last_result = syscalls::stat(filename.c_str(), &info);
 				last_errno = errno;
 				last_time = currentTime;
@@ -150,6 +176,184 @@ public:
 	EntryMap cache;
 	mutable boost::mutex lock;
 	
+private:
+	int inotifyFd;
+	unsigned int maxWatches;
+	/** Maps watched directory paths to inotify watch descriptors... */
+	map<string, int> watchesByDir;
+	/** ...and vice versa. */
+	map<int, string> dirsByWatch;
+	
+	/**
+	 * Turns an absolute filename into a canonical form that can be compared
+	 * against the directory names reported by inotify, by removing duplicate
+	 * slashes, "." components and trailing slashes. Returns false if the
+	 * filename is relative or contains "..", in which case it can't be watched.
+	 * Symlinks are not resolved.
+	 */
+	static bool normalizePath(const StaticString &filename, string &result) {
+		const char *pos = filename.data();
+		const char *end = filename.data() + filename.size();
+		
+		if (filename.empty() || filename[0] != '/') {
+			return false;
+		}
+		result.clear();
+		result.reserve(filename.size());
+		while (pos < end) {
+			const char *componentEnd;
+			
+			while (pos < end && *pos == '/') {
+				pos++;
+			}
+			componentEnd = (const char *) memchr(pos, '/', end - pos);
+			if (componentEnd == NULL) {
+				componentEnd = end;
+			}
+			
+			StaticString component(pos, componentEnd - pos);
+			if (component == "..") {
+				return false;
+			} else if (!component.empty() && component != ".") {
+				result.append(1, '/');
+				result.append(component.data(), component.size());
+			}
+			pos = componentEnd;
+		}
+		if (result.empty()) {
+			result.assign(1, '/');
+		}
+		return true;
+	}
+	
+	/** Returns whether `path` is equal to `dir` or lies somewhere below it. */
+	static bool isSubPath(const string &path, const string &dir) {
+		return dir == "/"
+			|| path == dir
+			|| (path.size() > dir.size()
+				&& path.compare(0, dir.size(), dir) == 0
+				&& path[dir.size()] == '/');
+	}
+	
+	#ifdef __linux__
+		/**
+		 * Watches the given directory for changes to its entries.
+		 *
+		 * @return 1 if the directory is being watched, 0 if it doesn't exist
+		 *         (or is not a directory), -1 if it can't be watched.
+		 */
+		int watchDirectory(const string &dir) {
+			if (watchesByDir.find(dir) != watchesByDir.end()) {
+				return 1;
+			} else if (watchesByDir.size() >= maxWatches) {
+				return -1;
+			}
+			
+			int wd = inotify_add_watch(inotifyFd, dir.c_str(), IN_ONLYDIR
+				| IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+				| IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE
+				| IN_DELETE_SELF | IN_MOVE_SELF);
+			if (wd == -1) {
+				if (errno == ENOENT || errno == ENOTDIR) {
+					return 0;
+				} else {
+					return -1;
+				}
+			} else if (dirsByWatch.find(wd) != dirsByWatch.end()) {
+				// The same directory is already being watched under a
+				// different path, e.g. through a symlink. inotify only
+				// gives us one watch descriptor per inode, so we can't
+				// tell which path an event belongs to.
+				return -1;
+			} else {
+				watchesByDir.insert(make_pair(dir, wd));
+				dirsByWatch.insert(make_pair(wd, dir));
+				return 1;
+			}
+		}
+		
+		/**
+		 * Watches every directory on the way to the given normalized path,
+		 * starting at the root, so that a change anywhere along the path
+		 * (including a symlink swap of one of the parent directories)
+		 * generates an event. If one of the directories doesn't exist then
+		 * the watch on its parent will tell us when it is created.
+		 *
+		 * @return Whether the path is fully covered by watches.
+		 */
+		bool watchPath(const string &path) {
+			string::size_type pos = 0;
+			
+			while (pos != string::npos) {
+				int ret = watchDirectory((pos == 0) ? string(1, '/') : path.substr(0, pos));
+				if (ret == -1) {
+					return false;
+				} else if (ret == 0) {
+					return true;
+				}
+				pos = path.find('/', pos + 1);
+			}
+			return true;
+		}
+	#endif
+	
+	/**
+	 * Forgets all watched entries at or below the given path, as well as the
+	 * watches on the directories below it.
+	 */
+	void invalidate(const string &path) {
+		EntryList::iterator it = entries.begin();
+		while (it != entries.end()) {
+			if ((*it)->watched && isSubPath((*it)->watchedPath, path)) {
+				cache.remove((*it)->filename);
+				entries.erase(it++);
+			} else {
+				it++;
+			}
+		}
+		
+		map<string, int>::iterator wit = watchesByDir.lower_bound(path);
+		while (wit != watchesByDir.end() && wit->first.compare(0, path.size(), path) == 0) {
+			if (isSubPath(wit->first, path)) {
+				#ifdef __linux__
+					inotify_rm_watch(inotifyFd, wit->second);
+				#endif
+				dirsByWatch.erase(wit->second);
+				watchesByDir.erase(wit++);
+			} else {
+				wit++;
+			}
+		}
+	}
+	
+	#ifdef __linux__
+		void handleEvent(const struct inotify_event *event) {
+			if (event->mask & IN_Q_OVERFLOW) {
+				// We've missed events, so nothing can be trusted anymore.
+				invalidate("/");
+				return;
+			}
+			
+			map<int, string>::iterator it = dirsByWatch.find(event->wd);
+			if (it == dirsByWatch.end()) {
+				// A watch that we've already removed.
+				return;
+			}
+			
+			string path(it->second);
+			if (event->len > 0) {
+				// An entry inside the directory changed.
+				if (path != "/") {
+					path.append(1, '/');
+				}
+				path.append(event->name);
+			}
+			// Otherwise, the directory itself was removed or renamed.
+			invalidate(path);
+		}
+	#endif
+	
+public:
 	/**
 	 * Creates a new CachedFileStat object.
 	 *
@@ -157,6 +361,94 @@ public:
 	 */
 	CachedFileStat(unsigned int maxSize = 0) {
 		this->maxSize = maxSize;
+		inotifyFd = -1;
+		maxWatches = 0;
+	}
+	
+	~CachedFileStat() {
+		if (inotifyFd != -1) {
+			close(inotifyFd);
+		}
+	}
+	
+	/**
+	 * Backs this cache with inotify. From then on, every stat() on an absolute
+	 * path watches the directories leading to that file, and the result is
+	 * cached until one of those directories changes, no matter the throttle
+	 * rate. Both successful and failed stats are cached this way, so that
+	 * repeated lookups don't result in any system calls at all. Files whose
+	 * directories can't be watched, e.g. because `maxWatches` has been reached,
+	 * keep using the throttle rate.
+	 *
+	 * Changes are only noticed when processInotifyEvents() is called, so the
+	 * caller should call it whenever the returned file descriptor becomes
+	 * readable. Changes made on other machines to files on network filesystems
+	 * are not reported by inotify, and neither are changes to the target of a
+	 * symlink that lives outside the watched directories.
+	 *
+	 * @return A non-blocking file descriptor that becomes readable when there
+	 *         are pending events, or -1 if inotify is not available, in which
+	 *         case errno is set.
+	 */
+	int enableInotify(unsigned int maxWatches = 256) {
+		boost::unique_lock<boost::mutex> l(lock);
+		#ifdef __linux__
+			if (inotifyFd == -1) {
+				inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+			}
+			this->maxWatches = maxWatches;
+			return inotifyFd;
+		#else
+			errno = ENOSYS;
+			return -1;
+		#endif
+	}
+	
+	/**
+	 * Stops using inotify. Watched entries are removed from the cache, and
+	 * from now on the throttle rate applies to all files again.
+	 */
+	void disableInotify() {
+		boost::unique_lock<boost::mutex> l(lock);
+		if (inotifyFd != -1) {
+			invalidate("/");
+			close(inotifyFd);
+			inotifyFd = -1;
+			for (EntryList::iterator it = entries.begin(); it != entries.end(); it++) {
+				(*it)->unwatchable = false;
+			}
+		}
+	}
+	
+	/**
+	 * Reads all pending inotify events and invalidates the affected cache
+	 * entries. Does nothing if inotify is not enabled.
+	 *
+	 * @throws boost::thread_interrupted
+	 */
+	void processInotifyEvents() {
+		#ifdef __linux__
+			boost::unique_lock<boost::mutex> l(lock);
+			char buf[1024 * 4]
+				__attribute__ ((aligned(__alignof__(struct inotify_event))));
+			ssize_t ret;
+			
+			while (inotifyFd != -1) {
+				ret = syscalls::read(inotifyFd, buf, sizeof(buf));
+				if (ret <= 0) {
+					// EAGAIN means that there are no more events.
+					break;
+				}
+				
+				const char *pos = buf;
+				const char *end = buf + ret;
+				while (pos < end) {
+					const struct inotify_event *event = (const struct inotify_event *) pos;
+					handleEvent(event);
+					pos += sizeof(struct inotify_event) + event->len;
+				}
+			}
+		#endif
 	}
 	
 	/**
@@ -207,6 +499,21 @@ public:
 			entries.splice(entries.begin(), entries, it);
 			cache.set(filename, entries.begin());
 		}
+		
+		#ifdef __linux__
+			if (inotifyFd != -1 && !entry->watched && !entry->unwatchable) {
+				// The watches must be in place before the file is statted,
+				// or we might miss a change that happens in between.
+				if (normalizePath(filename, entry->watchedPath)
+				 && watchPath(entry->watchedPath))
+				{
+					entry->refresh(0);
+					entry->watched = true;
+				} else {
+					entry->unwatchable = true;
+				}
+			}
+		#endif
 		ret = entry->refresh(throttleRate);
 		*buf = entry->info;
 		return ret;
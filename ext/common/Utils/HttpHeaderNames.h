@@ -0,0 +1,222 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2013 Phusion
+ *
+ *  "Phusion Passenger" is a trademark of Hongli Lai & Ninh Bui.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_HTTP_HEADER_NAMES_H_
+#define _PASSENGER_HTTP_HEADER_NAMES_H_
+
+#include <cstring>
+#include <boost/cstdint.hpp>
+#include <StaticString.h>
+
+namespace Passenger {
+
+using namespace std;
+
+
+/**
+ * Converts CGI-style request header names, as found in SCGI headers, back
+ * to HTTP header names, e.g. "ACCEPT_ENCODING" (without the "HTTP_" prefix)
+ * to "Accept-Encoding". Underscores become dashes, and every letter that
+ * doesn't start a word is lowercased.
+ */
+struct HttpHeaderNames {
+	struct Entry {
+		const char *cgiName;
+		const char *httpName;
+		unsigned int size;
+	};
+
+	static const unsigned int TABLE_SIZE = 128;
+
+	/** Common header names, sorted alphabetically. */
+	static const Entry *entries() {
+		static const Entry result[] = {
+			{ "ACCEPT", "Accept", 6 },
+			{ "ACCEPT_CHARSET", "Accept-Charset", 14 },
+			{ "ACCEPT_ENCODING", "Accept-Encoding", 15 },
+			{ "ACCEPT_LANGUAGE", "Accept-Language", 15 },
+			{ "ACCESS_CONTROL_REQUEST_HEADERS", "Access-Control-Request-Headers", 30 },
+			{ "ACCESS_CONTROL_REQUEST_METHOD", "Access-Control-Request-Method", 29 },
+			{ "AUTHORIZATION", "Authorization", 13 },
+			{ "CACHE_CONTROL", "Cache-Control", 13 },
+			{ "CONNECTION", "Connection", 10 },
+			{ "COOKIE", "Cookie", 6 },
+			{ "DNT", "Dnt", 3 },
+			{ "EXPECT", "Expect", 6 },
+			{ "FORWARDED", "Forwarded", 9 },
+			{ "HOST", "Host", 4 },
+			{ "IF_MATCH", "If-Match", 8 },
+			{ "IF_MODIFIED_SINCE", "If-Modified-Since", 17 },
+			{ "IF_NONE_MATCH", "If-None-Match", 13 },
+			{ "IF_RANGE", "If-Range", 8 },
+			{ "IF_UNMODIFIED_SINCE", "If-Unmodified-Since", 19 },
+			{ "KEEP_ALIVE", "Keep-Alive", 10 },
+			{ "ORIGIN", "Origin", 6 },
+			{ "PRAGMA", "Pragma", 6 },
+			{ "RANGE", "Range", 5 },
+			{ "REFERER", "Referer", 7 },
+			{ "SEC_WEBSOCKET_EXTENSIONS", "Sec-Websocket-Extensions", 24 },
+			{ "SEC_WEBSOCKET_KEY", "Sec-Websocket-Key", 17 },
+			{ "SEC_WEBSOCKET_PROTOCOL", "Sec-Websocket-Protocol", 22 },
+			{ "SEC_WEBSOCKET_VERSION", "Sec-Websocket-Version", 21 },
+			{ "TE", "Te", 2 },
+			{ "UPGRADE", "Upgrade", 7 },
+			{ "UPGRADE_INSECURE_REQUESTS", "Upgrade-Insecure-Requests", 25 },
+			{ "USER_AGENT", "User-Agent", 10 },
+			{ "VIA", "Via", 3 },
+			{ "X_CSRF_TOKEN", "X-Csrf-Token", 12 },
+			{ "X_FORWARDED_FOR", "X-Forwarded-For", 15 },
+			{ "X_FORWARDED_HOST", "X-Forwarded-Host", 16 },
+			{ "X_FORWARDED_PROTO", "X-Forwarded-Proto", 17 },
+			{ "X_HTTP_METHOD_OVERRIDE", "X-Http-Method-Override", 22 },
+			{ "X_REAL_IP", "X-Real-Ip", 9 },
+			{ "X_REQUESTED_WITH", "X-Requested-With", 16 },
+			{ "X_REQUEST_ID", "X-Request-Id", 12 },
+			{ NULL, NULL, 0 }
+		};
+		return result;
+	}
+
+	/**
+	 * Maps hash() values to 1 + the index of the entry with that hash value,
+	 * or 0 if there is none. hash() has been chosen so that all entries have
+	 * different hash values. If you add an entry then you must find new
+	 * hash() multipliers and regenerate this table.
+	 */
+	static const unsigned char *slots() {
+		static const unsigned char result[TABLE_SIZE] = {
+			 0, 27,  0,  0,  0, 11,  0,  0,  0,  0, 25,  2, 33,  0,  0, 29,
+			 0, 10,  0, 21, 39,  0,  0,  0, 17,  1,  0, 41,  0,  4, 16,  0,
+			26, 38,  8,  0, 13,  0,  0, 30,  0, 12,  0,  0,  0,  0,  0, 37,
+			 0,  0,  5,  0,  0,  0,  0,  0,  0,  0,  0,  9,  0, 18,  0,  0,
+			 0, 32, 24,  0,  0, 34,  0, 20,  0,  0,  0,  0,  0, 14,  0,  0,
+			 0,  0,  0,  0,  0,  0,  0,  0, 31,  0,  0,  0,  0,  0, 28,  0,
+			 0, 22,  0,  0,  0,  0,  0, 15,  0,  0,  0,  0,  3, 23,  6,  0,
+			 0, 35,  0,  0, 36,  0,  0,  0,  7,  0,  0,  0, 40,  0,  0, 19,
+		};
+		return result;
+	}
+
+	static unsigned int hash(const char *name, size_t size) {
+		return (unsigned int) (size
+			+ 4 * (unsigned char) name[0]
+			+ 14 * (unsigned char) name[size - 1]
+			+ 11 * (unsigned char) name[size / 2])
+			& (TABLE_SIZE - 1);
+	}
+
+	/**
+	 * Returns the HTTP name of the given common header, or NULL if it's
+	 * not one of the common ones.
+	 */
+	static const Entry *lookup(const char *name, size_t size) {
+		if (size == 0) {
+			return NULL;
+		}
+		unsigned char slot = slots()[hash(name, size)];
+		if (slot == 0) {
+			return NULL;
+		}
+		const Entry *entry = &entries()[slot - 1];
+		if (entry->size == size && memcmp(entry->cgiName, name, size) == 0) {
+			return entry;
+		} else {
+			return NULL;
+		}
+	}
+
+	/**
+	 * Converts any header name. Eight characters are processed at a time:
+	 * uppercase letters are lowercased and underscores are turned into dashes
+	 * with a few bitwise operations. Afterwards the characters that start
+	 * a word are restored.
+	 *
+	 * @param output Must have room for <em>size</em> characters.
+	 */
+	static void convert(const char *name, size_t size, char *output) {
+		const boost::uint64_t ones = 0x0101010101010101ull;
+		const boost::uint64_t highBits = ones * 0x80;
+		const boost::uint64_t lowBits = ones * 0x7f;
+		size_t i = 0;
+
+		for (; i + 8 <= size; i += 8) {
+			boost::uint64_t word;
+			memcpy(&word, name + i, 8);
+
+			// The high bit of each byte is set if that byte is an uppercase letter.
+			boost::uint64_t low = word & lowBits;
+			boost::uint64_t upper = (low + ones * (0x80 - 'A'))
+				& ~(low + ones * (0x80 - 'Z' - 1))
+				& ~word & highBits;
+			// The high bit of each byte is set if that byte is an underscore.
+			boost::uint64_t x = word ^ (ones * '_');
+			boost::uint64_t underscore = ~(((x & lowBits) + lowBits) | x) & highBits;
+
+			word |= upper >> 2;
+			word ^= (underscore >> 7) * ('_' ^ '-');
+			memcpy(output + i, &word, 8);
+		}
+		for (; i < size; i++) {
+			char ch = name[i];
+			if (ch == '_') {
+				ch = '-';
+			} else if (ch >= 'A' && ch <= 'Z') {
+				ch = ch - 'A' + 'a';
+			}
+			output[i] = ch;
+		}
+
+		if (size > 0 && name[0] != '_') {
+			output[0] = name[0];
+		}
+		char *pos = output;
+		char *end = output + size;
+		while ((pos = (char *) memchr(pos, '-', end - pos)) != NULL) {
+			pos++;
+			if (pos < end && *pos != '-') {
+				*pos = name[pos - output];
+			}
+		}
+	}
+
+	/**
+	 * Writes the HTTP name of the given CGI-style header name to <em>pos</em>,
+	 * which must have room for <em>name.size()</em> characters. Returns the
+	 * position right after the written name.
+	 */
+	static char *append(char *pos, const StaticString &name) {
+		const Entry *entry = lookup(name.data(), name.size());
+		if (entry != NULL) {
+			memcpy(pos, entry->httpName, entry->size);
+		} else {
+			convert(name.data(), name.size(), pos);
+		}
+		return pos + name.size();
+	}
+};
+
+
+} // namespace Passenger
+
+#endif /* _PASSENGER_HTTP_HEADER_NAMES_H_ */
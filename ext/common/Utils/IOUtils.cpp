@@ -54,6 +54,7 @@
 	// For accept4 macros
 	#include <sys/syscall.h>
 	#include <linux/net.h>
+	#include <sys/eventfd.h>
 #endif
 
 #if defined(__APPLE__)
@@ -582,7 +583,7 @@ connectToTcpServer(NTCP_State &state) {
 
 	ret = syscalls::connect(state.fd, state.res->ai_addr, state.res->ai_addrlen);
 	if (ret == -1) {
-		if (errno == EINPROGRESS || errno == EWOULDBLOCK) {
+		if (errno == EINPROGRESS || errno == EALREADY || errno == EWOULDBLOCK) {
 			return false;
 		} else if (errno == EISCONN) {
 			freeaddrinfo(state.res);
@@ -667,6 +668,40 @@ createPipe() {
 	}
 }
 
+Pipe
+createNotificationChannel() {
+	#ifdef __linux__
+		int fd = eventfd(0, 0);
+		if (fd == -1) {
+			int e = errno;
+			throw SystemException("Cannot create an eventfd", e);
+		}
+		FileDescriptor channel(fd);
+		setNonBlocking(channel);
+		return Pipe(channel, channel);
+	#else
+		Pipe p = createPipe();
+		setNonBlocking(p[0]);
+		setNonBlocking(p[1]);
+		return p;
+	#endif
+}
+
+void
+notifyChannel(int fd) {
+	#ifdef __linux__
+		eventfd_t value = 1;
+		ssize_t ret = syscalls::write(fd, &value, sizeof(value));
+	#else
+		ssize_t ret = syscalls::write(fd, "x", 1);
+	#endif
+	// EAGAIN means that there are plenty of notifications pending already.
+	if (ret == -1 && errno != EAGAIN) {
+		int e = errno;
+		throw SystemException("Cannot write to a notification channel", e);
+	}
+}
+
 static bool
 waitUntilIOEvent(int fd, short event, unsigned long long *timeout) {
 	struct pollfd pfd;
@@ -305,6 +305,16 @@ struct NConnect_State {
 	ServerAddressType type;
 	NUnix_State s_unix;
 	NTCP_State s_tcp;
+
+	/** The file descriptor that is being connected. Only valid
+	 * after setupNonBlockingSocket() has been called. */
+	FileDescriptor &fd() {
+		if (type == SAT_UNIX) {
+			return s_unix.fd;
+		} else {
+			return s_tcp.fd;
+		}
+	}
 };
 
 /**
@@ -351,6 +361,26 @@ SocketPair createUnixSocketPair();
  */
 Pipe createPipe();
 
+/**
+ * Creates a non-blocking channel through which one process can wake up
+ * another: an eventfd on Linux, in which case both ends are the same file
+ * descriptor, and a pipe elsewhere. Write to the second end with
+ * notifyChannel(); the first end becomes readable until it's drained.
+ *
+ * @throws SystemException
+ * @throws boost::thread_interrupted
+ */
+Pipe createNotificationChannel();
+
+/**
+ * Writes a notification to the writing end of a channel that was created
+ * with createNotificationChannel().
+ *
+ * @throws SystemException
+ * @throws boost::thread_interrupted
+ */
+void notifyChannel(int fd);
+
 /**
  * Waits at most <tt>*timeout</tt> microseconds for the file descriptor to become readable.
  * Returns true if it become readable within the timeout, false if the timeout expired.
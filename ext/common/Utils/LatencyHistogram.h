@@ -0,0 +1,213 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2013 Phusion
+ *
+ *  "Phusion Passenger" is a trademark of Hongli Lai & Ninh Bui.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_LATENCY_HISTOGRAM_H_
+#define _PASSENGER_LATENCY_HISTOGRAM_H_
+
+#include <string>
+#include <cstdio>
+#include <cstring>
+
+namespace Passenger {
+
+using namespace std;
+
+
+/**
+ * A fixed-size histogram of latencies in microseconds, in the style of
+ * HdrHistogram. Values below LINEAR_BUCKETS are counted exactly. Above that,
+ * each power of two is divided into SUB_BUCKETS equally sized buckets, so any
+ * percentile is reported with a relative error of at most 1/SUB_BUCKETS.
+ * Values of MAX_VALUE and higher are counted as MAX_VALUE.
+ *
+ * Recording a value is a handful of shifts plus an increment, and never
+ * allocates memory. Not thread-safe.
+ */
+class LatencyHistogram {
+public:
+	static const unsigned int LINEAR_BUCKETS = 16;
+	static const unsigned int SUB_BUCKETS = 8;
+	static const unsigned int SUB_BUCKET_BITS = 3;
+	/** Values are tracked up to 2^MAX_EXPONENT microseconds, about 12 days. */
+	static const unsigned int MAX_EXPONENT = 40;
+	static const unsigned long long MAX_VALUE = (1ull << MAX_EXPONENT) - 1;
+	/** The linear buckets cover exponents 0-3, so the first sub-bucketed exponent is 4. */
+	static const unsigned int BUCKET_COUNT = LINEAR_BUCKETS + (MAX_EXPONENT - 4) * SUB_BUCKETS;
+
+private:
+	unsigned int counts[BUCKET_COUNT];
+	unsigned long long count;
+	unsigned long long sum;
+	unsigned long long max;
+
+	static unsigned int bucketIndex(unsigned long long value) {
+		if (value < LINEAR_BUCKETS) {
+			return (unsigned int) value;
+		}
+
+		unsigned int exponent = 4;
+		while ((value >> (exponent + 1)) != 0) {
+			exponent++;
+		}
+		unsigned int shift = exponent - SUB_BUCKET_BITS;
+		return LINEAR_BUCKETS
+			+ (exponent - 4) * SUB_BUCKETS
+			+ (unsigned int) ((value >> shift) & (SUB_BUCKETS - 1));
+	}
+
+	/** The highest value that is counted in the given bucket. */
+	static unsigned long long bucketUpperBound(unsigned int index) {
+		if (index < LINEAR_BUCKETS) {
+			return index;
+		}
+
+		unsigned int exponent = 4 + (index - LINEAR_BUCKETS) / SUB_BUCKETS;
+		unsigned int subBucket = (index - LINEAR_BUCKETS) % SUB_BUCKETS;
+		unsigned int shift = exponent - SUB_BUCKET_BITS;
+		unsigned long long lowerBound = (unsigned long long) (SUB_BUCKETS + subBucket) << shift;
+		return lowerBound + (1ull << shift) - 1;
+	}
+
+	static void formatDuration(string &output, unsigned long long usec) {
+		char buf[32];
+		if (usec < 1000) {
+			snprintf(buf, sizeof(buf), "%uus", (unsigned int) usec);
+		} else if (usec < 1000000) {
+			snprintf(buf, sizeof(buf), "%.1fms", usec / 1000.0);
+		} else {
+			snprintf(buf, sizeof(buf), "%.2fs", usec / 1000000.0);
+		}
+		buf[sizeof(buf) - 1] = '\0';
+		output.append(buf);
+	}
+
+public:
+	LatencyHistogram() {
+		reset();
+	}
+
+	void reset() {
+		memset(counts, 0, sizeof(counts));
+		count = 0;
+		sum = 0;
+		max = 0;
+	}
+
+	void record(unsigned long long usec) {
+		if (usec > MAX_VALUE) {
+			usec = MAX_VALUE;
+		}
+		counts[bucketIndex(usec)]++;
+		count++;
+		sum += usec;
+		if (usec > max) {
+			max = usec;
+		}
+	}
+
+	unsigned long long getCount() const {
+		return count;
+	}
+
+	unsigned long long getMean() const {
+		if (count == 0) {
+			return 0;
+		} else {
+			return sum / count;
+		}
+	}
+
+	unsigned long long getMax() const {
+		return max;
+	}
+
+	/**
+	 * Returns the value below which the given percentage of all recorded
+	 * values fall, or 0 if nothing has been recorded yet.
+	 *
+	 * @param percentile A number between 0 and 100.
+	 */
+	unsigned long long getPercentile(double percentile) const {
+		if (count == 0) {
+			return 0;
+		}
+
+		unsigned long long target = (unsigned long long) (percentile / 100.0 * count + 0.5);
+		if (target == 0) {
+			target = 1;
+		} else if (target > count) {
+			target = count;
+		}
+
+		unsigned long long seen = 0;
+		for (unsigned int i = 0; i < BUCKET_COUNT; i++) {
+			seen += counts[i];
+			if (seen >= target) {
+				unsigned long long result = bucketUpperBound(i);
+				return (result < max) ? result : max;
+			}
+		}
+		return max;
+	}
+
+	template<typename Stream>
+	void toXml(Stream &stream) const {
+		stream << "<count>" << count << "</count>";
+		stream << "<mean>" << getMean() << "</mean>";
+		stream << "<p50>" << getPercentile(50) << "</p50>";
+		stream << "<p90>" << getPercentile(90) << "</p90>";
+		stream << "<p99>" << getPercentile(99) << "</p99>";
+		stream << "<p999>" << getPercentile(99.9) << "</p999>";
+		stream << "<max>" << max << "</max>";
+	}
+
+	/**
+	 * Returns a one-line human-readable summary, e.g.
+	 * "count=123 mean=1.2ms p50=1.0ms p90=2.1ms p99=9.8ms max=12.0ms".
+	 */
+	string inspect() const {
+		string result;
+		char buf[32];
+
+		snprintf(buf, sizeof(buf), "count=%llu", count);
+		buf[sizeof(buf) - 1] = '\0';
+		result.append(buf);
+		result.append(" mean=");
+		formatDuration(result, getMean());
+		result.append(" p50=");
+		formatDuration(result, getPercentile(50));
+		result.append(" p90=");
+		formatDuration(result, getPercentile(90));
+		result.append(" p99=");
+		formatDuration(result, getPercentile(99));
+		result.append(" max=");
+		formatDuration(result, max);
+		return result;
+	}
+};
+
+
+} // namespace Passenger
+
+#endif /* _PASSENGER_LATENCY_HISTOGRAM_H_ */
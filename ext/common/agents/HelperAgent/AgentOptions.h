@@ -28,6 +28,7 @@
 #include <sys/types.h>
 #include <string>
 #include <boost/shared_ptr.hpp>
+#include <Constants.h>
 #include <Utils/VariantMap.h>
 
 namespace Passenger {
@@ -49,6 +50,10 @@ struct AgentOptions {
 	unsigned int maxPoolSize;
 	unsigned int maxInstancesPerApp;
 	unsigned int poolIdleTime;
+	unsigned int requestLoops;
+	unsigned int unionStationBatchSize;
+	unsigned int unionStationBatchDelay;
+	unsigned int clientFreelistSize;
 	string requestSocketFilename;
 	string requestSocketPassword;
 	string adminSocketAddress;
@@ -56,12 +61,18 @@ struct AgentOptions {
 	string loggingAgentAddress;
 	string loggingAgentPassword;
 	string adminToolStatusPassword;
+	string adminToolManipulationPassword;
 	vector<string> prestartUrls;
 
 	bool testBinary;
 	string requestSocketLink;
+	/** Whether the Watchdog passes a HotRestartHandoff from the previous
+	 * helper agent instance through the feedback fd, after the options. */
+	bool hotRestartHandoff;
 
-	AgentOptions() { }
+	AgentOptions()
+		: clientFreelistSize(DEFAULT_CLIENT_FREELIST_SIZE)
+		{ }
 
 	AgentOptions(const VariantMap &options) {
 		testBinary = options.get("test_binary", false) == "1";
@@ -94,10 +105,19 @@ struct AgentOptions {
 		loggingAgentAddress   = options.get("logging_agent_address");
 		loggingAgentPassword  = options.get("logging_agent_password");
 		adminToolStatusPassword = options.get("admin_tool_status_password");
+		adminToolManipulationPassword = options.get("admin_tool_manipulation_password", false);
 		
 		// Optional options.
 		prestartUrls          = options.getStrSet("prestart_urls", false);
 		requestSocketLink     = options.get("request_socket_link", false);
+		requestLoops          = options.getInt("request_loops", false, 1);
+		unionStationBatchSize = options.getInt("union_station_batch_size", false,
+			DEFAULT_UNION_STATION_BATCH_SIZE);
+		unionStationBatchDelay = options.getInt("union_station_batch_delay", false,
+			DEFAULT_UNION_STATION_BATCH_DELAY);
+		clientFreelistSize    = options.getInt("client_freelist_size", false,
+			DEFAULT_CLIENT_FREELIST_SIZE);
+		hotRestartHandoff     = options.getBool("hot_restart_handoff", false, false);
 	}
 };
 
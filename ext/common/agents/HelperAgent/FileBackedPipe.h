@@ -29,10 +29,12 @@
 #include <boost/weak_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/shared_array.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/function.hpp>
 #include <boost/bind.hpp>
 #include <string>
 #include <sstream>
+#include <algorithm>
 #include <memory>
 #include <cstdlib>
 #include <cassert>
@@ -126,6 +128,9 @@ public:
 private:
 	typedef boost::function<void (int err, const char *data, size_t size)> EioReadCallback;
 
+	/** The maximum amount of buffered data that is passed to the data event handler at once. */
+	static const size_t READ_BLOCK_SIZE = 1024 * 64;
+
 	// We already have a boost::shared_ptr reference to libev through MultiLibeio.
 	const string dir;
 	size_t threshold;
@@ -172,14 +177,23 @@ private:
 		/* Offset in the file at which data should be read. This can be
 		 * temporarily larger than 'writtenSize'. If this is the case then
 		 * the data with offset past 'writtenSize' should be obtained from
-		 * the writeBuffer.
+		 * the writingBuffer and the writeBuffer, in that order.
 		 */
 		off_t readOffset;
-		/* Data buffered in memory, to be written to the file ASAP. Data is
-		 * removed from the buffer *after* the file write operation has
-		 * finished, not before.
+		/* The data that is currently being written to the file. The contents
+		 * of writeBuffer are swapped into here when a write operation is started,
+		 * so that the libeio thread can write them without them being copied.
+		 * It's removed *after* the file write operation has finished, not before.
+		 * Shared with the write operation so that it stays valid even if the
+		 * pipe is reset in the mean time.
 		 */
+		boost::shared_ptr<string> writingBuffer;
+		/* Data buffered in memory, to be written to the file ASAP. */
 		string writeBuffer;
+		/* Buffer for reading data back from the file. Reused for subsequent
+		 * reads unless a previous read operation still holds a reference to it.
+		 */
+		shared_array<char> readBuffer;
 	} file;
 
 	bool callOnData(const char *data, size_t size, bool passDataToConsumedCallback) {
@@ -294,13 +308,14 @@ private:
 	void writeBufferToFile() {
 		assert(dataState == IN_FILE);
 		if (!file.writingToFile) {
-			shared_array<char> buffer(new char[file.writeBuffer.size()]);
-			memcpy(buffer.get(), file.writeBuffer.data(), file.writeBuffer.size());
+			assert(file.writingBuffer == NULL);
+			file.writingBuffer = boost::make_shared<string>();
+			file.writingBuffer->swap(file.writeBuffer);
 			file.writingToFile = true;
-			libeio.write(file.fd, buffer.get(), file.writeBuffer.size(),
-				file.writtenSize, 0, boost::bind(
+			libeio.write(file.fd, (void *) file.writingBuffer->data(),
+				file.writingBuffer->size(), file.writtenSize, 0, boost::bind(
 					&FileBackedPipe::writeBufferToFileCallback, this,
-					_1, file.fd, buffer, file.writeBuffer.size(),
+					_1, file.fd, file.writingBuffer,
 					generation,
 					boost::weak_ptr<FileBackedPipe>(shared_from_this())
 				)
@@ -309,7 +324,7 @@ private:
 	}
 
 	void writeBufferToFileCallback(eio_req req, FileDescriptor fd,
-		shared_array<char> buffer, size_t size,
+		boost::shared_ptr<string> buffer,
 		unsigned int generation, boost::weak_ptr<FileBackedPipe> wself)
 	{
 		boost::shared_ptr<FileBackedPipe> self = wself.lock();
@@ -321,8 +336,9 @@ private:
 			setError(req.errorno);
 		} else {
 			assert(dataState == IN_FILE);
-			file.writeBuffer.erase(0, size);
-			file.writtenSize += size;
+			assert(buffer == file.writingBuffer);
+			file.writtenSize += buffer->size();
+			file.writingBuffer.reset();
 			file.writingToFile = false;
 			if (file.writeBuffer.empty()) {
 				callOnCommit();
@@ -381,15 +397,27 @@ private:
 
 	void readBlockFromFileOrWriteBuffer(const EioReadCallback &callback) {
 		if (file.readOffset >= file.writtenSize) {
-			StaticString data = StaticString(file.writeBuffer).substr(
-				file.readOffset - file.writtenSize, 1024 * 16);
+			size_t offset = file.readOffset - file.writtenSize;
+			StaticString data;
+			if (file.writingBuffer != NULL && offset < file.writingBuffer->size()) {
+				data = StaticString(*file.writingBuffer).substr(offset, READ_BLOCK_SIZE);
+			} else {
+				if (file.writingBuffer != NULL) {
+					offset -= file.writingBuffer->size();
+				}
+				data = StaticString(file.writeBuffer).substr(offset, READ_BLOCK_SIZE);
+			}
 			callback(0, data.data(), data.size());
 		} else {
-			shared_array<char> buffer(new char[1024 * 16]);
-			eio_req *req = libeio.read(file.fd, buffer.get(), 1024 * 16, file.readOffset, 0,
+			if (file.readBuffer == NULL || !file.readBuffer.unique()) {
+				file.readBuffer.reset(new char[READ_BLOCK_SIZE]);
+			}
+			size_t size = std::min<off_t>((off_t) READ_BLOCK_SIZE,
+				file.writtenSize - file.readOffset);
+			eio_req *req = libeio.read(file.fd, file.readBuffer.get(), size, file.readOffset, 0,
 				boost::bind(
 					&FileBackedPipe::readCallback, this,
-					_1, file.fd, buffer, callback, generation,
+					_1, file.fd, file.readBuffer, callback, generation,
 					boost::weak_ptr<FileBackedPipe>(shared_from_this())
 				)
 			);
@@ -595,6 +623,9 @@ public:
 		file.writingToFile = false;
 		file.readOffset = 0;
 		file.writtenSize = 0;
+		file.writingBuffer.reset();
+		file.writeBuffer.clear();
+		file.readBuffer.reset();
 	}
 
 	void setThreshold(size_t value) {
@@ -613,6 +644,7 @@ public:
 		case IN_FILE:
 			return (ssize_t) file.writtenSize
 				- file.readOffset
+				+ (file.writingBuffer != NULL ? file.writingBuffer->size() : 0)
 				+ file.writeBuffer.size();
 		
 		default:
@@ -696,7 +728,8 @@ public:
 	}
 
 	bool isCommittingToDisk() const {
-		return (dataState == OPENING_FILE || dataState == IN_FILE) && !file.writeBuffer.empty();
+		return (dataState == OPENING_FILE || dataState == IN_FILE)
+			&& (file.writingBuffer != NULL || !file.writeBuffer.empty());
 	}
 
 	void start() {
@@ -36,6 +36,7 @@
 #include <grp.h>
 
 #include <set>
+#include <algorithm>
 #include <vector>
 #include <string>
 #include <iostream>
@@ -54,9 +55,11 @@
 #include <agents/HelperAgent/AgentOptions.h>
 
 #include <agents/Base.h>
+#include <agents/HotRestartHandoff.h>
 #include <Constants.h>
 #include <ApplicationPool2/Pool.h>
 #include <MessageServer.h>
+#include <RequestRing.h>
 #include <MessageReadersWriters.h>
 #include <FileDescriptor.h>
 #include <ResourceLocator.h>
@@ -77,6 +80,24 @@ using namespace Passenger;
 using namespace Passenger::ApplicationPool2;
 
 
+/**
+ * Dumps the state of all request handlers. If there is more than one
+ * request loop then each handler's output is prefixed with the loop number.
+ */
+template<typename Stream>
+static void
+inspectRequestHandlers(const vector< boost::shared_ptr<RequestHandler> > &requestHandlers,
+	Stream &stream)
+{
+	for (unsigned int i = 0; i < requestHandlers.size(); i++) {
+		if (requestHandlers.size() > 1) {
+			stream << "Request loop " << (i + 1) << ":\n";
+		}
+		requestHandlers[i]->inspect(stream);
+	}
+}
+
+
 class RemoteController: public MessageServer::Handler {
 private:
 	struct SpecificContext: public MessageServer::ClientContext {
@@ -84,10 +105,31 @@ private:
 	
 	typedef MessageServer::CommonClientContext CommonClientContext;
 	
-	boost::shared_ptr<RequestHandler> requestHandler;
+	vector< boost::shared_ptr<RequestHandler> > requestHandlers;
 	PoolPtr pool;
 	
 	
+	/**
+	 * Parses the key-value pairs that follow the command name in <tt>args</tt>.
+	 * Returns false if there's an odd number of them.
+	 */
+	static bool parseOptionArgs(const vector<string> &args, VariantMap &map) {
+		if ((args.size() - 1) % 2 != 0) {
+			return false;
+		}
+
+		vector<string>::const_iterator it = args.begin(), end = args.end();
+		it++;
+		while (it != end) {
+			const string &key = *it;
+			it++;
+			const string &value = *it;
+			map.set(key, value);
+			it++;
+		}
+		return true;
+	}
+	
 	/*********************************************
 	 * Message handler methods
 	 *********************************************/
@@ -118,19 +160,9 @@ private:
 	{
 		TRACE_POINT();
 		commonContext.requireRights(Account::INSPECT_BASIC_INFO);
-		if ((args.size() - 1) % 2 != 0) {
-			return false;
-		}
-
 		VariantMap map;
-		vector<string>::const_iterator it = args.begin(), end = args.end();
-		it++;
-		while (it != end) {
-			const string &key = *it;
-			it++;
-			const string &value = *it;
-			map.set(key, value);
-			it++;
+		if (!parseOptionArgs(args, map)) {
+			return false;
 		}
 		writeScalarMessage(commonContext.fd, pool->inspect(Pool::InspectOptions(map)));
 		return true;
@@ -147,6 +179,19 @@ private:
 		writeScalarMessage(commonContext.fd, pool->toXml(includeSensitiveInfo));
 	}
 
+	bool processLatencies(CommonClientContext &commonContext, SpecificContext *specificContext,
+		const vector<string> &args)
+	{
+		TRACE_POINT();
+		commonContext.requireRights(Account::INSPECT_BASIC_INFO);
+		VariantMap map;
+		if (!parseOptionArgs(args, map)) {
+			return false;
+		}
+		writeScalarMessage(commonContext.fd, pool->inspectLatencies(Pool::InspectOptions(map)));
+		return true;
+	}
+
 	void processBacktraces(CommonClientContext &commonContext, SpecificContext *specificContext,
 		const vector<string> &args)
 	{
@@ -161,13 +206,50 @@ private:
 		TRACE_POINT();
 		stringstream stream;
 		commonContext.requireRights(Account::INSPECT_REQUESTS);
-		requestHandler->inspect(stream);
+		inspectRequestHandlers(requestHandlers, stream);
 		writeScalarMessage(commonContext.fd, stream.str());
 	}
+
+	/**
+	 * Receives a web server process's request ring (see RequestRing.h): the
+	 * shared memory file, the notification file descriptor and a socket that
+	 * the web server process keeps the other end of. Replies with the ID that
+	 * the web server process should announce the ring with. Rings are spread
+	 * over the request handlers.
+	 */
+	void processRegisterRequestRing(CommonClientContext &commonContext, SpecificContext *specificContext,
+		const vector<string> &args)
+	{
+		TRACE_POINT();
+		commonContext.requireRights(Account::REGISTER_REQUEST_RING);
+		unsigned long long timeout = 5000000;
+		FileDescriptor memoryFd(readFileDescriptorWithNegotiation(commonContext.fd, &timeout));
+		FileDescriptor notifyFd(readFileDescriptorWithNegotiation(commonContext.fd, &timeout));
+		FileDescriptor lifetimeFd(readFileDescriptorWithNegotiation(commonContext.fd, &timeout));
+
+		UPDATE_TRACE_POINT();
+		RequestRingPtr ring;
+		try {
+			ring = RequestRing::attach(memoryFd, notifyFd);
+		} catch (const IOException &e) {
+			writeArrayMessage(commonContext.fd, "error", e.what(), NULL);
+			return;
+		}
+
+		unsigned long long id;
+		do {
+			pool->randomGenerator->generateBytes(&id, sizeof(id));
+		} while (!requestHandlers[id % requestHandlers.size()]->addRequestRing(id, ring, lifetimeFd));
+		char idString[sizeof(id) * 2 + 1];
+		integerToHex<unsigned long long>(id, idString);
+		writeArrayMessage(commonContext.fd, "ok", idString, NULL);
+	}
 	
 public:
-	RemoteController(const boost::shared_ptr<RequestHandler> &requestHandler, const PoolPtr &pool) {
-		this->requestHandler = requestHandler;
+	RemoteController(const vector< boost::shared_ptr<RequestHandler> > &requestHandlers,
+		const PoolPtr &pool)
+	{
+		this->requestHandlers = requestHandlers;
 		this->pool = pool;
 	}
 	
@@ -187,12 +269,16 @@ public:
 				processDetachProcessByKey(commonContext, specificContext, args);
 			} else if (args[0] == "inspect") {
 				return processInspect(commonContext, specificContext, args);
+			} else if (args[0] == "latencies") {
+				return processLatencies(commonContext, specificContext, args);
 			} else if (isCommand(args, "toXml", 1)) {
 				processToXml(commonContext, specificContext, args);
 			} else if (isCommand(args, "backtraces", 0)) {
 				processBacktraces(commonContext, specificContext, args);
 			} else if (isCommand(args, "requests", 0)) {
 				processRequests(commonContext, specificContext, args);
+			} else if (isCommand(args, "register_request_ring", 0)) {
+				processRegisterRequestRing(commonContext, specificContext, args);
 			} else {
 				return false;
 			}
@@ -208,10 +294,12 @@ public:
 class ExitHandler: public MessageServer::Handler {
 private:
 	EventFd &exitEvent;
+	EventFd &hotRestartEvent;
 	
 public:
-	ExitHandler(EventFd &_exitEvent)
-		: exitEvent(_exitEvent)
+	ExitHandler(EventFd &_exitEvent, EventFd &_hotRestartEvent)
+		: exitEvent(_exitEvent),
+		  hotRestartEvent(_hotRestartEvent)
 	{ }
 	
 	virtual bool processMessage(MessageServer::CommonClientContext &commonContext,
@@ -226,6 +314,14 @@ public:
 			UPDATE_TRACE_POINT();
 			writeArrayMessage(commonContext.fd, "exit command received", NULL);
 			return true;
+		} else if (args[0] == "hot_restart") {
+			TRACE_POINT();
+			commonContext.requireRights(Account::HOT_RESTART);
+			UPDATE_TRACE_POINT();
+			hotRestartEvent.notify();
+			UPDATE_TRACE_POINT();
+			writeArrayMessage(commonContext.fd, "hot restart command received", NULL);
+			return true;
 		} else {
 			return false;
 		}
@@ -241,12 +337,18 @@ class Server {
 private:
 	static const int MESSAGE_SERVER_THREAD_STACK_SIZE = 128 * 1024;
 	static const int EVENT_LOOP_THREAD_STACK_SIZE = 256 * 1024;
+	/** How long a hot restart waits for requests in progress to finish, in milliseconds. */
+	static const unsigned int HOT_RESTART_DRAIN_TIMEOUT = 10000;
 	
 	FileDescriptor feedbackFd;
 	const AgentOptions &options;
 	
 	BackgroundEventLoop poolLoop;
-	BackgroundEventLoop requestLoop;
+	/** One event loop per RequestHandler. The first handler accepts clients
+	 * from the request socket and hands them out round-robin over all
+	 * handlers, which share the same Pool, so that client I/O can be spread
+	 * over multiple CPU cores. */
+	vector< boost::shared_ptr<BackgroundEventLoop> > requestLoops;
 
 	FileDescriptor requestSocket;
 	ServerInstanceDir serverInstanceDir;
@@ -259,11 +361,13 @@ private:
 	AccountsDatabasePtr accountsDatabase;
 	MessageServerPtr messageServer;
 	ResourceLocator resourceLocator;
-	boost::shared_ptr<RequestHandler> requestHandler;
+	vector< boost::shared_ptr<RequestHandler> > requestHandlers;
 	boost::shared_ptr<oxt::thread> prestarterThread;
 	boost::shared_ptr<oxt::thread> messageServerThread;
 	boost::shared_ptr<oxt::thread> eventLoopThread;
+	boost::shared_ptr<oxt::thread> adoptionExpiryThread;
 	EventFd exitEvent;
+	EventFd hotRestartEvent;
 	
 	/**
 	 * Starts listening for client connections on this server's request socket.
@@ -366,7 +470,7 @@ private:
 	}
 	
 	void onSigquit(ev::sig &signal, int revents) {
-		requestHandler->inspect(cerr);
+		inspectRequestHandlers(requestHandlers, cerr);
 		cerr.flush();
 		cerr << "\n" << pool->inspect();
 		cerr.flush();
@@ -386,7 +490,7 @@ private:
 		Server *self = (Server *) userData;
 
 		cerr << "### Request handler state\n";
-		self->requestHandler->inspect(cerr);
+		inspectRequestHandlers(self->requestHandlers, cerr);
 		cerr << "\n";
 		cerr.flush();
 		
@@ -407,11 +511,114 @@ private:
 		cerr << oxt::thread::all_backtraces();
 		cerr.flush();
 	}
+
+	/**
+	 * Returns the number of request event loops to run. A configured
+	 * value of 0 means one loop per CPU core.
+	 */
+	unsigned int getRequestLoopCount() const {
+		unsigned int count = options.requestLoops;
+		if (count == 0) {
+			count = boost::thread::hardware_concurrency();
+		}
+		return std::max<unsigned int>(count, 1);
+	}
+
+	/**
+	 * Shuts down the processes that the previous helper agent handed over
+	 * during a hot restart, but that no Group has claimed within
+	 * <em>delay</em> seconds.
+	 */
+	static void discardUnadoptedProcessesLater(SpawnerFactoryPtr spawnerFactory,
+		unsigned int delay)
+	{
+		syscalls::sleep(delay);
+		unsigned int count = spawnerFactory->discardAdoptableProcesses();
+		if (count > 0) {
+			P_INFO("Shutting down " << count << " application process(es) that were "
+				"handed over by the previous helper agent, but were not used");
+		}
+	}
+
+	/**
+	 * Hands the request socket, the admin socket and all application processes
+	 * over to a new helper agent instance, by writing a HotRestartHandoff to the
+	 * feedback fd and then exiting with HELPER_AGENT_HOT_RESTART_EXIT_CODE. The
+	 * Watchdog reads the handoff while we're writing it, so we wait for its
+	 * acknowledgement before exiting. It then starts a new helper agent and
+	 * passes the handoff to it. The pool is deliberately not destroyed, so that
+	 * the application processes keep running. Never returns.
+	 */
+	void performHotRestart() {
+		TRACE_POINT();
+		P_INFO("Hot restart requested; waiting for requests in progress to finish...");
+		for (unsigned int i = 0; i < requestHandlers.size(); i++) {
+			requestHandlers[i]->stopAccepting();
+		}
+		Timer timer;
+		while (clientCount() > 0 && timer.elapsed() < HOT_RESTART_DRAIN_TIMEOUT) {
+			syscalls::usleep(100000);
+		}
+
+		UPDATE_TRACE_POINT();
+		try {
+			HotRestartHandoff handoff;
+			vector<ProcessHandoff> processes = pool->getProcessHandoffs();
+			unsigned long long timeout = 30000000;
+
+			int messageServerFd = dup(messageServer->getServerFd());
+			if (messageServerFd == -1) {
+				int e = errno;
+				throw SystemException("Cannot duplicate the message server socket", e);
+			}
+
+			handoff.addFd(requestSocket);
+			handoff.addFd(FileDescriptor(messageServerFd));
+			for (unsigned int i = 0; i < processes.size(); i++) {
+				processes[i].addTo(handoff);
+			}
+			handoff.writeTo(feedbackFd, &timeout);
+			if (!HotRestartHandoff::waitForAcknowledgement(feedbackFd, &timeout)) {
+				throw IOException("The watchdog did not acknowledge the handoff");
+			}
+			P_INFO("Handed over " << processes.size() << " application process(es) "
+				"to the new helper agent; exiting");
+		} catch (const tracable_exception &e) {
+			P_ERROR("Hot restart failed: " << e.what() << "\n" << e.backtrace());
+			_exit(1);
+		}
+		_exit(HELPER_AGENT_HOT_RESTART_EXIT_CODE);
+	}
+
+	/**
+	 * Returns the number of connected clients over all request handlers.
+	 */
+	unsigned int clientCount() const {
+		unsigned int result = 0;
+		for (unsigned int i = 0; i < requestHandlers.size(); i++) {
+			result += requestHandlers[i]->getClientCount();
+		}
+		return result;
+	}
+
+	/**
+	 * Returns the minimum inactivity time, in milliseconds, over all
+	 * request handlers.
+	 */
+	unsigned long long inactivityTime() const {
+		unsigned long long result = 0;
+		for (unsigned int i = 0; i < requestHandlers.size(); i++) {
+			unsigned long long time = requestHandlers[i]->inactivityTime();
+			if (i == 0 || time < result) {
+				result = time;
+			}
+		}
+		return result;
+	}
 	
 public:
 	Server(FileDescriptor feedbackFd, const AgentOptions &_options)
 		: options(_options),
-		  requestLoop(true),
 		  serverInstanceDir(_options.serverInstanceDir, false),
 		  resourceLocator(options.passengerRoot)
 	{
@@ -420,14 +627,28 @@ public:
 		
 		UPDATE_TRACE_POINT();
 		generation = serverInstanceDir.getGeneration(options.generationNumber);
-		startListening();
+		HotRestartHandoff handoff;
+		if (options.hotRestartHandoff && handoff.readFrom(feedbackFd) && handoff.fds.size() >= 2) {
+			P_INFO("Hot restart: taking over the request socket and the admin socket "
+				"from the previous helper agent");
+			requestSocket = handoff.fds[0];
+		} else {
+			handoff.clear();
+			startListening();
+		}
 		accountsDatabase = boost::make_shared<AccountsDatabase>();
 		accountsDatabase->add("_passenger-status", options.adminToolStatusPassword, false,
 			Account::INSPECT_BASIC_INFO | Account::INSPECT_SENSITIVE_INFO |
 			Account::INSPECT_BACKTRACES | Account::INSPECT_REQUESTS);
-		accountsDatabase->add("_web_server", options.exitPassword, false, Account::EXIT);
+		accountsDatabase->add("_web_server", options.exitPassword, false,
+			Account::EXIT | Account::REGISTER_REQUEST_RING);
+		if (!options.adminToolManipulationPassword.empty()) {
+			accountsDatabase->add("_passenger-config", options.adminToolManipulationPassword,
+				false, Account::HOT_RESTART);
+		}
 		messageServer = boost::make_shared<MessageServer>(
-			parseUnixSocketAddress(options.adminSocketAddress), accountsDatabase);
+			parseUnixSocketAddress(options.adminSocketAddress), accountsDatabase,
+			handoff.empty() ? -1 : handoff.fds[1].detach());
 		
 		createFile(generation->getPath() + "/helper_agent.pid",
 			toString(getpid()), S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
@@ -448,6 +669,8 @@ public:
 		UPDATE_TRACE_POINT();
 		loggerFactory = boost::make_shared<UnionStation::LoggerFactory>(options.loggingAgentAddress,
 			"logging", options.loggingAgentPassword);
+		loggerFactory->setBatching(options.unionStationBatchSize,
+			(unsigned long long) options.unionStationBatchDelay * 1000);
 		spawnerFactory = boost::make_shared<SpawnerFactory>(poolLoop.safe,
 			resourceLocator, generation, boost::make_shared<SpawnerConfig>(randomGenerator));
 		pool = boost::make_shared<Pool>(poolLoop.safe.get(), spawnerFactory, loggerFactory,
@@ -456,14 +679,43 @@ public:
 		pool->setMax(options.maxPoolSize);
 		//pool->setMaxPerApp(maxInstancesPerApp);
 		pool->setMaxIdleTime(options.poolIdleTime * 1000000);
+
+		if (!handoff.empty()) {
+			vector<ProcessHandoff> processes = ProcessHandoff::extractFrom(handoff);
+			P_INFO("Hot restart: " << processes.size() << " application process(es) "
+				"from the previous helper agent will be adopted");
+			spawnerFactory->addAdoptableProcesses(processes);
+			handoff.clear();
+			if (options.poolIdleTime > 0) {
+				adoptionExpiryThread = ptr(new oxt::thread(
+					boost::bind(discardUnadoptedProcessesLater, spawnerFactory,
+						options.poolIdleTime),
+					"Hot restart adoption expiry", 64 * 1024
+				));
+			}
+		}
 		
-		requestHandler = boost::make_shared<RequestHandler>(requestLoop.safe,
-			requestSocket, pool, options);
+		unsigned int requestLoopCount = getRequestLoopCount();
+		P_DEBUG("Using " << requestLoopCount << " request event loop(s)");
+		for (unsigned int i = 0; i < requestLoopCount; i++) {
+			boost::shared_ptr<BackgroundEventLoop> loop =
+				boost::make_shared<BackgroundEventLoop>(true);
+			requestLoops.push_back(loop);
+			requestHandlers.push_back(boost::make_shared<RequestHandler>(loop->safe,
+				requestSocket, pool, options));
+		}
+		if (requestHandlers.size() > 1) {
+			requestHandlers[0]->distributeClients(requestHandlers);
+			for (unsigned int i = 1; i < requestHandlers.size(); i++) {
+				requestHandlers[i]->setRequestRingRegistry(
+					requestHandlers[0]->getRequestRingRegistry());
+			}
+		}
 
-		messageServer->addHandler(boost::make_shared<RemoteController>(requestHandler, pool));
-		messageServer->addHandler(ptr(new ExitHandler(exitEvent)));
+		messageServer->addHandler(boost::make_shared<RemoteController>(requestHandlers, pool));
+		messageServer->addHandler(ptr(new ExitHandler(exitEvent, hotRestartEvent)));
 
-		sigquitWatcher.set(requestLoop.loop);
+		sigquitWatcher.set(requestLoops[0]->loop);
 		sigquitWatcher.set(SIGQUIT);
 		sigquitWatcher.set<Server, &Server::onSigquit>(this);
 		sigquitWatcher.start();
@@ -492,6 +744,9 @@ public:
 		
 		P_DEBUG("Shutting down helper agent...");
 		prestarterThread->interrupt_and_join();
+		if (adoptionExpiryThread != NULL) {
+			adoptionExpiryThread->interrupt_and_join();
+		}
 		if (messageServerThread != NULL) {
 			messageServerThread->interrupt_and_join();
 		}
@@ -502,8 +757,10 @@ public:
 		uninstallDiagnosticsDumper();
 		pool.reset();
 		poolLoop.stop();
-		requestLoop.stop();
-		requestHandler.reset();
+		for (unsigned int i = 0; i < requestLoops.size(); i++) {
+			requestLoops[i]->stop();
+		}
+		requestHandlers.clear();
 
 		if (!options.requestSocketLink.empty()) {
 			char path[PATH_MAX + 1];
@@ -540,11 +797,17 @@ public:
 		));
 		
 		poolLoop.start("Pool event loop", 0);
-		requestLoop.start("Request event loop", 0);
+		for (unsigned int i = 0; i < requestLoops.size(); i++) {
+			if (requestLoops.size() == 1) {
+				requestLoops[i]->start("Request event loop", 0);
+			} else {
+				requestLoops[i]->start("Request event loop " + toString(i + 1), 0);
+			}
+		}
 
 		
 		/* Wait until the watchdog closes the feedback fd (meaning it
-		 * was killed) or until we receive an exit message.
+		 * was killed) or until we receive an exit or hot restart message.
 		 */
 		this_thread::disable_syscall_interruption dsi;
 		fd_set fds;
@@ -553,7 +816,9 @@ public:
 		FD_ZERO(&fds);
 		FD_SET(feedbackFd, &fds);
 		FD_SET(exitEvent.fd(), &fds);
-		largestFd = (feedbackFd > exitEvent.fd()) ? (int) feedbackFd : exitEvent.fd();
+		FD_SET(hotRestartEvent.fd(), &fds);
+		largestFd = std::max<int>(feedbackFd,
+			std::max(exitEvent.fd(), hotRestartEvent.fd()));
 		UPDATE_TRACE_POINT();
 		installDiagnosticsDumper();
 		if (syscalls::select(largestFd + 1, &fds, NULL, NULL, NULL) == -1) {
@@ -574,13 +839,16 @@ public:
 			P_DEBUG("Watchdog seems to be killed; forcing shutdown of all subprocesses");
 			syscalls::killpg(getpgrp(), SIGKILL);
 			_exit(2); // In case killpg() fails.
+		} else if (FD_ISSET(hotRestartEvent.fd(), &fds)) {
+			uninstallDiagnosticsDumper();
+			performHotRestart();
 		} else {
 			/* We received an exit command. We want to exit 5 seconds after
 			 * all clients have disconnected have become inactive.
 			 */
 			P_DEBUG("Received command to exit gracefully. "
 				"Waiting until 5 seconds after all clients have disconnected...");
-			while (requestHandler->inactivityTime() < 5000) {
+			while (inactivityTime() < 5000) {
 				syscalls::usleep(250000);
 			}
 			P_DEBUG("It's now 5 seconds after all clients have disconnected. "
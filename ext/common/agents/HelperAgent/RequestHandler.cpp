@@ -185,12 +185,25 @@ Client::onAppOutputWritable(ev::io &io, int revents) {
 }
 
 
+void
+Client::onClientSpliceReadable(ev::io &io, int revents) {
+	assert(requestHandler != NULL);
+	requestHandler->onClientSpliceReadable(shared_from_this());
+}
+
+
 void
 Client::onTimeout(ev::timer &timer, int revents) {
 	assert(requestHandler != NULL);
 	requestHandler->onTimeout(shared_from_this());
 }
 
+void
+Client::onAppConnectRetry(ev::timer &timer, int revents) {
+	assert(requestHandler != NULL);
+	requestHandler->onAppConnectRetry(shared_from_this());
+}
+
 
 Client *
 RequestHandler::getClientPointer(const ClientPtr &client) {
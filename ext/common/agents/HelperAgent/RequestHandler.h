@@ -72,6 +72,12 @@
                 (o)
         clientOutputWatcher
 
+   On Linux, large unbuffered request bodies bypass clientInput: once the
+   first chunk has been forwarded, the rest is moved from the client socket
+   to the application socket with splice(), through bodySplicePipe, without
+   being copied into user space. clientSpliceWatcher takes over the role of
+   clientInput for the remainder of the body.
+
  */
 
 #ifndef _PASSENGER_REQUEST_HANDLER_H_
@@ -90,12 +96,17 @@
 #include <sys/types.h>
 #include <arpa/inet.h>
 #include <sys/un.h>
+#include <fcntl.h>
 #include <typeinfo>
+#include <map>
 #include <cassert>
 #include <cctype>
+#include <cstring>
+#include <strings.h>
 
 #include <Logging.h>
 #include <EventedBufferedInput.h>
+#include <RequestRing.h>
 #include <MessageReadersWriters.h>
 #include <Constants.h>
 #include <UnionStation.h>
@@ -107,6 +118,8 @@
 #include <Utils/Template.h>
 #include <Utils/Timer.h>
 #include <Utils/Dechunker.h>
+#include <Utils/HttpHeaderNames.h>
+#include <Utils/StringMap.h>
 #include <agents/HelperAgent/AgentOptions.h>
 #include <agents/HelperAgent/FileBackedPipe.h>
 #include <agents/HelperAgent/ScgiRequestParser.h>
@@ -121,6 +134,9 @@ using namespace ApplicationPool2;
 class RequestHandler;
 
 #define MAX_STATUS_HEADER_SIZE 64
+/** How often to retry a non-blocking connect to an application's Unix
+ * domain socket whose backlog is full, in seconds. */
+#define APP_CONNECT_RETRY_INTERVAL 0.01
 
 #define RH_ERROR(client, x) P_ERROR("[Client " << client->name() << "] " << x)
 #define RH_WARN(client, x) P_WARN("[Client " << client->name() << "] " << x)
@@ -136,6 +152,10 @@ class RequestHandler;
 
 class Client: public boost::enable_shared_from_this<Client> {
 private:
+	/** Recycled Clients give up buffers that have grown larger than this,
+	 * so that a few big responses don't pin memory in the client freelist. */
+	static const size_t MAX_RETAINED_BUFFER_SIZE = 1024 * 16;
+
 	struct ev_loop *getLoop() const;
 	const SafeLibevPtr &getSafeLibev() const;
 	unsigned int getConnectPasswordTimeout(const RequestHandler *handler) const;
@@ -165,8 +185,10 @@ private:
 	static void onAppInputError(const EventedBufferedInputPtr &source, const char *message, int errnoCode);
 	
 	void onAppOutputWritable(ev::io &io, int revents);
+	void onClientSpliceReadable(ev::io &io, int revents);
 
 	void onTimeout(ev::timer &timer, int revents);
+	void onAppConnectRetry(ev::timer &timer, int revents);
 
 
 	static const char *boolStr(bool val) {
@@ -178,9 +200,16 @@ private:
 		requestHandler = NULL;
 		state = DISCONNECTED;
 		backgroundOperations = 0;
-		requestBodyIsBuffered = false;
 		freeBufferedConnectPassword();
 		connectedAt = 0;
+		waitingForNextRequest = false;
+		requestRingKey = 0;
+		pendingRingRequest.clear();
+		resetRequestFields();
+	}
+
+	void resetRequestFields() {
+		requestBodyIsBuffered = false;
 		contentLength = 0;
 		clientBodyAlreadyRead = 0;
 		checkoutSessionAfterCommit = false;
@@ -188,7 +217,43 @@ private:
 		sessionCheckoutTry = 0;
 		responseHeaderSeen = false;
 		chunkedResponse = false;
+		keepAlive = false;
+		appKeepAlive = false;
+		requestBodyForwarded = false;
+		confirmRequestRing = false;
+		responseContentLength = -1;
+		responseBodyAlreadyRead = 0;
 		appRoot.clear();
+		requestBeganAt = 0;
+		checkoutBeganAt = 0;
+		sessionCheckedOutAt = 0;
+		sessionInitiatedAt = 0;
+		firstResponseByteAt = 0;
+	}
+
+	/** Releases everything that belongs to the current request, but
+	 * leaves the client connection itself alone. */
+	void resetRequestState() {
+		appInput->reset(NULL, FileDescriptor());
+		if (appOutputBuffer.capacity() > MAX_RETAINED_BUFFER_SIZE) {
+			string().swap(appOutputBuffer);
+		} else {
+			appOutputBuffer.resize(0);
+		}
+		if (chunkFrameBuffer.capacity() > MAX_RETAINED_BUFFER_SIZE) {
+			string().swap(chunkFrameBuffer);
+		}
+		appOutputWatcher.stop();
+		stopSplicingBody();
+		
+		timeoutTimer.stop();
+		appConnectRetryTimer.stop();
+		scgiParser.reset();
+		session.reset();
+		options = Options();
+		responseHeaderBufferer.reset();
+		responseDechunker.reset();
+		freeScopeLogs();
 	}
 
 	void freeScopeLogs() {
@@ -234,6 +299,19 @@ public:
 	ev::io appOutputWatcher;
 
 
+	/***** Zero-copy request body forwarding *****/
+
+	/** Whether the request body is currently being moved from the client
+	 * socket to the application socket with splice(). */
+	bool splicingBody;
+	/** Kernel pipe through which spliced body data flows. */
+	Pipe bodySplicePipe;
+	/** Number of bytes currently sitting in bodySplicePipe. */
+	size_t bodySplicePipeSize;
+	/** Watches the client socket for readability while splicing. */
+	ev::io clientSpliceWatcher;
+
+
 	/***** State variables *****/
 
 	enum {
@@ -262,10 +340,19 @@ public:
 		unsigned int alreadyRead;
 	} bufferedConnectPassword;
 
-	// Used for enforcing the connection timeout.
+	// Used for enforcing the connection timeout and the application connect timeout.
 	ev::timer timeoutTimer;
+	// Used for retrying non-blocking connects to application Unix domain sockets.
+	ev::timer appConnectRetryTimer;
 
 	ev_tstamp connectedAt;
+	/** Timestamps of the stages of the current request, for
+	 * Group::recordRequestLatencies(). 0 if not reached yet. */
+	ev_tstamp requestBeganAt;
+	ev_tstamp checkoutBeganAt;
+	ev_tstamp sessionCheckedOutAt;
+	ev_tstamp sessionInitiatedAt;
+	ev_tstamp firstResponseByteAt;
 	long long contentLength;
 	unsigned long long clientBodyAlreadyRead;
 	Options options;
@@ -289,6 +376,36 @@ public:
 	HttpHeaderBufferer responseHeaderBufferer;
 	Dechunker responseDechunker;
 
+	/** Whether the web server wants to reuse this connection for further
+	 * requests. If so, the response body is framed with the chunked transfer
+	 * encoding so that the web server can tell where the response ends. */
+	bool keepAlive;
+	/** Scratch buffer for building such chunks. */
+	string chunkFrameBuffer;
+	/** Whether the connection to the application may be reused after this
+	 * request. Only http_session connections are reused. Cleared as soon as
+	 * it turns out that the end of the response can't be detected without
+	 * the application closing the connection. */
+	bool appKeepAlive;
+	/** Whether the request body has been completely sent to the application. */
+	bool requestBodyForwarded;
+	/** The size of the application's response body, or -1 if it's unknown. */
+	long long responseContentLength;
+	unsigned long long responseBodyAlreadyRead;
+	/** Whether this is an idle keep-alive connection: the previous request
+	 * has been completed and no data for the next one has arrived yet. */
+	bool waitingForNextRequest;
+	/** Identifies this connection in the web server's request ring, or 0 if
+	 * the web server doesn't send requests for it through a request ring.
+	 * See RequestHandler::registerRequestRingClient(). */
+	unsigned long long requestRingKey;
+	/** Whether the response to the current request must confirm that
+	 * requestRingKey was registered. */
+	bool confirmRequestRing;
+	/** A request that arrived through the request ring while the previous
+	 * request on this connection was still being finished. */
+	string pendingRingRequest;
+
 
 	Client() {
 		fdnum = -1;
@@ -322,8 +439,13 @@ public:
 		
 		appOutputWatcher.set<Client, &Client::onAppOutputWritable>(this);
 
+		splicingBody = false;
+		bodySplicePipeSize = 0;
+		clientSpliceWatcher.set<Client, &Client::onClientSpliceReadable>(this);
+
 
 		timeoutTimer.set<Client, &Client::onTimeout>(this);
+		appConnectRetryTimer.set<Client, &Client::onAppConnectRetry>(this);
 
 
 		responseDechunker.onData = onAppInputChunk;
@@ -364,15 +486,25 @@ public:
 		clientOutputPipe->start();
 		clientOutputWatcher.set(getLoop());
 		clientOutputWatcher.set(_fd, ev::WRITE);
+		clientSpliceWatcher.set(getLoop());
+		clientSpliceWatcher.set(_fd, ev::READ);
 
 		// appOutputWatcher is initialized in initiateSession.
 
 		timeoutTimer.set(getLoop());
 		timeoutTimer.start(getConnectPasswordTimeout(handler) / 1000.0, 0.0);
+		appConnectRetryTimer.set(getLoop());
 	}
 
+	/**
+	 * Releases all per-request state of a discarded Client so that it can be put
+	 * in the RequestHandler's client freelist and associated with a new
+	 * connection later. The I/O channel objects and their buffers are kept.
+	 *
+	 * @pre reassociateable()
+	 */
 	void disassociate() {
-		assert(requestHandler != NULL);
+		assert(reassociateable());
 		resetPrimitiveFields();
 		fd = FileDescriptor();
 
@@ -380,17 +512,50 @@ public:
 		clientBodyBuffer->reset();
 		clientOutputPipe->reset();
 		clientOutputWatcher.stop();
+		resetRequestState();
+	}
 
-		appInput->reset(NULL, FileDescriptor());
-		appOutputBuffer.resize(0);
-		appOutputWatcher.stop();
-		
-		timeoutTimer.stop();
-		scgiParser.reset();
-		session.reset();
-		responseHeaderBufferer.reset();
-		responseDechunker.reset();
-		freeScopeLogs();
+	/**
+	 * Whether this Client's connection can be used for another request now
+	 * that the current response has been fully written. This requires the
+	 * web server to have asked for keep-alive, and the request body to have
+	 * been fully consumed so that the next request starts at a known offset.
+	 */
+	bool canReadNextRequest() const {
+		return keepAlive
+			&& backgroundOperations == 0
+			&& contentLength >= 0
+			&& clientBodyAlreadyRead == (unsigned long long) contentLength
+			&& !clientInput->endReached()
+			&& !splicingBody;
+	}
+
+	/**
+	 * Resets all per-request state so that the next request on this
+	 * keep-alive connection can be read. Any data that the client has
+	 * already sent is kept in clientInput.
+	 *
+	 * Every request on a keep-alive connection is preceded by the connect
+	 * password, just like the first one. Web server modules can then build
+	 * a request without knowing whether it will be sent over a new or over
+	 * a reused connection. The connect password timeout is not applied
+	 * here because idle keep-alive connections may legitimately sit
+	 * around for a long time.
+	 *
+	 * @pre canReadNextRequest()
+	 */
+	void prepareForNextRequest() {
+		assert(canReadNextRequest());
+		resetRequestFields();
+		state = BEGIN_READING_CONNECT_PASSWORD;
+		waitingForNextRequest = true;
+
+		clientInput->stop();
+		clientBodyBuffer->reset(getSafeLibev());
+		clientOutputPipe->reset(getSafeLibev());
+		clientOutputPipe->start();
+		clientOutputWatcher.stop();
+		resetRequestState();
 	}
 
 	void discard() {
@@ -405,8 +570,10 @@ public:
 
 		appInput->stop();
 		appOutputWatcher.stop();
+		stopSplicingBody();
 
 		timeoutTimer.stop();
+		appConnectRetryTimer.stop();
 
 		freeScopeLogs();
 
@@ -459,6 +626,13 @@ public:
 		}
 	}
 
+	void stopSplicingBody() {
+		splicingBody = false;
+		bodySplicePipe = Pipe();
+		bodySplicePipeSize = 0;
+		clientSpliceWatcher.stop();
+	}
+
 	void freeBufferedConnectPassword() {
 		if (bufferedConnectPassword.data != NULL) {
 			free(bufferedConnectPassword.data);
@@ -526,6 +700,7 @@ public:
 				session->getGroup()->name << ")\n";
 			stream << indent << "session gupid               = " << session->getGupid() << "\n";
 			stream << indent << "session initiated           = " << boolStr(session->initiated()) << "\n";
+			stream << indent << "session connecting          = " << boolStr(session->connecting()) << "\n";
 		}
 		stream
 			<< indent << "requestBodyIsBuffered       = " << boolStr(requestBodyIsBuffered) << "\n"
@@ -541,6 +716,8 @@ public:
 			<< indent << "appInput                    = " << appInput.get() << " " << appInput->inspect() << "\n"
 			<< indent << "appInput started            = " << boolStr(appInput->isStarted()) << "\n"
 			<< indent << "appInput reachedEnd         = " << boolStr(appInput->endReached()) << "\n"
+			<< indent << "splicingBody                = " << boolStr(splicingBody) << "\n"
+			<< indent << "keepAlive                   = " << boolStr(keepAlive) << "\n"
 			<< indent << "responseHeaderSeen          = " << boolStr(responseHeaderSeen) << "\n"
 			<< indent << "useUnionStation             = " << boolStr(useUnionStation()) << "\n"
 			;
@@ -550,6 +727,104 @@ public:
 typedef boost::shared_ptr<Client> ClientPtr;
 
 
+/**
+ * Keeps track of the request rings that web server processes have registered
+ * (see RequestRing.h), and of the RequestHandler that owns the connection
+ * behind each request ring token. A ring is consumed by one RequestHandler,
+ * but the connections whose requests it carries may have been handed out to
+ * any of them, so all RequestHandlers share one registry.
+ *
+ * Web servers refer to a ring by an unguessable 64-bit ID, so that they can't
+ * accidentally (e.g. across helper agent restarts) or deliberately announce
+ * a ring that belongs to another process. Internally, rings are numbered
+ * sequentially, and a client is identified by the ring number in the upper
+ * 32 bits and the token in the lower 32 bits of a key.
+ */
+class RequestRingRegistry {
+private:
+	mutable boost::mutex syncher;
+	unsigned int lastRingNumber;
+	map<unsigned long long, unsigned int> ringNumbers;
+	map<unsigned long long, RequestHandler *> clientHandlers;
+
+public:
+	RequestRingRegistry()
+		: lastRingNumber(0)
+		{ }
+
+	/** Registers a ring with the given ID. Returns its number, or 0 if
+	 * there already is a ring with that ID. */
+	unsigned int addRing(unsigned long long id) {
+		boost::lock_guard<boost::mutex> l(syncher);
+		if (ringNumbers.find(id) != ringNumbers.end()) {
+			return 0;
+		} else {
+			lastRingNumber++;
+			ringNumbers[id] = lastRingNumber;
+			return lastRingNumber;
+		}
+	}
+
+	/** Unregisters the ring with the given ID and number, together with the
+	 * clients behind its tokens. Returns those clients' keys and handlers. */
+	map<unsigned long long, RequestHandler *> removeRing(unsigned long long id,
+		unsigned int number)
+	{
+		boost::lock_guard<boost::mutex> l(syncher);
+		unsigned long long begin = (unsigned long long) number << 32;
+		unsigned long long end = (unsigned long long) (number + 1) << 32;
+		map<unsigned long long, RequestHandler *>::iterator first, last;
+		map<unsigned long long, RequestHandler *> result;
+
+		ringNumbers.erase(id);
+		first = clientHandlers.lower_bound(begin);
+		last = clientHandlers.lower_bound(end);
+		result.insert(first, last);
+		clientHandlers.erase(first, last);
+		return result;
+	}
+
+	/** Returns the key of the client that is identified by `token` in the
+	 * ring with the given ID, or 0 if there is no such ring. */
+	unsigned long long getClientKey(unsigned long long id, unsigned int token) const {
+		boost::lock_guard<boost::mutex> l(syncher);
+		map<unsigned long long, unsigned int>::const_iterator it = ringNumbers.find(id);
+		if (it == ringNumbers.end()) {
+			return 0;
+		} else {
+			return ((unsigned long long) it->second << 32) | token;
+		}
+	}
+
+	void addClient(unsigned long long key, RequestHandler *handler) {
+		boost::lock_guard<boost::mutex> l(syncher);
+		clientHandlers[key] = handler;
+	}
+
+	/** Removes the client with the given key, unless it has been
+	 * registered by another handler in the mean time. */
+	void removeClient(unsigned long long key, RequestHandler *handler) {
+		boost::lock_guard<boost::mutex> l(syncher);
+		map<unsigned long long, RequestHandler *>::iterator it = clientHandlers.find(key);
+		if (it != clientHandlers.end() && it->second == handler) {
+			clientHandlers.erase(it);
+		}
+	}
+
+	RequestHandler *lookupClient(unsigned long long key) const {
+		boost::lock_guard<boost::mutex> l(syncher);
+		map<unsigned long long, RequestHandler *>::const_iterator it = clientHandlers.find(key);
+		if (it == clientHandlers.end()) {
+			return NULL;
+		} else {
+			return it->second;
+		}
+	}
+};
+
+typedef boost::shared_ptr<RequestRingRegistry> RequestRingRegistryPtr;
+
+
 class RequestHandler {
 public:
 	enum BenchmarkPoint {
@@ -574,25 +849,135 @@ private:
 	LoggerFactoryPtr loggerFactory;
 	ev::io requestSocketWatcher;
 	ev::timer resumeSocketWatcherTimer;
+	/** Set by stopAccepting(). */
+	bool acceptingStopped;
 	HashMap<int, ClientPtr> clients;
 	Timer inactivityTimer;
 	bool accept4Available;
+	/** The handlers that accepted clients are handed out to, round-robin,
+	 * including this one. Empty if this handler keeps all clients that it
+	 * accepts. See distributeClients(). */
+	vector<RequestHandler *> clientTargets;
+	unsigned int nextClientTarget;
+
+	/** Disconnected Clients that are ready to be associated with a new
+	 * connection. Reusing them saves us from reallocating the I/O channels,
+	 * pipes and their buffers on every connection.
+	 */
+	vector<ClientPtr> freeClients;
+	/** Disconnected Clients that may be added to the freelist once the
+	 * current event loop iteration is done with them.
+	 */
+	vector<ClientPtr> clientsToRecycle;
+	ev::timer recycleClientsTimer;
+
+	/** Preformatted "Status: ...\r\n" and "HTTP/1.1 ...\r\n" lines for all
+	 * status codes with a standard reason phrase, indexed by status code
+	 * minus 100. Empty for other status codes.
+	 */
+	string statusHeaderLines[500];
+	string statusLines[500];
+	/** Cached "Date: ...\r\n" header line, see getDateHeader(). */
+	char dateHeader[64];
+	unsigned int dateHeaderSize;
+	time_t dateHeaderTime;
+
+	/** A request ring that this handler consumes. */
+	struct RequestRingConsumer {
+		RequestHandler *handler;
+		unsigned long long id;
+		unsigned int number;
+		RequestRingPtr ring;
+		/** The web server holds the other end of this socket, so it
+		 * becomes readable when the web server process exits. */
+		FileDescriptor lifetimeFd;
+		ev::io notifyWatcher;
+		ev::io lifetimeWatcher;
+
+		void onNotify(ev::io &io, int revents) {
+			handler->onRequestRingNotify(this);
+		}
+
+		void onLifetimeReadable(ev::io &io, int revents) {
+			handler->onRequestRingLifetimeReadable(this);
+		}
+	};
+	typedef boost::shared_ptr<RequestRingConsumer> RequestRingConsumerPtr;
+
+	RequestRingRegistryPtr requestRings;
+	/** The request rings that this handler consumes, by ring number. */
+	map<unsigned int, RequestRingConsumerPtr> requestRingConsumers;
+	/** The clients of this handler that have announced a request ring
+	 * token, by key. See RequestRingRegistry. */
+	map<unsigned long long, ClientPtr> requestRingClients;
+
+	/** Persisted pool options, indexed by the PASSENGER_OPTIONS_ID header of
+	 * the request they were parsed from. See fillPoolOptions().
+	 */
+	StringMap< boost::shared_ptr<const Options> > poolOptionsCache;
+	static const unsigned int MAX_CACHED_POOL_OPTIONS = 1024;
+
+	void initializeResponseFragments() {
+		for (int i = 0; i < 500; i++) {
+			const char *statusCodeAndReasonPhrase = getStatusCodeAndReasonPhrase(i + 100);
+			if (statusCodeAndReasonPhrase != NULL) {
+				statusHeaderLines[i] = string("Status: ") + statusCodeAndReasonPhrase + "\r\n";
+				statusLines[i] = string("HTTP/1.1 ") + statusCodeAndReasonPhrase + "\r\n";
+			}
+		}
+		dateHeaderSize = 0;
+		dateHeaderTime = (time_t) -1;
+	}
 
 
+	ClientPtr checkoutClient() {
+		if (freeClients.empty()) {
+			return boost::make_shared<Client>();
+		} else {
+			ClientPtr client = freeClients.back();
+			freeClients.pop_back();
+			return client;
+		}
+	}
+
 	void disconnect(const ClientPtr &client) {
 		// Prevent Client object from being destroyed until we're done.
 		ClientPtr reference = client;
 
 		clients.erase(client->fd);
+		unregisterRequestRingClient(client);
 		client->discard();
 		client->verifyInvariants();
 		RH_DEBUG(client, "Disconnected; new client count = " << clients.size());
 
+		// Our callers may still be using the Client, so we only
+		// reset it for reuse in the next event loop iteration.
+		if (freeClients.size() + clientsToRecycle.size() < maxFreeClients) {
+			clientsToRecycle.push_back(client);
+			if (!recycleClientsTimer.is_active()) {
+				recycleClientsTimer.start();
+			}
+		}
+
 		if (clients.empty()) {
 			inactivityTimer.start();
 		}
 	}
 
+	void onRecycleClients(ev::timer &timer, int revents) {
+		vector<ClientPtr>::iterator it, end = clientsToRecycle.end();
+		for (it = clientsToRecycle.begin(); it != end; it++) {
+			ClientPtr &client = *it;
+			// Clients that are still referenced elsewhere, e.g. by
+			// a pending asyncGet() callback, are simply dropped.
+			if (client.unique() && client->reassociateable()) {
+				client->disassociate();
+				freeClients.push_back(client);
+			}
+		}
+		clientsToRecycle.clear();
+	}
+
 	void disconnectWithError(const ClientPtr &client, const StaticString &message) {
 		RH_WARN(client, "Disconnecting with error: " << message);
 		if (client->useUnionStation()) {
@@ -640,6 +1025,31 @@ private:
 		*result = inactivityTimer.elapsed();
 	}
 
+	void realGetClientCount(unsigned int *result) const {
+		*result = clients.size();
+	}
+
+	void realStopAccepting() {
+		acceptingStopped = true;
+		requestSocketWatcher.stop();
+		resumeSocketWatcherTimer.stop();
+
+		vector<ClientPtr> idleClients;
+		HashMap<int, ClientPtr>::const_iterator it;
+		for (it = clients.begin(); it != clients.end(); it++) {
+			const ClientPtr &client = it->second;
+			if (client->state == Client::BEGIN_READING_CONNECT_PASSWORD
+			 && client->waitingForNextRequest)
+			{
+				idleClients.push_back(client);
+			}
+		}
+		for (unsigned int i = 0; i < idleClients.size(); i++) {
+			RH_DEBUG(idleClients[i], "Not accepting requests anymore; disconnecting idle keep-alive client");
+			disconnect(idleClients[i]);
+		}
+	}
+
 	static bool getBoolOption(const ClientPtr &client, const StaticString &name, bool defaultValue = false) {
 		ScgiRequestParser::const_iterator it = client->scgiParser.getHeaderIterator(name);
 		if (it != client->scgiParser.end()) {
@@ -689,8 +1099,8 @@ private:
 			status, (unsigned long) data.size());
 
 		client->clientOutputPipe->write(header, pos - header);
-		client->clientOutputPipe->write(data.data(), data.size());
-		client->clientOutputPipe->end();
+		writeBodyToClientOutputPipe(client, data.data(), data.size());
+		endClientOutputPipe(client);
 
 		if (client->useUnionStation()) {
 			snprintf(header, end - header, "Status: %d %s",
@@ -771,8 +1181,8 @@ private:
 
 		const string header = str.str();
 		client->clientOutputPipe->write(header.data(), header.size());
-		client->clientOutputPipe->write(data.data(), data.size());
-		client->clientOutputPipe->end();
+		writeBodyToClientOutputPipe(client, data.data(), data.size());
+		endClientOutputPipe(client);
 
 		if (client->useUnionStation()) {
 			client->logMessage("Status: 500 Internal Server Error");
@@ -808,275 +1218,443 @@ private:
 	 *****************************************************/
 	
 	struct Header {
-		StaticString key;
+		/** The entire header line, including its line terminator. */
+		StaticString line;
 		StaticString value;
 
-		Header() { }
-
-		Header(const StaticString &_key, const StaticString &_value)
-			: key(_key),
-			  value(_value)
-			{ }
-		
 		bool empty() const {
-			return key.empty();
+			return line.empty();
 		}
+	};
 
-		const char *begin() const {
-			return key.data();
-		}
+	/**
+	 * The response header lines that processResponseHeader() is interested in.
+	 * Built by indexResponseHeader() in a single pass over the header data.
+	 * Only the first occurrence of each header is recorded.
+	 */
+	struct ResponseHeaderIndex {
+		/** The HTTP status line, including its line terminator. Empty if the
+		 * application didn't send one. */
+		StaticString statusLine;
+		Header status;
+		Header transferEncoding;
+		Header date;
+		Header oobw;
+		Header contentLength;
+		Header connection;
+	};
 
-		const char *end() const {
-			return value.data() + value.size() + sizeof("\r\n") - 1;
-		}
+	/** A part of the application's response header that is to be replaced
+	 * by <em>replacement</em> when forwarding it to the client. */
+	struct HeaderEdit {
+		const char *begin;
+		const char *end;
+		StaticString replacement;
 
-		size_t size() const {
-			return end() - begin();
-		}
+		HeaderEdit() { }
+
+		HeaderEdit(const StaticString &original, const StaticString &_replacement)
+			: begin(original.data()),
+			  end(original.data() + original.size()),
+			  replacement(_replacement)
+			{ }
 	};
 
-	/** Given a substring containing the start of the header value,
-	 * extracts the substring that contains a single header value.
-	 *
-	 *   const char *data =
-	 *      "Status: 200 OK\r\n"
-	 *      "Foo: bar\r\n";
-	 *   extractHeaderValue(data + strlen("Status:"), strlen(data) - strlen("Status:"));
-	 *      // "200 OK"
-	 */
-	static StaticString extractHeaderValue(const char *data, size_t size) {
-		const char *start = data;
-		const char *end   = data + size;
-		const char *terminator;
-		
-		while (start < end && *start == ' ') {
-			start++;
-		}
-		
-		terminator = (const char *) memchr(start, '\r', end - start);
-		if (terminator == NULL) {
-			return StaticString();
-		} else {
-			return StaticString(start, terminator - start);
-		}
+	static bool headerNameEquals(const char *name, size_t len, const StaticString &expected) {
+		return len == expected.size() && strncasecmp(name, expected.data(), len) == 0;
 	}
 
-	static Header lookupHeader(const StaticString &headerData, const StaticString &name) {
-		string::size_type searchStart = 0;
-		while (searchStart < headerData.size()) {
-			string::size_type pos = headerData.find(name, searchStart);
-			if (OXT_UNLIKELY(pos == string::npos)) {
-				return Header();
-			} else if ((pos == 0 || headerData[pos - 1] == '\n')
-				&& headerData.size() > pos + name.size()
-				&& headerData[pos + name.size()] == ':')
-			{
-				StaticString value = extractHeaderValue(
-					headerData.data() + pos + name.size() + 1,
-					headerData.size() - pos - name.size() - 1);
-				return Header(headerData.substr(pos, name.size()), value);
-			} else {
-				searchStart = pos + name.size() + 1;
+	/**
+	 * Scans the given header data once, line by line, and records the
+	 * positions of the headers in ResponseHeaderIndex. Lines are found with
+	 * memchr(), which most libc implementations vectorize. Header names are
+	 * compared case-insensitively, and only if their lengths match.
+	 */
+	static void indexResponseHeader(const StaticString &headerData, ResponseHeaderIndex &index) {
+		const char *pos = headerData.data();
+		const char *end = headerData.data() + headerData.size();
+
+		while (pos < end) {
+			const char *lineEnd = (const char *) memchr(pos, '\n', end - pos);
+			lineEnd = (lineEnd == NULL) ? end : lineEnd + 1;
+
+			if (pos == headerData.data() && startsWith(headerData, "HTTP/1.")) {
+				index.statusLine = StaticString(pos, lineEnd - pos);
+				pos = lineEnd;
+				continue;
 			}
-		}
-		return Header();
-	}
-
-	static Header lookupHeader(const StaticString &headerData, const StaticString &name,
-		const StaticString &name2)
-	{
-		Header header = lookupHeader(headerData, name);
-		if (header.empty()) {
-			header = lookupHeader(headerData, name2);
-		}
-		return header;
-	}
 
-	bool addStatusHeaderFromStatusLine(const ClientPtr &client, string &headerData) {
-		string::size_type begin, end;
+			const char *colon = (const char *) memchr(pos, ':', lineEnd - pos);
+			if (colon != NULL) {
+				size_t nameLen = colon - pos;
+				Header *header;
+
+				if (headerNameEquals(pos, nameLen, "Status")) {
+					header = &index.status;
+				} else if (headerNameEquals(pos, nameLen, "Transfer-Encoding")) {
+					header = &index.transferEncoding;
+				} else if (headerNameEquals(pos, nameLen, "Date")) {
+					header = &index.date;
+				} else if (headerNameEquals(pos, nameLen, "X-Passenger-Request-OOB-Work")) {
+					header = &index.oobw;
+				} else if (headerNameEquals(pos, nameLen, "Content-Length")) {
+					header = &index.contentLength;
+				} else if (headerNameEquals(pos, nameLen, "Connection")) {
+					header = &index.connection;
+				} else {
+					header = NULL;
+				}
 
-		begin = headerData.find(' ');
-		if (begin != string::npos) {
-			end = headerData.find("\r\n", begin + 1);
-		} else {
-			end = string::npos;
-		}
-		if (begin != string::npos && end != string::npos) {
-			StaticString statusValue(headerData.data() + begin + 1, end - begin);
-			if (statusValue.size() <= MAX_STATUS_HEADER_SIZE) {
-				char header[MAX_STATUS_HEADER_SIZE + sizeof("Status: \r\n")];
-				char *pos = header;
-				const char *end = header + sizeof(header);
-
-				pos = appendData(pos, end, "Status: ");
-				pos = appendData(pos, end, statusValue);
-				pos = appendData(pos, end, "\r\n");
-				headerData.append(StaticString(header, pos - header));
-				return true;
-			} else {
-				disconnectWithError(client, "application sent malformed response: the Status header's (" +
-					statusValue + ") exceeds the allowed limit of " +
-					toString(MAX_STATUS_HEADER_SIZE) + " bytes.");
-				return false;
+				if (header != NULL && header->empty()) {
+					const char *valueBegin = colon + 1;
+					const char *valueEnd = lineEnd;
+					while (valueBegin < valueEnd && *valueBegin == ' ') {
+						valueBegin++;
+					}
+					if (valueEnd > valueBegin && valueEnd[-1] == '\n') {
+						valueEnd--;
+					}
+					if (valueEnd > valueBegin && valueEnd[-1] == '\r') {
+						valueEnd--;
+					}
+					header->line = StaticString(pos, lineEnd - pos);
+					header->value = StaticString(valueBegin, valueEnd - valueBegin);
+				}
 			}
-		} else {
-			disconnectWithError(client, "application sent malformed response: the HTTP status line is invalid.");
-			return false;
+
+			pos = lineEnd;
 		}
 	}
 
-	static bool addReasonPhrase(string &headerData, const Header &status) {
-		if (status.value.find(' ') == string::npos) {
-			int statusCode = stringToInt(status.value);
-			const char *statusCodeAndReasonPhrase = getStatusCodeAndReasonPhrase(statusCode);
-			char newStatus[100];
-			char *pos = newStatus;
-			const char *end = newStatus + sizeof(newStatus);
-
-			pos = appendData(pos, end, "Status: ");
-			if (statusCodeAndReasonPhrase == NULL) {
-				pos = appendData(pos, end, toString(statusCode));
-				pos = appendData(pos, end, " Unknown Reason-Phrase\r\n");
-			} else {
-				pos = appendData(pos, end, statusCodeAndReasonPhrase);
-				pos = appendData(pos, end, "\r\n");
+	/**
+	 * If the given Status header value lacks a reason phrase, returns a
+	 * "Status:" header line with the standard reason phrase. The line is
+	 * either taken from statusHeaderLines or formatted into <em>buf</em>,
+	 * which must be at least 100 bytes. Returns an empty string if the
+	 * status value is fine as it is. <em>newValue</em> is set to the new
+	 * header value.
+	 */
+	StaticString addReasonPhrase(char *buf, const StaticString &value, StaticString &newValue) const {
+		if (value.find(' ') == string::npos) {
+			int statusCode = stringToInt(value);
+			if (statusCode >= 100 && statusCode < 600
+			 && !statusHeaderLines[statusCode - 100].empty())
+			{
+				const string &line = statusHeaderLines[statusCode - 100];
+				newValue = StaticString(line.data() + sizeof("Status: ") - 1,
+					line.size() - sizeof("Status: \r\n") + 1);
+				return line;
 			}
 
-			headerData.replace(status.begin() - headerData.data(), status.size(),
-				newStatus, pos - newStatus);
-			return true;
+			char *pos = buf;
+			const char *end = buf + 100;
+			const char *valueBegin;
+
+			pos = appendData(pos, end, "Status: ");
+			valueBegin = pos;
+			pos = appendData(pos, end, toString(statusCode));
+			pos = appendData(pos, end, " Unknown Reason-Phrase");
+			newValue = StaticString(valueBegin, pos - valueBegin);
+			pos = appendData(pos, end, "\r\n");
+			return StaticString(buf, pos - buf);
 		} else {
-			return false;
+			newValue = value;
+			return StaticString();
 		}
 	}
 
-	bool removeStatusLine(const ClientPtr &client, string &headerData) {
-		string::size_type end = headerData.find("\r\n");
-		if (end != string::npos) {
-			headerData.erase(0, end + 2);
-			return true;
-		} else {
-			disconnectWithError(client, "application sent malformed response: the HTTP status line is invalid.");
-			return false;
+	/**
+	 * Returns the preformatted "HTTP/1.1" status line for the given Status
+	 * header value if it's a standard status code and reason phrase, or
+	 * an empty string otherwise.
+	 */
+	StaticString lookupStatusLine(const StaticString &statusValue) const {
+		int statusCode = stringToInt(statusValue);
+		if (statusCode >= 100 && statusCode < 600) {
+			const string &line = statusLines[statusCode - 100];
+			if (!line.empty()
+			 && line.size() == statusValue.size() + sizeof("HTTP/1.1 \r\n") - 1
+			 && memcmp(line.data() + sizeof("HTTP/1.1 ") - 1, statusValue.data(),
+			           statusValue.size()) == 0)
+			{
+				return line;
+			}
 		}
+		return StaticString();
 	}
 
-	static void addStatusLineFromStatusHeader(string &headerData, const Header &status) {
-		char statusLine[100];
-		char *pos = statusLine;
-		const char *end = statusLine + sizeof(statusLine);
-
-		pos = appendData(pos, end, "HTTP/1.1 ");
-		pos = appendData(pos, end, status.value);
-		pos = appendData(pos, end, "\r\n");
-
-		headerData.insert(0, statusLine, pos - statusLine);
-	}
+	/**
+	 * Returns a "Date:" header line for the current time. The line is
+	 * formatted at most once per second; the event loop's cached time is
+	 * used so that this doesn't even need a system call.
+	 */
+	StaticString getDateHeader() {
+		time_t now = (time_t) ev_now(libev->getLoop());
+		if (now != dateHeaderTime) {
+			char *pos = dateHeader;
+			const char *end = dateHeader + sizeof(dateHeader) - 1;
+			struct tm the_tm;
 
-	static void removeHeader(string &headerData, const Header &header) {
-		headerData.erase(header.begin() - headerData.data(), header.size());
+			pos = appendData(pos, end, "Date: ");
+			gmtime_r(&now, &the_tm);
+			pos += strftime(pos, end - pos, "%a, %d %b %Y %H:%M:%S GMT", &the_tm);
+			pos = appendData(pos, end, "\r\n");
+			dateHeaderSize = pos - dateHeader;
+			dateHeaderTime = now;
+		}
+		return StaticString(dateHeader, dateHeaderSize);
 	}
 
 	/*
 	 * Given a full header, possibly modify the header and send it to the clientOutputPipe.
+	 *
+	 * The header is indexed once by indexResponseHeader(). All modifications are
+	 * then expressed as a handful of edits on the original data, plus some
+	 * headers that are appended at the end, and the result is assembled with
+	 * a single copy.
 	 */
 	bool processResponseHeader(const ClientPtr &client,
 		const StaticString &origHeaderData)
 	{
-		string headerData;
-		headerData.reserve(origHeaderData.size() + 150);
 		// Strip trailing CRLF.
-		headerData.append(origHeaderData.data(), origHeaderData.size() - 2);
-		
-		if (startsWith(headerData, "HTTP/1.")) {
-			Header status = lookupHeader(headerData, "Status", "status");
-			if (status.empty()) {
+		StaticString headerData(origHeaderData.data(), origHeaderData.size() - 2);
+		ResponseHeaderIndex index;
+		HeaderEdit edits[5];
+		unsigned int nedits = 0;
+		StaticString statusValue, appendedStatusHeader;
+		char statusHeaderBuf[MAX_STATUS_HEADER_SIZE + 100];
+		char statusLineBuf[MAX_STATUS_HEADER_SIZE + 100];
+
+		indexResponseHeader(headerData, index);
+
+		if (!index.statusLine.empty()) {
+			if (index.status.empty()) {
 				// Add status header if necessary.
-				if (!addStatusHeaderFromStatusLine(client, headerData)) {
+				const char *begin = (const char *) memchr(index.statusLine.data(), ' ',
+					index.statusLine.size());
+				const char *end = (const char *) memchr(index.statusLine.data(), '\r',
+					index.statusLine.size());
+				if (begin == NULL || end == NULL || end < begin) {
+					disconnectWithError(client, "application sent malformed response: the HTTP status line is invalid.");
 					return false;
 				}
+				statusValue = StaticString(begin + 1, end - begin - 1);
+				if (statusValue.size() > MAX_STATUS_HEADER_SIZE) {
+					disconnectWithError(client, "application sent malformed response: the Status header's (" +
+						statusValue + ") exceeds the allowed limit of " +
+						toString(MAX_STATUS_HEADER_SIZE) + " bytes.");
+					return false;
+				}
+				char *pos = statusHeaderBuf;
+				const char *bufEnd = statusHeaderBuf + sizeof(statusHeaderBuf);
+				pos = appendData(pos, bufEnd, "Status: ");
+				pos = appendData(pos, bufEnd, statusValue);
+				pos = appendData(pos, bufEnd, "\r\n");
+				appendedStatusHeader = StaticString(statusHeaderBuf, pos - statusHeaderBuf);
 			} else {
 				// Add reason phrase to existing status header if necessary.
-				addReasonPhrase(headerData, status);
+				StaticString newStatus = addReasonPhrase(statusHeaderBuf,
+					index.status.value, statusValue);
+				if (!newStatus.empty()) {
+					edits[nedits++] = HeaderEdit(index.status.line, newStatus);
+				}
 			}
 			// Remove status line if necesary.
 			if (!getBoolOption(client, "PASSENGER_STATUS_LINE", true)) {
-				if (!removeStatusLine(client, headerData)) {
-					return false;
-				}
+				edits[nedits++] = HeaderEdit(index.statusLine, StaticString());
 			}
-		} else {
-			Header status = lookupHeader(headerData, "Status", "status");
-			if (!status.empty()) {
-				// Add reason phrase to status header if necessary.
-				if (addReasonPhrase(headerData, status)) {
-					status = lookupHeader(headerData, "Status", "status");
+		} else if (!index.status.empty()) {
+			// Add reason phrase to status header if necessary.
+			StaticString newStatus = addReasonPhrase(statusHeaderBuf,
+				index.status.value, statusValue);
+			// Add status line if necessary. This edit must come before
+			// any edit of the first header line.
+			if (getBoolOption(client, "PASSENGER_STATUS_LINE", true)) {
+				StaticString statusLine = lookupStatusLine(statusValue);
+				if (statusLine.empty()) {
+					char *pos = statusLineBuf;
+					const char *bufEnd = statusLineBuf + sizeof(statusLineBuf);
+					pos = appendData(pos, bufEnd, "HTTP/1.1 ");
+					pos = appendData(pos, bufEnd, statusValue);
+					pos = appendData(pos, bufEnd, "\r\n");
+					statusLine = StaticString(statusLineBuf, pos - statusLineBuf);
 				}
-				// Add status line if necessary.
-				if (getBoolOption(client, "PASSENGER_STATUS_LINE", true)) {
-					addStatusLineFromStatusHeader(headerData, status);
-				}
-			} else {
-				disconnectWithError(client, "application sent malformed response: it didn't send an HTTP status line or a Status header.");
-				return false;
+				edits[nedits++] = HeaderEdit(StaticString(headerData.data(), 0), statusLine);
 			}
+			if (!newStatus.empty()) {
+				edits[nedits++] = HeaderEdit(index.status.line, newStatus);
+			}
+		} else {
+			disconnectWithError(client, "application sent malformed response: it didn't send an HTTP status line or a Status header.");
+			return false;
 		}
 
 		if (client->useUnionStation()) {
-			Header status = lookupHeader(headerData, "Status", "status");
 			string message = "Status: ";
-			message.append(status.value);
+			message.append(statusValue);
 			client->logMessage(message);
 		}
 
 		// Process chunked transfer encoding.
-		Header transferEncoding = lookupHeader(headerData, "Transfer-Encoding", "transfer-encoding");
-		if (!transferEncoding.empty() && transferEncoding.value == "chunked") {
+		if (!index.transferEncoding.empty() && index.transferEncoding.value == "chunked") {
 			P_TRACE(3, "Response with chunked transfer encoding detected.");
 			client->chunkedResponse = true;
-			removeHeader(headerData, transferEncoding);
+			edits[nedits++] = HeaderEdit(index.transferEncoding.line, StaticString());
+		}
+
+		// Detect out of band work request
+		if (!index.oobw.empty()) {
+			P_TRACE(3, "Response with oobw detected.");
+			if (client->session != NULL) {
+				client->session->requestOOBW();
+			}
+			edits[nedits++] = HeaderEdit(index.oobw.line, StaticString());
+		}
+
+		if (client->appKeepAlive) {
+			determineResponseFraming(client, index, statusValue);
+			// The Connection header describes the connection between us
+			// and the application, not the one with the web server.
+			if (!index.connection.empty()) {
+				edits[nedits++] = HeaderEdit(index.connection.line, StaticString());
+			}
 		}
 
 		// Add X-Powered-By.
+		StaticString poweredBy;
 		if (getBoolOption(client, "PASSENGER_SHOW_VERSION_IN_HEADER", true)) {
-			headerData.append("X-Powered-By: Phusion Passenger " PASSENGER_VERSION "\r\n");
+			poweredBy = "X-Powered-By: Phusion Passenger " PASSENGER_VERSION "\r\n";
 		} else {
-			headerData.append("X-Powered-By: Phusion Passenger\r\n");
+			poweredBy = "X-Powered-By: Phusion Passenger\r\n";
 		}
 
 		// Add Date header. https://code.google.com/p/phusion-passenger/issues/detail?id=485
-		if (lookupHeader(headerData, "Date", "date").empty()) {
-			char dateStr[60];
-			char *pos = dateStr;
-			const char *end = dateStr + sizeof(dateStr) - 1;
-			time_t the_time = time(NULL);
-			struct tm the_tm;
+		StaticString date;
+		if (index.date.empty()) {
+			date = getDateHeader();
+		}
+
+		// Tell the web server that it may use its request ring for this
+		// connection from now on.
+		StaticString ringConfirmation;
+		if (client->confirmRequestRing) {
+			ringConfirmation = "X-Passenger-Request-Ring: ok\r\n";
+		}
+
+		// Apply the edits in the order in which they occur in the header.
+		// The sort is stable so that an insertion at the start of the header
+		// stays in front of an edit of the first line.
+		for (unsigned int i = 1; i < nedits; i++) {
+			HeaderEdit edit = edits[i];
+			unsigned int j = i;
+			while (j > 0 && edits[j - 1].begin > edit.begin) {
+				edits[j] = edits[j - 1];
+				j--;
+			}
+			edits[j] = edit;
+		}
 
-			pos = appendData(pos, end, "Date: ");
-			gmtime_r(&the_time, &the_tm);
-			pos += strftime(pos, end - pos, "%a, %d %b %G %H:%M:%S %Z", &the_tm);
-			pos = appendData(pos, end, "\r\n");
-			headerData.append(dateStr, pos - dateStr);
+		size_t size = headerData.size() + appendedStatusHeader.size()
+			+ poweredBy.size() + date.size() + ringConfirmation.size() + 2;
+		for (unsigned int i = 0; i < nedits; i++) {
+			size = size - (edits[i].end - edits[i].begin) + edits[i].replacement.size();
 		}
 
-		// Detect out of band work request
-		Header oobw = lookupHeader(headerData, "X-Passenger-Request-OOB-Work", "x-passenger-request-oob-work");
-		if (!oobw.empty()) {
-			P_TRACE(3, "Response with oobw detected.");
-			if (client->session != NULL) {
-				client->session->requestOOBW();
-			}
-			removeHeader(headerData, oobw);
+		string result;
+		const char *pos = headerData.data();
+		result.reserve(size);
+		for (unsigned int i = 0; i < nedits; i++) {
+			result.append(pos, edits[i].begin - pos);
+			result.append(edits[i].replacement.data(), edits[i].replacement.size());
+			pos = edits[i].end;
 		}
+		result.append(pos, headerData.data() + headerData.size() - pos);
+		result.append(appendedStatusHeader.data(), appendedStatusHeader.size());
+		result.append(poweredBy.data(), poweredBy.size());
+		result.append(date.data(), date.size());
+		result.append(ringConfirmation.data(), ringConfirmation.size());
+		result.append("\r\n", 2);
 
-		headerData.append("\r\n");
-		writeToClientOutputPipe(client, headerData);
+		writeToClientOutputPipe(client, result, false);
 		return true;
 	}
 
-	void writeToClientOutputPipe(const ClientPtr &client, const StaticString &data) {
+	/**
+	 * Figures out how the end of the response body can be detected on a
+	 * keep-alive connection to the application. If it's only delimited by
+	 * the application closing the connection, then the connection can't be
+	 * reused and appKeepAlive is cleared.
+	 */
+	void determineResponseFraming(const ClientPtr &client, const ResponseHeaderIndex &index,
+		const StaticString &statusValue)
+	{
+		int statusCode = stringToInt(statusValue);
+
+		if (!index.connection.empty()
+		 && index.connection.value.size() == sizeof("close") - 1
+		 && strncasecmp(index.connection.value.data(), "close", sizeof("close") - 1) == 0)
+		{
+			client->appKeepAlive = false;
+		} else if (statusCode < 200) {
+			// Interim responses are followed by another response
+			// header, which we don't support.
+			client->appKeepAlive = false;
+		} else if (statusCode == 204 || statusCode == 304
+			|| client->scgiParser.getHeader("REQUEST_METHOD") == "HEAD")
+		{
+			client->responseContentLength = 0;
+		} else if (client->chunkedResponse) {
+			// responseDechunker finds the end.
+		} else if (!index.contentLength.empty()
+			&& index.contentLength.value[0] >= '0'
+			&& index.contentLength.value[0] <= '9')
+		{
+			client->responseContentLength = stringToULL(index.contentLength.value);
+		} else {
+			client->appKeepAlive = false;
+		}
+
+		if (!client->appKeepAlive) {
+			RH_TRACE(client, 3, "Application response is not reusable for keep-alive");
+		}
+	}
+
+	/**
+	 * Writes response body data to clientOutputPipe. On keep-alive connections
+	 * the data is framed as a chunk. Returns the result of FileBackedPipe::write().
+	 */
+	bool writeBodyToClientOutputPipe(const ClientPtr &client, const char *data, size_t size) {
+		if (!client->keepAlive) {
+			return client->clientOutputPipe->write(data, size);
+		} else if (size == 0) {
+			// An empty chunk would terminate the response.
+			return !client->clientOutputPipe->isCommittingToDisk();
+		} else {
+			char header[sizeof(size_t) * 2 + 3];
+			int len = snprintf(header, sizeof(header), "%lx\r\n", (unsigned long) size);
+			string &frame = client->chunkFrameBuffer;
+			frame.assign(header, len);
+			frame.append(data, size);
+			frame.append("\r\n", 2);
+			return client->clientOutputPipe->write(frame.data(), frame.size());
+		}
+	}
+
+	void endClientOutputPipe(const ClientPtr &client) {
+		if (client->keepAlive) {
+			client->clientOutputPipe->write("0\r\n\r\n", 5);
+		}
+		client->clientOutputPipe->end();
+	}
+
+	void writeToClientOutputPipe(const ClientPtr &client, const StaticString &data, bool body = true) {
 		bool wasCommittingToDisk = client->clientOutputPipe->isCommittingToDisk();
-		bool nowCommittingToDisk = !client->clientOutputPipe->write(data.data(), data.size());
+		bool nowCommittingToDisk;
+		if (body) {
+			nowCommittingToDisk = !writeBodyToClientOutputPipe(client, data.data(), data.size());
+		} else {
+			nowCommittingToDisk = !client->clientOutputPipe->write(data.data(), data.size());
+		}
 		if (!wasCommittingToDisk && nowCommittingToDisk) {
 			RH_TRACE(client, 3, "Buffering response data to disk; temporarily stopping application socket.");
 			client->backgroundOperations++;
@@ -1095,6 +1673,9 @@ private:
 
 		if (!data.empty()) {
 			RH_TRACE(client, 3, "Application sent data: \"" << cEscapeString(data) << "\"");
+			if (client->firstResponseByteAt == 0) {
+				client->firstResponseByteAt = ev_time();
+			}
 
 			// Buffer the application response until we've encountered the end of the header.
 			if (!client->responseHeaderSeen) {
@@ -1107,6 +1688,9 @@ private:
 						client->responseHeaderSeen = true;
 						StaticString header = client->responseHeaderBufferer.getData();
 						if (processResponseHeader(client, header)) {
+							if (client->appKeepAlive && client->responseContentLength == 0) {
+								onAppResponseEnd(client, consumed == data.size());
+							}
 							return consumed;
 						} else {
 							assert(!client->connected());
@@ -1116,8 +1700,20 @@ private:
 			// The header has already been processed so forward it
 			// directly to clientOutputPipe, possibly through a
 			// dechunker first.
+			} else if (client->appKeepAlive && client->responseContentLength >= 0) {
+				size_t size = (size_t) std::min<unsigned long long>(data.size(),
+					client->responseContentLength - client->responseBodyAlreadyRead);
+				onAppInputChunk(client, StaticString(data.data(), size));
+				client->responseBodyAlreadyRead += size;
+				if (client->responseBodyAlreadyRead == (unsigned long long) client->responseContentLength) {
+					onAppResponseEnd(client, size == data.size());
+				}
 			} else if (client->chunkedResponse) {
-				client->responseDechunker.feed(data.data(), data.size());
+				size_t fed = client->responseDechunker.feed(data.data(), data.size());
+				if (client->appKeepAlive && !client->responseDechunker.acceptingInput()) {
+					onAppResponseEnd(client, fed == data.size()
+						&& !client->responseDechunker.hasError());
+				}
 			} else {
 				onAppInputChunk(client, data);
 			}
@@ -1136,7 +1732,11 @@ private:
 
 	void onAppInputChunkEnd(const ClientPtr &client) {
 		RH_LOG_EVENT(client, "onAppInputChunkEnd");
-		onAppInputEof(client);
+		// On keep-alive connections, onAppInputData() ends the response
+		// because it knows whether anything follows the last chunk.
+		if (!client->appKeepAlive) {
+			onAppInputEof(client);
+		}
 	}
 
 	void onAppInputEof(const ClientPtr &client) {
@@ -1148,22 +1748,91 @@ private:
 		}
 
 		RH_DEBUG(client, "Application sent EOF");
-		client->session.reset();
-		client->endScopeLog(&client->scopeLogs.requestProxying);
-		client->clientOutputPipe->end();
+		endAppResponse(client, false);
 	}
 
-	void onAppInputError(const ClientPtr &client, const char *message, int errorCode) {
-		RH_LOG_EVENT(client, "onAppInputError");
-		if (!client->connected()) {
+	/**
+	 * Called when the complete response has been received over a keep-alive
+	 * connection to the application. <em>cleanEnd</em> is whether nothing
+	 * follows the response. If the request has been completely sent as well,
+	 * then the connection is returned to the socket's connection pool.
+	 */
+	void onAppResponseEnd(const ClientPtr &client, bool cleanEnd) {
+		RH_LOG_EVENT(client, "onAppResponseEnd");
+		if (!client->connected() || client->session == NULL) {
 			return;
 		}
 
-		if (errorCode == ECONNRESET) {
-			// We might as well treat ECONNRESET like an EOF.
-			// http://stackoverflow.com/questions/2974021/what-does-econnreset-mean-in-the-context-of-an-af-local-socket
-			onAppInputEof(client);
-		} else {
+		bool reuse = cleanEnd && requestCompletelySentToApp(client);
+		RH_DEBUG(client, "Application response complete; " <<
+			(reuse ? "reusing" : "closing") << " application connection");
+		// The connection may be handed to another client from now on.
+		client->appInput->stop();
+		endAppResponse(client, reuse);
+	}
+
+	void endAppResponse(const ClientPtr &client, bool reuseConnection) {
+		recordRequestLatencies(client);
+		client->session->close(reuseConnection);
+		client->session.reset();
+		client->endScopeLog(&client->scopeLogs.requestProxying);
+		endClientOutputPipe(client);
+	}
+
+	static bool requestCompletelySentToApp(const ClientPtr &client) {
+		if (client->contentLength >= 0) {
+			return client->requestBodyForwarded
+				&& client->clientBodyAlreadyRead == (unsigned long long) client->contentLength;
+		} else {
+			// The application was told that there is no body,
+			// so nothing but the header may have been sent.
+			return client->state == Client::FORWARDING_BODY_TO_APP
+				&& client->clientBodyAlreadyRead == 0;
+		}
+	}
+
+	static unsigned long long usecBetween(ev_tstamp begin, ev_tstamp end) {
+		if (end > begin) {
+			return (unsigned long long) ((end - begin) * 1000000);
+		} else {
+			return 0;
+		}
+	}
+
+	/**
+	 * Records the latencies of the request that just completed in its Group.
+	 * Requests that didn't get as far as a response, or that were answered
+	 * without going through the pool, aren't recorded.
+	 */
+	void recordRequestLatencies(const ClientPtr &client) {
+		if (client->firstResponseByteAt == 0 || client->sessionInitiatedAt == 0) {
+			return;
+		}
+
+		GroupPtr group = client->session->getGroup();
+		if (group == NULL) {
+			return;
+		}
+
+		ev_tstamp now = ev_time();
+		group->recordRequestLatencies(
+			usecBetween(client->checkoutBeganAt, client->sessionCheckedOutAt),
+			usecBetween(client->sessionCheckedOutAt, client->sessionInitiatedAt),
+			usecBetween(client->sessionInitiatedAt, client->firstResponseByteAt),
+			usecBetween(client->requestBeganAt, now));
+	}
+
+	void onAppInputError(const ClientPtr &client, const char *message, int errorCode) {
+		RH_LOG_EVENT(client, "onAppInputError");
+		if (!client->connected()) {
+			return;
+		}
+
+		if (errorCode == ECONNRESET) {
+			// We might as well treat ECONNRESET like an EOF.
+			// http://stackoverflow.com/questions/2974021/what-does-econnreset-mean-in-the-context-of-an-af-local-socket
+			onAppInputEof(client);
+		} else {
 			stringstream message;
 			message << "application socket read error: ";
 			message << strerror(errorCode);
@@ -1234,9 +1903,33 @@ private:
 			return;
 		}
 
-		RH_TRACE(client, 2, "Client output pipe ended; disconnecting client");
 		client->endScopeLog(&client->scopeLogs.requestProcessing);
-		disconnect(client);
+		if (client->canReadNextRequest()) {
+			RH_TRACE(client, 2, "Client output pipe ended; waiting for next request on keep-alive connection");
+			// We're inside a clientOutputPipe callback, so reset it in the next tick.
+			libev->runLater(boost::bind(&RequestHandler::readNextRequest, this, client));
+		} else {
+			RH_TRACE(client, 2, "Client output pipe ended; disconnecting client");
+			disconnect(client);
+		}
+	}
+
+	void readNextRequest(ClientPtr client) {
+		if (!client->connected()) {
+			return;
+		}
+		if (acceptingStopped) {
+			RH_TRACE(client, 2, "Not accepting requests anymore; disconnecting keep-alive client");
+			disconnect(client);
+			return;
+		}
+		client->prepareForNextRequest();
+		client->clientInput->start();
+		if (!client->pendingRingRequest.empty()) {
+			string data;
+			data.swap(client->pendingRingRequest);
+			feedRequestRingEntry(client, data);
+		}
 	}
 
 	void onClientOutputPipeError(const ClientPtr &client, int errorCode) {
@@ -1304,6 +1997,10 @@ private:
 
 
 	void onResumeSocketWatcher(ev::timer &timer, int revents) {
+		if (acceptingStopped) {
+			resumeSocketWatcherTimer.stop();
+			return;
+		}
 		P_INFO("Resuming listening on server socket.");
 		resumeSocketWatcherTimer.stop();
 		requestSocketWatcher.start();
@@ -1312,10 +2009,14 @@ private:
 	void onAcceptable(ev::io &io, int revents) {
 		bool endReached = false;
 		unsigned int count = 0;
-		unsigned int maxAcceptTries = clamp<unsigned int>(clients.size(), 1, 10);
+		unsigned int tries = 0;
+		unsigned int maxAcceptTries = clientTargets.empty()
+			? clamp<unsigned int>(clients.size(), 1, 10)
+			: 10;
 		ClientPtr acceptedClients[10];
 
-		while (!endReached && count < maxAcceptTries) {
+		while (!endReached && tries < maxAcceptTries) {
+			tries++;
 			FileDescriptor fd = acceptNonBlockingSocket(requestSocket);
 			if (fd == -1) {
 				if (errno == EAGAIN || errno == EWOULDBLOCK) {
@@ -1339,12 +2040,18 @@ private:
 					"\r\n"
 					"Benchmark point: after_accept\n");
 			} else {
-				ClientPtr client = boost::make_shared<Client>();
-				client->associate(this, fd);
-				clients.insert(make_pair<int, ClientPtr>(fd, client));
-				acceptedClients[count] = client;
-				count++;
-				RH_DEBUG(client, "New client accepted; new client count = " << clients.size());
+				RequestHandler *target = nextTarget();
+				if (target == this) {
+					ClientPtr client = checkoutClient();
+					client->associate(this, fd);
+					clients.insert(make_pair<int, ClientPtr>(fd, client));
+					acceptedClients[count] = client;
+					count++;
+					RH_DEBUG(client, "New client accepted; new client count = " << clients.size());
+				} else {
+					target->libev->runLater(boost::bind(
+						&RequestHandler::onClientHandedOver, target, fd));
+				}
 			}
 		}
 
@@ -1358,6 +2065,28 @@ private:
 	}
 
 
+	RequestHandler *nextTarget() {
+		if (clientTargets.empty()) {
+			return this;
+		} else {
+			RequestHandler *target = clientTargets[nextClientTarget];
+			nextClientTarget = (nextClientTarget + 1) % clientTargets.size();
+			return target;
+		}
+	}
+
+	/** Called in this handler's event loop when another handler
+	 * has accepted a client on our behalf. */
+	void onClientHandedOver(const FileDescriptor &fd) {
+		ClientPtr client = checkoutClient();
+		client->associate(this, fd);
+		clients.insert(make_pair<int, ClientPtr>(fd, client));
+		RH_DEBUG(client, "New client handed over; new client count = " << clients.size());
+		client->clientInput->readNow();
+		inactivityTimer.stop();
+	}
+
+
 	size_t onClientInputData(const ClientPtr &client, const StaticString &data) {
 		RH_LOG_EVENT(client, "onClientInputData");
 		if (!client->connected()) {
@@ -1510,6 +2239,9 @@ private:
 		}
 
 		switch (client->state) {
+		case Client::CHECKING_OUT_SESSION:
+			state_checkingOutSession_onAppOutputWritable(client);
+			break;
 		case Client::SENDING_HEADER_TO_APP:
 			state_sendingHeaderToApp_onAppOutputWritable(client);
 			break;
@@ -1522,6 +2254,22 @@ private:
 	}
 
 
+	void onClientSpliceReadable(const ClientPtr &client) {
+		RH_LOG_EVENT(client, "onClientSpliceReadable");
+		if (!client->connected()) {
+			return;
+		}
+
+		switch (client->state) {
+		case Client::FORWARDING_BODY_TO_APP:
+			state_forwardingBodyToApp_onClientSpliceReadable(client);
+			break;
+		default:
+			abort();
+		}
+	}
+
+
 	void onTimeout(const ClientPtr &client) {
 		RH_LOG_EVENT(client, "onTimeout");
 		if (!client->connected()) {
@@ -1533,6 +2281,13 @@ private:
 		case Client::STILL_READING_CONNECT_PASSWORD:
 			disconnectWithError(client, "no connect password received within timeout");
 			break;
+		case Client::CHECKING_OUT_SESSION:
+			if (client->session != NULL && client->session->connecting()) {
+				state_checkingOutSession_onAppConnectTimeout(client);
+			} else {
+				disconnectWithError(client, "timeout");
+			}
+			break;
 		default:
 			disconnectWithError(client, "timeout");
 			break;
@@ -1540,6 +2295,22 @@ private:
 	}
 
 
+	void onAppConnectRetry(const ClientPtr &client) {
+		RH_LOG_EVENT(client, "onAppConnectRetry");
+		if (!client->connected()) {
+			return;
+		}
+
+		switch (client->state) {
+		case Client::CHECKING_OUT_SESSION:
+			state_checkingOutSession_onAppConnectRetry(client);
+			break;
+		default:
+			abort();
+		}
+	}
+
+
 	/*****************************************************
 	 * COMPONENT: client -> application plumbing
 	 *
@@ -1568,6 +2339,8 @@ private:
 	}
 
 	size_t state_beginReadingConnectPassword_onClientData(const ClientPtr &client, const char *data, size_t size) {
+		client->waitingForNextRequest = false;
+		client->requestBeganAt = ev_time();
 		if (size >= options.requestSocketPassword.size()) {
 			checkConnectPassword(client, data, options.requestSocketPassword.size());
 			return options.requestSocketPassword.size();
@@ -1675,12 +2448,75 @@ private:
 		}
 	}
 
+	/**
+	 * Fills the pool options that are set by PASSENGER_* headers, except for
+	 * the ones that fillPoolOptions() parses for every request.
+	 */
+	void fillPoolOptionsFromPassengerHeaders(const ClientPtr &client) {
+		Options &options = client->options;
+
+		options = Options();
+		options.ruby = this->options.defaultRubyCommand;
+		options.loggingAgentAddress = this->options.loggingAgentAddress;
+		options.loggingAgentUsername = "logging";
+		options.loggingAgentPassword = this->options.loggingAgentPassword;
+		options.defaultUser = this->options.defaultUser;
+		options.defaultGroup = this->options.defaultGroup;
+		fillPoolOption(client, options.appGroupName, "PASSENGER_APP_GROUP_NAME");
+		fillPoolOption(client, options.environment, "PASSENGER_ENV");
+		fillPoolOption(client, options.ruby, "PASSENGER_RUBY");
+		fillPoolOption(client, options.python, "PASSENGER_PYTHON");
+		fillPoolOption(client, options.nodejs, "PASSENGER_NODEJS");
+		fillPoolOption(client, options.user, "PASSENGER_USER");
+		fillPoolOption(client, options.group, "PASSENGER_GROUP");
+		fillPoolOption(client, options.minProcesses, "PASSENGER_MIN_INSTANCES");
+		fillPoolOption(client, options.spawnConcurrency, "PASSENGER_SPAWN_CONCURRENCY");
+		fillPoolOption(client, options.predictiveSpawning, "PASSENGER_PREDICTIVE_SPAWNING");
+		fillPoolOption(client, options.loadBalancing, "PASSENGER_LOAD_BALANCING");
+		fillPoolOption(client, options.maxRequests, "PASSENGER_MAX_REQUESTS");
+		fillPoolOption(client, options.spawnMethod, "PASSENGER_SPAWN_METHOD");
+		fillPoolOption(client, options.startCommand, "PASSENGER_START_COMMAND");
+		fillPoolOptionSecToMsec(client, options.startTimeout, "PASSENGER_START_TIMEOUT");
+		fillPoolOption(client, options.maxPreloaderIdleTime, "PASSENGER_MAX_PRELOADER_IDLE_TIME");
+		fillPoolOption(client, options.maxRequestQueueSize, "PASSENGER_MAX_REQUEST_QUEUE_SIZE");
+		fillPoolOption(client, options.statThrottleRate, "PASSENGER_STAT_THROTTLE_RATE");
+		fillPoolOption(client, options.restartDir, "PASSENGER_RESTART_DIR");
+		fillPoolOption(client, options.startupFile, "PASSENGER_STARTUP_FILE");
+		fillPoolOption(client, options.loadShellEnvvars, "PASSENGER_LOAD_SHELL_ENVVARS");
+		fillPoolOption(client, options.debugger, "PASSENGER_DEBUGGER");
+		fillPoolOption(client, options.raiseInternalError, "PASSENGER_RAISE_INTERNAL_ERROR");
+	}
+
+	/**
+	 * Web servers may send a PASSENGER_OPTIONS_ID header along with the request,
+	 * promising that all requests with the same ID carry the same PASSENGER_*
+	 * option headers. The options that are set by those headers are then parsed
+	 * only once per ID and copied from poolOptionsCache afterwards. The app root,
+	 * the base URI, the app type, the log level and the environment variables
+	 * are still determined for every request.
+	 */
 	void fillPoolOptions(const ClientPtr &client) {
 		Options &options = client->options;
 		ScgiRequestParser &parser = client->scgiParser;
 		ScgiRequestParser::const_iterator it, end = client->scgiParser.end();
 
-		options = Options();
+		StaticString optionsId = parser.getHeader("PASSENGER_OPTIONS_ID");
+		boost::shared_ptr<const Options> cachedOptions;
+		if (!optionsId.empty()) {
+			cachedOptions = poolOptionsCache.get(optionsId);
+		}
+		if (cachedOptions != NULL) {
+			options = *cachedOptions;
+		} else {
+			fillPoolOptionsFromPassengerHeaders(client);
+			if (!optionsId.empty()) {
+				if (poolOptionsCache.size() >= MAX_CACHED_POOL_OPTIONS) {
+					poolOptionsCache = StringMap< boost::shared_ptr<const Options> >();
+				}
+				poolOptionsCache.set(optionsId,
+					boost::make_shared<Options>(options.copyAndPersist()));
+			}
+		}
 
 		StaticString scriptName = parser.getHeader("SCRIPT_NAME");
 		StaticString appRoot = parser.getHeader("PASSENGER_APP_ROOT");
@@ -1706,34 +2542,8 @@ private:
 			options.baseURI = scriptName;
 		}
 		
-		options.ruby = this->options.defaultRubyCommand;
 		options.logLevel = getLogLevel();
-		options.loggingAgentAddress = this->options.loggingAgentAddress;
-		options.loggingAgentUsername = "logging";
-		options.loggingAgentPassword = this->options.loggingAgentPassword;
-		options.defaultUser = this->options.defaultUser;
-		options.defaultGroup = this->options.defaultGroup;
-		fillPoolOption(client, options.appGroupName, "PASSENGER_APP_GROUP_NAME");
 		fillPoolOption(client, options.appType, "PASSENGER_APP_TYPE");
-		fillPoolOption(client, options.environment, "PASSENGER_ENV");
-		fillPoolOption(client, options.ruby, "PASSENGER_RUBY");
-		fillPoolOption(client, options.python, "PASSENGER_PYTHON");
-		fillPoolOption(client, options.nodejs, "PASSENGER_NODEJS");
-		fillPoolOption(client, options.user, "PASSENGER_USER");
-		fillPoolOption(client, options.group, "PASSENGER_GROUP");
-		fillPoolOption(client, options.minProcesses, "PASSENGER_MIN_INSTANCES");
-		fillPoolOption(client, options.maxRequests, "PASSENGER_MAX_REQUESTS");
-		fillPoolOption(client, options.spawnMethod, "PASSENGER_SPAWN_METHOD");
-		fillPoolOption(client, options.startCommand, "PASSENGER_START_COMMAND");
-		fillPoolOptionSecToMsec(client, options.startTimeout, "PASSENGER_START_TIMEOUT");
-		fillPoolOption(client, options.maxPreloaderIdleTime, "PASSENGER_MAX_PRELOADER_IDLE_TIME");
-		fillPoolOption(client, options.maxRequestQueueSize, "PASSENGER_MAX_REQUEST_QUEUE_SIZE");
-		fillPoolOption(client, options.statThrottleRate, "PASSENGER_STAT_THROTTLE_RATE");
-		fillPoolOption(client, options.restartDir, "PASSENGER_RESTART_DIR");
-		fillPoolOption(client, options.startupFile, "PASSENGER_STARTUP_FILE");
-		fillPoolOption(client, options.loadShellEnvvars, "PASSENGER_LOAD_SHELL_ENVVARS");
-		fillPoolOption(client, options.debugger, "PASSENGER_DEBUGGER");
-		fillPoolOption(client, options.raiseInternalError, "PASSENGER_RAISE_INTERNAL_ERROR");
 		
 		for (it = client->scgiParser.begin(); it != end; it++) {
 			if (!startsWith(it->first, "PASSENGER_")
@@ -1814,6 +2624,15 @@ private:
 			 */
 			parser.rebuildData(modified);
 			client->contentLength = getULongLongOption(client, "CONTENT_LENGTH");
+			client->keepAlive = getBoolOption(client, "PASSENGER_KEEPALIVE");
+			if (client->keepAlive && client->contentLength == -1) {
+				// The body of a keep-alive request cannot be terminated
+				// by EOF, so no CONTENT_LENGTH means no body.
+				client->contentLength = 0;
+			}
+			if (client->keepAlive && client->requestRingKey == 0) {
+				registerRequestRingClient(client);
+			}
 			fillPoolOptions(client);
 			if (!client->connected()) {
 				return consumed;
@@ -1922,11 +2741,11 @@ private:
 			RH_TRACE(client, 2, "Checking out session: appRoot=" << client->options.appRoot);
 			client->state = Client::CHECKING_OUT_SESSION;
 			client->beginScopeLog(&client->scopeLogs.getFromPool, "get from pool");
+			client->checkoutBeganAt = ev_time();
+			// sessionCheckedOut_real() decrements this, possibly before asyncGet() returns.
+			client->backgroundOperations++;
 			pool->asyncGet(client->options, boost::bind(&RequestHandler::sessionCheckedOut,
 				this, client, _1, _2));
-			if (!client->sessionCheckedOut) {
-				client->backgroundOperations++;
-			}
 		} else {
 			writeSimpleResponse(client, "Benchmark point: before_checkout_session\n");
 		}
@@ -1971,6 +2790,7 @@ private:
 			RH_DEBUG(client, "Session checked out: pid=" << session->getPid() <<
 				", gupid=" << session->getGupid());
 			client->session = session;
+			client->sessionCheckedOutAt = ev_time();
 			initiateSession(client);
 		}
 	}
@@ -2034,28 +2854,74 @@ private:
 	void initiateSession(const ClientPtr &client) {
 		assert(client->state == Client::CHECKING_OUT_SESSION);
 		client->sessionCheckoutTry++;
+		bool initiated;
 		try {
-			client->session->initiate();
+			initiated = client->session->initiateNonBlocking();
 		} catch (const SystemException &e2) {
-			if (client->sessionCheckoutTry < 10) {
-				RH_DEBUG(client, "Error checking out session (" << e2.what() <<
-					"); retrying (attempt " << client->sessionCheckoutTry << ")");
-				client->sessionCheckedOut = false;
-				pool->asyncGet(client->options,
-					boost::bind(&RequestHandler::sessionCheckedOut,
-						this, client, _1, _2));
-				if (!client->sessionCheckedOut) {
-					client->backgroundOperations++;
-				}
-			} else {
-				string message = "could not initiate a session (";
-				message.append(e2.what());
-				message.append(")");
-				disconnectWithError(client, message);
-			}
+			onSessionInitiateError(client, e2);
 			return;
 		}
-		
+
+		if (initiated) {
+			onSessionInitiated(client);
+		} else {
+			RH_DEBUG(client, "Connecting to application asynchronously");
+			client->timeoutTimer.start(appConnectTimeout / 1000.0, 0.0);
+			waitForSessionConnect(client);
+		}
+	}
+
+	void waitForSessionConnect(const ClientPtr &client) {
+		if (getSocketAddressType(client->session->getSocket()->address) == SAT_UNIX) {
+			/* A non-blocking connect to a Unix domain socket only fails with
+			 * EAGAIN if the backlog is full, and the socket won't report
+			 * writability when the backlog drains. So we poll instead.
+			 */
+			client->appConnectRetryTimer.start(APP_CONNECT_RETRY_INTERVAL, 0.0);
+		} else {
+			client->appOutputWatcher.set(libev->getLoop());
+			client->appOutputWatcher.set(client->session->fd(), ev::WRITE);
+			client->appOutputWatcher.start();
+		}
+	}
+
+	void continueInitiatingSession(const ClientPtr &client) {
+		bool initiated;
+		try {
+			initiated = client->session->continueInitiate();
+		} catch (const SystemException &e2) {
+			client->timeoutTimer.stop();
+			onSessionInitiateError(client, e2);
+			return;
+		}
+
+		if (initiated) {
+			client->timeoutTimer.stop();
+			onSessionInitiated(client);
+		} else {
+			waitForSessionConnect(client);
+		}
+	}
+
+	void onSessionInitiateError(const ClientPtr &client, const SystemException &e) {
+		if (client->sessionCheckoutTry < 10) {
+			RH_DEBUG(client, "Error checking out session (" << e.what() <<
+				"); retrying (attempt " << client->sessionCheckoutTry << ")");
+			client->sessionCheckedOut = false;
+			client->backgroundOperations++;
+			client->checkoutBeganAt = ev_time();
+			pool->asyncGet(client->options,
+				boost::bind(&RequestHandler::sessionCheckedOut,
+					this, client, _1, _2));
+		} else {
+			string message = "could not initiate a session (";
+			message.append(e.what());
+			message.append(")");
+			disconnectWithError(client, message);
+		}
+	}
+
+	void onSessionInitiated(const ClientPtr &client) {
 		if (client->useUnionStation()) {
 			client->endScopeLog(&client->scopeLogs.getFromPool);
 			client->logMessage("Application PID: " +
@@ -2065,6 +2931,7 @@ private:
 		}
 		
 		RH_DEBUG(client, "Session initiated: fd=" << client->session->fd());
+		client->sessionInitiatedAt = ev_time();
 		setNonBlocking(client->session->fd());
 		client->appInput->reset(libev.get(), client->session->fd());
 		client->appInput->start();
@@ -2073,6 +2940,25 @@ private:
 		sendHeaderToApp(client);
 	}
 
+	void state_checkingOutSession_onAppOutputWritable(const ClientPtr &client) {
+		RH_TRACE(client, 3, "Application socket became writable; continuing connect");
+		client->appOutputWatcher.stop();
+		continueInitiatingSession(client);
+	}
+
+	void state_checkingOutSession_onAppConnectRetry(const ClientPtr &client) {
+		RH_TRACE(client, 3, "Retrying connect to application");
+		continueInitiatingSession(client);
+	}
+
+	void state_checkingOutSession_onAppConnectTimeout(const ClientPtr &client) {
+		client->appOutputWatcher.stop();
+		client->appConnectRetryTimer.stop();
+		client->session->abortInitiate();
+		onSessionInitiateError(client, SystemException(
+			"Timeout connecting to the application", ETIMEDOUT));
+	}
+
 
 	/******* State: SENDING_HEADER_TO_APP *******/
 
@@ -2125,55 +3011,83 @@ private:
 			assert(client->session->getProtocol() == "http_session");
 			const ScgiRequestParser &parser = client->scgiParser;
 			ScgiRequestParser::const_iterator it, end = parser.end();
+			StaticString method = parser.getHeader("REQUEST_METHOD");
+			StaticString uri = parser.getHeader("REQUEST_URI");
+			StaticString contentLength = parser.getHeader("CONTENT_LENGTH");
+			StaticString contentType = parser.getHeader("CONTENT_TYPE");
+			StaticString connection, txnId;
+
+			client->appKeepAlive = client->session->connectionIsPersistent();
+			if (client->appKeepAlive) {
+				connection = "Connection: keep-alive\r\n";
+			} else {
+				connection = "Connection: close\r\n";
+			}
+			if (client->options.analytics) {
+				txnId = client->options.logger->getTxnId();
+			}
+
+			// Calculate the exact size first so that the header can be
+			// built in a single buffer.
+			size_t size = method.size() + 1 + uri.size()
+				+ sizeof(" HTTP/1.1\r\n") - 1
+				+ connection.size()
+				+ 2;
+			for (it = parser.begin(); it != end; it++) {
+				if (startsWith(it->first, "HTTP_")) {
+					size += it->first.size() - (sizeof("HTTP_") - 1) + 2
+						+ it->second.size() + 2;
+				}
+			}
+			if (!contentLength.empty()) {
+				size += sizeof("Content-Length: ") - 1 + contentLength.size() + 2;
+			}
+			if (!contentType.empty()) {
+				size += sizeof("Content-Type: ") - 1 + contentType.size() + 2;
+			}
+			if (!txnId.empty()) {
+				size += sizeof("Passenger-Txn-Id: ") - 1 + txnId.size() + 2;
+			}
+
 			string data;
+			data.resize(size);
+			char *pos = &data[0];
+			const char *bufEnd = pos + size;
 
-			data.reserve(parser.getHeaderData().size() + 128);
-			data.append(parser.getHeader("REQUEST_METHOD"));
-			data.append(" ");
-			data.append(parser.getHeader("REQUEST_URI"));
-			data.append(" HTTP/1.1\r\n");
-			data.append("Connection: close\r\n");
+			pos = appendData(pos, bufEnd, method);
+			pos = appendData(pos, bufEnd, " ");
+			pos = appendData(pos, bufEnd, uri);
+			pos = appendData(pos, bufEnd, " HTTP/1.1\r\n");
+			pos = appendData(pos, bufEnd, connection);
 
 			for (it = parser.begin(); it != end; it++) {
 				if (startsWith(it->first, "HTTP_")) {
-					string subheader = it->first.substr(sizeof("HTTP_") - 1);
-					string::size_type i;
-					for (i = 0; i < subheader.size(); i++) {
-						if (subheader[i] == '_') {
-							subheader[i] = '-';
-						} else if (i > 0 && subheader[i - 1] != '-') {
-							subheader[i] = tolower(subheader[i]);
-						}
-					}
-
-					data.append(subheader);
-					data.append(": ");
-					data.append(it->second);
-					data.append("\r\n");
+					pos = HttpHeaderNames::append(pos,
+						it->first.substr(sizeof("HTTP_") - 1));
+					pos = appendData(pos, bufEnd, ": ");
+					pos = appendData(pos, bufEnd, it->second);
+					pos = appendData(pos, bufEnd, "\r\n");
 				}
 			}
 
-			StaticString header = parser.getHeader("CONTENT_LENGTH");
-			if (!header.empty()) {
-				data.append("Content-Length: ");
-				data.append(header);
-				data.append("\r\n");
+			if (!contentLength.empty()) {
+				pos = appendData(pos, bufEnd, "Content-Length: ");
+				pos = appendData(pos, bufEnd, contentLength);
+				pos = appendData(pos, bufEnd, "\r\n");
 			}
-
-			header = parser.getHeader("CONTENT_TYPE");
-			if (!header.empty()) {
-				data.append("Content-Type: ");
-				data.append(header);
-				data.append("\r\n");
+			if (!contentType.empty()) {
+				pos = appendData(pos, bufEnd, "Content-Type: ");
+				pos = appendData(pos, bufEnd, contentType);
+				pos = appendData(pos, bufEnd, "\r\n");
 			}
-
-			if (client->options.analytics) {
-				data.append("Passenger-Txn-Id: ");
-				data.append(client->options.logger->getTxnId());
-				data.append("\r\n");
+			if (!txnId.empty()) {
+				pos = appendData(pos, bufEnd, "Passenger-Txn-Id: ");
+				pos = appendData(pos, bufEnd, txnId);
+				pos = appendData(pos, bufEnd, "\r\n");
 			}
 
-			data.append("\r\n");
+			pos = appendData(pos, bufEnd, "\r\n");
+			assert(pos == bufEnd);
 
 			StaticString datas[] = { data };
 			ssize_t ret = gatheredWrite(client->session->fd(), datas,
@@ -2213,6 +3127,13 @@ private:
 
 	/******* State: FORWARDING_BODY_TO_APP *******/
 
+	/** Unbuffered request bodies with at least this many bytes left are spliced. */
+	static const unsigned long long SPLICE_BODY_THRESHOLD = 1024 * 128;
+	/** Maximum number of bytes to move with a single splice() call. */
+	static const size_t SPLICE_CHUNK_SIZE = 1024 * 64;
+	/** Maximum number of client reads per event loop iteration. */
+	static const unsigned int SPLICE_MAX_ITERATIONS = 16;
+
 	void state_forwardingBodyToApp_verifyInvariants(const ClientPtr &client) const {
 		assert(client->state == Client::FORWARDING_BODY_TO_APP);
 	}
@@ -2283,6 +3204,10 @@ private:
 			if (client->contentLength >= 0 && client->clientBodyAlreadyRead == (unsigned long long) client->contentLength) {
 				client->clientInput->stop();
 				state_forwardingBodyToApp_onClientEof(client);
+			} else if ((size_t) ret == size && shouldSpliceBodyToApp(client)) {
+				// clientInput's buffer is empty now, so we can
+				// take over reading from the client socket.
+				beginSplicingBodyToApp(client);
 			}
 
 			return ret;
@@ -2295,6 +3220,7 @@ private:
 
 		RH_TRACE(client, 2, "End of (unbuffered) client body reached; done sending data to application");
 		client->clientInput->stop();
+		client->requestBodyForwarded = true;
 		if (client->session != NULL && client->shouldHalfCloseWrite()) {
 			syscalls::shutdown(client->session->fd(), SHUT_WR);
 		}
@@ -2305,7 +3231,9 @@ private:
 
 		RH_TRACE(client, 3, "Application socket became writable again.");
 		client->appOutputWatcher.stop();
-		if (client->requestBodyIsBuffered) {
+		if (client->splicingBody) {
+			spliceBodyToApp(client);
+		} else if (client->requestBodyIsBuffered) {
 			assert(!client->clientBodyBuffer->isStarted());
 			client->clientBodyBuffer->start();
 		} else {
@@ -2315,6 +3243,149 @@ private:
 	}
 
 
+	void state_forwardingBodyToApp_onClientSpliceReadable(const ClientPtr &client) {
+		state_forwardingBodyToApp_verifyInvariants(client);
+		assert(client->splicingBody);
+		spliceBodyToApp(client);
+	}
+
+	bool shouldSpliceBodyToApp(const ClientPtr &client) const {
+		#ifdef __linux__
+			return !client->requestBodyIsBuffered
+				&& client->contentLength >= 0
+				&& (unsigned long long) client->contentLength - client->clientBodyAlreadyRead
+					>= SPLICE_BODY_THRESHOLD;
+		#else
+			return false;
+		#endif
+	}
+
+	void beginSplicingBodyToApp(const ClientPtr &client) {
+		#ifdef __linux__
+			int fds[2];
+
+			if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) == -1) {
+				int e = errno;
+				RH_DEBUG(client, "Cannot create a pipe for splicing the request body: " <<
+					strerror(e) << " (errno=" << e << "); falling back to regular forwarding");
+				return;
+			}
+
+			RH_TRACE(client, 2, "Splicing the remaining " <<
+				(client->contentLength - client->clientBodyAlreadyRead) <<
+				" bytes of client body data to application");
+			client->bodySplicePipe = Pipe(FileDescriptor(fds[0]), FileDescriptor(fds[1]));
+			client->bodySplicePipeSize = 0;
+			client->splicingBody = true;
+			client->clientInput->stop();
+			client->clientSpliceWatcher.start();
+		#else
+			abort();
+		#endif
+	}
+
+	/**
+	 * Moves request body data from the client socket to the application socket
+	 * until either socket would block. We only read from the client while the
+	 * splice pipe is empty, so that data never gets stuck in the pipe while we're
+	 * waiting for the client.
+	 */
+	void spliceBodyToApp(const ClientPtr &client) {
+		#ifdef __linux__
+			unsigned int iterations = 0;
+
+			while (true) {
+				if (client->session == NULL) {
+					RH_TRACE(client, 2, "Application had already sent EOF. Stop reading client input.");
+					client->stopSplicingBody();
+					syscalls::shutdown(client->fd, SHUT_RD);
+					return;
+				}
+
+				if (client->bodySplicePipeSize > 0) {
+					ssize_t ret = splice(client->bodySplicePipe[0], NULL,
+						client->session->fd(), NULL,
+						client->bodySplicePipeSize,
+						SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+					if (ret == -1) {
+						int e = errno;
+						RH_TRACE(client, 3, "Could not splice to application socket: " << strerror(e) << " (errno=" << e << ")");
+						if (e == EAGAIN) {
+							RH_TRACE(client, 3, "Waiting until the application socket is writable again.");
+							client->clientSpliceWatcher.stop();
+							client->appOutputWatcher.start();
+						} else if (e == EPIPE || e == ECONNRESET) {
+							// Client will be disconnected after response forwarding is done.
+							client->stopSplicingBody();
+							syscalls::shutdown(client->fd, SHUT_RD);
+						} else {
+							disconnectWithAppSocketWriteError(client, e);
+						}
+						return;
+					}
+
+					client->bodySplicePipeSize -= ret;
+					client->clientBodyAlreadyRead += ret;
+					RH_TRACE(client, 3, "Managed to splice " << ret << " bytes; total=" <<
+						client->clientBodyAlreadyRead << ", content-length=" << client->contentLength);
+					assert(client->clientBodyAlreadyRead <= (unsigned long long) client->contentLength);
+					if (client->clientBodyAlreadyRead == (unsigned long long) client->contentLength) {
+						client->stopSplicingBody();
+						state_forwardingBodyToApp_onClientEof(client);
+						return;
+					}
+
+				} else if (iterations >= SPLICE_MAX_ITERATIONS) {
+					// Give other clients a chance. We'll continue in the
+					// next event loop iteration if the client is still readable.
+					client->clientSpliceWatcher.start();
+					return;
+
+				} else {
+					size_t size = std::min<unsigned long long>(SPLICE_CHUNK_SIZE,
+						(unsigned long long) client->contentLength - client->clientBodyAlreadyRead);
+					ssize_t ret = splice(client->fd, NULL,
+						client->bodySplicePipe[1], NULL,
+						size,
+						SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+					iterations++;
+					if (ret == -1) {
+						int e = errno;
+						if (e == EAGAIN) {
+							client->clientSpliceWatcher.start();
+						} else if (e == EINVAL) {
+							// The client socket does not support splicing, e.g.
+							// because the kernel is too old. Nothing has been
+							// read, so we can just go back to clientInput.
+							RH_DEBUG(client, "Cannot splice from client socket; falling back to regular forwarding");
+							client->stopSplicingBody();
+							client->clientInput->start();
+						} else if (e == ECONNRESET) {
+							RH_TRACE(client, 3, "Client socket ECONNRESET error; treating it as EOF");
+							client->stopSplicingBody();
+							state_forwardingBodyToApp_onClientEof(client);
+						} else {
+							stringstream message;
+							message << "client socket read error: ";
+							message << strerror(e);
+							message << " (errno=" << e << ")";
+							disconnectWithError(client, message.str());
+						}
+						return;
+					} else if (ret == 0) {
+						client->stopSplicingBody();
+						state_forwardingBodyToApp_onClientEof(client);
+						return;
+					}
+					client->bodySplicePipeSize += ret;
+				}
+			}
+		#else
+			abort();
+		#endif
+	}
+
+
 	void state_forwardingBodyToApp_onClientBodyBufferData(const ClientPtr &client,
 		const char *data, size_t size, const FileBackedPipe::ConsumeCallback &consumed)
 	{
@@ -2356,15 +3427,221 @@ private:
 		assert(client->requestBodyIsBuffered);
 
 		RH_TRACE(client, 2, "End of (buffered) client body reached; done sending data to application");
+		client->requestBodyForwarded = true;
 		if (client->session != NULL && client->shouldHalfCloseWrite()) {
 			syscalls::shutdown(client->session->fd(), SHUT_WR);
 		}
 	}
 
 
+	/******* Request rings *******/
+
+	/**
+	 * A web server may send the requests that follow the first one on a
+	 * keep-alive connection through its request ring instead of through the
+	 * connection. It announces this in the first request with a
+	 * PASSENGER_REQUEST_RING header of the form "<ring ID>:<token>", with the
+	 * ring ID in hexadecimal. Announcements of unknown rings are ignored.
+	 */
+	void registerRequestRingClient(const ClientPtr &client) {
+		ScgiRequestParser::const_iterator it =
+			client->scgiParser.getHeaderIterator("PASSENGER_REQUEST_RING");
+		if (it == client->scgiParser.end()) {
+			return;
+		}
+
+		StaticString value = it->second;
+		string::size_type pos = value.find(':');
+		unsigned long long key = 0;
+		if (pos != string::npos && pos > 0 && pos < value.size() - 1) {
+			key = requestRings->getClientKey(hexToULL(value.substr(0, pos)),
+				stringToUint(value.substr(pos + 1)));
+		}
+		if (key == 0) {
+			RH_DEBUG(client, "Ignoring announcement of unknown request ring " << value);
+			return;
+		}
+
+		map<unsigned long long, ClientPtr>::iterator cit = requestRingClients.find(key);
+		if (cit != requestRingClients.end()) {
+			// The web server has reused the token of a connection that
+			// it closed, but we haven't noticed that yet.
+			cit->second->requestRingKey = 0;
+			cit->second = client;
+		} else {
+			requestRingClients.insert(make_pair(key, client));
+		}
+		client->requestRingKey = key;
+		client->confirmRequestRing = true;
+		requestRings->addClient(key, this);
+		RH_TRACE(client, 2, "Registered as request ring client " << value);
+	}
+
+	void unregisterRequestRingClient(const ClientPtr &client) {
+		if (client->requestRingKey != 0) {
+			requestRingClients.erase(client->requestRingKey);
+			requestRings->removeClient(client->requestRingKey, this);
+			client->requestRingKey = 0;
+		}
+	}
+
+	void realAddRequestRing(unsigned long long id, unsigned int number,
+		const RequestRingPtr &ring, const FileDescriptor &lifetimeFd)
+	{
+		RequestRingConsumerPtr consumer = boost::make_shared<RequestRingConsumer>();
+		consumer->handler = this;
+		consumer->id = id;
+		consumer->number = number;
+		consumer->ring = ring;
+		consumer->lifetimeFd = lifetimeFd;
+		setNonBlocking(lifetimeFd);
+		consumer->notifyWatcher.set(libev->getLoop());
+		consumer->notifyWatcher.set(ring->getNotifyFd(), ev::READ);
+		consumer->notifyWatcher.set<RequestRingConsumer,
+			&RequestRingConsumer::onNotify>(consumer.get());
+		consumer->notifyWatcher.start();
+		consumer->lifetimeWatcher.set(libev->getLoop());
+		consumer->lifetimeWatcher.set(lifetimeFd, ev::READ);
+		consumer->lifetimeWatcher.set<RequestRingConsumer,
+			&RequestRingConsumer::onLifetimeReadable>(consumer.get());
+		consumer->lifetimeWatcher.start();
+		requestRingConsumers.insert(make_pair(number, consumer));
+		P_DEBUG("Request ring " << number << " added");
+
+		// Entries may have been pushed before we started watching.
+		onRequestRingNotify(consumer.get());
+	}
+
+	/**
+	 * Stops consuming a request ring. The web server may already have pushed
+	 * requests into it that will never be processed now, so the connections
+	 * behind its tokens are closed. That way the web server gets an error
+	 * instead of waiting for a response forever.
+	 */
+	void removeRequestRing(RequestRingConsumer *consumer) {
+		// Prevent the consumer from being destroyed until we're done.
+		RequestRingConsumerPtr reference = requestRingConsumers[consumer->number];
+		consumer->notifyWatcher.stop();
+		consumer->lifetimeWatcher.stop();
+		map<unsigned long long, RequestHandler *> clients =
+			requestRings->removeRing(consumer->id, consumer->number);
+		requestRingConsumers.erase(consumer->number);
+		P_DEBUG("Request ring " << consumer->number << " removed");
+
+		map<unsigned long long, RequestHandler *>::const_iterator it;
+		for (it = clients.begin(); it != clients.end(); it++) {
+			if (it->second == this) {
+				disconnectRequestRingClient(it->first);
+			} else {
+				it->second->libev->runLater(boost::bind(
+					&RequestHandler::disconnectRequestRingClient,
+					it->second, it->first));
+			}
+		}
+	}
+
+	void disconnectRequestRingClient(unsigned long long key) {
+		map<unsigned long long, ClientPtr>::iterator it = requestRingClients.find(key);
+		if (it != requestRingClients.end()) {
+			ClientPtr client = it->second;
+			disconnectWithWarning(client, "its request ring has been removed");
+		}
+	}
+
+	void realGetRequestRingCount(unsigned int *result) const {
+		*result = requestRingConsumers.size();
+	}
+
+	void onRequestRingNotify(RequestRingConsumer *consumer) {
+		RequestRingPtr ring = consumer->ring;
+		unsigned long long keyBase = (unsigned long long) consumer->number << 32;
+		unsigned int token;
+		string data;
+
+		try {
+			ring->clearNotification();
+			do {
+				while (ring->pop(token, data)) {
+					dispatchRequestRingEntry(keyBase | token, data);
+				}
+			} while (!ring->prepareToWait());
+		} catch (const IOException &e) {
+			P_WARN("Removing request ring " << consumer->number << ": " << e.what());
+			removeRequestRing(consumer);
+		}
+	}
+
+	void onRequestRingLifetimeReadable(RequestRingConsumer *consumer) {
+		// Prevent the consumer from being destroyed until we're done.
+		RequestRingConsumerPtr reference = requestRingConsumers[consumer->number];
+		char buf[64];
+		ssize_t ret = syscalls::read(consumer->lifetimeFd, buf, sizeof(buf));
+		if (ret == 0 || (ret == -1 && errno != EAGAIN)) {
+			// Pick up entries that were pushed right before the
+			// web server process exited; their connections are
+			// probably gone too, but that's for the clients to find out.
+			onRequestRingNotify(consumer);
+			if (requestRingConsumers.find(consumer->number) != requestRingConsumers.end()) {
+				removeRequestRing(consumer);
+			}
+		}
+	}
+
+	void dispatchRequestRingEntry(unsigned long long key, const string &data) {
+		RequestHandler *target = requestRings->lookupClient(key);
+		if (target == this) {
+			handleRequestRingEntry(key, data);
+		} else if (target != NULL) {
+			target->libev->runLater(boost::bind(&RequestHandler::handleRequestRingEntry,
+				target, key, data));
+		} else {
+			// The connection has been closed, which the web server
+			// notices when it reads the response.
+			P_DEBUG("Dropping request ring entry for unknown token " << (unsigned int) key);
+		}
+	}
+
+	void handleRequestRingEntry(unsigned long long key, const string &data) {
+		map<unsigned long long, ClientPtr>::iterator it = requestRingClients.find(key);
+		if (it == requestRingClients.end()) {
+			P_DEBUG("Dropping request ring entry for a connection that has been closed");
+			return;
+		}
+
+		ClientPtr client = it->second;
+		if (!client->pendingRingRequest.empty()) {
+			disconnectWithError(client, "received a request through the request ring "
+				"while another one was pending");
+		} else if (client->state == Client::BEGIN_READING_CONNECT_PASSWORD
+		        && client->waitingForNextRequest)
+		{
+			feedRequestRingEntry(client, data);
+		} else {
+			// The web server has read the entire response, but we
+			// haven't finished the request yet. readNextRequest() will
+			// pick it up.
+			RH_TRACE(client, 3, "Request ring entry arrived before the previous "
+				"request was finished; deferring it");
+			client->pendingRingRequest = data;
+		}
+	}
+
+	void feedRequestRingEntry(const ClientPtr &client, const StaticString &data) {
+		RH_TRACE(client, 3, "Processing " << data.size() << " bytes from the request ring");
+		if (!client->clientInput->feed(data)) {
+			disconnectWithError(client, "cannot process a request from the request ring "
+				"because the connection has unprocessed data");
+		}
+	}
+
+
 public:
 	// For unit testing purposes.
 	unsigned int connectPasswordTimeout; // milliseconds
+	unsigned int appConnectTimeout; // milliseconds
+
+	/** The maximum number of disconnected Clients to keep around for reuse. */
+	unsigned int maxFreeClients;
 
 	BenchmarkPoint benchmarkPoint;
 
@@ -2380,7 +3657,11 @@ public:
 		  benchmarkPoint(getDefaultBenchmarkPoint())
 	{
 		accept4Available = true;
+		acceptingStopped = false;
+		nextClientTarget = 0;
 		connectPasswordTimeout = 15000;
+		appConnectTimeout = 30000;
+		maxFreeClients = _options.clientFreelistSize;
 		loggerFactory = pool->loggerFactory;
 
 		requestSocketWatcher.set(_requestSocket, ev::READ);
@@ -2391,6 +3672,14 @@ public:
 		resumeSocketWatcherTimer.set<RequestHandler, &RequestHandler::onResumeSocketWatcher>(this);
 		resumeSocketWatcherTimer.set(_libev->getLoop());
 		resumeSocketWatcherTimer.set(3, 3);
+
+		recycleClientsTimer.set<RequestHandler, &RequestHandler::onRecycleClients>(this);
+		recycleClientsTimer.set(_libev->getLoop());
+		recycleClientsTimer.set(0, 0);
+
+		requestRings = boost::make_shared<RequestRingRegistry>();
+
+		initializeResponseFragments();
 	}
 
 	template<typename Stream>
@@ -2404,11 +3693,90 @@ public:
 		}
 	}
 
+	unsigned int getFreeClientCount() const {
+		return freeClients.size();
+	}
+
 	unsigned long long inactivityTime() const {
 		unsigned long long result;
 		libev->run(boost::bind(&RequestHandler::getInactivityTime, this, &result));
 		return result;
 	}
+
+	unsigned int getClientCount() const {
+		unsigned int result;
+		libev->run(boost::bind(&RequestHandler::realGetClientCount, this, &result));
+		return result;
+	}
+
+	/**
+	 * Stops accepting new connections on the request socket, and disconnects
+	 * idle keep-alive connections as well as keep-alive connections that
+	 * finish their current request. Connections that are still waiting in
+	 * the request socket's backlog are left alone, so that whoever inherits
+	 * the request socket (see the hot restart support in the helper agent)
+	 * can accept them. Requests that are in progress are allowed to finish.
+	 */
+	void stopAccepting() {
+		libev->run(boost::bind(&RequestHandler::realStopAccepting, this));
+	}
+
+	/**
+	 * Starts consuming requests from a request ring that a web server process
+	 * has registered. The web server process announces the ring to connections
+	 * with `id`. The ring is removed when the other end of `lifetimeFd` is
+	 * closed. Returns false if there already is a ring with that ID.
+	 *
+	 * @post getRequestRingRegistry() knows about the ring.
+	 */
+	bool addRequestRing(unsigned long long id, const RequestRingPtr &ring,
+		const FileDescriptor &lifetimeFd)
+	{
+		unsigned int number = requestRings->addRing(id);
+		if (number == 0) {
+			return false;
+		}
+		libev->run(boost::bind(&RequestHandler::realAddRequestRing, this,
+			id, number, ring, lifetimeFd));
+		return true;
+	}
+
+	unsigned int getRequestRingCount() const {
+		unsigned int result;
+		libev->run(boost::bind(&RequestHandler::realGetRequestRingCount, this, &result));
+		return result;
+	}
+
+	const RequestRingRegistryPtr &getRequestRingRegistry() const {
+		return requestRings;
+	}
+
+	/**
+	 * Makes this handler share the request ring registry of another handler.
+	 * Must be called before any request rings are added and before the event
+	 * loop is started.
+	 */
+	void setRequestRingRegistry(const RequestRingRegistryPtr &registry) {
+		requestRings = registry;
+	}
+
+	/**
+	 * Makes this handler the only one that accepts clients from the request
+	 * socket. Accepted clients are handed out round-robin over `handlers`,
+	 * which should include this handler, so that a new connection only
+	 * wakes up one event loop. The other handlers stop watching the request
+	 * socket. Must be called before any of the event loops are started.
+	 */
+	void distributeClients(const vector< boost::shared_ptr<RequestHandler> > &handlers) {
+		clientTargets.clear();
+		nextClientTarget = 0;
+		for (unsigned int i = 0; i < handlers.size(); i++) {
+			clientTargets.push_back(handlers[i].get());
+			if (handlers[i].get() != this) {
+				handlers[i]->requestSocketWatcher.stop();
+			}
+		}
+	}
 };
 
 
@@ -0,0 +1,178 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2013 Phusion
+ *
+ *  "Phusion Passenger" is a trademark of Hongli Lai & Ninh Bui.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_AGENT_HOT_RESTART_HANDOFF_H_
+#define _PASSENGER_AGENT_HOT_RESTART_HANDOFF_H_
+
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <FileDescriptor.h>
+#include <Exceptions.h>
+#include <Utils/IOUtils.h>
+#include <Utils/MessageIO.h>
+#include <Utils/StrIntUtils.h>
+
+namespace Passenger {
+
+using namespace std;
+
+
+/**
+ * The state that an agent hands over to its successor during a hot restart:
+ * a number of file descriptors plus a number of array messages that describe
+ * them. The meaning of the contents is up to the agent; the Watchdog merely
+ * relays a HotRestartHandoff from the exiting agent process to the new one.
+ *
+ * On the wire, over a Unix domain socket, it looks like this:
+ *
+ *   1. An array message: "hot restart handoff", number of file descriptors,
+ *      number of messages.
+ *   2. The file descriptors, each one passed with writeFileDescriptor().
+ *   3. The array messages.
+ *
+ * File descriptors are passed without negotiation: the receiver reads while
+ * the sender is writing, so the handoff does not have to fit in the socket
+ * buffer. The sender must not exit before the receiver has read everything,
+ * because file descriptors that are in flight when the sender exits may get
+ * lost. The receiver therefore confirms with acknowledge(), and the sender
+ * waits for that with waitForAcknowledgement().
+ */
+struct HotRestartHandoff {
+	vector<FileDescriptor> fds;
+	vector< vector<string> > messages;
+
+	bool empty() const {
+		return fds.empty() && messages.empty();
+	}
+
+	void clear() {
+		fds.clear();
+		messages.clear();
+	}
+
+	/**
+	 * Adds a file descriptor and returns its index in <tt>fds</tt>.
+	 */
+	unsigned int addFd(const FileDescriptor &fd) {
+		fds.push_back(fd);
+		return fds.size() - 1;
+	}
+
+	/**
+	 * @throws SystemException
+	 * @throws TimeoutException
+	 * @throws boost::thread_interrupted
+	 */
+	void writeTo(int fd, unsigned long long *timeout = NULL) const {
+		vector<string> header;
+		header.push_back("hot restart handoff");
+		header.push_back(toString(fds.size()));
+		header.push_back(toString(messages.size()));
+		writeArrayMessage(fd, header, timeout);
+
+		vector<FileDescriptor>::const_iterator fd_it;
+		for (fd_it = fds.begin(); fd_it != fds.end(); fd_it++) {
+			writeFileDescriptor(fd, *fd_it, timeout);
+		}
+
+		vector< vector<string> >::const_iterator msg_it;
+		for (msg_it = messages.begin(); msg_it != messages.end(); msg_it++) {
+			writeArrayMessage(fd, *msg_it, timeout);
+		}
+	}
+
+	/**
+	 * Reads a handoff written by writeTo(), replacing the current contents.
+	 * Returns false if end-of-file was reached before a complete handoff
+	 * could be read.
+	 *
+	 * @throws SystemException
+	 * @throws IOException The data is not a hot restart handoff.
+	 * @throws TimeoutException
+	 * @throws boost::thread_interrupted
+	 */
+	bool readFrom(int fd, unsigned long long *timeout = NULL) {
+		vector<string> header;
+		unsigned int i, fdCount, messageCount;
+
+		clear();
+		if (!readArrayMessage(fd, header, timeout)) {
+			return false;
+		}
+		if (header.size() != 3 || header[0] != "hot restart handoff") {
+			throw IOException("Hot restart handoff expected");
+		}
+		fdCount = atoi(header[1].c_str());
+		messageCount = atoi(header[2].c_str());
+
+		for (i = 0; i < fdCount; i++) {
+			fds.push_back(FileDescriptor(readFileDescriptor(fd, timeout)));
+		}
+		messages.resize(messageCount);
+		for (i = 0; i < messageCount; i++) {
+			if (!readArrayMessage(fd, messages[i], timeout)) {
+				clear();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * Tells the sender that the handoff has been read completely.
+	 *
+	 * @throws SystemException
+	 * @throws TimeoutException
+	 * @throws boost::thread_interrupted
+	 */
+	static void acknowledge(int fd, unsigned long long *timeout = NULL) {
+		writeArrayMessage(fd, timeout, "hot restart handoff received", NULL);
+	}
+
+	/**
+	 * Waits until the receiver has called acknowledge(). Returns false if
+	 * the receiver closed the connection instead.
+	 *
+	 * @throws SystemException
+	 * @throws IOException The receiver sent something unexpected.
+	 * @throws TimeoutException
+	 * @throws boost::thread_interrupted
+	 */
+	static bool waitForAcknowledgement(int fd, unsigned long long *timeout = NULL) {
+		vector<string> args;
+		if (!readArrayMessage(fd, args, timeout)) {
+			return false;
+		} else if (args.size() != 1 || args[0] != "hot restart handoff received") {
+			throw IOException("Hot restart handoff acknowledgement expected");
+		} else {
+			return true;
+		}
+	}
+};
+
+
+} // namespace Passenger
+
+#endif /* _PASSENGER_AGENT_HOT_RESTART_HANDOFF_H_ */
@@ -33,6 +33,8 @@
 
 #include <string>
 #include <set>
+#include <list>
+#include <vector>
 #ifndef _PCREPOSIX_H
 	#include <regex.h>
 #endif
@@ -486,15 +488,22 @@ public:
 		GC_TIME
 	};
 	
+	typedef StaticString (Context::*StringGetter)() const;
+	typedef int (Context::*IntGetter)() const;
+	
 	virtual ~Context() { }
 	
-	virtual string getURI() const = 0;
-	virtual string getController() const = 0;
+	/* The strings returned by these methods must stay valid for as long as
+	 * the Context is alive, and must be followed by a null terminator so that
+	 * they can be passed to regexec() without copying.
+	 */
+	virtual StaticString getURI() const = 0;
+	virtual StaticString getController() const = 0;
 	virtual int getResponseTime() const = 0;
-	virtual string getStatus() const = 0;
+	virtual StaticString getStatus() const = 0;
 	virtual int getStatusCode() const = 0;
 	virtual int getGcTime() const = 0;
-	virtual bool hasHint(const string &name) const = 0;
+	virtual bool hasHint(const StaticString &name) const = 0;
 	
 	int getResponseTimeWithoutGc() const {
 		return getResponseTime() - getGcTime();
@@ -521,6 +530,36 @@ public:
 		}
 	}
 	
+	/** Returns the getter for the given string field, or NULL if it's not a string field. */
+	static StringGetter getStringGetter(FieldIdentifier id) {
+		switch (id) {
+		case URI:
+			return &Context::getURI;
+		case CONTROLLER:
+			return &Context::getController;
+		case STATUS:
+			return &Context::getStatus;
+		default:
+			return NULL;
+		}
+	}
+	
+	/** Returns the getter for the given integer field, or NULL if it's not an integer field. */
+	static IntGetter getIntGetter(FieldIdentifier id) {
+		switch (id) {
+		case RESPONSE_TIME:
+			return &Context::getResponseTime;
+		case RESPONSE_TIME_WITHOUT_GC:
+			return &Context::getResponseTimeWithoutGc;
+		case STATUS_CODE:
+			return &Context::getStatusCode;
+		case GC_TIME:
+			return &Context::getGcTime;
+		default:
+			return NULL;
+		}
+	}
+	
 	int queryIntField(FieldIdentifier id) const {
 		switch (id) {
 		case RESPONSE_TIME:
@@ -590,20 +629,20 @@ public:
 		gcTime = 0;
 	}
 	
-	virtual string getURI() const {
-		return uri;
+	virtual StaticString getURI() const {
+		return StaticString(uri.c_str(), uri.size());
 	}
 	
-	virtual string getController() const {
-		return controller;
+	virtual StaticString getController() const {
+		return StaticString(controller.c_str(), controller.size());
 	}
 	
 	virtual int getResponseTime() const {
 		return responseTime;
 	}
 	
-	virtual string getStatus() const {
-		return status;
+	virtual StaticString getStatus() const {
+		return StaticString(status.c_str(), status.size());
 	}
 	
 	virtual int getStatusCode() const {
@@ -614,68 +653,125 @@ public:
 		return gcTime;
 	}
 	
-	virtual bool hasHint(const string &name) const {
-		return hints.find(name) != hints.end();
+	virtual bool hasHint(const StaticString &name) const {
+		// There are usually very few hints, so scanning them is cheaper
+		// than creating a temporary string for a set lookup.
+		set<string>::const_iterator it, end = hints.end();
+		for (it = hints.begin(); it != end; it++) {
+			if (name == *it) {
+				return true;
+			}
+		}
+		return false;
 	}
 };
 
-class ContextFromLog: public Context {
+/**
+ * A Context that is built up one log entry at a time, as the entries of a
+ * transaction come in. It extracts the same information as ContextFromLog,
+ * but evaluating a filter against it doesn't require reparsing the log.
+ */
+class ContextFromLogEntries: public SimpleContext {
 private:
-	StaticString logData;
-	mutable SimpleContext *parsedData;
-	
-	struct ParseState {
-		unsigned long long requestProcessingStart;
-		unsigned long long requestProcessingEnd;
-		unsigned long long smallestTimestamp;
-		unsigned long long largestTimestamp;
-		unsigned long long gcTimeStart;
-		unsigned long long gcTimeEnd;
-	};
+	unsigned long long requestProcessingStart;
+	unsigned long long requestProcessingEnd;
+	unsigned long long smallestTimestamp;
+	unsigned long long largestTimestamp;
+	unsigned long long gcTimeStart;
+	unsigned long long gcTimeEnd;
 	
-	static void parseLine(const StaticString &txnId, unsigned long long timestamp,
-		const StaticString &data, SimpleContext &ctx, ParseState &state)
-	{
+	static unsigned long long extractEventTimestamp(const StaticString &data) {
+		size_t pos = data.find('(');
+		if (pos == string::npos) {
+			return 0;
+		} else {
+			pos++;
+			size_t start = pos;
+			while (pos < data.size() && isDigit(data[pos])) {
+				pos++;
+			}
+			if (pos >= data.size()) {
+				return 0;
+			} else {
+				return hexatriToULL(data.substr(start, pos - start));
+			}
+		}
+	}
+	
+	static bool isDigit(char ch) {
+		return ch >= '0' && ch <= '9';
+	}
+	
+public:
+	ContextFromLogEntries() {
+		requestProcessingStart = 0;
+		requestProcessingEnd = 0;
+		smallestTimestamp = 0;
+		largestTimestamp = 0;
+		gcTimeStart = 0;
+		gcTimeEnd = 0;
+	}
+	
+	/**
+	 * Processes a single log entry.
+	 *
+	 * @param timestamp The entry's timestamp.
+	 * @param data The entry's data, i.e. without the transaction ID,
+	 *             timestamp and write count.
+	 */
+	void addEntry(unsigned long long timestamp, const StaticString &data) {
 		if (startsWith(data, "BEGIN: request processing")) {
-			state.requestProcessingStart = extractEventTimestamp(data);
+			requestProcessingStart = extractEventTimestamp(data);
 		} else if (startsWith(data, "END: request processing")
 		        || startsWith(data, "FAIL: request processing")) {
-			state.requestProcessingEnd = extractEventTimestamp(data);
+			requestProcessingEnd = extractEventTimestamp(data);
 		} else if (startsWith(data, "URI: ")) {
-			ctx.uri = data.substr(data.find(':') + 2);
+			uri = data.substr(data.find(':') + 2);
 		} else if (startsWith(data, "Controller action: ")) {
 			StaticString value = data.substr(data.find(':') + 2);
 			size_t pos = value.find('#');
 			if (pos != string::npos) {
-				ctx.controller = value.substr(0, pos);
+				controller = value.substr(0, pos);
 			}
 		} else if (startsWith(data, "Status: ")) {
 			StaticString value = data.substr(data.find(':') + 2);
-			ctx.status = value;
-			ctx.statusCode = stringToInt(value);
+			status = value;
+			statusCode = stringToInt(value);
 		} else if (startsWith(data, "Initial GC time: ")) {
 			StaticString value = data.substr(data.find(':') + 2);
-			state.gcTimeStart = stringToULL(value);
+			gcTimeStart = stringToULL(value);
 		} else if (startsWith(data, "Final GC time: ")) {
 			StaticString value = data.substr(data.find(':') + 2);
-			state.gcTimeEnd = stringToULL(value);
+			gcTimeEnd = stringToULL(value);
+		}
+		
+		if (smallestTimestamp == 0 || timestamp < smallestTimestamp) {
+			smallestTimestamp = timestamp;
+		}
+		if (timestamp > largestTimestamp) {
+			largestTimestamp = timestamp;
 		}
 		
-		if (state.smallestTimestamp == 0 || timestamp < state.smallestTimestamp) {
-			state.smallestTimestamp = timestamp;
+		if (requestProcessingEnd != 0) {
+			responseTime = int(requestProcessingEnd - requestProcessingStart);
+		} else if (smallestTimestamp != 0) {
+			responseTime = largestTimestamp - smallestTimestamp;
 		}
-		if (timestamp > state.largestTimestamp) {
-			state.largestTimestamp = timestamp;
+		if (gcTimeEnd != 0) {
+			gcTime = gcTimeEnd - gcTimeStart;
 		}
 	}
+};
+
+class ContextFromLog: public Context {
+private:
+	StaticString logData;
+	mutable ContextFromLogEntries *parsedData;
 	
-	static void reallyParse(const StaticString &data, SimpleContext &ctx) {
+	static void reallyParse(const StaticString &data, ContextFromLogEntries &ctx) {
 		const char *current = data.data();
 		const char *end     = data.data() + data.size();
 		
-		ParseState state;
-		memset(&state, 0, sizeof(state));
-		
 		while (current < end) {
 			current = skipNewlines(current, end);
 			if (current < end) {
@@ -691,24 +787,12 @@ private:
 					// the lines but for the purposes of ContextFromLog
 					// analyzing the data without sorting is good enough.
 					if (splitLine(line, txnId, timestamp, writeCount, lineData)) {
-						parseLine(txnId, timestamp, lineData, ctx,
-						state);
+						ctx.addEntry(timestamp, lineData);
 					}
 				}
 				current = endOfLine;
 			}
 		}
-		
-		if (state.requestProcessingEnd != 0) {
-			ctx.responseTime = int(state.requestProcessingEnd -
-				state.requestProcessingStart);
-		} else if (state.smallestTimestamp != 0) {
-			ctx.responseTime = state.largestTimestamp - state.smallestTimestamp;
-		}
-		
-		if (state.gcTimeEnd != 0) {
-			ctx.gcTime = state.gcTimeEnd - state.gcTimeStart;
-		}
 	}
 	
 	static bool splitLine(const StaticString &line, StaticString &txnId,
@@ -738,32 +822,10 @@ private:
 		return true;
 	}
 	
-	static unsigned long long extractEventTimestamp(const StaticString &data) {
-		size_t pos = data.find('(');
-		if (pos == string::npos) {
-			return 0;
-		} else {
-			pos++;
-			size_t start = pos;
-			while (pos < data.size() && isDigit(data[pos])) {
-				pos++;
-			}
-			if (pos >= data.size()) {
-				return 0;
-			} else {
-				return hexatriToULL(data.substr(start, pos - start));
-			}
-		}
-	}
-	
 	static bool isNewline(char ch) {
 		return ch == '\n' || ch == '\r';
 	}
 	
-	static bool isDigit(char ch) {
-		return ch >= '0' && ch <= '9';
-	}
-	
 	static const char *skipNewlines(const char *current, const char *end) {
 		while (current < end && isNewline(*current)) {
 			current++;
@@ -778,9 +840,9 @@ private:
 		return current;
 	}
 	
-	SimpleContext *parse() const {
+	ContextFromLogEntries *parse() const {
 		if (parsedData == NULL) {
-			auto_ptr<SimpleContext> ctx(new SimpleContext());
+			auto_ptr<ContextFromLogEntries> ctx(new ContextFromLogEntries());
 			reallyParse(logData, *ctx.get());
 			parsedData = ctx.release();
 		}
@@ -797,11 +859,11 @@ public:
 		delete parsedData;
 	}
 	
-	virtual string getURI() const {
-		return parse()->uri;
+	virtual StaticString getURI() const {
+		return parse()->getURI();
 	}
 	
-	virtual string getController() const {
+	virtual StaticString getController() const {
 		return parse()->getController();
 	}
 	
@@ -809,7 +871,7 @@ public:
 		return parse()->getResponseTime();
 	}
 	
-	virtual string getStatus() const {
+	virtual StaticString getStatus() const {
 		return parse()->getStatus();
 	}
 	
@@ -821,7 +883,7 @@ public:
 		return parse()->getGcTime();
 	}
 	
-	virtual bool hasHint(const string &name) const {
+	virtual bool hasHint(const StaticString &name) const {
 		return parse()->hasHint(name);
 	}
 };
@@ -836,6 +898,7 @@ private:
 	struct MultiExpression;
 	struct Comparison;
 	struct FunctionCall;
+	struct Program;
 	typedef boost::shared_ptr<BooleanComponent> BooleanComponentPtr;
 	typedef boost::shared_ptr<MultiExpression> MultiExpressionPtr;
 	typedef boost::shared_ptr<Comparison> ComparisonPtr;
@@ -844,6 +907,8 @@ private:
 	struct BooleanComponent {
 		virtual ~BooleanComponent() { }
 		virtual bool evaluate(const Context &ctx) = 0;
+		/** Appends instructions to the program that evaluate this component. */
+		virtual void compile(Program &program) const = 0;
 	};
 	
 	enum LogicalOperator {
@@ -891,6 +956,8 @@ private:
 			
 			return result;
 		}
+		
+		virtual void compile(Program &program) const;
 	};
 	
 	struct Negation: public BooleanComponent {
@@ -903,6 +970,138 @@ private:
 		virtual bool evaluate(const Context &ctx) {
 			return !expr->evaluate(ctx);
 		}
+		
+		virtual void compile(Program &program) const;
+	};
+	
+	/**
+	 * An operand of a compiled instruction. Context fields are resolved to
+	 * getter methods at compile time, and literals are converted to every
+	 * type that they may be used as, so evaluating an operand never
+	 * allocates memory.
+	 */
+	struct Operand {
+		Context::StringGetter stringGetter;
+		Context::IntGetter intGetter;
+		StaticString stringValue;
+		int intValue;
+		bool boolValue;
+		/** Only set for regular expression literals. */
+		const regex_t *regexp;
+		
+		Operand()
+			: stringGetter(NULL),
+			  intGetter(NULL),
+			  intValue(0),
+			  boolValue(false),
+			  regexp(NULL)
+			{ }
+		
+		/**
+		 * Returns the value as a null terminated string. <em>buf</em> is
+		 * used for converting integer fields to strings.
+		 */
+		StaticString getString(const Context &ctx, char *buf, unsigned int bufsize) const {
+			if (stringGetter != NULL) {
+				return (ctx.*stringGetter)();
+			} else if (intGetter != NULL) {
+				int size = snprintf(buf, bufsize, "%d", (ctx.*intGetter)());
+				return StaticString(buf, size);
+			} else {
+				return stringValue;
+			}
+		}
+		
+		int getInt(const Context &ctx) const {
+			if (intGetter != NULL) {
+				return (ctx.*intGetter)();
+			} else {
+				// String fields have the integer value 0.
+				return intValue;
+			}
+		}
+		
+		bool getBool(const Context &ctx) const {
+			if (stringGetter != NULL) {
+				return !(ctx.*stringGetter)().empty();
+			} else if (intGetter != NULL) {
+				return (ctx.*intGetter)() > 0;
+			} else {
+				return boolValue;
+			}
+		}
+	};
+	
+	enum Opcode {
+		/** result = subject */
+		OP_CONSTANT,
+		/** result = subject as boolean */
+		OP_BOOLEAN_VALUE,
+		/** result = subject =~ object, inverted if 'negate' */
+		OP_STRING_MATCHES,
+		/** result = subject == object, inverted if 'negate' */
+		OP_STRING_EQUALS,
+		/** result = subject <comparator> object */
+		OP_INTEGER_COMPARE,
+		/** result = subject == object, inverted if 'negate' */
+		OP_BOOLEAN_EQUALS,
+		/** result = starts_with(subject, object) */
+		OP_STARTS_WITH,
+		/** result = has_hint(subject) */
+		OP_HAS_HINT,
+		/** result = !result */
+		OP_NOT,
+		/** Continue at 'target' if !result. */
+		OP_JUMP_IF_FALSE,
+		/** Continue at 'target' if result. */
+		OP_JUMP_IF_TRUE
+	};
+	
+	struct Instruction {
+		Opcode opcode;
+		Comparator comparator;
+		bool negate;
+		unsigned int target;
+		Operand subject;
+		Operand object;
+		
+		Instruction(Opcode _opcode = OP_CONSTANT)
+			: opcode(_opcode),
+			  comparator(UNKNOWN_COMPARATOR),
+			  negate(false),
+			  target(0)
+			{ }
+	};
+	
+	/**
+	 * A filter compiled into a flat list of instructions, which operate on
+	 * a single boolean result register. Logical operators are compiled into
+	 * conditional jumps.
+	 */
+	struct Program {
+		vector<Instruction> instructions;
+		/** Strings that integer literals have been converted into. Shared
+		 * between copies of the Filter because operands point to them.
+		 */
+		boost::shared_ptr< list<string> > strings;
+		
+		Program()
+			: strings(boost::make_shared< list<string> >())
+			{ }
+		
+		unsigned int add(const Instruction &instruction) {
+			instructions.push_back(instruction);
+			return instructions.size() - 1;
+		}
+		
+		unsigned int size() const {
+			return instructions.size();
+		}
+		
+		StaticString store(const string &str) {
+			strings->push_back(str);
+			return strings->back();
+		}
 	};
 	
 	struct Value {
@@ -1045,6 +1244,12 @@ private:
 			}
 		}
 		
+		/**
+		 * Converts this value into an operand for a compiled instruction.
+		 * Strings that the operand refers to are stored in the program.
+		 */
+		Operand toOperand(Program &program) const;
+		
 		ValueType getType() const {
 			switch (source) {
 			case REGEXP_LITERAL:
@@ -1121,6 +1326,8 @@ private:
 		virtual bool evaluate(const Context &ctx) {
 			return val.getBooleanValue(ctx);
 		}
+		
+		virtual void compile(Program &program) const;
 	};
 	
 	struct Comparison: public BooleanComponent {
@@ -1141,6 +1348,8 @@ private:
 				return false;
 			}
 		}
+		
+		virtual void compile(Program &program) const;
 	
 	private:
 		bool compareStringOrRegexp(const string &str, const Context &ctx) {
@@ -1206,6 +1415,8 @@ private:
 				arguments[1].getStringValue(ctx));
 		}
 		
+		virtual void compile(Program &program) const;
+		
 		virtual void checkArguments() const {
 			if (arguments.size() != 2) {
 				throw SyntaxError("you passed " + toString(arguments.size()) + 
@@ -1219,6 +1430,8 @@ private:
 			return ctx.hasHint(arguments[0].getStringValue(ctx));
 		}
 		
+		virtual void compile(Program &program) const;
+		
 		virtual void checkArguments() const {
 			if (arguments.size() != 1) {
 				throw SyntaxError("you passed " + toString(arguments.size()) + 
@@ -1229,9 +1442,30 @@ private:
 	
 	Tokenizer tokenizer;
 	BooleanComponentPtr root;
+	Program program;
 	Token lookahead;
 	bool debug;
 	
+	static bool compareIntegers(Comparator comparator, int value, int value2) {
+		switch (comparator) {
+		case EQUALS:
+			return value == value2;
+		case NOT_EQUALS:
+			return value != value2;
+		case GREATER_THAN:
+			return value > value2;
+		case GREATER_THAN_OR_EQUALS:
+			return value >= value2;
+		case LESS_THAN:
+			return value < value2;
+		case LESS_THAN_OR_EQUALS:
+			return value <= value2;
+		default:
+			// error
+			return false;
+		}
+	}
+	
 	static bool isLiteralToken(const Token &token) {
 		return token.type == Tokenizer::REGEXP
 			|| token.type == Tokenizer::STRING
@@ -1579,14 +1813,215 @@ public:
 		root = matchMultiExpression(0);
 		logMatch(0, "end of data");
 		match(Tokenizer::END_OF_DATA);
+		root->compile(program);
 	}
 	
 	bool run(const Context &ctx) {
+		const Instruction *instructions = &program.instructions[0];
+		unsigned int size = program.instructions.size();
+		unsigned int pc = 0;
+		bool result = false;
+		char buf[32], buf2[32];
+		
+		while (pc < size) {
+			const Instruction &instruction = instructions[pc];
+			pc++;
+			switch (instruction.opcode) {
+			case OP_CONSTANT:
+				result = instruction.subject.boolValue;
+				break;
+			case OP_BOOLEAN_VALUE:
+				result = instruction.subject.getBool(ctx);
+				break;
+			case OP_STRING_MATCHES:
+				result = (regexec(instruction.object.regexp,
+					instruction.subject.getString(ctx, buf, sizeof(buf)).data(),
+					0, NULL, 0) == 0) != instruction.negate;
+				break;
+			case OP_STRING_EQUALS:
+				result = (instruction.subject.getString(ctx, buf, sizeof(buf))
+					== instruction.object.getString(ctx, buf2, sizeof(buf2)))
+					!= instruction.negate;
+				break;
+			case OP_INTEGER_COMPARE:
+				result = compareIntegers(instruction.comparator,
+					instruction.subject.getInt(ctx),
+					instruction.object.getInt(ctx));
+				break;
+			case OP_BOOLEAN_EQUALS:
+				result = (instruction.subject.getBool(ctx)
+					== instruction.object.getBool(ctx))
+					!= instruction.negate;
+				break;
+			case OP_STARTS_WITH:
+				result = startsWith(instruction.subject.getString(ctx, buf, sizeof(buf)),
+					instruction.object.getString(ctx, buf2, sizeof(buf2)));
+				break;
+			case OP_HAS_HINT:
+				result = ctx.hasHint(instruction.subject.getString(ctx, buf, sizeof(buf)));
+				break;
+			case OP_NOT:
+				result = !result;
+				break;
+			case OP_JUMP_IF_FALSE:
+				if (!result) {
+					pc = instruction.target;
+				}
+				break;
+			case OP_JUMP_IF_TRUE:
+				if (result) {
+					pc = instruction.target;
+				}
+				break;
+			}
+		}
+		return result;
+	}
+	
+	/**
+	 * Evaluates the filter by walking the syntax tree instead of running the
+	 * compiled program. This is a lot slower; it's used by the unit tests and
+	 * benchmarks to verify the compiled program.
+	 */
+	bool runOnSyntaxTree(const Context &ctx) {
 		return root->evaluate(ctx);
 	}
 };
 
 
+inline void
+Filter::MultiExpression::compile(Program &program) const {
+	vector<unsigned int> exitJumps;
+	
+	// Mirrors evaluate(): an AND whose result is false ends the whole
+	// expression, while an OR merely skips its right hand side if the
+	// result so far is true.
+	firstExpression->compile(program);
+	for (unsigned int i = 0; i < rest.size(); i++) {
+		const Part &part = rest[i];
+		if (part.theOperator == AND) {
+			exitJumps.push_back(program.add(Instruction(OP_JUMP_IF_FALSE)));
+			part.expression->compile(program);
+			if (i + 1 < rest.size() && rest[i + 1].theOperator == OR) {
+				exitJumps.push_back(program.add(Instruction(OP_JUMP_IF_FALSE)));
+			}
+		} else {
+			unsigned int jump = program.add(Instruction(OP_JUMP_IF_TRUE));
+			part.expression->compile(program);
+			program.instructions[jump].target = program.size();
+		}
+	}
+	for (unsigned int i = 0; i < exitJumps.size(); i++) {
+		program.instructions[exitJumps[i]].target = program.size();
+	}
+}
+
+inline void
+Filter::Negation::compile(Program &program) const {
+	expr->compile(program);
+	program.add(Instruction(OP_NOT));
+}
+
+inline Filter::Operand
+Filter::Value::toOperand(Program &program) const {
+	Operand operand;
+	switch (source) {
+	case REGEXP_LITERAL:
+		operand.stringValue = StaticString(storedString().c_str(), storedString().size());
+		operand.intValue = 0;
+		operand.boolValue = true;
+		operand.regexp = &storedRegexp();
+		break;
+	case STRING_LITERAL:
+		operand.stringValue = StaticString(storedString().c_str(), storedString().size());
+		operand.intValue = atoi(storedString());
+		operand.boolValue = !storedString().empty();
+		break;
+	case INTEGER_LITERAL:
+		operand.stringValue = program.store(toString(u.intValue));
+		operand.intValue = u.intValue;
+		operand.boolValue = (bool) u.intValue;
+		break;
+	case BOOLEAN_LITERAL:
+		operand.stringValue = u.boolValue ? "true" : "false";
+		operand.intValue = (int) u.boolValue;
+		operand.boolValue = u.boolValue;
+		break;
+	case CONTEXT_FIELD_IDENTIFIER:
+		operand.stringGetter = Context::getStringGetter(u.contextFieldIdentifier);
+		operand.intGetter = Context::getIntGetter(u.contextFieldIdentifier);
+		break;
+	}
+	return operand;
+}
+
+inline void
+Filter::SingleValueComponent::compile(Program &program) const {
+	Instruction instruction(OP_BOOLEAN_VALUE);
+	instruction.subject = val.toOperand(program);
+	program.add(instruction);
+}
+
+inline void
+Filter::Comparison::compile(Program &program) const {
+	Instruction instruction;
+	instruction.comparator = comparator;
+	instruction.subject = subject.toOperand(program);
+	instruction.object = object.toOperand(program);
+	
+	switch (subject.getType()) {
+	case STRING_TYPE:
+		if (comparator == MATCHES || comparator == NOT_MATCHES) {
+			instruction.opcode = OP_STRING_MATCHES;
+			instruction.negate = comparator == NOT_MATCHES;
+		} else if (comparator == EQUALS || comparator == NOT_EQUALS) {
+			instruction.opcode = OP_STRING_EQUALS;
+			instruction.negate = comparator == NOT_EQUALS;
+		} else {
+			// error
+			instruction.opcode = OP_CONSTANT;
+			instruction.subject.boolValue = false;
+		}
+		break;
+	case INTEGER_TYPE:
+		instruction.opcode = OP_INTEGER_COMPARE;
+		break;
+	case BOOLEAN_TYPE:
+		if (comparator == EQUALS || comparator == NOT_EQUALS) {
+			instruction.opcode = OP_BOOLEAN_EQUALS;
+			instruction.negate = comparator == NOT_EQUALS;
+		} else {
+			// error
+			instruction.opcode = OP_CONSTANT;
+			instruction.subject.boolValue = false;
+		}
+		break;
+	default:
+		// error
+		instruction.opcode = OP_CONSTANT;
+		instruction.subject.boolValue = false;
+		break;
+	}
+	
+	program.add(instruction);
+}
+
+inline void
+Filter::StartsWithFunctionCall::compile(Program &program) const {
+	Instruction instruction(OP_STARTS_WITH);
+	instruction.subject = arguments[0].toOperand(program);
+	instruction.object = arguments[1].toOperand(program);
+	program.add(instruction);
+}
+
+inline void
+Filter::HasHintFunctionCall::compile(Program &program) const {
+	Instruction instruction(OP_HAS_HINT);
+	instruction.subject = arguments[0].toOperand(program);
+	program.add(instruction);
+}
+
+
 } // namespace FilterSupport
 } // namespace Passenger
 
@@ -291,6 +291,8 @@ private:
 		bool crashProtect, discarded;
 		string data;
 		string filters;
+		/** Only maintained if 'filters' is non-empty. */
+		FilterSupport::ContextFromLogEntries filterContext;
 		
 		Transaction(LoggingServer *server, ev_tstamp createdAt) {
 			this->server = server;
@@ -342,7 +344,6 @@ private:
 			const char *current = filters.data();
 			const char *end     = filters.data() + filters.size();
 			bool result         = true;
-			FilterSupport::ContextFromLog ctx(data);
 			
 			// 'filters' may contain multiple filter sources, separated
 			// by '\1' characters. Process each.
@@ -355,7 +356,7 @@ private:
 				
 				StaticString source(current, pos);
 				FilterSupport::Filter &filter = server->compileFilter(source);
-				result = filter.run(ctx);
+				result = filter.run(filterContext);
 				
 				current = tmp.data() + pos + 1;
 			}
@@ -663,6 +664,9 @@ private:
 		transaction->data.append(" ");
 		transaction->data.append(data);
 		transaction->data.append("\n");
+		if (!transaction->filters.empty()) {
+			transaction->filterContext.addEntry(hexatriToULL(timestamp), data);
+		}
 		return true;
 	}
 	
@@ -35,16 +35,33 @@ private:
 		try {
 			pid_t pid, ret;
 			int status, e;
+			FileDescriptor currentFeedbackFd;
+			bool handedOver;
 			
 			while (!this_thread::interruption_requested()) {
 				{
 					boost::lock_guard<boost::mutex> l(lock);
 					pid = this->pid;
+					currentFeedbackFd = feedbackFd;
 				}
 				
 				// Process can be started before the watcher thread is launched.
 				if (pid == 0) {
 					pid = start();
+					boost::lock_guard<boost::mutex> l(lock);
+					currentFeedbackFd = feedbackFd;
+				}
+				
+				/* After startup, an agent only writes to its feedback fd in order
+				 * to hand over its state during a hot restart. It then waits for
+				 * us to receive that before exiting. Otherwise the feedback fd
+				 * becomes readable when the agent exits.
+				 */
+				waitUntilReadable(currentFeedbackFd);
+				{
+					this_thread::disable_interruption di;
+					this_thread::disable_syscall_interruption dsi;
+					handedOver = receiveHotRestartHandoff(pid, currentFeedbackFd);
 				}
 				ret = syscalls::waitpid(pid, &status, 0);
 				if (ret == -1 && errno == ECHILD) {
@@ -71,6 +88,16 @@ private:
 				
 				this_thread::disable_interruption di;
 				this_thread::disable_syscall_interruption dsi;
+				if (handedOver && ret != -1 && WIFEXITED(status)
+				 && WEXITSTATUS(status) == HELPER_AGENT_HOT_RESTART_EXIT_CODE)
+				{
+					P_INFO(name() << " (pid=" << pid << ") exited in order to be "
+						"hot restarted, restarting it...");
+					continue;
+				} else if (handedOver) {
+					discardHotRestartHandoff();
+				}
+				
 				if (ret == -1) {
 					P_WARN(name() << " (pid=" << pid << ") crashed or killed for "
 						"an unknown reason (errno = " <<
@@ -172,6 +199,45 @@ protected:
 	 */
 	virtual bool processStartupInfo(pid_t pid, FileDescriptor &fd, const vector<string> &args) = 0;
 	
+	/**
+	 * Called when the agent process's feedback fd has become readable after
+	 * startup. That either means that the agent has exited, or that it is
+	 * writing a HotRestartHandoff for its successor, after which it exits
+	 * with exit code HELPER_AGENT_HOT_RESTART_EXIT_CODE. In the latter case,
+	 * this method should read and store the handoff, acknowledge it, and
+	 * return true. It is called while the agent is still alive, so that the
+	 * agent doesn't have to fit the entire handoff in the socket buffer.
+	 * May not throw exceptions.
+	 */
+	virtual bool receiveHotRestartHandoff(pid_t pid, FileDescriptor &fd) {
+		return false;
+	}
+	
+	/**
+	 * Called when the agent process exited in some other way than a hot
+	 * restart, after receiveHotRestartHandoff() returned true. Should discard
+	 * the stored handoff, so that the restart behaves like a crash recovery.
+	 */
+	virtual void discardHotRestartHandoff() { }
+	
+	/**
+	 * Waits until the given file descriptor is readable, has reached EOF or
+	 * has encountered an error.
+	 *
+	 * @throws boost::thread_interrupted
+	 */
+	static void waitUntilReadable(int fd) {
+		struct pollfd fds;
+		int ret;
+		
+		fds.fd = fd;
+		fds.events = POLLIN;
+		fds.revents = 0;
+		do {
+			ret = syscalls::poll(&fds, 1, -1);
+		} while (ret == -1 && errno == EINTR);
+	}
+	
 	/**
 	 * Kill a process with SIGKILL, and attempt to kill its children too. 
 	 * Then wait until it has quit.
@@ -29,6 +29,9 @@ protected:
 	VariantMap params, report;
 	string requestSocketFilename;
 	string messageSocketFilename;
+	/** Handed over by the previous helper agent process during a hot restart,
+	 * to be passed to the next one. */
+	HotRestartHandoff hotRestartHandoff;
 	
 	virtual const char *name() const {
 		return "Phusion Passenger helper agent";
@@ -50,7 +53,38 @@ protected:
 	virtual void sendStartupArguments(pid_t pid, FileDescriptor &fd) {
 		VariantMap options = agentsOptions;
 		params.addTo(options);
-		options.writeToFd(fd);
+		if (hotRestartHandoff.empty()) {
+			options.writeToFd(fd);
+		} else {
+			// Only pass the handoff once, even if this fails.
+			HotRestartHandoff handoff = hotRestartHandoff;
+			hotRestartHandoff.clear();
+			options.set("hot_restart_handoff", "true");
+			options.writeToFd(fd);
+			handoff.writeTo(fd);
+		}
+	}
+	
+	virtual bool receiveHotRestartHandoff(pid_t pid, FileDescriptor &fd) {
+		unsigned long long timeout = 30000000;
+		try {
+			// Returns false if the helper agent simply exited.
+			if (hotRestartHandoff.readFrom(fd, &timeout)) {
+				HotRestartHandoff::acknowledge(fd, &timeout);
+				return true;
+			} else {
+				return false;
+			}
+		} catch (const std::exception &e) {
+			P_WARN(name() << " (pid=" << pid << ") requested a hot restart, "
+				"but its state could not be received: " << e.what());
+			hotRestartHandoff.clear();
+			return false;
+		}
+	}
+	
+	virtual void discardHotRestartHandoff() {
+		hotRestartHandoff.clear();
 	}
 	
 	virtual bool processStartupInfo(pid_t pid, FileDescriptor &fd, const vector<string> &args) {
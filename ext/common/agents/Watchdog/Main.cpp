@@ -44,6 +44,7 @@
 #include <cerrno>
 
 #include <agents/Base.h>
+#include <agents/HotRestartHandoff.h>
 #include <Constants.h>
 #include <ServerInstanceDir.h>
 #include <FileDescriptor.h>
@@ -90,6 +90,31 @@ u_char int_buf[32], *end, *buf, *pos;
 	
 
 	
+		if (conf->spawn_concurrency != NGX_CONF_UNSET) {
+			end = ngx_snprintf(int_buf,
+				sizeof(int_buf) - 1,
+				"%d",
+				conf->spawn_concurrency);
+			len += 28;
+			len += end - int_buf + 1;
+		}
+	
+
+	
+		if (conf->predictive_spawning != NGX_CONF_UNSET) {
+			len += 30;
+			len += conf->predictive_spawning ? sizeof("true") : sizeof("false");
+		}
+	
+
+	
+		if (conf->load_balancing.data != NULL) {
+			len += 25;
+			len += conf->load_balancing.len + 1;
+		}
+	
+
+	
 		if (conf->max_requests != NGX_CONF_UNSET) {
 			end = ngx_snprintf(int_buf,
 				sizeof(int_buf) - 1,
@@ -323,6 +348,49 @@ buf = pos = ngx_pnalloc(cf->pool, len);
 	
 
 	
+		if (conf->spawn_concurrency != NGX_CONF_UNSET) {
+			pos = ngx_copy(pos,
+				"PASSENGER_SPAWN_CONCURRENCY",
+				28);
+			end = ngx_snprintf(int_buf,
+				sizeof(int_buf) - 1,
+				"%d",
+				conf->spawn_concurrency);
+			pos = ngx_copy(pos,
+				int_buf,
+				end - int_buf);
+			*pos = '\0';
+			pos++;
+		}
+	
+
+	
+		if (conf->predictive_spawning != NGX_CONF_UNSET) {
+			pos = ngx_copy(pos,
+				"PASSENGER_PREDICTIVE_SPAWNING",
+				30);
+			if (conf->predictive_spawning) {
+				pos = ngx_copy(pos, "true", sizeof("true"));
+			} else {
+				pos = ngx_copy(pos, "false", sizeof("false"));
+			}
+		}
+	
+
+	
+		if (conf->load_balancing.data != NULL) {
+			pos = ngx_copy(pos,
+				"PASSENGER_LOAD_BALANCING",
+				25);
+			pos = ngx_copy(pos,
+				conf->load_balancing.data,
+				conf->load_balancing.len);
+			*pos = '\0';
+			pos++;
+		}
+	
+
+	
 		if (conf->max_requests != NGX_CONF_UNSET) {
 			pos = ngx_copy(pos,
 				"PASSENGER_MAX_REQUESTS",
@@ -35,6 +35,7 @@
 #include "ngx_http_passenger_module.h"
 #include "Configuration.h"
 #include "ContentHandler.h"
+#include "UpstreamKeepalive.h"
 #include "common/Constants.h"
 #include "common/agents/LoggingAgent/FilterSupport.h"
 
@@ -52,6 +53,26 @@ static ngx_str_t headers_to_hide[] = {
 
 passenger_main_conf_t passenger_main_conf;
 
+/*
+ * The variables that are passed to the application for every request. Variables
+ * set with passenger_set_cgi_param are appended to these.
+ */
+#define DEFAULT_VAR(header_name, var_name) \
+    { { sizeof(header_name), (u_char *) header_name }, \
+      { sizeof(var_name), (u_char *) var_name } }
+
+static ngx_keyval_t default_vars[] = {
+    DEFAULT_VAR("SCGI",            "1"),
+    DEFAULT_VAR("QUERY_STRING",    "$query_string"),
+    DEFAULT_VAR("REQUEST_METHOD",  "$request_method"),
+    DEFAULT_VAR("SERVER_PROTOCOL", "$server_protocol"),
+    DEFAULT_VAR("SERVER_SOFTWARE", "nginx/$nginx_version"),
+    DEFAULT_VAR("REMOTE_ADDR",     "$remote_addr"),
+    DEFAULT_VAR("REMOTE_PORT",     "$remote_port"),
+    DEFAULT_VAR("SERVER_ADDR",     "$server_addr"),
+    DEFAULT_VAR("SERVER_PORT",     "$server_port")
+};
+
 static ngx_path_init_t  ngx_http_proxy_temp_path = {
     ngx_string(NGX_HTTP_PROXY_TEMP_PATH), { 1, 2, 0 }
 };
@@ -80,6 +101,8 @@ passenger_create_main_conf(ngx_conf_t *cf)
     conf->max_pool_size = (ngx_uint_t) NGX_CONF_UNSET;
     conf->max_instances_per_app = (ngx_uint_t) NGX_CONF_UNSET;
     conf->pool_idle_time = (ngx_uint_t) NGX_CONF_UNSET;
+    conf->upstream_keepalive = (ngx_uint_t) NGX_CONF_UNSET;
+    conf->stat_cache_inotify = NGX_CONF_UNSET;
     conf->user_switching = NGX_CONF_UNSET;
     conf->default_user.data = NULL;
     conf->default_user.len  = 0;
@@ -96,6 +119,8 @@ passenger_create_main_conf(ngx_conf_t *cf)
     conf->union_station_gateway_cert.len = 0;
     conf->union_station_proxy_address.data = NULL;
     conf->union_station_proxy_address.len = 0;
+    conf->union_station_batch_size = (ngx_uint_t) NGX_CONF_UNSET;
+    conf->union_station_batch_delay = (ngx_uint_t) NGX_CONF_UNSET;
     
     conf->prestart_uris = ngx_array_create(cf->pool, 1, sizeof(ngx_str_t));
     if (conf->prestart_uris == NULL) {
@@ -145,6 +170,14 @@ passenger_init_main_conf(ngx_conf_t *cf, void *conf_pointer)
         conf->pool_idle_time = DEFAULT_POOL_IDLE_TIME;
     }
     
+    if (conf->upstream_keepalive == (ngx_uint_t) NGX_CONF_UNSET) {
+        conf->upstream_keepalive = DEFAULT_UPSTREAM_KEEPALIVE;
+    }
+    
+    if (conf->stat_cache_inotify == NGX_CONF_UNSET) {
+        conf->stat_cache_inotify = 1;
+    }
+    
     if (conf->user_switching == NGX_CONF_UNSET) {
         conf->user_switching = 1;
     }
@@ -202,6 +235,14 @@ passenger_init_main_conf(ngx_conf_t *cf, void *conf_pointer)
         conf->union_station_proxy_address.data = (u_char *) "";
     }
     
+    if (conf->union_station_batch_size == (ngx_uint_t) NGX_CONF_UNSET) {
+        conf->union_station_batch_size = DEFAULT_UNION_STATION_BATCH_SIZE;
+    }
+    
+    if (conf->union_station_batch_delay == (ngx_uint_t) NGX_CONF_UNSET) {
+        conf->union_station_batch_delay = DEFAULT_UNION_STATION_BATCH_DELAY;
+    }
+    
     return NGX_CONF_OK;
 }
 
@@ -210,6 +251,7 @@ passenger_create_loc_conf(ngx_conf_t *cf)
 {
     passenger_loc_conf_t  *conf;
     ngx_keyval_t          *kv;
+    ngx_uint_t             i;
 
     conf = ngx_pcalloc(cf->pool, sizeof(passenger_loc_conf_t));
     if (conf == NULL) {
@@ -277,27 +319,18 @@ passenger_create_loc_conf(ngx_conf_t *cf)
     conf->upstream_config.cyclic_temp_file = 0;
     conf->upstream_config.change_buffering = 1;
     
-    #define DEFINE_VAR_TO_PASS(header_name, var_name) \
-        kv = ngx_array_push(conf->vars_source);       \
-        kv->key.data = (u_char *) header_name;        \
-        kv->key.len  = strlen(header_name) + 1;       \
-        kv->value.data = (u_char *) var_name;         \
-        kv->value.len  = strlen(var_name) + 1
-    
     conf->vars_source = ngx_array_create(cf->pool, 4, sizeof(ngx_keyval_t));
     if (conf->vars_source == NULL) {
         return NGX_CONF_ERROR;
     }
-    
-    DEFINE_VAR_TO_PASS("SCGI",            "1");
-    DEFINE_VAR_TO_PASS("QUERY_STRING",    "$query_string");
-    DEFINE_VAR_TO_PASS("REQUEST_METHOD",  "$request_method");
-    DEFINE_VAR_TO_PASS("SERVER_PROTOCOL", "$server_protocol");
-    DEFINE_VAR_TO_PASS("SERVER_SOFTWARE", "nginx/$nginx_version");
-    DEFINE_VAR_TO_PASS("REMOTE_ADDR",     "$remote_addr");
-    DEFINE_VAR_TO_PASS("REMOTE_PORT",     "$remote_port");
-    DEFINE_VAR_TO_PASS("SERVER_ADDR",     "$server_addr");
-    DEFINE_VAR_TO_PASS("SERVER_PORT",     "$server_port");
+
+    for (i = 0; i < sizeof(default_vars) / sizeof(ngx_keyval_t); i++) {
+        kv = ngx_array_push(conf->vars_source);
+        if (kv == NULL) {
+            return NGX_CONF_ERROR;
+        }
+        *kv = default_vars[i];
+    }
 
 #if NGINX_VERSION_NUM >= 1000010
     ngx_str_set(&conf->upstream_config.module, "passenger");
@@ -306,10 +339,56 @@ passenger_create_loc_conf(ngx_conf_t *cf)
     return conf;
 }
 
+/*
+ * Appends a PASSENGER_OPTIONS_ID header to the cached option headers. Its value
+ * is derived from the other cached option headers, so that the HelperAgent only
+ * has to parse each distinct set of options once. It is left out if the options
+ * may vary per request, i.e. if passenger_set_cgi_param sets PASSENGER_* headers
+ * in this block or in a block that it inherits them from.
+ */
+static void
+append_options_id(ngx_conf_t *cf, passenger_loc_conf_t *conf)
+{
+    ngx_uint_t     i;
+    ngx_keyval_t  *src;
+    u_char        *buf, *pos;
+    size_t         len;
+
+    src = conf->vars_source->elts;
+    for (i = 0; i < conf->vars_source->nelts; i++) {
+        if (src[i].key.len >= sizeof("PASSENGER_") - 1
+         && ngx_strncmp(src[i].key.data, "PASSENGER_", sizeof("PASSENGER_") - 1) == 0)
+        {
+            return;
+        }
+    }
+
+    len = conf->options_cache.len
+        + sizeof("PASSENGER_OPTIONS_ID")
+        + NGX_SIZE_T_LEN + sizeof("-12345678-12345678");
+    buf = ngx_pnalloc(cf->pool, len);
+    if (buf == NULL) {
+        return;
+    }
+
+    pos = ngx_copy(buf, conf->options_cache.data, conf->options_cache.len);
+    pos = ngx_copy(pos, "PASSENGER_OPTIONS_ID", sizeof("PASSENGER_OPTIONS_ID"));
+    pos = ngx_sprintf(pos, "%uz-%08xD-%08xD",
+        conf->options_cache.len,
+        ngx_crc32_long(conf->options_cache.data, conf->options_cache.len),
+        ngx_hash_key(conf->options_cache.data, conf->options_cache.len));
+    *pos = '\0';
+    pos++;
+
+    conf->options_cache.data = buf;
+    conf->options_cache.len = pos - buf;
+}
+
 static void
 cache_loc_conf_options(ngx_conf_t *cf, passenger_loc_conf_t *conf)
 {
     #include "CacheLocationConfig.c"
+    append_options_id(cf, conf);
 }
 
 char *
@@ -330,6 +409,15 @@ passenger_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
     ngx_http_script_copy_code_t  *copy;
 
     #include "MergeLocationConfig.c"
+
+    /* A block without passenger_set_cgi_param directives of its own inherits
+     * those of its parent. This must happen before the options are cached
+     * because whether they get an ID depends on these variables.
+     */
+    if (conf->vars_source->nelts == sizeof(default_vars) / sizeof(ngx_keyval_t)) {
+        conf->vars_source = prev->vars_source;
+    }
+
     if (prev->options_cache.data == NULL) {
         cache_loc_conf_options(cf, prev);
     }
@@ -611,17 +699,6 @@ passenger_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
         conf->upstream_config.upstream = prev->upstream_config.upstream;
     }
 
-    if (conf->vars_source == NULL) {
-        conf->flushes = prev->flushes;
-        conf->vars_len = prev->vars_len;
-        conf->vars = prev->vars;
-        conf->vars_source = prev->vars_source;
-
-        if (conf->vars_source == NULL) {
-            return NGX_CONF_OK;
-        }
-    }
-
     conf->vars_len = ngx_array_create(cf->pool, 64, 1);
     if (conf->vars_len == NULL) {
         return NGX_CONF_ERROR;
@@ -776,6 +853,8 @@ passenger_enabled(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         if (passenger_conf->upstream_config.upstream == NULL) {
             return NGX_CONF_ERROR;
         }
+        passenger_conf->upstream_config.upstream->peer.init_upstream =
+            passenger_init_upstream_keepalive;
         
         clcf = ngx_http_conf_get_module_loc_conf(cf, ngx_http_core_module);
         clcf->handler = passenger_content_handler;
@@ -986,6 +1065,20 @@ const ngx_command_t passenger_commands[] = {
       offsetof(passenger_main_conf_t, pool_idle_time),
       NULL },
 
+    { ngx_string("passenger_upstream_keepalive"),
+      NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(passenger_main_conf_t, upstream_keepalive),
+      NULL },
+
+    { ngx_string("passenger_stat_cache_inotify"),
+      NGX_HTTP_MAIN_CONF | NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(passenger_main_conf_t, stat_cache_inotify),
+      NULL },
+
     { ngx_string("passenger_user_switching"),
       NGX_HTTP_MAIN_CONF | NGX_CONF_FLAG,
       ngx_conf_set_flag_slot,
@@ -1049,6 +1142,20 @@ const ngx_command_t passenger_commands[] = {
       offsetof(passenger_main_conf_t, union_station_proxy_address),
       NULL },
 
+    { ngx_string("passenger_union_station_batch_size"),
+      NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(passenger_main_conf_t, union_station_batch_size),
+      NULL },
+
+    { ngx_string("passenger_union_station_batch_delay"),
+      NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(passenger_main_conf_t, union_station_batch_delay),
+      NULL },
+
     /******** Per-location config ********/
 
     #include "ConfigurationCommands.c"
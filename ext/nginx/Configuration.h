@@ -59,6 +59,8 @@ typedef struct {
     ngx_uint_t   max_pool_size;
     ngx_uint_t   max_instances_per_app;
     ngx_uint_t   pool_idle_time;
+    ngx_uint_t   upstream_keepalive;
+    ngx_flag_t   stat_cache_inotify;
     ngx_flag_t   user_switching;
     ngx_str_t    default_user;
     ngx_str_t    default_group;
@@ -68,6 +70,8 @@ typedef struct {
     ngx_uint_t   union_station_gateway_port;
     ngx_str_t    union_station_gateway_cert;
     ngx_str_t    union_station_proxy_address;
+    ngx_uint_t   union_station_batch_size;
+    ngx_uint_t   union_station_batch_delay;
     ngx_array_t *prestart_uris;
 } passenger_main_conf_t;
 
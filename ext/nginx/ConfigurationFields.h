@@ -57,10 +57,14 @@
 
 	ngx_int_t min_instances;
 
+	ngx_int_t predictive_spawning;
+
 	ngx_int_t request_queue_overflow_status_code;
 
 	ngx_int_t show_version_in_header;
 
+	ngx_int_t spawn_concurrency;
+
 	ngx_int_t start_timeout;
 
 	ngx_array_t *union_station_filters;
@@ -81,6 +85,8 @@
 
 	ngx_str_t group;
 
+	ngx_str_t load_balancing;
+
 	ngx_str_t nodejs;
 
 	ngx_str_t python;
@@ -51,6 +51,11 @@ static ngx_int_t parse_status_line(ngx_http_request_t *r,
 static ngx_int_t process_header(ngx_http_request_t *r);
 static void abort_request(ngx_http_request_t *r);
 static void finalize_request(ngx_http_request_t *r, ngx_int_t rc);
+#ifdef PASSENGER_UPSTREAM_KEEPALIVE_SUPPORTED
+static ngx_int_t input_filter_init(void *data);
+static ngx_int_t chunked_filter(ngx_event_pipe_t *p, ngx_buf_t *buf);
+static ngx_int_t non_buffered_chunked_filter(void *data, ssize_t bytes);
+#endif
 
 
 static unsigned int
@@ -238,13 +243,18 @@ fix_peer_address(ngx_http_request_t *r) {
     unsigned int                      peer_index;
     const char                       *request_socket_filename;
     unsigned int                      request_socket_filename_len;
+    ngx_event_get_peer_pt             get;
+    void                             *data;
 
-    if (r->upstream->peer.get != ngx_http_upstream_get_round_robin_peer) {
+    get  = r->upstream->peer.get;
+    data = r->upstream->peer.data;
+    passenger_upstream_keepalive_unwrap_peer(&get, &data);
+    if (get != ngx_http_upstream_get_round_robin_peer) {
         /* This function only supports the round-robin upstream method. */
         return;
     }
 
-    rrp        = r->upstream->peer.data;
+    rrp        = data;
     peers      = rrp->peers;
     request_socket_filename =
         pp_agents_starter_get_request_socket_filename(pp_agents_starter,
@@ -300,6 +310,35 @@ create_key(ngx_http_request_t *r)
 #endif
 
 
+#ifdef PASSENGER_UPSTREAM_KEEPALIVE_SUPPORTED
+
+/**
+ * Checks whether the helper agent connection can be kept alive after this
+ * request. The helper agent must be able to tell where the request body
+ * ends without relying on EOF, and Nginx must read the entire response body,
+ * which it doesn't do for HEAD requests.
+ */
+static int
+should_keepalive(ngx_http_request_t *r, passenger_loc_conf_t *slcf) {
+    if (passenger_main_conf.upstream_keepalive == 0
+     || r->method == NGX_HTTP_HEAD) {
+        return 0;
+    }
+    #if NGINX_VERSION_NUM >= 1003013
+        /* Upgraded connections (e.g. WebSocket) are never reused. */
+        if (r->headers_in.upgrade != NULL) {
+            return 0;
+        }
+    #endif
+    if (r->headers_in.content_length_n >= 0) {
+        return slcf->upstream_config.pass_request_body;
+    } else {
+        return r->upstream->request_bufs == NULL;
+    }
+}
+
+#endif
+
 static ngx_int_t
 create_request(ngx_http_request_t *r)
 {
@@ -410,6 +449,13 @@ create_request(ngx_http_request_t *r)
 
     len += sizeof("PASSENGER_APP_TYPE") + app_type_string_len;
 
+    #ifdef PASSENGER_UPSTREAM_KEEPALIVE_SUPPORTED
+        context->keepalive = should_keepalive(r, slcf);
+        if (context->keepalive) {
+            len += sizeof("PASSENGER_KEEPALIVE") + sizeof("true");
+        }
+    #endif
+
     if (slcf->union_station_filters != NGX_CONF_UNSET_PTR && slcf->union_station_filters->nelts > 0) {
         len += sizeof("UNION_STATION_FILTERS");
         
@@ -585,6 +631,14 @@ create_request(ngx_http_request_t *r)
                        sizeof("PASSENGER_APP_TYPE"));
     b->last = ngx_copy(b->last, app_type_string, app_type_string_len);
 
+    #ifdef PASSENGER_UPSTREAM_KEEPALIVE_SUPPORTED
+        if (context->keepalive) {
+            b->last = ngx_copy(b->last, "PASSENGER_KEEPALIVE",
+                               sizeof("PASSENGER_KEEPALIVE"));
+            b->last = ngx_copy(b->last, "true", sizeof("true"));
+        }
+    #endif
+
     if (slcf->union_station_filters != NGX_CONF_UNSET_PTR && slcf->union_station_filters->nelts > 0) {
         b->last = ngx_copy(b->last, "UNION_STATION_FILTERS",
                            sizeof("UNION_STATION_FILTERS"));
@@ -708,6 +762,18 @@ create_request(ngx_http_request_t *r)
 
     cl->next = NULL;
 
+    #ifdef PASSENGER_UPSTREAM_KEEPALIVE_SUPPORTED
+        if (context->keepalive) {
+            /* The helper agent frames the response body with the chunked
+             * transfer encoding so that we can tell where it ends.
+             */
+            r->upstream->input_filter_init = input_filter_init;
+            r->upstream->input_filter = non_buffered_chunked_filter;
+            r->upstream->input_filter_ctx = r;
+            r->upstream->pipe->input_filter = chunked_filter;
+        }
+    #endif
+
     return NGX_OK;
 }
 
@@ -727,6 +793,10 @@ reinit_request(ngx_http_request_t *r)
     context->status_count = 0;
     context->status_start = NULL;
     context->status_end = NULL;
+    #ifdef PASSENGER_UPSTREAM_KEEPALIVE_SUPPORTED
+        ngx_memzero(&context->chunked, sizeof(ngx_http_chunked_t));
+        r->upstream->keepalive = 0;
+    #endif
 
     r->upstream->process_header = process_status_line;
     r->state = 0;
@@ -1190,6 +1260,224 @@ process_header(ngx_http_request_t *r)
 }
 
 
+#ifdef PASSENGER_UPSTREAM_KEEPALIVE_SUPPORTED
+
+static ngx_int_t
+input_filter_init(void *data)
+{
+    ngx_http_request_t   *r = data;
+    ngx_http_upstream_t  *u;
+    passenger_context_t  *context;
+
+    u = r->upstream;
+    context = ngx_http_get_module_ctx(r, ngx_http_passenger_module);
+
+    ngx_memzero(&context->chunked, sizeof(ngx_http_chunked_t));
+
+    /* The smallest possible body is the terminating chunk "0" CRLF CRLF. */
+    u->pipe->length = 3;
+    u->length = 1;
+
+    return NGX_OK;
+}
+
+/**
+ * Event pipe input filter for buffered responses. Strips the chunked
+ * framing from the response body and marks the helper agent connection
+ * as reusable once the terminating chunk has been seen.
+ */
+static ngx_int_t
+chunked_filter(ngx_event_pipe_t *p, ngx_buf_t *buf)
+{
+    ngx_int_t             rc;
+    ngx_buf_t            *b, **prev;
+    ngx_chain_t          *cl;
+    ngx_http_request_t   *r;
+    passenger_context_t  *context;
+
+    if (buf->pos == buf->last) {
+        return NGX_OK;
+    }
+
+    r = p->input_ctx;
+    context = ngx_http_get_module_ctx(r, ngx_http_passenger_module);
+
+    b = NULL;
+    prev = &buf->shadow;
+
+    for ( ;; ) {
+        rc = ngx_http_parse_chunked(r, buf, &context->chunked);
+
+        if (rc == NGX_OK) {
+            /* A chunk has been parsed successfully. */
+
+            if (p->free) {
+                cl = p->free;
+                b = cl->buf;
+                p->free = cl->next;
+                ngx_free_chain(p->pool, cl);
+            } else {
+                b = ngx_alloc_buf(p->pool);
+                if (b == NULL) {
+                    return NGX_ERROR;
+                }
+            }
+
+            ngx_memzero(b, sizeof(ngx_buf_t));
+
+            b->pos = buf->pos;
+            b->start = buf->start;
+            b->end = buf->end;
+            b->tag = p->tag;
+            b->temporary = 1;
+            b->recycled = 1;
+
+            *prev = b;
+            prev = &b->shadow;
+
+            cl = ngx_alloc_chain_link(p->pool);
+            if (cl == NULL) {
+                return NGX_ERROR;
+            }
+
+            cl->buf = b;
+            cl->next = NULL;
+
+            if (p->in) {
+                *p->last_in = cl;
+            } else {
+                p->in = cl;
+            }
+            p->last_in = &cl->next;
+
+            b->num = buf->num;
+
+            if (buf->last - buf->pos >= context->chunked.size) {
+                buf->pos += (size_t) context->chunked.size;
+                b->last = buf->pos;
+                context->chunked.size = 0;
+            } else {
+                context->chunked.size -= buf->last - buf->pos;
+                buf->pos = buf->last;
+                b->last = buf->last;
+            }
+
+            continue;
+        }
+
+        if (rc == NGX_DONE) {
+            /* The whole response body has been read. */
+            p->upstream_done = 1;
+            r->upstream->keepalive = 1;
+            break;
+        }
+
+        if (rc == NGX_AGAIN) {
+            /* Set the minimal amount of data we want to see. */
+            p->length = context->chunked.length;
+            break;
+        }
+
+        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                      "Phusion Passenger helper agent sent an invalid chunked response");
+        return NGX_ERROR;
+    }
+
+    if (b) {
+        b->shadow = buf;
+        b->last_shadow = 1;
+        return NGX_OK;
+    }
+
+    /* There is no data record in the buf, add it to the free chain. */
+    if (ngx_event_pipe_add_free_buf(p, buf) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+/**
+ * Like chunked_filter(), but for responses that are not buffered.
+ */
+static ngx_int_t
+non_buffered_chunked_filter(void *data, ssize_t bytes)
+{
+    ngx_http_request_t   *r = data;
+    ngx_int_t             rc;
+    ngx_buf_t            *b, *buf;
+    ngx_chain_t          *cl, **ll;
+    ngx_http_upstream_t  *u;
+    passenger_context_t  *context;
+
+    context = ngx_http_get_module_ctx(r, ngx_http_passenger_module);
+    u = r->upstream;
+    buf = &u->buffer;
+
+    buf->pos = buf->last;
+    buf->last += bytes;
+
+    for (cl = u->out_bufs, ll = &u->out_bufs; cl; cl = cl->next) {
+        ll = &cl->next;
+    }
+
+    for ( ;; ) {
+        rc = ngx_http_parse_chunked(r, buf, &context->chunked);
+
+        if (rc == NGX_OK) {
+            /* A chunk has been parsed successfully. */
+
+            cl = ngx_chain_get_free_buf(r->pool, &u->free_bufs);
+            if (cl == NULL) {
+                return NGX_ERROR;
+            }
+
+            *ll = cl;
+            ll = &cl->next;
+
+            b = cl->buf;
+
+            b->flush = 1;
+            b->memory = 1;
+
+            b->pos = buf->pos;
+            b->tag = u->output.tag;
+
+            if (buf->last - buf->pos >= context->chunked.size) {
+                buf->pos += (size_t) context->chunked.size;
+                b->last = buf->pos;
+                context->chunked.size = 0;
+            } else {
+                context->chunked.size -= buf->last - buf->pos;
+                buf->pos = buf->last;
+                b->last = buf->last;
+            }
+
+            continue;
+        }
+
+        if (rc == NGX_DONE) {
+            /* The whole response body has been read. */
+            u->keepalive = 1;
+            u->length = 0;
+            break;
+        }
+
+        if (rc == NGX_AGAIN) {
+            break;
+        }
+
+        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                      "Phusion Passenger helper agent sent an invalid chunked response");
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+#endif /* PASSENGER_UPSTREAM_KEEPALIVE_SUPPORTED */
+
+
 static void
 abort_request(ngx_http_request_t *r)
 {
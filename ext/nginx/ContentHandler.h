@@ -31,6 +31,7 @@
 #include <ngx_core.h>
 #include <ngx_http.h>
 #include "common/ApplicationPool2/AppTypes.h"
+#include "UpstreamKeepalive.h"
 
 
 typedef struct {
@@ -48,6 +49,14 @@ typedef struct {
     
     /** The application's type. */
     PassengerAppType app_type;
+    
+#ifdef PASSENGER_UPSTREAM_KEEPALIVE_SUPPORTED
+    /** Whether the helper agent connection is kept alive after this
+     * request, in which case the response body is chunked. */
+    unsigned    keepalive:1;
+    /** Chunked response body parser state. */
+    ngx_http_chunked_t chunked;
+#endif
 } passenger_context_t;
 
 
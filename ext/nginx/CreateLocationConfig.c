@@ -72,6 +72,19 @@
 	
 
 	
+		conf->spawn_concurrency = NGX_CONF_UNSET;
+	
+
+	
+		conf->predictive_spawning = NGX_CONF_UNSET;
+	
+
+	
+		conf->load_balancing.data = NULL;
+		conf->load_balancing.len  = 0;
+	
+
+	
 		conf->max_requests = NGX_CONF_UNSET;
 	
 
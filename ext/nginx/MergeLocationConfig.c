@@ -82,6 +82,24 @@
 	
 
 	
+		ngx_conf_merge_value(conf->spawn_concurrency,
+			prev->spawn_concurrency,
+			NGX_CONF_UNSET);
+	
+
+	
+		ngx_conf_merge_value(conf->predictive_spawning,
+			prev->predictive_spawning,
+			NGX_CONF_UNSET);
+	
+
+	
+		ngx_conf_merge_str_value(conf->load_balancing,
+			prev->load_balancing,
+			NULL);
+	
+
+	
 		ngx_conf_merge_value(conf->max_requests,
 			prev->max_requests,
 			NGX_CONF_UNSET);
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) Maxim Dounin
+ * Copyright (C) Nginx, Inc.
+ * Copyright (C) 2013 Phusion
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _PASSENGER_NGINX_UPSTREAM_KEEPALIVE_H_
+#define _PASSENGER_NGINX_UPSTREAM_KEEPALIVE_H_
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+#include "ngx_http_passenger_module.h"
+
+/*
+ * Keep-alive connections to the helper agent require the chunked response
+ * parser and the upstream connection caching hooks, which appeared in
+ * Nginx 1.1.4.
+ */
+#if NGINX_VERSION_NUM >= 1001004
+    #define PASSENGER_UPSTREAM_KEEPALIVE_SUPPORTED
+#endif
+
+/**
+ * Replacement for the round-robin upstream initializer, which additionally
+ * caches idle connections to the helper agent in the current worker process
+ * so that subsequent requests can reuse them. The cache size is determined by
+ * the 'passenger_upstream_keepalive' option; a value of 0 disables caching.
+ */
+ngx_int_t passenger_init_upstream_keepalive(ngx_conf_t *cf,
+                                            ngx_http_upstream_srv_conf_t *us);
+
+/**
+ * If <tt>*get</tt> and <tt>*data</tt> are the peer callback and peer data
+ * installed by the keep-alive connection cache, replaces them with the
+ * callback and data of the underlying load balancer.
+ */
+void passenger_upstream_keepalive_unwrap_peer(ngx_event_get_peer_pt *get,
+                                              void **data);
+
+#endif /* _PASSENGER_NGINX_UPSTREAM_KEEPALIVE_H_ */
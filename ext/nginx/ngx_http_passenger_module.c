@@ -47,6 +47,7 @@
 
 #define HELPER_SERVER_MAX_SHUTDOWN_TIME 5
 #define HELPER_SERVER_PASSWORD_SIZE     64
+#define STAT_CACHE_MAX_WATCHES          256
 
 
 static int                first_start = 1;
@@ -291,6 +292,8 @@ start_helper_server(ngx_cycle_t *cycle) {
     pp_variant_map_set_int    (params, "union_station_gateway_port", passenger_main_conf.union_station_gateway_port);
     pp_variant_map_set_ngx_str(params, "union_station_gateway_cert", &passenger_main_conf.union_station_gateway_cert);
     pp_variant_map_set_ngx_str(params, "union_station_proxy_address", &passenger_main_conf.union_station_proxy_address);
+    pp_variant_map_set_int    (params, "union_station_batch_size", passenger_main_conf.union_station_batch_size);
+    pp_variant_map_set_int    (params, "union_station_batch_delay", passenger_main_conf.union_station_batch_delay);
     pp_variant_map_set_strset (params, "prestart_urls", (const char **) prestart_uris_ary, passenger_main_conf.prestart_uris->nelts);
 
     ctl = (ngx_keyval_t *) passenger_main_conf.ctl->elts;
@@ -436,6 +439,53 @@ init_module(ngx_cycle_t *cycle) {
     return NGX_OK;
 }
 
+static void
+stat_cache_inotify_handler(ngx_event_t *ev) {
+    pp_cached_file_stat_process_inotify_events(pp_stat_cache);
+}
+
+/**
+ * Backs the stat cache with inotify, so that the file existence checks in the
+ * content handler are answered from memory until a watched directory changes.
+ * The inotify file descriptor is registered with the event loop, which tells
+ * us when to process changes.
+ *
+ * Each worker process has its own copy of the stat cache and its own watches.
+ * Sharing them between workers would require a single process to read the
+ * events and a cross-process lock around every lookup.
+ */
+static void
+start_stat_cache_watcher(ngx_cycle_t *cycle) {
+    ngx_connection_t *c;
+    int fd;
+    
+    fd = pp_cached_file_stat_enable_inotify(pp_stat_cache, STAT_CACHE_MAX_WATCHES);
+    if (fd == -1) {
+        if (ngx_errno != NGX_ENOSYS) {
+            ngx_log_error(NGX_LOG_NOTICE, cycle->log, ngx_errno,
+                "Cannot initialize inotify for the Phusion Passenger stat cache");
+        }
+        return;
+    }
+    
+    /* Without an event handler, changes would never be noticed, so
+     * fall back to plain stat() calls if registration fails.
+     */
+    c = ngx_get_connection(fd, cycle->log);
+    if (c == NULL) {
+        pp_cached_file_stat_disable_inotify(pp_stat_cache);
+        return;
+    }
+    c->read->handler = stat_cache_inotify_handler;
+    c->read->log = cycle->log;
+    if (ngx_handle_read_event(c->read, 0) != NGX_OK) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, 0,
+            "Cannot register the stat cache inotify file descriptor");
+        ngx_free_connection(c);
+        pp_cached_file_stat_disable_inotify(pp_stat_cache);
+    }
+}
+
 /**
  * Called when an Nginx worker process is started. This happens after init_module
  * is called.
@@ -455,6 +505,10 @@ init_worker_process(ngx_cycle_t *cycle) {
         if (core_conf->master) {
             pp_agents_starter_detach(pp_agents_starter);
         }
+        
+        if (passenger_main_conf.stat_cache_inotify) {
+            start_stat_cache_watcher(cycle);
+        }
     }
     return NGX_OK;
 }
@@ -36,6 +36,9 @@
 #endif
 #include "../spin_lock.hpp"
 
+/** The maximum number of trace points recorded per thread. */
+#define OXT_MAX_BACKTRACE_DEPTH 128
+
 namespace oxt {
 
 
@@ -72,8 +75,22 @@ struct thread_local_context {
 	spin_lock syscall_interruption_lock;
 
 	#ifdef OXT_BACKTRACE_IS_ENABLED
-		std::vector<trace_point *> backtrace_list;
-		spin_lock backtrace_lock;
+		/**
+		 * The trace points that are currently active in this thread, from
+		 * outermost to innermost. Only the owning thread modifies this, without
+		 * locking or allocating memory, so that TRACE_POINT() stays cheap.
+		 * Trace points beyond OXT_MAX_BACKTRACE_DEPTH are not recorded.
+		 *
+		 * Other threads read it using a seqlock protocol: the owning thread
+		 * increments <tt>backtrace_generation</tt> (making it odd) before
+		 * modifying the list and increments it again (making it even) afterwards.
+		 * A reader copies the list and retries until it sees the same even
+		 * generation before and after copying. See copy_backtrace() in
+		 * implementation.cpp.
+		 */
+		trace_point *backtrace_list[OXT_MAX_BACKTRACE_DEPTH];
+		volatile unsigned int backtrace_size;
+		volatile unsigned int backtrace_generation;
 	#endif
 	
 	static thread_local_context_ptr make_shared_ptr();
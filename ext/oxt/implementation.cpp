@@ -140,9 +140,13 @@ trace_point::trace_point(const char *_function, const char *_source, unsigned sh
 	  m_detached(false)
 {
 	thread_local_context *ctx = get_thread_local_context();
-	if (OXT_LIKELY(ctx != NULL)) {
-		spin_lock::scoped_lock l(ctx->backtrace_lock);
-		ctx->backtrace_list.push_back(this);
+	if (OXT_LIKELY(ctx != NULL && ctx->backtrace_size < OXT_MAX_BACKTRACE_DEPTH)) {
+		ctx->backtrace_generation++;
+		OXT_WRITE_BARRIER();
+		ctx->backtrace_list[ctx->backtrace_size] = this;
+		ctx->backtrace_size++;
+		OXT_WRITE_BARRIER();
+		ctx->backtrace_generation++;
 	} else {
 		m_detached = true;
 	}
@@ -161,9 +165,12 @@ trace_point::~trace_point() {
 	if (OXT_LIKELY(!m_detached)) {
 		thread_local_context *ctx = get_thread_local_context();
 		if (OXT_LIKELY(ctx != NULL)) {
-			spin_lock::scoped_lock l(ctx->backtrace_lock);
-			assert(!ctx->backtrace_list.empty());
-			ctx->backtrace_list.pop_back();
+			assert(ctx->backtrace_size > 0);
+			ctx->backtrace_generation++;
+			OXT_WRITE_BARRIER();
+			ctx->backtrace_size--;
+			OXT_WRITE_BARRIER();
+			ctx->backtrace_generation++;
 		}
 	}
 }
@@ -178,16 +185,18 @@ trace_point::update(const char *source, unsigned short line) {
 tracable_exception::tracable_exception() {
 	thread_local_context *ctx = get_thread_local_context();
 	if (OXT_LIKELY(ctx != NULL)) {
-		spin_lock::scoped_lock l(ctx->backtrace_lock);
-		vector<trace_point *>::const_iterator it, end = ctx->backtrace_list.end();
+		// Only the current thread modifies its own backtrace, so no
+		// synchronization is necessary here.
+		unsigned int i, size = ctx->backtrace_size;
 		
-		backtrace_copy.reserve(ctx->backtrace_list.size());
-		for (it = ctx->backtrace_list.begin(); it != end; it++) {
+		backtrace_copy.reserve(size);
+		for (i = 0; i < size; i++) {
+			const trace_point *orig = ctx->backtrace_list[i];
 			trace_point *p = new trace_point(
-				(*it)->function,
-				(*it)->source,
-				(*it)->line,
-				(*it)->data,
+				orig->function,
+				orig->source,
+				orig->line,
+				orig->data,
 				trace_point::detached());
 			backtrace_copy.push_back(p);
 		}
@@ -223,6 +232,56 @@ tracable_exception::~tracable_exception() throw() {
 	}
 }
 
+/**
+ * Copies the backtrace of the given thread into 'result'. The thread may be
+ * running and modifying its backtrace while we're copying it, so this follows
+ * the seqlock protocol described in thread_local_context: the copy is retried
+ * until no trace point was pushed or popped during the copy. This guarantees
+ * that all trace points that we've read were still alive at that time.
+ */
+static void
+copy_backtrace(const thread_local_context *ctx, vector<trace_point> &result) {
+	unsigned int generation, size, i;
+	bool is_current_thread = ctx == get_thread_local_context();
+	
+	result.reserve(OXT_MAX_BACKTRACE_DEPTH);
+	do {
+		result.clear();
+		if (is_current_thread) {
+			// We may have been called from a signal handler that interrupted
+			// a push or pop, in which case the generation stays odd until we
+			// return. Reading our own backtrace is always safe though.
+			generation = ctx->backtrace_generation;
+		} else {
+			do {
+				generation = ctx->backtrace_generation;
+			} while (generation % 2 != 0);
+		}
+		OXT_READ_BARRIER();
+		size = ctx->backtrace_size;
+		if (size > OXT_MAX_BACKTRACE_DEPTH) {
+			// Torn read; the generation check below will catch it.
+			size = OXT_MAX_BACKTRACE_DEPTH;
+		}
+		for (i = 0; i < size; i++) {
+			const trace_point *p = ctx->backtrace_list[i];
+			result.push_back(trace_point(p->function, p->source, p->line,
+				p->data, trace_point::detached()));
+		}
+		OXT_READ_BARRIER();
+	} while (generation != ctx->backtrace_generation);
+}
+
+static const trace_point *
+as_trace_point_pointer(const trace_point *p) {
+	return p;
+}
+
+static const trace_point *
+as_trace_point_pointer(const trace_point &p) {
+	return &p;
+}
+
 template<typename Collection>
 static string
 format_backtrace(const Collection &backtrace_list) {
@@ -234,7 +293,7 @@ format_backtrace(const Collection &backtrace_list) {
 		typename Collection::const_reverse_iterator it;
 		
 		for (it = backtrace_list.rbegin(); it != backtrace_list.rend(); it++) {
-			const trace_point *p = *it;
+			const trace_point *p = as_trace_point_pointer(*it);
 			
 			result << "     in '" << p->function << "'";
 			if (p->source != NULL) {
@@ -306,7 +365,8 @@ thread_local_context::thread_local_context()
 	#endif
 	syscall_interruption_lock.lock();
 	#ifdef OXT_BACKTRACE_IS_ENABLED
-		backtrace_list.reserve(50);
+		backtrace_size = 0;
+		backtrace_generation = 0;
 	#endif
 }
 
@@ -373,8 +433,9 @@ thread::name() const throw() {
 std::string
 thread::backtrace() const throw() {
 	#ifdef OXT_BACKTRACE_IS_ENABLED
-		spin_lock::scoped_lock l(context->backtrace_lock);
-		return format_backtrace(context->backtrace_list);
+		vector<trace_point> backtrace_list;
+		copy_backtrace(context.get(), backtrace_list);
+		return format_backtrace(backtrace_list);
 	#else
 		return "    (backtrace support disabled during compile time)";
 	#endif
@@ -400,8 +461,9 @@ thread::all_backtraces() throw() {
 				#endif
 				result << "):" << endl;
 				
-				spin_lock::scoped_lock l(ctx->backtrace_lock);
-				std::string bt = format_backtrace(ctx->backtrace_list);
+				vector<trace_point> backtrace_list;
+				copy_backtrace(ctx.get(), backtrace_list);
+				std::string bt = format_backtrace(backtrace_list);
 				result << bt;
 				if (bt.empty() || bt[bt.size() - 1] != '\n') {
 					result << endl;
@@ -81,6 +81,25 @@
 	#define restrict_ref
 #endif
 
+/*
+ * Memory barriers for data that is shared between threads without locking.
+ * OXT_WRITE_BARRIER() ensures that stores before it become visible to other
+ * CPUs before stores after it, and OXT_READ_BARRIER() ensures the same for
+ * loads. Both also act as compiler barriers. x86 never reorders stores with
+ * other stores or loads with other loads, so there a compiler barrier suffices.
+ */
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+	#define OXT_READ_BARRIER() \
+		do { __asm__ __volatile__ ("" ::: "memory"); } while (false)
+	#define OXT_WRITE_BARRIER() \
+		do { __asm__ __volatile__ ("" ::: "memory"); } while (false)
+#elif defined(__GNUC__)
+	#define OXT_READ_BARRIER() __sync_synchronize()
+	#define OXT_WRITE_BARRIER() __sync_synchronize()
+#else
+	#error "Memory barriers are not implemented for this compiler."
+#endif
+
 /*
  * GCC supports the __thread keyword on x86 since version 3.3, but versions earlier
  * than 4.1.2 have bugs (http://gcc.gnu.org/ml/gcc-bugs/2006-09/msg02275.html).
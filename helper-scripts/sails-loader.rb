@@ -27,6 +27,10 @@ require 'socket'
 
 module PhusionPassenger
 module App
+	# The maximum number of connections to the app's HTTP server that
+	# Phusion Passenger keeps open for reuse.
+	CONNECTION_POOL_LIMIT = 16
+	
 	def self.options
 		return @@options
 	end
@@ -118,7 +122,7 @@ module App
 			sleep 0.01
 		end
 		puts "!> Ready"
-		puts "!> socket: main;tcp://127.0.0.1:#{port};http_session;0"
+		puts "!> socket: main;tcp://127.0.0.1:#{port};http_session;0;#{CONNECTION_POOL_LIMIT}"
 		puts "!> pid: #{pid}"
 		puts "!> "
 		begin
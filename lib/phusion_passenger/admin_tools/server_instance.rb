@@ -324,6 +324,19 @@ private
 				raise CorruptedDirectoryError
 			end
 			return [username, password, "helper_admin"]
+		when :passenger_config
+			username = "_passenger-config"
+			begin
+				filename = "#{@generation_path}/admin-manipulation-password.txt"
+				password = File.open(filename, "rb") do |f|
+					f.read
+				end
+			rescue Errno::EACCES
+				raise RoleDeniedError
+			rescue Errno::ENOENT
+				raise CorruptedDirectoryError
+			end
+			return [username, password, "helper_admin"]
 		else
 			raise ArgumentError, "Unsupported role #{role}"
 		end
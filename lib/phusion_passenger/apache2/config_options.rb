@@ -73,6 +73,25 @@ APACHE2_DIRECTORY_CONFIGURATION_OPTIONS = [
 		:min_value => 0,
 		:desc => "The minimum number of application instances to keep when cleaning idle instances."
 	},
+	{
+		:name => "PassengerSpawnConcurrency",
+		:type => :integer,
+		:context => ["OR_LIMIT", "ACCESS_CONF", "RSRC_CONF"],
+		:min_value => 1,
+		:desc => "The maximum number of application processes to spawn in parallel."
+	},
+	{
+		:name => "PassengerPredictiveSpawning",
+		:type => :flag,
+		:context => ["OR_LIMIT", "ACCESS_CONF", "RSRC_CONF"],
+		:desc => "Whether to spawn application processes ahead of predicted demand."
+	},
+	{
+		:name => "PassengerLoadBalancing",
+		:type => :string,
+		:context => ["OR_LIMIT", "ACCESS_CONF", "RSRC_CONF"],
+		:desc => "How to choose the application process that handles a request: 'utilization' or 'latency'."
+	},
 	{
 		:name => "PassengerUser",
 		:type => :string,
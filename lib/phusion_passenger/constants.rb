@@ -50,6 +50,10 @@ module PhusionPassenger
 		DEFAULT_ANALYTICS_LOG_PERMISSIONS = "u=rwx,g=rx,o=rx"
 		DEFAULT_UNION_STATION_GATEWAY_ADDRESS = "gateway.unionstationapp.com"
 		DEFAULT_UNION_STATION_GATEWAY_PORT = 443
+		DEFAULT_UNION_STATION_BATCH_SIZE = 0
+		DEFAULT_UNION_STATION_BATCH_DELAY = 1000
+		DEFAULT_CLIENT_FREELIST_SIZE = 128
+		DEFAULT_UPSTREAM_KEEPALIVE = 32
 
 		# Size limits
 		MESSAGE_SERVER_MAX_USERNAME_SIZE = 100
@@ -69,6 +73,7 @@ module PhusionPassenger
 
 		# Misc
 		FEEDBACK_FD = 3
+		HELPER_AGENT_HOT_RESTART_EXIT_CODE = 3
 		PROGRAM_NAME = "Phusion Passenger"
 		INDEX_DOC_URL       = "http://www.modrails.com/documentation/Users%20guide.html"
 		APACHE2_DOC_URL     = "http://www.modrails.com/documentation/Users%20guide%20Apache.html"
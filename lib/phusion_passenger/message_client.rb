@@ -113,11 +113,29 @@ class MessageClient
 		return read_scalar
 	end
 	
+	def pool_latencies(options = {})
+		write("latencies", *options.to_a.flatten)
+		check_security_response
+		return read_scalar
+	rescue
+		auto_disconnect
+		raise
+	end
+	
 	def helper_agent_requests
 		write("requests")
 		check_security_response
 		return read_scalar
 	end
+	
+	def helper_agent_hot_restart
+		write("hot_restart")
+		check_security_response
+		result = read
+		if result.nil?
+			raise EOFError
+		end
+	end
 
 	### HelperAgent BacktracesServer methods ###
 	
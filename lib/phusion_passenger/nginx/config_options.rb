@@ -118,6 +118,18 @@ LOCATION_CONFIGURATION_OPTIONS = [
 		:name  => 'passenger_min_instances',
 		:type  => :integer
 	},
+	{
+		:name  => 'passenger_spawn_concurrency',
+		:type  => :integer
+	},
+	{
+		:name  => 'passenger_predictive_spawning',
+		:type  => :flag
+	},
+	{
+		:name  => 'passenger_load_balancing',
+		:type  => :string
+	},
 	{
 		:name  => 'passenger_max_requests',
 		:type  => :integer
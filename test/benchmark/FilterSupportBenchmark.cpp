@@ -0,0 +1,89 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2013 Phusion
+ *
+ *  "Phusion Passenger" is a trademark of Hongli Lai & Ninh Bui.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+/*
+ * Compares evaluating Union Station filters by walking their syntax tree
+ * with evaluating their compiled instruction program.
+ *
+ * Usage: FilterSupportBenchmark [ITERATIONS]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <agents/LoggingAgent/FilterSupport.h>
+#include <Utils/Timer.h>
+
+using namespace std;
+using namespace Passenger;
+using namespace Passenger::FilterSupport;
+
+static const char *sources[] = {
+	"uri == '/foo' && response_time > 100000",
+	"uri =~ /^\\/api\\// && (status_code == 200 || status_code == 201) && has_hint('cache_hit')",
+	"controller == 'HomeController' || starts_with(status, '5') || response_time_without_gc >= 5000",
+	NULL
+};
+
+static void
+benchmark(const char *name, Filter &filter, const Context &ctx, bool compiled,
+	unsigned int iterations)
+{
+	Timer timer;
+	unsigned int matched = 0;
+	
+	for (unsigned int i = 0; i < iterations; i++) {
+		if (compiled) {
+			matched += filter.run(ctx);
+		} else {
+			matched += filter.runOnSyntaxTree(ctx);
+		}
+	}
+	
+	unsigned long long elapsed = timer.elapsed();
+	printf("  %-12s: %u iterations in %llu msec (%.3f usec per iteration, %u matched)\n",
+		name, iterations, elapsed, elapsed * 1000.0 / iterations, matched);
+}
+
+int
+main(int argc, char *argv[]) {
+	unsigned int iterations = (argc > 1) ? atoi(argv[1]) : 1000000;
+	SimpleContext ctx;
+	
+	ctx.uri = "/api/users";
+	ctx.controller = "UsersController";
+	ctx.status = "201 Created";
+	ctx.statusCode = 201;
+	ctx.responseTime = 123456;
+	ctx.hints.insert("cache_hit");
+	
+	for (unsigned int i = 0; sources[i] != NULL; i++) {
+		Filter filter(sources[i]);
+		printf("%s\n", sources[i]);
+		benchmark("syntax tree", filter, ctx, false, iterations);
+		benchmark("compiled", filter, ctx, true, iterations);
+	}
+	return 0;
+}
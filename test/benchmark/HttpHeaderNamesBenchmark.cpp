@@ -0,0 +1,133 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2013 Phusion
+ *
+ *  "Phusion Passenger" is a trademark of Hongli Lai & Ninh Bui.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+/*
+ * Compares converting CGI-style header names back to HTTP header names the
+ * old way (a std::string per name, lowercased one character at a time) with
+ * HttpHeaderNames, on header sets as sent by common browsers.
+ *
+ * Usage: HttpHeaderNamesBenchmark [ITERATIONS]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <string>
+
+#include <Utils/HttpHeaderNames.h>
+#include <Utils/Timer.h>
+
+using namespace std;
+using namespace Passenger;
+
+static const char *chrome[] = {
+	"HOST", "CONNECTION", "CACHE_CONTROL", "UPGRADE_INSECURE_REQUESTS",
+	"USER_AGENT", "ACCEPT", "SEC_FETCH_SITE", "SEC_FETCH_MODE", "SEC_FETCH_USER",
+	"SEC_FETCH_DEST", "REFERER", "ACCEPT_ENCODING", "ACCEPT_LANGUAGE", "COOKIE",
+	NULL
+};
+
+static const char *firefox[] = {
+	"HOST", "USER_AGENT", "ACCEPT", "ACCEPT_LANGUAGE", "ACCEPT_ENCODING",
+	"REFERER", "DNT", "CONNECTION", "COOKIE", "UPGRADE_INSECURE_REQUESTS",
+	"IF_MODIFIED_SINCE", "IF_NONE_MATCH", "CACHE_CONTROL",
+	NULL
+};
+
+static const char *xhrBehindProxy[] = {
+	"HOST", "X_REAL_IP", "X_FORWARDED_FOR", "X_FORWARDED_PROTO", "CONNECTION",
+	"ACCEPT", "X_REQUESTED_WITH", "X_CSRF_TOKEN", "USER_AGENT", "ORIGIN",
+	"REFERER", "ACCEPT_ENCODING", "ACCEPT_LANGUAGE", "COOKIE", "X_NEWRELIC_ID",
+	NULL
+};
+
+static size_t
+convertOld(const char **names, string &data) {
+	data.clear();
+	for (unsigned int i = 0; names[i] != NULL; i++) {
+		string subheader = names[i];
+		string::size_type j;
+		for (j = 0; j < subheader.size(); j++) {
+			if (subheader[j] == '_') {
+				subheader[j] = '-';
+			} else if (j > 0 && subheader[j - 1] != '-') {
+				subheader[j] = tolower(subheader[j]);
+			}
+		}
+		data.append(subheader);
+		data.append(": \r\n");
+	}
+	return data.size();
+}
+
+static size_t
+convertNew(const char **names, string &data) {
+	size_t size = 0;
+	for (unsigned int i = 0; names[i] != NULL; i++) {
+		size += strlen(names[i]) + 4;
+	}
+	data.resize(size);
+	char *pos = &data[0];
+	for (unsigned int i = 0; names[i] != NULL; i++) {
+		pos = HttpHeaderNames::append(pos, names[i]);
+		memcpy(pos, ": \r\n", 4);
+		pos += 4;
+	}
+	return size;
+}
+
+static void
+benchmark(const char *name, const char **names, bool useNew, unsigned int iterations) {
+	Timer timer;
+	string data;
+	size_t total = 0;
+	
+	for (unsigned int i = 0; i < iterations; i++) {
+		if (useNew) {
+			total += convertNew(names, data);
+		} else {
+			total += convertOld(names, data);
+		}
+	}
+	
+	unsigned long long elapsed = timer.elapsed();
+	printf("  %-4s: %u iterations in %llu msec (%.3f usec per header set, %llu bytes)\n",
+		name, iterations, elapsed, elapsed * 1000.0 / iterations,
+		(unsigned long long) total);
+}
+
+int
+main(int argc, char *argv[]) {
+	unsigned int iterations = (argc > 1) ? atoi(argv[1]) : 1000000;
+	const char **sets[] = { chrome, firefox, xhrBehindProxy };
+	const char *setNames[] = { "Chrome", "Firefox", "XHR behind a proxy" };
+	
+	for (unsigned int i = 0; i < sizeof(sets) / sizeof(sets[0]); i++) {
+		printf("%s\n", setNames[i]);
+		benchmark("old", sets[i], false, iterations);
+		benchmark("new", sets[i], true, iterations);
+	}
+	return 0;
+}
@@ -0,0 +1,99 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2013 Phusion
+ *
+ *  "Phusion Passenger" is a trademark of Hongli Lai & Ninh Bui.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+/*
+ * Compares the cost of collecting process metrics through 'ps' with the cost
+ * of reading them directly from /proc.
+ *
+ * Usage: ProcessMetricsCollectorBenchmark [NUMBER_OF_PROCESSES] [ITERATIONS]
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <Utils/ProcessMetricsCollector.h>
+#include <Utils/Timer.h>
+
+using namespace std;
+using namespace Passenger;
+
+static void
+benchmark(const char *name, ProcessMetricsCollector &collector, const vector<pid_t> &pids,
+	unsigned int iterations)
+{
+	Timer timer;
+	size_t found = 0;
+	
+	for (unsigned int i = 0; i < iterations; i++) {
+		found = collector.collect(pids).size();
+	}
+	
+	unsigned long long elapsed = timer.elapsed();
+	printf("%-6s: %u iterations in %llu msec (%.2f msec per iteration, %u/%u processes found)\n",
+		name, iterations, elapsed, (double) elapsed / iterations,
+		(unsigned int) found, (unsigned int) pids.size());
+}
+
+int
+main(int argc, char *argv[]) {
+	unsigned int count = (argc > 1) ? atoi(argv[1]) : 100;
+	unsigned int iterations = (argc > 2) ? atoi(argv[2]) : 50;
+	vector<pid_t> pids;
+	
+	for (unsigned int i = 0; i < count; i++) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			pause();
+			_exit(0);
+		} else if (pid == -1) {
+			perror("fork()");
+			break;
+		} else {
+			pids.push_back(pid);
+		}
+	}
+	
+	printf("Collecting metrics for %u processes\n", (unsigned int) pids.size());
+	
+	ProcessMetricsCollector collector;
+	collector.setProcFsEnabled(false);
+	benchmark("ps", collector, pids, iterations);
+	
+	#ifdef __linux__
+		collector.setProcFsEnabled(true);
+		benchmark("/proc", collector, pids, iterations);
+	#endif
+	
+	for (unsigned int i = 0; i < pids.size(); i++) {
+		kill(pids[i], SIGKILL);
+		waitpid(pids[i], NULL, 0);
+	}
+	return 0;
+}
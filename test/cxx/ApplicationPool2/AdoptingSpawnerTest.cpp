@@ -0,0 +1,146 @@
+#include <TestSupport.h>
+#include <ApplicationPool2/SpawnerFactory.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+using namespace std;
+using namespace Passenger;
+using namespace Passenger::ApplicationPool2;
+
+namespace tut {
+	struct ApplicationPool2_AdoptingSpawnerTest {
+		ServerInstanceDirPtr serverInstanceDir;
+		ServerInstanceDir::GenerationPtr generation;
+		BackgroundEventLoop bg;
+		SpawnerConfigPtr spawnerConfig;
+		SpawnerFactoryPtr spawnerFactory;
+		vector<ProcessPtr> processes;
+
+		ApplicationPool2_AdoptingSpawnerTest() {
+			createServerInstanceDirAndGeneration(serverInstanceDir, generation);
+			spawnerConfig = boost::make_shared<SpawnerConfig>();
+			spawnerFactory = boost::make_shared<SpawnerFactory>(bg.safe, *resourceLocator,
+				generation, spawnerConfig);
+			bg.start();
+			setLogLevel(LVL_ERROR);
+		}
+
+		~ApplicationPool2_AdoptingSpawnerTest() {
+			vector<ProcessPtr>::iterator it;
+			for (it = processes.begin(); it != processes.end(); it++) {
+				(*it)->requiresShutdown = false;
+			}
+			processes.clear();
+			spawnerFactory.reset();
+			setLogLevel(DEFAULT_LOG_LEVEL);
+		}
+
+		Options createOptions(const string &appGroupName) {
+			Options options;
+			options.spawnMethod = "dummy";
+			options.appRoot = "stub/rack";
+			options.appGroupName = appGroupName;
+			return options;
+		}
+
+		ProcessHandoff createProcessHandoff(const string &appGroupName, pid_t pid) {
+			ProcessHandoff process;
+			process.appGroupName = appGroupName;
+			process.pid = pid;
+			process.gupid = "adopted-" + toString(pid);
+			process.connectPassword = "secret";
+			process.adminSocket = createUnixSocketPair()[0];
+			process.sockets = boost::make_shared<SocketList>();
+			process.sockets->add("main", "tcp://127.0.0.1:1234", "session", 1);
+			return process;
+		}
+
+		static pid_t exitedPid() {
+			pid_t pid = fork();
+			if (pid == 0) {
+				_exit(0);
+			}
+			waitpid(pid, NULL, 0);
+			return pid;
+		}
+
+		ProcessPtr spawn(const SpawnerPtr &spawner, const Options &options) {
+			ProcessPtr process = spawner->spawn(options);
+			processes.push_back(process);
+			return process;
+		}
+	};
+
+	DEFINE_TEST_GROUP(ApplicationPool2_AdoptingSpawnerTest);
+
+	TEST_METHOD(1) {
+		// The first Spawner created for an app group hands out the adopted
+		// processes before spawning new ones, and skips processes that have
+		// exited in the mean time.
+		vector<ProcessHandoff> handoffs;
+		handoffs.push_back(createProcessHandoff("app1", getpid()));
+		handoffs.push_back(createProcessHandoff("app1", exitedPid()));
+		handoffs.push_back(createProcessHandoff("app1", getppid()));
+		handoffs.push_back(createProcessHandoff("app2", getpid()));
+		spawnerFactory->addAdoptableProcesses(handoffs);
+
+		Options options = createOptions("app1");
+		SpawnerPtr spawner = spawnerFactory->create(options);
+		ensure("(1)", dynamic_pointer_cast<AdoptingSpawner>(spawner) != NULL);
+
+		ProcessPtr process = spawn(spawner, options);
+		ensure_equals("(2)", process->pid, getpid());
+		ensure_equals("(3)", process->gupid, "adopted-" + toString(getpid()));
+		ensure_equals("(4)", process->connectPassword, "secret");
+		ensure_equals("(5)", process->sockets->size(), 1u);
+
+		process = spawn(spawner, options);
+		ensure_equals("(6)", process->pid, getppid());
+
+		process = spawn(spawner, options);
+		ensure("(7)", process->dummy);
+		ensure_equals("(8)", process->gupid.find("adopted-"), string::npos);
+
+		// Spawners created later for the same app group don't adopt anything.
+		spawner = spawnerFactory->create(options);
+		ensure("(9)", dynamic_pointer_cast<AdoptingSpawner>(spawner) == NULL);
+
+		// Other app groups get their own processes.
+		spawner = spawnerFactory->create(createOptions("app2"));
+		process = spawn(spawner, createOptions("app2"));
+		ensure_equals("(10)", process->gupid, "adopted-" + toString(getpid()));
+	}
+
+	TEST_METHOD(2) {
+		// discardAdoptableProcesses() shuts down processes that no Spawner has
+		// claimed, as well as processes that an AdoptingSpawner has claimed but
+		// not handed out yet.
+		FileDescriptor peer1, peer2;
+		{
+			SocketPair adminSocket1 = createUnixSocketPair();
+			SocketPair adminSocket2 = createUnixSocketPair();
+			vector<ProcessHandoff> handoffs;
+			handoffs.push_back(createProcessHandoff("app1", getpid()));
+			handoffs.push_back(createProcessHandoff("app1", getpid()));
+			handoffs.back().adminSocket = adminSocket1[0];
+			handoffs.push_back(createProcessHandoff("app2", getpid()));
+			handoffs.back().adminSocket = adminSocket2[0];
+			spawnerFactory->addAdoptableProcesses(handoffs);
+			peer1 = adminSocket1[1];
+			peer2 = adminSocket2[1];
+		}
+
+		Options options = createOptions("app1");
+		SpawnerPtr spawner = spawnerFactory->create(options);
+		spawn(spawner, options);
+
+		ensure_equals("(1)", spawnerFactory->discardAdoptableProcesses(), 2u);
+		char buf;
+		ensure_equals("(2)", readExact(peer1, &buf, 1), 0u);
+		ensure_equals("(3)", readExact(peer2, &buf, 1), 0u);
+
+		ProcessPtr process = spawn(spawner, options);
+		ensure("(4)", process->dummy);
+		ensure_equals("(5)", spawnerFactory->discardAdoptableProcesses(), 0u);
+	}
+}
@@ -619,6 +619,138 @@ namespace tut {
 		ensure_equals(pool->getSuperGroupCount(), 0u);
 	}
 	
+	TEST_METHOD(17) {
+		// If spawnConcurrency > 1 then the Group spawns multiple
+		// processes in parallel.
+		Options options = createOptions();
+		options.minProcesses = 3;
+		options.spawnConcurrency = 3;
+		GroupPtr group = pool->findOrCreateGroup(options);
+		spawnerConfig->spawnTime = 1000000;
+		
+		ScopedLock l(pool->syncher);
+		pool->asyncGet(options, callback, false);
+		ensure(group->spawning());
+		ensure_equals(group->utilization(), 3u);
+		l.unlock();
+		
+		// Spawning serially would take 3 seconds.
+		EVENTUALLY(2,
+			result = pool->getProcessCount() == 3;
+		);
+		EVENTUALLY(5,
+			LockGuard l2(pool->syncher);
+			result = !group->spawning();
+		);
+	}
+	
+	TEST_METHOD(18) {
+		// Parallel spawning does not exceed the pool's capacity.
+		Options options = createOptions();
+		options.minProcesses = 3;
+		options.spawnConcurrency = 3;
+		pool->setMax(2);
+		GroupPtr group = pool->findOrCreateGroup(options);
+		spawnerConfig->spawnTime = 100000;
+		
+		ScopedLock l(pool->syncher);
+		pool->asyncGet(options, callback, false);
+		ensure_equals(group->utilization(), 2u);
+		ensure(pool->atFullCapacity(false));
+		l.unlock();
+		
+		EVENTUALLY(5,
+			LockGuard l2(pool->syncher);
+			result = !group->spawning();
+		);
+		ensure_equals(pool->getProcessCount(), 2u);
+	}
+	
+	TEST_METHOD(19) {
+		// When load balancing by latency, asyncGet() checks out a session from
+		// the process with the lowest expected latency, not the one with the
+		// lowest utilization.
+		Options options = createOptions();
+		options.loadBalancing = "latency";
+		options.minProcesses = 2;
+		pool->setMax(2);
+		spawnerConfig->concurrency = 2;
+		pool->asyncGet(options, callback);
+		EVENTUALLY(5,
+			result = number == 1 && pool->getProcessCount() == 2;
+		);
+		currentSession.reset();
+		
+		GroupPtr group = pool->findOrCreateGroup(options);
+		ProcessPtr slowProcess, fastProcess;
+		{
+			LockGuard l(pool->syncher);
+			slowProcess = group->enabledProcesses.front();
+			fastProcess = group->enabledProcesses.back();
+			slowProcess->averageResponseTime = 100000;
+			fastProcess->averageResponseTime = 1000;
+		}
+		
+		// The fast process is preferred even if it's already busy...
+		vector<SessionPtr> sessions;
+		for (int i = 0; i < 2; i++) {
+			pool->asyncGet(options, callback);
+			EVENTUALLY(5,
+				result = number == i + 2;
+			);
+			ensure_equals(currentSession->getProcess(), fastProcess);
+			sessions.push_back(currentSession);
+			currentSession.reset();
+		}
+		
+		// ...until it's at full utilization.
+		pool->asyncGet(options, callback);
+		EVENTUALLY(5,
+			result = number == 4;
+		);
+		ensure_equals(currentSession->getProcess(), slowProcess);
+	}
+	
+	TEST_METHOD(82) {
+		// When load balancing by latency, a process that hasn't served a
+		// request yet is assumed to be as fast as the others, so that its
+		// open sessions count against it even if its concurrency is unlimited.
+		Options options = createOptions();
+		options.loadBalancing = "latency";
+		options.minProcesses = 2;
+		pool->setMax(2);
+		spawnerConfig->concurrency = 0;
+		pool->asyncGet(options, callback);
+		EVENTUALLY(5,
+			result = number == 1 && pool->getProcessCount() == 2;
+		);
+		currentSession.reset();
+		
+		GroupPtr group = pool->findOrCreateGroup(options);
+		ProcessPtr sampledProcess, unsampledProcess;
+		{
+			LockGuard l(pool->syncher);
+			sampledProcess = group->enabledProcesses.front();
+			unsampledProcess = group->enabledProcesses.back();
+			sampledProcess->averageResponseTime = 1000;
+			unsampledProcess->averageResponseTime = 0;
+		}
+		
+		vector<SessionPtr> sessions;
+		for (int i = 0; i < 4; i++) {
+			pool->asyncGet(options, callback);
+			EVENTUALLY(5,
+				result = number == i + 2;
+			);
+			sessions.push_back(currentSession);
+			currentSession.reset();
+		}
+		
+		LockGuard l(pool->syncher);
+		ensure_equals("(1)", sampledProcess->sessions, 2);
+		ensure_equals("(2)", unsampledProcess->sessions, 2);
+	}
+	
 	
 	/*********** Test asyncGet() behavior on multiple SuperGroups,
 	             each with a single Group ***********/
@@ -1746,6 +1878,43 @@ namespace tut {
 		pool->get(options, &ticket).reset();
 	}
 
+	TEST_METHOD(80) {
+		// Without stat throttling, the restart files are checked outside the
+		// pool lock. Restarts should still be detected, and the result of a
+		// check should not be applied to later get() actions.
+		TempDirCopy dir("stub/wsgi", "tmp.wsgi");
+		Options options = createOptions();
+		options.appRoot = "tmp.wsgi";
+
+		string gupid = pool->get(options, &ticket)->getProcess()->gupid;
+		ensure_equals("(1)", pool->get(options, &ticket)->getProcess()->gupid, gupid);
+
+		touchFile("tmp.wsgi/tmp/restart.txt", 1);
+		string gupid2 = pool->get(options, &ticket)->getProcess()->gupid;
+		ensure("(2)", gupid2 != gupid);
+		ensure_equals("(3)", pool->get(options, &ticket)->getProcess()->gupid, gupid2);
+		ensure_equals("(4)", pool->getProcessCount(), 1u);
+	}
+
+	TEST_METHOD(81) {
+		// With stat throttling, the restart files are checked inside the pool
+		// lock. Changes should be detected once the throttle period has passed.
+		TempDirCopy dir("stub/wsgi", "tmp.wsgi");
+		Options options = createOptions();
+		options.appRoot = "tmp.wsgi";
+		options.statThrottleRate = 2;
+
+		SystemTime::force(1000);
+		string gupid = pool->get(options, &ticket)->getProcess()->gupid;
+		touchFile("tmp.wsgi/tmp/restart.txt", 1);
+		ensure_equals("(1)", pool->get(options, &ticket)->getProcess()->gupid, gupid);
+
+		SystemTime::force(1003);
+		string gupid2 = pool->get(options, &ticket)->getProcess()->gupid;
+		ensure("(2)", gupid2 != gupid);
+		ensure_equals("(3)", pool->get(options, &ticket)->getProcess()->gupid, gupid2);
+	}
+
 
 	/*****************************/
 }
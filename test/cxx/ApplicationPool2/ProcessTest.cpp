@@ -1,6 +1,7 @@
 #include <TestSupport.h>
 #include <ApplicationPool2/Process.h>
 #include <Utils/IOUtils.h>
+#include <poll.h>
 
 using namespace Passenger;
 using namespace Passenger::ApplicationPool2;
@@ -24,19 +25,19 @@ namespace tut {
 			server1 = createTcpServer("127.0.0.1", 0);
 			getsockname(server1, (struct sockaddr *) &addr, &len);
 			sockets->add("main1",
-				"tcp://127.0.0.1:" + toString(addr.sin_port),
+				"tcp://127.0.0.1:" + toString(ntohs(addr.sin_port)),
 				"session", 3);
 			
 			server2 = createTcpServer("127.0.0.1", 0);
 			getsockname(server2, (struct sockaddr *) &addr, &len);
 			sockets->add("main2",
-				"tcp://127.0.0.1:" + toString(addr.sin_port),
+				"tcp://127.0.0.1:" + toString(ntohs(addr.sin_port)),
 				"session", 3);
 			
 			server3 = createTcpServer("127.0.0.1", 0);
 			getsockname(server3, (struct sockaddr *) &addr, &len);
 			sockets->add("main3",
-				"tcp://127.0.0.1:" + toString(addr.sin_port),
+				"tcp://127.0.0.1:" + toString(ntohs(addr.sin_port)),
 				"session", 3);
 			
 			adminSocket = createUnixSocketPair();
@@ -136,4 +137,149 @@ namespace tut {
 		ensure(process->atFullCapacity());
 		ensure(process->newSession() == NULL);
 	}
+	
+	TEST_METHOD(5) {
+		// initiateNonBlocking() connects to a TCP socket without blocking.
+		ProcessPtr process = boost::make_shared<Process>(bg.safe,
+			123, "", "", adminSocket[0],
+			errorPipe[0], sockets, 0, 0);
+		process->dummy = true;
+		process->requiresShutdown = false;
+		SessionPtr session = process->newSession();
+		bool initiated = session->initiateNonBlocking();
+		for (int i = 0; i < 100 && !initiated; i++) {
+			ensure(session->connecting());
+			ensure(!session->initiated());
+			struct pollfd pfd;
+			pfd.fd = session->fd();
+			pfd.events = POLLOUT;
+			pfd.revents = 0;
+			poll(&pfd, 1, 100);
+			initiated = session->continueInitiate();
+		}
+		ensure("Session initiated", initiated);
+		ensure(session->initiated());
+		ensure(!session->connecting());
+		ensure(session->fd() != -1);
+		session->close(true);
+		ensure_equals(session->fd(), -1);
+	}
+	
+	TEST_METHOD(6) {
+		// initiateNonBlocking() reports that connecting is in progress if the
+		// backlog of a Unix domain socket is full, and continueInitiate()
+		// finishes connecting once there is room again.
+		DeleteFileEventually d("tmp.socket");
+		FileDescriptor server(createUnixServer("tmp.socket", 1));
+		SocketListPtr unixSockets = boost::make_shared<SocketList>();
+		unixSockets->add("main", "unix:tmp.socket", "session", 0);
+		ProcessPtr process = boost::make_shared<Process>(bg.safe,
+			123, "", "", adminSocket[0],
+			errorPipe[0], unixSockets, 0, 0);
+		process->dummy = true;
+		process->requiresShutdown = false;
+		
+		vector<SessionPtr> sessions;
+		SessionPtr session;
+		for (int i = 0; i < 100; i++) {
+			session = process->newSession();
+			sessions.push_back(session);
+			if (!session->initiateNonBlocking()) {
+				break;
+			}
+		}
+		ensure("Backlog is full", session->connecting());
+		ensure(!session->initiated());
+		ensure(!session->continueInitiate());
+		
+		FileDescriptor(syscalls::accept(server, NULL, NULL));
+		ensure("Connected after backlog drained", session->continueInitiate());
+		ensure(session->initiated());
+		ensure(!session->connecting());
+	}
+	
+	TEST_METHOD(7) {
+		// abortInitiate() cancels a connection attempt.
+		DeleteFileEventually d("tmp.socket");
+		FileDescriptor server(createUnixServer("tmp.socket", 1));
+		SocketListPtr unixSockets = boost::make_shared<SocketList>();
+		unixSockets->add("main", "unix:tmp.socket", "session", 0);
+		ProcessPtr process = boost::make_shared<Process>(bg.safe,
+			123, "", "", adminSocket[0],
+			errorPipe[0], unixSockets, 0, 0);
+		process->dummy = true;
+		process->requiresShutdown = false;
+		
+		vector<SessionPtr> sessions;
+		SessionPtr session;
+		for (int i = 0; i < 100; i++) {
+			session = process->newSession();
+			sessions.push_back(session);
+			if (!session->initiateNonBlocking()) {
+				break;
+			}
+		}
+		ensure(session->connecting());
+		session->abortInitiate();
+		ensure(!session->connecting());
+		ensure(!session->initiated());
+		ensure_equals(session->fd(), -1);
+	}
+	
+	TEST_METHOD(8) {
+		// The expected latency is the average response time multiplied by
+		// the number of sessions that would be open after checking out one more.
+		ProcessPtr process = boost::make_shared<Process>(bg.safe,
+			123, "", "", adminSocket[0],
+			errorPipe[0], sockets, 0, 0);
+		process->dummy = true;
+		process->requiresShutdown = false;
+		
+		// Until a response time has been recorded, the given default is used.
+		ensure_equals(process->expectedLatency(0), 0.0);
+		ensure_equals(process->expectedLatency(500), 500.0);
+		
+		process->recordResponseTime(1000);
+		ensure_equals(process->averageResponseTime, 1000.0);
+		ensure_equals(process->expectedLatency(500), 1000.0);
+		
+		SessionPtr session = process->newSession();
+		ensure_equals(process->expectedLatency(500), 2000.0);
+		
+		for (int i = 0; i < 50; i++) {
+			process->recordResponseTime(5000);
+		}
+		ensure(fabs(process->averageResponseTime - 5000) < 10);
+	}
+	
+	TEST_METHOD(9) {
+		// A connection that is closed successfully is reused by the next
+		// session, unless the other side has closed it in the mean time.
+		Socket &socket = sockets->front();
+		SessionPtr session = boost::make_shared<Session>(ProcessPtr(), &socket);
+		session->initiate();
+		ensure(session->connectionIsPersistent());
+		int fd = session->fd();
+		FileDescriptor peer(syscalls::accept(server1, NULL, NULL));
+		session->close(true);
+		ensure_equals(socket.getIdleConnectionCount(), 1);
+		
+		session = boost::make_shared<Session>(ProcessPtr(), &socket);
+		session->initiate();
+		ensure_equals("The idle connection is reused", (int) session->fd(), fd);
+		session->close(true);
+		
+		peer.close();
+		struct pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		ensure_equals(poll(&pfd, 1, 1000), 1);
+		
+		session = boost::make_shared<Session>(ProcessPtr(), &socket);
+		session->initiate();
+		ensure_equals("The stale connection is discarded", socket.getIdleConnectionCount(), 0);
+		FileDescriptor peer2(syscalls::accept(server1, NULL, NULL));
+		session->close(false);
+	}
 }
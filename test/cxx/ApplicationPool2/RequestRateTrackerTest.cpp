@@ -0,0 +1,95 @@
+#include <TestSupport.h>
+#include <ApplicationPool2/RequestRateTracker.h>
+
+using namespace Passenger;
+using namespace Passenger::ApplicationPool2;
+using namespace std;
+
+namespace tut {
+	struct ApplicationPool2_RequestRateTrackerTest {
+		RequestRateTracker tracker;
+		unsigned long long now;
+
+		ApplicationPool2_RequestRateTrackerTest() {
+			now = 1000000000;
+		}
+
+		/** Simulates the given number of requests per second for the given
+		 * number of seconds, spread evenly over each second.
+		 */
+		void simulate(unsigned int requestsPerSecond, unsigned int seconds) {
+			for (unsigned int i = 0; i < seconds; i++) {
+				for (unsigned int j = 0; j < requestsPerSecond; j++) {
+					tracker.recordArrival(now + j * (1000000 / requestsPerSecond));
+				}
+				now += 1000000;
+			}
+		}
+	};
+
+	DEFINE_TEST_GROUP(ApplicationPool2_RequestRateTrackerTest);
+
+	TEST_METHOD(1) {
+		// Nothing is predicted if no requests have arrived.
+		ensure_equals(tracker.getShortTermRate(now), 0.0);
+		ensure_equals(tracker.getLongTermRate(now), 0.0);
+		ensure(!tracker.isRising(now));
+		ensure_equals(tracker.predictedConcurrency(now), 0.0);
+	}
+
+	TEST_METHOD(2) {
+		// Arrivals in the bucket that is still being filled are not counted.
+		tracker.recordArrival(now);
+		for (int i = 0; i < 100; i++) {
+			tracker.recordArrival(now + i * 1000);
+		}
+		ensure_equals(tracker.getShortTermRate(now + 500000), 0.0);
+		ensure(tracker.getShortTermRate(now + 1000000) > 0);
+	}
+
+	TEST_METHOD(3) {
+		// Under a steady load, both averages converge to the actual rate
+		// and traffic is not considered to be rising.
+		simulate(10, 300);
+		ensure("(1)", fabs(tracker.getShortTermRate(now) - 10) < 0.1);
+		ensure("(2)", fabs(tracker.getLongTermRate(now) - 10) < 0.1);
+		ensure("(3)", !tracker.isRising(now));
+	}
+
+	TEST_METHOD(4) {
+		// The predicted concurrency is the arrival rate times the service time.
+		tracker.recordServiceTime(500000);
+		simulate(10, 300);
+		ensure(fabs(tracker.predictedConcurrency(now) - 5) < 0.1);
+	}
+
+	TEST_METHOD(5) {
+		// A sudden increase in traffic is detected as a rising trend, and the
+		// prediction extrapolates it.
+		tracker.recordServiceTime(500000);
+		simulate(2, 300);
+		simulate(20, 5);
+		ensure("(1)", tracker.isRising(now));
+		ensure("(2)", tracker.predictedConcurrency(now) >
+			tracker.getShortTermRate(now) * tracker.getServiceTime());
+	}
+
+	TEST_METHOD(6) {
+		// The averages decay while no requests arrive.
+		simulate(10, 300);
+		now += 60 * 1000000ull;
+		ensure("(1)", tracker.getShortTermRate(now) < 0.01);
+		ensure("(2)", tracker.getLongTermRate(now) < 10 * 0.4);
+		ensure("(3)", !tracker.isRising(now));
+	}
+
+	TEST_METHOD(7) {
+		// The service time is a moving average of the recorded samples.
+		tracker.recordServiceTime(1000000);
+		ensure_equals(tracker.getServiceTime(), 1.0);
+		for (int i = 0; i < 100; i++) {
+			tracker.recordServiceTime(200000);
+		}
+		ensure(fabs(tracker.getServiceTime() - 0.2) < 0.01);
+	}
+}
@@ -2,6 +2,7 @@
 #include <ApplicationPool2/SmartSpawner.h>
 #include <Logging.h>
 #include <Utils/json.h>
+#include <Utils/Timer.h>
 #include <unistd.h>
 #include <climits>
 #include <signal.h>
@@ -60,6 +61,17 @@ namespace tut {
 			return options;
 		}
 
+		static void spawnAndRecord(boost::shared_ptr<SmartSpawner> spawner, Options options,
+			ProcessPtr *process, string *error)
+		{
+			try {
+				*process = spawner->spawn(options);
+				(*process)->requiresShutdown = false;
+			} catch (const std::exception &e) {
+				*error = e.what();
+			}
+		}
+
 		void _gatherOutput(const char *data, unsigned int size) {
 			boost::lock_guard<boost::mutex> l(gatheredOutputSyncher);
 			gatheredOutput.append(data, size);
@@ -245,4 +257,33 @@ namespace tut {
 			result = gatheredOutput.find("hello world!\n") != string::npos;
 		);
 	}
+
+	TEST_METHOD(86) {
+		// Multiple threads can spawn at the same time. Only the spawn command
+		// is sent to the preloader one thread at a time; the startup of the
+		// forked processes happens in parallel.
+		Options options = createOptions();
+		options.appRoot      = "stub/rack";
+		options.startCommand = "bash\t" "-c\t" "sleep 2; exec ruby start.rb";
+		options.startupFile  = "start.rb";
+		boost::shared_ptr<SmartSpawner> spawner = createSpawner(options);
+		// Start the preloader first so that it doesn't count towards the time.
+		process = spawner->spawn(options);
+		process->requiresShutdown = false;
+
+		ProcessPtr process1, process2;
+		string error1, error2;
+		Timer timer;
+		boost::thread thr1(boost::bind(spawnAndRecord, spawner, options, &process1, &error1));
+		boost::thread thr2(boost::bind(spawnAndRecord, spawner, options, &process2, &error2));
+		thr1.join();
+		thr2.join();
+		unsigned long long elapsed = timer.elapsed();
+
+		ensure_equals(error1, "");
+		ensure_equals(error2, "");
+		ensure(process1->pid != process2->pid);
+		ensure("The two spawns overlapped (" + toString(elapsed) + " msec)",
+			elapsed < 3800);
+	}
 }
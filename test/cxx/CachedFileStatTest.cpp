@@ -1,6 +1,7 @@
 #include "TestSupport.h"
 #include "Utils/CachedFileStat.hpp"
 #include "Utils/SystemTime.h"
+#include "Utils.h"
 #include <sys/types.h>
 #include <utime.h>
 
@@ -17,6 +18,14 @@ namespace tut {
 			unlink("test2.txt");
 			unlink("test3.txt");
 			unlink("test4.txt");
+			removeDirTree("tmp.stat");
+		}
+		
+		/** Returns the absolute path of the given file inside tmp.stat. */
+		static string tmpPath(const string &name) {
+			char cwd[PATH_MAX];
+			ensure("getcwd() succeeds", getcwd(cwd, sizeof(cwd)) != NULL);
+			return string(cwd) + "/tmp.stat/" + name;
 		}
 	};
 	
@@ -399,4 +408,122 @@ namespace tut {
 		ensure(stat.knows("test4.txt"));
 		ensure(stat.knows("test5.txt"));
 	}
+	
+	
+	/************ Tests involving inotify ************/
+	
+	#ifdef __linux__
+	TEST_METHOD(20) {
+		// With inotify enabled, both successful and failed stats are
+		// cached until a change is reported, even with a throttle rate of 0.
+		CachedFileStat stat(10);
+		mkdir("tmp.stat", 0700);
+		ensure(stat.enableInotify() != -1);
+		string filename = tmpPath("test.txt");
+		
+		ensure_equals("1st stat fails",
+			stat.stat(filename, &buf, 0),
+			-1);
+		ensure_equals(errno, ENOENT);
+		touch(filename.c_str());
+		ensure_equals("2nd stat used the cached result",
+			stat.stat(filename, &buf, 0),
+			-1);
+		
+		stat.processInotifyEvents();
+		ensure_equals("3rd stat succeeded",
+			stat.stat(filename, &buf, 0),
+			0);
+		
+		unlink(filename.c_str());
+		ensure_equals("4th stat used the cached result",
+			stat.stat(filename, &buf, 0),
+			0);
+		stat.processInotifyEvents();
+		ensure_equals("5th stat fails",
+			stat.stat(filename, &buf, 0),
+			-1);
+	}
+	
+	TEST_METHOD(21) {
+		// Modifying a file invalidates its cache entry.
+		CachedFileStat stat(10);
+		mkdir("tmp.stat", 0700);
+		ensure(stat.enableInotify() != -1);
+		string filename = tmpPath("test.txt");
+		
+		touch(filename.c_str(), 1);
+		stat.stat(filename, &buf, 0);
+		ensure_equals(buf.st_mtime, (time_t) 1);
+		touch(filename.c_str(), 1000);
+		stat.processInotifyEvents();
+		stat.stat(filename, &buf, 0);
+		ensure_equals(buf.st_mtime, (time_t) 1000);
+	}
+	
+	TEST_METHOD(22) {
+		// Creating a directory that didn't exist at the time of the
+		// stat invalidates the cache entry.
+		CachedFileStat stat(10);
+		mkdir("tmp.stat", 0700);
+		ensure(stat.enableInotify() != -1);
+		string filename = tmpPath("subdir//./test.txt");
+		
+		ensure_equals("1st stat fails",
+			stat.stat(filename, &buf, 0),
+			-1);
+		mkdir("tmp.stat/subdir", 0700);
+		touch("tmp.stat/subdir/test.txt");
+		stat.processInotifyEvents();
+		ensure_equals("2nd stat succeeded",
+			stat.stat(filename, &buf, 0),
+			0);
+	}
+	
+	TEST_METHOD(23) {
+		// Swapping a symlinked parent directory invalidates the cache
+		// entries below it.
+		CachedFileStat stat(10);
+		mkdir("tmp.stat", 0700);
+		mkdir("tmp.stat/release1", 0700);
+		mkdir("tmp.stat/release2", 0700);
+		touch("tmp.stat/release1/test.txt", 1);
+		touch("tmp.stat/release2/test.txt", 2);
+		ensure(symlink("release1", "tmp.stat/current") == 0);
+		ensure(stat.enableInotify() != -1);
+		string filename = tmpPath("current/test.txt");
+		
+		stat.stat(filename, &buf, 0);
+		ensure_equals(buf.st_mtime, (time_t) 1);
+		ensure(symlink("release2", "tmp.stat/current.new") == 0);
+		ensure(rename("tmp.stat/current.new", "tmp.stat/current") == 0);
+		stat.processInotifyEvents();
+		stat.stat(filename, &buf, 0);
+		ensure_equals(buf.st_mtime, (time_t) 2);
+	}
+	
+	TEST_METHOD(24) {
+		// Files that can't be watched keep using the throttle rate.
+		CachedFileStat stat(10);
+		mkdir("tmp.stat", 0700);
+		ensure(stat.enableInotify(1) != -1);
+		string filename = tmpPath("test.txt");
+		
+		ensure_equals("1st stat fails",
+			stat.stat(filename, &buf, 0),
+			-1);
+		touch(filename.c_str());
+		ensure_equals("2nd stat did not go through the cache",
+			stat.stat(filename, &buf, 0),
+			0);
+		
+		ensure_equals("Relative filename is not watched",
+			stat.stat("test.txt", &buf, 0),
+			-1);
+		touch("test.txt");
+		ensure_equals("Relative filename did not go through the cache",
+			stat.stat("test.txt", &buf, 0),
+			0);
+	}
+	#endif
 }
@@ -623,4 +623,32 @@ namespace tut {
 		ensure("(3)", !isStarted());
 		ensure_equals("(4)", getBufferSize(), 0u);
 	}
+
+	TEST_METHOD(29) {
+		// Large amounts of data buffered on disk are read back intact,
+		// in blocks of 64 KB.
+		pipe->setThreshold(1024);
+		toConsume = 1024 * 1024;
+		init();
+		string data;
+		for (int i = 0; i < 200000; i++) {
+			data.append(1, 'a' + i % 26);
+		}
+		for (int i = 0; i < 10; i++) {
+			write(StaticString(data.data() + i * 20000, 20000));
+		}
+		EVENTUALLY(5,
+			result = getDataState() == FileBackedPipe::IN_FILE && !isCommittingToDisk();
+		);
+		ensure_equals("(1)", getBufferSize(), 200000u);
+
+		startPipe();
+		EVENTUALLY(5,
+			result = getBufferSize() == 0;
+		);
+		receivedData.erase(std::remove(receivedData.begin(), receivedData.end(), '\n'),
+			receivedData.end());
+		ensure("(2)", receivedData == data);
+		ensure_equals("(3)", consumeCallbackCount, 4);
+	}
 }
@@ -16,7 +16,11 @@ namespace tut {
 		SimpleContext ctx;
 		
 		bool eval(const StaticString &source, bool debug = false) {
-			return Filter(source, debug).run(ctx);
+			Filter filter(source, debug);
+			bool result = filter.run(ctx);
+			string message = "Compiled program and syntax tree agree on '" + source + "'";
+			ensure_equals(message.c_str(), result, filter.runOnSyntaxTree(ctx));
+			return result;
 		}
 		
 		bool validate(const StaticString &source) {
@@ -344,6 +348,42 @@ namespace tut {
 		ensure("(21)", eval("(uri == 'foo' && response_time == 1) || response_time == 10"));
 	}
 	
+	TEST_METHOD(33) {
+		// The compiled program evaluates any combination of logical
+		// operators in the same way as the syntax tree.
+		const char *values[] = { "false", "true" };
+		const char *operators[] = { "&&", "||" };
+		
+		for (int a = 0; a < 2; a++) {
+			for (int b = 0; b < 2; b++) {
+				for (int c = 0; c < 2; c++) {
+					for (int op1 = 0; op1 < 2; op1++) {
+						for (int op2 = 0; op2 < 2; op2++) {
+							string left = string(values[a]) + " " +
+								operators[op1] + " " + values[b];
+							string right = string(values[b]) + " " +
+								operators[op2] + " " + values[c];
+							eval(left + " " + operators[op2] + " " + values[c]);
+							eval("(" + left + ") " + operators[op2] + " " + values[c]);
+							eval(string(values[a]) + " " + operators[op1] + " (" + right + ")");
+						}
+					}
+				}
+			}
+		}
+	}
+	
+	TEST_METHOD(34) {
+		// Integer fields can be used as strings, and string fields as booleans.
+		ctx.statusCode = 201;
+		ctx.uri = "foo";
+		ctx.hints.insert("bar");
+		ensure("(1)", eval("starts_with(status_code, '20')"));
+		ensure("(2)", !eval("starts_with(status_code, '30')"));
+		ensure("(3)", eval("starts_with(uri, 'f') && has_hint('bar')"));
+		ensure("(4)", !eval("has_hint(uri)"));
+	}
+	
 	
 	/******** Error tests *******/
 	
@@ -430,4 +470,24 @@ namespace tut {
 		);
 		ensure_equals(ctx.getResponseTime(), 2);
 	}
+	
+	TEST_METHOD(53) {
+		// ContextFromLogEntries extracts the same information one entry at a time.
+		ContextFromLogEntries ctx;
+		ctx.addEntry(hexatriToULL("1233"), "ATTACH");
+		ctx.addEntry(hexatriToULL("1234"), "BEGIN: request processing (1235, 10, 10)");
+		ctx.addEntry(hexatriToULL("1240"), "URI: /foo");
+		ensure_equals(ctx.getURI(), "/foo");
+		ensure_equals("Response time so far", ctx.getResponseTime(), 33);
+		ctx.addEntry(hexatriToULL("1241"), "Controller action: HomeController#index");
+		ctx.addEntry(hexatriToULL("1242"), "Status: 200 OK");
+		ctx.addEntry(hexatriToULL("1243"), "Initial GC time: 1");
+		ctx.addEntry(hexatriToULL("1244"), "Final GC time: 10");
+		ctx.addEntry(hexatriToULL("2234"), "END: request processing (2234, 10, 10)");
+		ensure_equals(ctx.getController(), "HomeController");
+		ensure_equals(ctx.getResponseTime(), 46655);
+		ensure_equals(ctx.getStatus(), "200 OK");
+		ensure_equals(ctx.getStatusCode(), 200);
+		ensure_equals(ctx.getGcTime(), 9);
+	}
 }
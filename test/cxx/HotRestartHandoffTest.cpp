@@ -0,0 +1,174 @@
+#include <TestSupport.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <agents/HotRestartHandoff.h>
+#include <ApplicationPool2/ProcessHandoff.h>
+#include <Utils/IOUtils.h>
+#include <Utils/MessageIO.h>
+
+using namespace Passenger;
+using namespace Passenger::ApplicationPool2;
+using namespace std;
+
+namespace tut {
+	struct HotRestartHandoffTest {
+		SocketPair connection;
+		bool acknowledged;
+
+		HotRestartHandoffTest() {
+			connection = createUnixSocketPair();
+			acknowledged = false;
+		}
+
+		void writeAndWaitForAcknowledgement(const HotRestartHandoff &handoff) {
+			handoff.writeTo(connection[0]);
+			acknowledged = HotRestartHandoff::waitForAcknowledgement(connection[0]);
+		}
+
+		ProcessHandoff createProcessHandoff(const string &appGroupName, pid_t pid,
+			const FileDescriptor &adminSocket)
+		{
+			ProcessHandoff process;
+			process.appGroupName = appGroupName;
+			process.pid = pid;
+			process.gupid = "gupid-" + toString(pid);
+			process.connectPassword = "secret";
+			process.adminSocket = adminSocket;
+			process.sockets = boost::make_shared<SocketList>();
+			process.sockets->add("main", "unix:/tmp/main", "session", 1);
+			process.sockets->add("http", "tcp://127.0.0.1:1234", "http", 0);
+			process.spawnerCreationTime = 1000;
+			process.spawnStartTime = 2000;
+			return process;
+		}
+	};
+
+	DEFINE_TEST_GROUP(HotRestartHandoffTest);
+
+	TEST_METHOD(1) {
+		// A handoff survives a round trip over a socket, including its
+		// file descriptors.
+		Pipe pipe = createPipe();
+		HotRestartHandoff handoff, received;
+		vector<string> message;
+
+		handoff.addFd(pipe[1]);
+		message.push_back("hello");
+		message.push_back("world");
+		handoff.messages.push_back(message);
+
+		boost::thread writer(boost::bind(
+			&HotRestartHandoffTest::writeAndWaitForAcknowledgement,
+			this, handoff));
+		ensure("(1)", received.readFrom(connection[1]));
+		HotRestartHandoff::acknowledge(connection[1]);
+		writer.join();
+		ensure("(2)", acknowledged);
+
+		ensure_equals("(3)", received.fds.size(), 1u);
+		ensure_equals("(4)", received.messages.size(), 1u);
+		ensure("(5)", received.messages[0] == message);
+		writeExact(received.fds[0], "x", 1);
+		char buf;
+		ensure_equals("(6)", readExact(pipe[0], &buf, 1), 1u);
+		ensure_equals("(7)", buf, 'x');
+	}
+
+	TEST_METHOD(2) {
+		// readFrom() returns false if the connection is closed before a
+		// complete handoff has been read, and waitForAcknowledgement()
+		// returns false if the connection is closed without acknowledgement.
+		HotRestartHandoff received;
+		connection[0].close();
+		ensure("(1)", !received.readFrom(connection[1]));
+		ensure("(2)", received.empty());
+		ensure("(3)", !HotRestartHandoff::waitForAcknowledgement(connection[1]));
+	}
+
+	TEST_METHOD(3) {
+		// A handoff doesn't have to fit in the socket buffer, because the
+		// receiver reads while the sender writes.
+		SocketPair adminSocket = createUnixSocketPair();
+		HotRestartHandoff handoff, received;
+		unsigned int i;
+		int bufsize = 4096;
+
+		setsockopt(connection[0], SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+		for (i = 0; i < 200; i++) {
+			createProcessHandoff("app" + toString(i % 3), 1000 + i,
+				adminSocket[0]).addTo(handoff);
+		}
+
+		boost::thread writer(boost::bind(
+			&HotRestartHandoffTest::writeAndWaitForAcknowledgement,
+			this, handoff));
+		ensure("(1)", received.readFrom(connection[1]));
+		HotRestartHandoff::acknowledge(connection[1]);
+		writer.join();
+		ensure("(2)", acknowledged);
+		ensure_equals("(3)", received.fds.size(), 200u);
+		ensure_equals("(4)", received.messages.size(), 200u);
+	}
+
+	TEST_METHOD(4) {
+		// ProcessHandoff descriptions survive a round trip.
+		SocketPair adminSocket = createUnixSocketPair();
+		Pipe errorPipe = createPipe();
+		HotRestartHandoff handoff, received;
+
+		ProcessHandoff process1 = createProcessHandoff("app1", 1234, adminSocket[0]);
+		process1.errorPipe = errorPipe[0];
+		process1.addTo(handoff);
+		createProcessHandoff("app2", 5678, adminSocket[0]).addTo(handoff);
+		vector<string> other;
+		other.push_back("something else");
+		handoff.messages.push_back(other);
+
+		boost::thread writer(boost::bind(
+			&HotRestartHandoffTest::writeAndWaitForAcknowledgement,
+			this, handoff));
+		ensure("(1)", received.readFrom(connection[1]));
+		HotRestartHandoff::acknowledge(connection[1]);
+		writer.join();
+
+		vector<ProcessHandoff> processes = ProcessHandoff::extractFrom(received);
+		ensure_equals("(2)", processes.size(), 2u);
+		ensure_equals("(3)", processes[0].appGroupName, "app1");
+		ensure_equals("(4)", processes[0].pid, (pid_t) 1234);
+		ensure_equals("(5)", processes[0].gupid, "gupid-1234");
+		ensure_equals("(6)", processes[0].connectPassword, "secret");
+		ensure_equals("(7)", processes[0].spawnerCreationTime, 1000ull);
+		ensure_equals("(8)", processes[0].spawnStartTime, 2000ull);
+		ensure("(9)", processes[0].adminSocket != -1);
+		ensure("(10)", processes[0].errorPipe != -1);
+		ensure_equals("(11)", processes[0].sockets->size(), 2u);
+		ensure_equals("(12)", processes[0].sockets->front().name, "main");
+		ensure_equals("(13)", processes[0].sockets->front().address, "unix:/tmp/main");
+		ensure_equals("(14)", processes[0].sockets->front().protocol, "session");
+		ensure_equals("(15)", processes[0].sockets->front().concurrency, 1);
+		ensure_equals("(16)", processes[0].sockets->back().address, "tcp://127.0.0.1:1234");
+		ensure_equals("(17)", processes[1].appGroupName, "app2");
+		ensure_equals("(18)", processes[1].pid, (pid_t) 5678);
+		ensure_equals("(19)", processes[1].errorPipe, -1);
+
+		writeExact(processes[1].adminSocket, "x", 1);
+		char buf;
+		ensure_equals("(20)", readExact(adminSocket[1], &buf, 1), 1u);
+		ensure_equals("(21)", buf, 'x');
+	}
+
+	TEST_METHOD(5) {
+		// extractFrom() rejects malformed process descriptions.
+		HotRestartHandoff handoff;
+		vector<string> message;
+		message.push_back("process");
+		message.push_back("app1");
+		handoff.messages.push_back(message);
+		try {
+			ProcessHandoff::extractFrom(handoff);
+			fail("IOException expected");
+		} catch (const IOException &) {
+			// Pass.
+		}
+	}
+}
@@ -0,0 +1,91 @@
+#include <TestSupport.h>
+#include <Utils/HttpHeaderNames.h>
+#include <cctype>
+
+using namespace Passenger;
+using namespace std;
+
+namespace tut {
+	struct HttpHeaderNamesTest {
+		/** The straightforward conversion algorithm, for reference. */
+		static string reference(const string &name) {
+			string result = name;
+			for (string::size_type i = 0; i < result.size(); i++) {
+				if (result[i] == '_') {
+					result[i] = '-';
+				} else if (i > 0 && result[i - 1] != '-') {
+					result[i] = tolower((unsigned char) result[i]);
+				}
+			}
+			return result;
+		}
+
+		static string convert(const string &name) {
+			string result(name.size(), '\0');
+			if (!name.empty()) {
+				HttpHeaderNames::convert(name.data(), name.size(), &result[0]);
+			}
+			return result;
+		}
+	};
+
+	DEFINE_TEST_GROUP(HttpHeaderNamesTest);
+
+	TEST_METHOD(1) {
+		// Every common header name is found, which means that hash()
+		// has no collisions, and its HTTP name is the converted name.
+		const HttpHeaderNames::Entry *entries = HttpHeaderNames::entries();
+		for (unsigned int i = 0; entries[i].cgiName != NULL; i++) {
+			const HttpHeaderNames::Entry *entry = HttpHeaderNames::lookup(
+				entries[i].cgiName, strlen(entries[i].cgiName));
+			ensure(entries[i].cgiName, entry == &entries[i]);
+			ensure_equals(entry->size, (unsigned int) strlen(entry->cgiName));
+			ensure_equals(string(entry->httpName), reference(entry->cgiName));
+		}
+	}
+
+	TEST_METHOD(2) {
+		// Other names are not found.
+		ensure(HttpHeaderNames::lookup("", 0) == NULL);
+		ensure(HttpHeaderNames::lookup("HOS", 3) == NULL);
+		ensure(HttpHeaderNames::lookup("HOSTS", 5) == NULL);
+		ensure(HttpHeaderNames::lookup("X_FOO", 5) == NULL);
+		ensure(HttpHeaderNames::lookup("user_agent", 10) == NULL);
+	}
+
+	TEST_METHOD(3) {
+		// convert() gives the same results as the straightforward algorithm
+		// for names of all lengths, with and without underscores.
+		const char *names[] = {
+			"", "A", "AB", "A_B", "_A", "A_", "__", "X_FORWARDED_FOR",
+			"X_SOME_VERY_LONG_CUSTOM_HEADER_NAME_0123", "ABCDEFGH", "ABCDEFG_HIJ",
+			"MIXED_Case_nAME", "WITH-DASH", "A__B", "DIGITS_42_AND_SYMBOLS_@[`{",
+			NULL
+		};
+		for (unsigned int i = 0; names[i] != NULL; i++) {
+			ensure_equals(names[i], convert(names[i]), reference(names[i]));
+		}
+	}
+
+	TEST_METHOD(4) {
+		// convert() leaves all non-letter bytes alone, including those
+		// with the high bit set.
+		string name;
+		for (int i = 1; i < 256; i++) {
+			if (i != '_' && !(i >= 'A' && i <= 'Z')) {
+				name.append(1, (char) i);
+			}
+		}
+		name = "X" + name;
+		ensure_equals(convert(name), reference(name));
+	}
+
+	TEST_METHOD(5) {
+		// append() writes the HTTP name and returns the position after it.
+		char buf[32];
+		char *end = HttpHeaderNames::append(buf, "ACCEPT_ENCODING");
+		ensure_equals(string(buf, end - buf), "Accept-Encoding");
+		end = HttpHeaderNames::append(buf, "X_CUSTOM_THING");
+		ensure_equals(string(buf, end - buf), "X-Custom-Thing");
+	}
+}
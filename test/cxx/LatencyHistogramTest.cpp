@@ -0,0 +1,86 @@
+#include <TestSupport.h>
+#include <Utils/LatencyHistogram.h>
+
+using namespace Passenger;
+using namespace std;
+
+namespace tut {
+	struct LatencyHistogramTest {
+		LatencyHistogram histogram;
+	};
+
+	DEFINE_TEST_GROUP(LatencyHistogramTest);
+
+	TEST_METHOD(1) {
+		// An empty histogram reports zeroes.
+		ensure_equals(histogram.getCount(), 0ull);
+		ensure_equals(histogram.getMean(), 0ull);
+		ensure_equals(histogram.getMax(), 0ull);
+		ensure_equals(histogram.getPercentile(50), 0ull);
+		ensure_equals(histogram.getPercentile(99), 0ull);
+	}
+
+	TEST_METHOD(2) {
+		// Small values are recorded exactly.
+		for (unsigned int i = 1; i <= 10; i++) {
+			histogram.record(i);
+		}
+		ensure_equals(histogram.getCount(), 10ull);
+		ensure_equals(histogram.getMean(), 5ull);
+		ensure_equals(histogram.getMax(), 10ull);
+		ensure_equals(histogram.getPercentile(50), 5ull);
+		ensure_equals(histogram.getPercentile(90), 9ull);
+		ensure_equals(histogram.getPercentile(100), 10ull);
+	}
+
+	TEST_METHOD(3) {
+		// Percentiles of larger values are accurate to within 1/SUB_BUCKETS.
+		for (unsigned long long i = 1; i <= 100000; i++) {
+			histogram.record(i * 10);
+		}
+		unsigned long long p50 = histogram.getPercentile(50);
+		unsigned long long p99 = histogram.getPercentile(99);
+		ensure("p50 lower bound", p50 >= 500000);
+		ensure("p50 upper bound", p50 <= 500000 + 500000 / LatencyHistogram::SUB_BUCKETS);
+		ensure("p99 lower bound", p99 >= 990000);
+		ensure("p99 upper bound", p99 <= 990000 + 990000 / LatencyHistogram::SUB_BUCKETS);
+		ensure_equals(histogram.getMax(), 1000000ull);
+		ensure_equals(histogram.getPercentile(100), 1000000ull);
+	}
+
+	TEST_METHOD(4) {
+		// Percentiles never exceed the maximum recorded value.
+		histogram.record(1000001);
+		ensure_equals(histogram.getPercentile(50), 1000001ull);
+	}
+
+	TEST_METHOD(5) {
+		// Values beyond MAX_VALUE are clamped.
+		unsigned long long maxValue = LatencyHistogram::MAX_VALUE;
+		histogram.record(maxValue + 1000);
+		histogram.record(~0ull);
+		ensure_equals(histogram.getCount(), 2ull);
+		ensure_equals(histogram.getMax(), maxValue);
+		ensure_equals(histogram.getPercentile(99), maxValue);
+	}
+
+	TEST_METHOD(6) {
+		// reset() clears everything.
+		histogram.record(123);
+		histogram.reset();
+		ensure_equals(histogram.getCount(), 0ull);
+		ensure_equals(histogram.getMax(), 0ull);
+		ensure_equals(histogram.getPercentile(50), 0ull);
+	}
+
+	TEST_METHOD(7) {
+		// inspect() summarizes the histogram in human-readable units.
+		histogram.record(500);
+		histogram.record(1500);
+		histogram.record(2000000);
+		string result = histogram.inspect();
+		ensure(result, result.find("count=3") != string::npos);
+		ensure(result, result.find("max=2.00s") != string::npos);
+		ensure(result, result.find("p50=1.5ms") != string::npos);
+	}
+}
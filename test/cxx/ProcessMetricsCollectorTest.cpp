@@ -120,4 +120,47 @@ namespace tut {
 			ensure(swap < 10000 || swap == -1);
 		#endif
 	}
+	
+	#ifdef __linux__
+		TEST_METHOD(4) {
+			// On Linux it collects the metrics from /proc.
+			child = spawnChild(50);
+			usleep(500000);
+			vector<pid_t> pids;
+			pids.push_back(child);
+			pids.push_back(getpid());
+			pids.push_back((pid_t) 999999);
+			ProcessMetricMap result = collector.collect(pids);
+			
+			ensure_equals(result.size(), 2u);
+			ensure(result.find(999999) == result.end());
+			ensure_equals(result[child].pid, child);
+			ensure_equals(result[child].ppid, getpid());
+			ensure_equals(result[child].processGroupId, getpgrp());
+			ensure_equals(result[child].uid, geteuid());
+			ensure_equals(result[child].command, "support/allocate_memory 50");
+			ensure("RSS is correct", result[child].rss > 50000 && result[child].rss < 60000);
+			ensure("VM size is correct", result[child].vmsize > 50000);
+			ensure_equals(result[getpid()].ppid, getppid());
+		}
+		
+		TEST_METHOD(5) {
+			// The metrics collected from /proc are equal to the ones reported by 'ps'.
+			child = spawnChild(10);
+			usleep(500000);
+			vector<pid_t> pids;
+			pids.push_back(child);
+			ProcessMetricMap procResult = collector.collect(pids);
+			collector.setProcFsEnabled(false);
+			ProcessMetricMap psResult = collector.collect(pids);
+			
+			ensure_equals(procResult.size(), 1u);
+			ensure_equals(psResult.size(), 1u);
+			ensure_equals(procResult[child].ppid, psResult[child].ppid);
+			ensure_equals(procResult[child].processGroupId, psResult[child].processGroupId);
+			ensure_equals(procResult[child].uid, psResult[child].uid);
+			ensure_equals(procResult[child].command, psResult[child].command);
+			ensure_equals(procResult[child].rss, psResult[child].rss);
+		}
+	#endif
 }
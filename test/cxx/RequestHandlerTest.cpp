@@ -6,6 +6,7 @@
 #include <Utils/json.h>
 #include <Utils/IOUtils.h>
 #include <Utils/Timer.h>
+#include <Utils/Dechunker.h>
 
 #include <boost/shared_array.hpp>
 #include <string>
@@ -33,6 +34,9 @@ namespace tut {
 		PoolPtr pool;
 		Pool::DebugSupportPtr debug;
 		boost::shared_ptr<RequestHandler> handler;
+		/** Additional event loops and handlers for multi-loop tests. */
+		vector< boost::shared_ptr<BackgroundEventLoop> > extraLoops;
+		vector< boost::shared_ptr<RequestHandler> > extraHandlers;
 		FileDescriptor connection;
 		map<string, string> defaultHeaders;
 
@@ -63,11 +67,16 @@ namespace tut {
 		
 		~RequestHandlerTest() {
 			setLogLevel(DEFAULT_LOG_LEVEL);
+			for (unsigned int i = 0; i < extraLoops.size(); i++) {
+				extraLoops[i]->stop();
+			}
 			if (bg.isStarted()) {
 				bg.safe->runSync(boost::bind(&RequestHandlerTest::destroy, this));
 			} else {
 				destroy();
 			}
+			extraHandlers.clear();
+			extraLoops.clear();
 			unlink(serverFilename.c_str());
 		}
 
@@ -124,6 +133,17 @@ namespace tut {
 			gatheredWrite(connection, args_array.get(), args.size() + 2, NULL);
 		}
 
+		/** Builds an SCGI request, like the ones that sendHeaders() sends. */
+		static string buildRequest(const map<string, string> &headers) {
+			string data;
+			map<string, string>::const_iterator it;
+			for (it = headers.begin(); it != headers.end(); it++) {
+				data.append(it->first.data(), it->first.size() + 1);
+				data.append(it->second.data(), it->second.size() + 1);
+			}
+			return toString(data.size()) + ":" + data + ",";
+		}
+
 		string stripHeaders(const string &str) {
 			string::size_type pos = str.find("\r\n\r\n");
 			if (pos == string::npos) {
@@ -141,12 +161,66 @@ namespace tut {
 			return result;
 		}
 
+		unsigned int getFreeClientCount() {
+			unsigned int result;
+			bg.safe->runSync(boost::bind(&RequestHandlerTest::real_getFreeClientCount,
+				this, &result));
+			return result;
+		}
+
+		void real_getFreeClientCount(unsigned int *result) {
+			*result = handler->getFreeClientCount();
+		}
+
 		void real_inspect(string *result) {
 			stringstream stream;
 			handler->inspect(stream);
 			*result = stream.str();
 		}
 
+		static void appendToString(const char *data, size_t size, void *userData) {
+			((string *) userData)->append(data, size);
+		}
+
+		/**
+		 * Reads a single response from a keep-alive connection. The response
+		 * header is returned as-is, followed by the dechunked body.
+		 */
+		string readKeepAliveResponse() {
+			string header, body;
+			Dechunker dechunker;
+			char buf[1024];
+			bool headerSeen = false;
+
+			dechunker.onData = appendToString;
+			dechunker.userData = &body;
+			while (dechunker.acceptingInput()) {
+				ssize_t ret = syscalls::read(connection, buf, sizeof(buf));
+				if (ret == -1) {
+					throw SystemException("Cannot read from connection", errno);
+				} else if (ret == 0) {
+					throw RuntimeException("Unexpected EOF on keep-alive connection");
+				}
+
+				StaticString data(buf, ret);
+				if (!headerSeen) {
+					header.append(buf, ret);
+					string::size_type pos = header.find("\r\n\r\n");
+					if (pos == string::npos) {
+						continue;
+					}
+					data = StaticString(header).substr(pos + 4);
+					headerSeen = true;
+					dechunker.feed(data.data(), data.size());
+					header.resize(pos + 4);
+				} else {
+					dechunker.feed(data.data(), data.size());
+				}
+			}
+			ensure("The response is correctly chunked", !dechunker.hasError());
+			return header + body;
+		}
+
 		static void writeBody(FileDescriptor conn, string body) {
 			try {
 				writeExact(conn, body);
@@ -975,6 +1049,564 @@ namespace tut {
 		ensure(containsSubstring(response, "Counter: 2\n"));
 	}
 
+	TEST_METHOD(53) {
+		set_test_name("Disconnected clients are recycled for new connections");
+
+		agentOptions.requestSocketPassword = "hello world";
+		setLogLevel(-1);
+		init();
+
+		for (int i = 0; i < 3; i++) {
+			connect();
+			writeExact(connection, "hello WORLD");
+			try {
+				readAll(connection);
+			} catch (const SystemException &e) {
+				ensure_equals(e.code(), ECONNRESET);
+			}
+			EVENTUALLY(5,
+				result = getFreeClientCount() == 1;
+			);
+		}
+	}
+
+	TEST_METHOD(54) {
+		set_test_name("Large unbuffered request bodies are forwarded to the application intact.");
+
+		DeleteFileEventually d("/tmp/output.txt");
+
+		// 2 MB of request body, large enough to be spliced on Linux.
+		string requestBody;
+		for (int i = 0; i < 102400; i++) {
+			char buf[100];
+			snprintf(buf, sizeof(buf), "%06d: hello world!\n", i);
+			requestBody.append(buf);
+		}
+
+		init();
+		connect();
+		sendHeaders(defaultHeaders,
+			"PASSENGER_APP_ROOT", wsgiAppPath.c_str(),
+			"PATH_INFO", "/upload",
+			"CONTENT_LENGTH", toString(requestBody.size()).c_str(),
+			"HTTP_X_OUTPUT", "/tmp/output.txt",
+			NULL);
+
+		TempThread thr(boost::bind(RequestHandlerTest::writeBody, connection, requestBody));
+
+		string result = stripHeaders(readAll(connection));
+		ensure_equals(result, "ok");
+		ensure("The request body arrived intact", readAll("/tmp/output.txt") == requestBody);
+	}
+
+	TEST_METHOD(55) {
+		set_test_name("Keep-alive connections can be used for multiple requests.");
+
+		init();
+		connect();
+		for (int i = 0; i < 3; i++) {
+			sendHeaders(defaultHeaders,
+				"PASSENGER_APP_ROOT", wsgiAppPath.c_str(),
+				"PASSENGER_KEEPALIVE", "true",
+				"PATH_INFO", "/",
+				NULL);
+			string response = readKeepAliveResponse();
+			ensure("Status line is correct", containsSubstring(response, "HTTP/1.1 200 OK\r\n"));
+			ensure_equals(stripHeaders(response), "hello <b>world</b>");
+		}
+
+		// Chunked application responses are forwarded as soon as the
+		// terminating chunk is seen, even if the application keeps
+		// the connection open.
+		sendHeaders(defaultHeaders,
+			"PASSENGER_APP_ROOT", wsgiAppPath.c_str(),
+			"PASSENGER_KEEPALIVE", "true",
+			"PATH_INFO", "/chunked",
+			NULL);
+		ensure_equals(stripHeaders(readKeepAliveResponse()),
+			"Counter: 0\nCounter: 1\nCounter: 2\n");
+	}
+
+	TEST_METHOD(56) {
+		set_test_name("Request bodies on keep-alive connections are delimited by CONTENT_LENGTH.");
+
+		DeleteFileEventually d("/tmp/output.txt");
+
+		init();
+		connect();
+		for (int i = 0; i < 2; i++) {
+			string requestBody = "hello world " + toString(i) + "\n";
+			sendHeaders(defaultHeaders,
+				"PASSENGER_APP_ROOT", wsgiAppPath.c_str(),
+				"PASSENGER_KEEPALIVE", "true",
+				"PASSENGER_BUFFERING", (i == 0) ? "true" : "false",
+				"PATH_INFO", "/upload",
+				"CONTENT_LENGTH", toString(requestBody.size()).c_str(),
+				"HTTP_X_OUTPUT", "/tmp/output.txt",
+				NULL);
+			writeExact(connection, requestBody);
+			ensure_equals(stripHeaders(readKeepAliveResponse()), "ok");
+			ensure_equals(readAll("/tmp/output.txt"), requestBody);
+		}
+
+		// If the response is done before the request body has been
+		// read then the connection cannot be reused, so it's closed.
+		sendHeaders(defaultHeaders,
+			"PASSENGER_APP_ROOT", wsgiAppPath.c_str(),
+			"PASSENGER_KEEPALIVE", "true",
+			"PATH_INFO", "/",
+			"CONTENT_LENGTH", "5",
+			NULL);
+		ensure_equals(stripHeaders(readKeepAliveResponse()), "hello <b>world</b>");
+		ensure_equals(readAll(connection), "");
+	}
+
+	TEST_METHOD(57) {
+		set_test_name("Every request on a keep-alive connection is preceded by the connect password.");
+
+		agentOptions.requestSocketPassword = "hello world";
+		init();
+		connect();
+		for (int i = 0; i < 2; i++) {
+			writeExact(connection, "hello world");
+			sendHeaders(defaultHeaders,
+				"PASSENGER_APP_ROOT", wsgiAppPath.c_str(),
+				"PASSENGER_KEEPALIVE", "true",
+				"PATH_INFO", "/",
+				NULL);
+			ensure_equals(stripHeaders(readKeepAliveResponse()), "hello <b>world</b>");
+		}
+
+		setLogLevel(-1);
+		writeExact(connection, "hello wurld");
+		sendHeaders(defaultHeaders,
+			"PASSENGER_APP_ROOT", wsgiAppPath.c_str(),
+			"PASSENGER_KEEPALIVE", "true",
+			"PATH_INFO", "/",
+			NULL);
+		ensure_equals(readAll(connection), "");
+	}
+
+	TEST_METHOD(58) {
+		set_test_name("Response header names are matched case-insensitively.");
+
+		init();
+		connect();
+		sendHeaders(defaultHeaders,
+			"PASSENGER_APP_ROOT", wsgiAppPath.c_str(),
+			"PATH_INFO", "/custom_date",
+			"HTTP_X_DATE", "Thu, 01 Jan 1970 00:00:00 GMT",
+			NULL);
+		string response = readAll(connection);
+		ensure("Status line is correct", startsWith(response, "HTTP/1.1 200 OK\r\n"));
+		ensure("Contains a Status header", containsSubstring(response, "Status: 200 OK\r\n"));
+		ensure("Contains the application's Date header",
+			containsSubstring(response, "DATE: Thu, 01 Jan 1970 00:00:00 GMT\r\n"));
+		ensure("Doesn't add another Date header", !containsSubstring(response, "Date:"));
+		ensure_equals(stripHeaders(response), "ok");
+	}
+
+	TEST_METHOD(59) {
+		set_test_name("The latencies of completed requests are recorded in their group.");
+
+		init();
+		connect();
+		for (int i = 0; i < 2; i++) {
+			sendHeaders(defaultHeaders,
+				"PASSENGER_APP_ROOT", wsgiAppPath.c_str(),
+				"PASSENGER_KEEPALIVE", "true",
+				"PATH_INFO", "/",
+				NULL);
+			ensure_equals(stripHeaders(readKeepAliveResponse()), "hello <b>world</b>");
+		}
+
+		string xml = pool->toXml();
+		ensure(xml, containsSubstring(xml,
+			"<latencies><queue_wait><count>2</count>"));
+		ensure(xml, containsSubstring(xml,
+			"<time_to_first_byte><count>2</count>"));
+		string summary = pool->inspectLatencies();
+		ensure(summary, containsSubstring(summary, "Total        : count=2 "));
+	}
+
+	TEST_METHOD(60) {
+		set_test_name("Pool options are parsed once per PASSENGER_OPTIONS_ID.");
+
+		init();
+		connect();
+		sendHeaders(defaultHeaders,
+			"PASSENGER_APP_ROOT", wsgiAppPath.c_str(),
+			"PASSENGER_APP_GROUP_NAME", "group a",
+			"PASSENGER_OPTIONS_ID", "1",
+			"PASSENGER_KEEPALIVE", "true",
+			"PATH_INFO", "/",
+			NULL);
+		ensure_equals(stripHeaders(readKeepAliveResponse()), "hello <b>world</b>");
+
+		// The web server promised that requests with the same ID have
+		// the same options, so the cached ones are used.
+		sendHeaders(defaultHeaders,
+			"PASSENGER_APP_ROOT", wsgiAppPath.c_str(),
+			"PASSENGER_APP_GROUP_NAME", "group b",
+			"PASSENGER_OPTIONS_ID", "1",
+			"PASSENGER_KEEPALIVE", "true",
+			"PATH_INFO", "/",
+			NULL);
+		ensure_equals(stripHeaders(readKeepAliveResponse()), "hello <b>world</b>");
+		ensure_equals(pool->getSuperGroupCount(), 1u);
+		ensure(pool->superGroups.get("group a") != NULL);
+
+		sendHeaders(defaultHeaders,
+			"PASSENGER_APP_ROOT", wsgiAppPath.c_str(),
+			"PASSENGER_APP_GROUP_NAME", "group b",
+			"PASSENGER_OPTIONS_ID", "2",
+			"PASSENGER_KEEPALIVE", "true",
+			"PATH_INFO", "/",
+			NULL);
+		ensure_equals(stripHeaders(readKeepAliveResponse()), "hello <b>world</b>");
+		ensure_equals(pool->getSuperGroupCount(), 2u);
+		ensure(pool->superGroups.get("group b") != NULL);
+	}
+
+	TEST_METHOD(61) {
+		set_test_name("Connections to http_session applications are reused as long as "
+			"the end of the response can be detected.");
+
+		TempDir tempdir("tmp.handler");
+		writeFile("tmp.handler/start.rb",
+			"require 'socket'\n"
+			"STDOUT.sync = true\n"
+			"puts '!> I have control 1.0'\n"
+			"abort 'Invalid initialization header' if STDIN.readline != \"You have control 1.0\\n\"\n"
+			"while STDIN.readline != \"\\n\"; end\n"
+			"server = TCPServer.new('127.0.0.1', 0)\n"
+			"puts '!> Ready'\n"
+			"puts \"!> socket: main;tcp://127.0.0.1:#{server.addr[1]};http_session;0;4\"\n"
+			"puts '!> '\n"
+			"Thread.new { STDIN.read; exit! }\n"
+			"count = 0\n"
+			"while true\n"
+			"  client = server.accept\n"
+			"  count += 1\n"
+			"  Thread.new(client, count) do |c, id|\n"
+			"    while line = c.gets\n"
+			"      header = line\n"
+			"      while (line = c.gets) && line != \"\\r\\n\"\n"
+			"        header << line\n"
+			"      end\n"
+			"      body = \"connection #{id}\"\n"
+			"      if header =~ /^X-Mode: chunked/i\n"
+			"        c.write(\"HTTP/1.1 200 OK\\r\\nTransfer-Encoding: chunked\\r\\n\\r\\n\" +\n"
+			"          \"#{body.size.to_s(16)}\\r\\n#{body}\\r\\n0\\r\\n\\r\\n\")\n"
+			"      elsif header =~ /^X-Mode: close/i\n"
+			"        c.write(\"HTTP/1.1 200 OK\\r\\nConnection: close\\r\\n\" +\n"
+			"          \"Content-Length: #{body.size}\\r\\n\\r\\n#{body}\")\n"
+			"        break\n"
+			"      else\n"
+			"        c.write(\"HTTP/1.1 200 OK\\r\\nConnection: keep-alive\\r\\n\" +\n"
+			"          \"Content-Length: #{body.size}\\r\\n\\r\\n#{body}\")\n"
+			"      end\n"
+			"    end\n"
+			"    c.close\n"
+			"  end\n"
+			"end\n");
+
+		init();
+		connect();
+		string modes[] = { "normal", "chunked", "close", "normal" };
+		string expected[] = { "connection 1", "connection 1", "connection 1", "connection 2" };
+		for (int i = 0; i < 4; i++) {
+			sendHeaders(defaultHeaders,
+				"PASSENGER_APP_ROOT", (root + "/test/tmp.handler").c_str(),
+				"PASSENGER_APP_TYPE", "",
+				"PASSENGER_START_COMMAND", ("ruby\t" + root + "/test/tmp.handler/start.rb").c_str(),
+				"PASSENGER_KEEPALIVE", "true",
+				"HTTP_X_MODE", modes[i].c_str(),
+				"PATH_INFO", "/",
+				NULL);
+			string response = readKeepAliveResponse();
+			ensure(response, !containsSubstring(response, "Connection:"));
+			ensure_equals(stripHeaders(response), expected[i]);
+		}
+	}
+
+	TEST_METHOD(62) {
+		set_test_name("With multiple request handlers, the first one hands out clients "
+			"round-robin and every handler answers requests.");
+
+		vector< boost::shared_ptr<RequestHandler> > handlers;
+		handler = boost::make_shared<RequestHandler>(bg.safe, requestSocket, pool, agentOptions);
+		handlers.push_back(handler);
+		for (int i = 0; i < 2; i++) {
+			extraLoops.push_back(boost::make_shared<BackgroundEventLoop>(true));
+			extraHandlers.push_back(boost::make_shared<RequestHandler>(extraLoops[i]->safe,
+				requestSocket, pool, agentOptions));
+			handlers.push_back(extraHandlers[i]);
+		}
+		for (unsigned int i = 0; i < handlers.size(); i++) {
+			handlers[i]->benchmarkPoint = RequestHandler::BP_AFTER_PARSING_HEADER;
+		}
+		handler->distributeClients(handlers);
+		bg.start();
+		for (unsigned int i = 0; i < extraLoops.size(); i++) {
+			extraLoops[i]->start();
+		}
+
+		vector<FileDescriptor> connections;
+		for (int i = 0; i < 6; i++) {
+			connections.push_back(FileDescriptor(connectToUnixServer(serverFilename)));
+		}
+		EVENTUALLY(5,
+			result = handlers[0]->getClientCount() == 2
+				&& handlers[1]->getClientCount() == 2
+				&& handlers[2]->getClientCount() == 2;
+		);
+
+		for (unsigned int i = 0; i < connections.size(); i++) {
+			connection = connections[i];
+			sendHeaders(defaultHeaders, "PATH_INFO", "/", NULL);
+			string response = readAll(connection);
+			ensure(response, containsSubstring(response,
+				"Benchmark point: after_parsing_header"));
+		}
+		EVENTUALLY(5,
+			result = handlers[0]->getClientCount() == 0
+				&& handlers[1]->getClientCount() == 0
+				&& handlers[2]->getClientCount() == 0;
+		);
+	}
+
+	TEST_METHOD(63) {
+		set_test_name("The generated Date header is an RFC 1123 date in GMT.");
+
+		init();
+		connect();
+		sendHeaders(defaultHeaders,
+			"PASSENGER_APP_ROOT", wsgiAppPath.c_str(),
+			"PATH_INFO", "/pid",
+			NULL);
+		string response = readAll(connection);
+		string::size_type begin = response.find("Date: ");
+		ensure("Contains a Date header", begin != string::npos);
+		begin += sizeof("Date: ") - 1;
+		string value = response.substr(begin, response.find("\r\n", begin) - begin);
+
+		struct tm tm;
+		memset(&tm, 0, sizeof(tm));
+		const char *end = strptime(value.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+		ensure(value, end != NULL && *end == '\0');
+		time_t date = timegm(&tm);
+		time_t now = time(NULL);
+		ensure(value, date <= now && date >= now - 10);
+	}
+
+	TEST_METHOD(64) {
+		set_test_name("A status line is generated from a Status header without a reason phrase.");
+
+		init();
+		connect();
+		sendHeaders(defaultHeaders,
+			"PASSENGER_APP_ROOT", wsgiAppPath.c_str(),
+			"PATH_INFO", "/custom_status",
+			"HTTP_X_CUSTOM_STATUS", "404",
+			NULL);
+		string response = readAll(connection);
+		ensure(response, startsWith(response, "HTTP/1.1 404 Not Found\r\n"));
+		ensure(response, containsSubstring(response, "Status: 404 Not Found\r\n"));
+		ensure_equals(stripHeaders(response), "ok");
+	}
+
+	TEST_METHOD(65) {
+		set_test_name("Requests on a keep-alive connection can be sent through a request ring.");
+
+		DeleteFileEventually d("/tmp/output.txt");
+
+		init();
+		RequestRingPtr ring = RequestRing::create();
+		SocketPair lifetime = createUnixSocketPair();
+		ensure("(1)", handler->addRequestRing(0xabcdef12345ull,
+			RequestRing::attach(ring->getMemoryFd(), ring->getNotifyFd()),
+			lifetime[1]));
+		ensure("(2)", !handler->addRequestRing(0xabcdef12345ull,
+			RequestRing::attach(ring->getMemoryFd(), ring->getNotifyFd()),
+			lifetime[1]));
+
+		// The first request announces the token over the connection.
+		connect();
+		sendHeaders(defaultHeaders,
+			"PASSENGER_APP_ROOT", wsgiAppPath.c_str(),
+			"PASSENGER_KEEPALIVE", "true",
+			"PASSENGER_REQUEST_RING", "abcdef12345:7",
+			"PATH_INFO", "/",
+			NULL);
+		string response = readKeepAliveResponse();
+		ensure_equals("(3)", stripHeaders(response), "hello <b>world</b>");
+		ensure("(4)", containsSubstring(response, "X-Passenger-Request-Ring: ok\r\n"));
+
+		// Only the response to the announcing request confirms it.
+		map<string, string> headers = defaultHeaders;
+		headers["PASSENGER_APP_ROOT"] = wsgiAppPath;
+		headers["PASSENGER_KEEPALIVE"] = "true";
+		headers["PATH_INFO"] = "/";
+		for (int i = 0; i < 3; i++) {
+			ensure("(5)", ring->push(7, agentOptions.requestSocketPassword + buildRequest(headers)));
+			response = readKeepAliveResponse();
+			ensure_equals("(6)", stripHeaders(response), "hello <b>world</b>");
+			ensure("(7)", !containsSubstring(response, "X-Passenger-Request-Ring"));
+		}
+
+		// Small request bodies travel along with the header.
+		string requestBody = "hello world\n";
+		headers["PATH_INFO"] = "/upload";
+		headers["CONTENT_LENGTH"] = toString(requestBody.size());
+		headers["HTTP_X_OUTPUT"] = "/tmp/output.txt";
+		ensure("(6)", ring->push(7, agentOptions.requestSocketPassword
+			+ buildRequest(headers) + requestBody));
+		ensure_equals("(8)", stripHeaders(readKeepAliveResponse()), "ok");
+		ensure_equals("(9)", readAll("/tmp/output.txt"), requestBody);
+
+		// The connection can still be used directly as well.
+		sendHeaders(defaultHeaders,
+			"PASSENGER_APP_ROOT", wsgiAppPath.c_str(),
+			"PASSENGER_KEEPALIVE", "true",
+			"PATH_INFO", "/",
+			NULL);
+		ensure_equals("(10)", stripHeaders(readKeepAliveResponse()), "hello <b>world</b>");
+	}
+
+	TEST_METHOD(66) {
+		set_test_name("Request ring entries reach connections that belong to another request handler.");
+
+		vector< boost::shared_ptr<RequestHandler> > handlers;
+		handler = boost::make_shared<RequestHandler>(bg.safe, requestSocket, pool, agentOptions);
+		handlers.push_back(handler);
+		extraLoops.push_back(boost::make_shared<BackgroundEventLoop>(true));
+		extraHandlers.push_back(boost::make_shared<RequestHandler>(extraLoops[0]->safe,
+			requestSocket, pool, agentOptions));
+		extraHandlers[0]->setRequestRingRegistry(handler->getRequestRingRegistry());
+		handlers.push_back(extraHandlers[0]);
+		handler->distributeClients(handlers);
+		bg.start();
+		extraLoops[0]->start();
+
+		// The ring is consumed by the second handler, while the
+		// first connection is handed out to the first handler.
+		RequestRingPtr ring = RequestRing::create();
+		SocketPair lifetime = createUnixSocketPair();
+		ensure("(1)", extraHandlers[0]->addRequestRing(1,
+			RequestRing::attach(ring->getMemoryFd(), ring->getNotifyFd()),
+			lifetime[1]));
+		connect();
+		EVENTUALLY(5,
+			result = handler->getClientCount() == 1;
+		);
+		sendHeaders(defaultHeaders,
+			"PASSENGER_APP_ROOT", wsgiAppPath.c_str(),
+			"PASSENGER_KEEPALIVE", "true",
+			"PASSENGER_REQUEST_RING", "1:3",
+			"PATH_INFO", "/",
+			NULL);
+		ensure_equals("(2)", stripHeaders(readKeepAliveResponse()), "hello <b>world</b>");
+
+		map<string, string> headers = defaultHeaders;
+		headers["PASSENGER_APP_ROOT"] = wsgiAppPath;
+		headers["PASSENGER_KEEPALIVE"] = "true";
+		headers["PATH_INFO"] = "/";
+		ensure("(3)", ring->push(3, agentOptions.requestSocketPassword + buildRequest(headers)));
+		ensure_equals("(4)", stripHeaders(readKeepAliveResponse()), "hello <b>world</b>");
+	}
+
+	TEST_METHOD(67) {
+		set_test_name("Request rings are removed when the web server closes its end of the "
+			"lifetime socket, and announcements of unknown rings are ignored.");
+
+		init();
+		RequestRingPtr ring = RequestRing::create();
+		SocketPair lifetime = createUnixSocketPair();
+		ensure("(1)", handler->addRequestRing(1,
+			RequestRing::attach(ring->getMemoryFd(), ring->getNotifyFd()),
+			lifetime[1]));
+		ensure_equals("(2)", handler->getRequestRingCount(), 1u);
+		ensure("(3)", handler->getRequestRingRegistry()->getClientKey(1, 3) != 0);
+
+		connect();
+		sendHeaders(defaultHeaders,
+			"PASSENGER_APP_ROOT", wsgiAppPath.c_str(),
+			"PASSENGER_KEEPALIVE", "true",
+			"PASSENGER_REQUEST_RING", "2:3",
+			"PATH_INFO", "/",
+			NULL);
+		string response = readKeepAliveResponse();
+		ensure_equals("(4)", stripHeaders(response), "hello <b>world</b>");
+		ensure("(5)", !containsSubstring(response, "X-Passenger-Request-Ring"));
+
+		// This entry is dropped because the connection announced a ring
+		// that doesn't exist.
+		map<string, string> headers = defaultHeaders;
+		headers["PASSENGER_APP_ROOT"] = wsgiAppPath;
+		headers["PASSENGER_KEEPALIVE"] = "true";
+		headers["PATH_INFO"] = "/pid";
+		ensure("(6)", ring->push(3, agentOptions.requestSocketPassword + buildRequest(headers)));
+		sendHeaders(defaultHeaders,
+			"PASSENGER_APP_ROOT", wsgiAppPath.c_str(),
+			"PASSENGER_KEEPALIVE", "true",
+			"PATH_INFO", "/",
+			NULL);
+		ensure_equals("(7)", stripHeaders(readKeepAliveResponse()), "hello <b>world</b>");
+
+		lifetime[0].close();
+		EVENTUALLY(5,
+			result = handler->getRequestRingCount() == 0;
+		);
+		ensure_equals("(8)", handler->getRequestRingRegistry()->getClientKey(1, 3), 0ull);
+	}
+
+	TEST_METHOD(68) {
+		set_test_name("Connections that use a request ring are closed when the ring is removed, "
+			"even if they belong to another request handler.");
+
+		vector< boost::shared_ptr<RequestHandler> > handlers;
+		handler = boost::make_shared<RequestHandler>(bg.safe, requestSocket, pool, agentOptions);
+		handlers.push_back(handler);
+		extraLoops.push_back(boost::make_shared<BackgroundEventLoop>(true));
+		extraHandlers.push_back(boost::make_shared<RequestHandler>(extraLoops[0]->safe,
+			requestSocket, pool, agentOptions));
+		extraHandlers[0]->setRequestRingRegistry(handler->getRequestRingRegistry());
+		handlers.push_back(extraHandlers[0]);
+		handler->distributeClients(handlers);
+		bg.start();
+		extraLoops[0]->start();
+
+		RequestRingPtr ring = RequestRing::create();
+		SocketPair lifetime = createUnixSocketPair();
+		ensure("(1)", extraHandlers[0]->addRequestRing(1,
+			RequestRing::attach(ring->getMemoryFd(), ring->getNotifyFd()),
+			lifetime[1]));
+		connect();
+		EVENTUALLY(5,
+			result = handler->getClientCount() == 1;
+		);
+		sendHeaders(defaultHeaders,
+			"PASSENGER_APP_ROOT", wsgiAppPath.c_str(),
+			"PASSENGER_KEEPALIVE", "true",
+			"PASSENGER_REQUEST_RING", "1:3",
+			"PATH_INFO", "/",
+			NULL);
+		ensure_equals("(2)", stripHeaders(readKeepAliveResponse()), "hello <b>world</b>");
+
+		lifetime[0].close();
+		char buf[1024];
+		unsigned long long timeout = 5000000;
+		try {
+			ensure_equals("(3)", readExact(connection, buf, sizeof(buf), &timeout), 0u);
+		} catch (const TimeoutException &) {
+			fail("The connection was not closed");
+		}
+		EVENTUALLY(5,
+			result = handler->getClientCount() == 0;
+		);
+	}
+
 	// Test small response buffering.
 	// Test large response buffering.
 }
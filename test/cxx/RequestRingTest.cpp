@@ -0,0 +1,197 @@
+#include <TestSupport.h>
+#include <RequestRing.h>
+#include <Utils/IOUtils.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <cstdlib>
+
+using namespace Passenger;
+using namespace std;
+
+namespace tut {
+	struct RequestRingTest {
+		RequestRingPtr producer, consumer;
+
+		void init(unsigned int capacity = RequestRing::DEFAULT_CAPACITY) {
+			producer = RequestRing::create(capacity);
+			consumer = RequestRing::attach(producer->getMemoryFd(),
+				producer->getNotifyFd());
+		}
+
+		bool notified() {
+			struct pollfd pfd;
+			pfd.fd = consumer->getNotifyFd();
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+			return poll(&pfd, 1, 0) == 1;
+		}
+
+		static string makeData(unsigned int size, char c) {
+			return string(size, c);
+		}
+	};
+
+	DEFINE_TEST_GROUP(RequestRingTest);
+
+	TEST_METHOD(1) {
+		// Entries are popped in the order in which they were pushed.
+		init();
+		unsigned int token;
+		string data;
+
+		ensure("(1)", !consumer->pop(token, data));
+		ensure("(2)", producer->push(1, "hello"));
+		ensure("(3)", producer->push(2, "world!"));
+		ensure("(4)", consumer->pop(token, data));
+		ensure_equals("(5)", token, 1u);
+		ensure_equals("(6)", data, "hello");
+		ensure("(7)", consumer->pop(token, data));
+		ensure_equals("(8)", token, 2u);
+		ensure_equals("(9)", data, "world!");
+		ensure("(10)", !consumer->pop(token, data));
+	}
+
+	TEST_METHOD(2) {
+		// Entries wrap around the end of the ring.
+		init(RequestRing::MIN_CAPACITY);
+		unsigned int token;
+		string data;
+
+		for (unsigned int i = 0; i < 200; i++) {
+			unsigned int size = 1 + (i * 997) % RequestRing::MAX_ENTRY_SIZE;
+			ensure("(1)", producer->push(i, makeData(size, 'a' + i % 26)));
+			if (i % 2 == 1) {
+				ensure("(2)", producer->push(i + 1000, "x"));
+			}
+			ensure("(3)", consumer->pop(token, data));
+			ensure_equals("(4)", token, i);
+			ensure_equals("(5)", data, makeData(size, 'a' + i % 26));
+			if (i % 2 == 1) {
+				ensure("(6)", consumer->pop(token, data));
+				ensure_equals("(7)", token, i + 1000);
+			}
+		}
+		ensure("(8)", !consumer->pop(token, data));
+	}
+
+	TEST_METHOD(3) {
+		// push() refuses entries that don't fit.
+		init(RequestRing::MIN_CAPACITY);
+		unsigned int token, count = 0;
+		string data;
+		string entry = makeData(RequestRing::MAX_ENTRY_SIZE, 'x');
+
+		ensure("(1)", !producer->push(1, ""));
+		ensure("(2)", !producer->push(1, makeData(RequestRing::MAX_ENTRY_SIZE + 1, 'x')));
+		while (producer->push(count, entry)) {
+			count++;
+		}
+		ensure("(3)", count > 0);
+		ensure("(4)", count < 4);
+		ensure("(5)", producer->push(count, "small"));
+		ensure("(6)", consumer->pop(token, data));
+		ensure_equals("(7)", token, 0u);
+		ensure("(8)", producer->push(count + 1, entry));
+	}
+
+	TEST_METHOD(4) {
+		// The producer only notifies the consumer when it's waiting.
+		init();
+		unsigned int token;
+		string data;
+
+		ensure("(1)", !notified());
+		ensure("(2)", producer->push(1, "first"));
+		ensure("(3)", notified());
+
+		consumer->clearNotification();
+		ensure("(4)", !notified());
+		ensure("(5)", producer->push(2, "second"));
+		ensure("(6)", !notified());
+		ensure("(7)", !consumer->prepareToWait());
+
+		ensure("(8)", consumer->pop(token, data));
+		ensure("(9)", consumer->pop(token, data));
+		ensure("(10)", !consumer->pop(token, data));
+		ensure("(11)", consumer->prepareToWait());
+		ensure("(12)", producer->push(3, "third"));
+		ensure("(13)", notified());
+	}
+
+	TEST_METHOD(5) {
+		// pop() rejects entries that don't make sense instead of reading
+		// beyond the ring.
+		init();
+		unsigned int token;
+		string data;
+		size_t size = 256 + RequestRing::DEFAULT_CAPACITY;
+		char *memory = (char *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			producer->getMemoryFd(), 0);
+		ensure("(1)", memory != MAP_FAILED);
+
+		ensure("(2)", producer->push(1, "hello"));
+		// Corrupt the entry size.
+		*((boost::uint32_t *) (memory + 256)) = RequestRing::MAX_ENTRY_SIZE + 1;
+		try {
+			consumer->pop(token, data);
+			fail("IOException expected");
+		} catch (const IOException &) {
+			// Pass.
+		}
+
+		// An entry that extends beyond the head.
+		*((boost::uint32_t *) (memory + 256)) = 1024;
+		try {
+			consumer->pop(token, data);
+			fail("IOException expected");
+		} catch (const IOException &) {
+			// Pass.
+		}
+
+		// A head that is too far ahead of the tail.
+		*((boost::uint32_t *) (memory + 256)) = 5;
+		*((boost::uint32_t *) (memory + 64)) = RequestRing::DEFAULT_CAPACITY + 8;
+		try {
+			consumer->pop(token, data);
+			fail("IOException expected");
+		} catch (const IOException &) {
+			// Pass.
+		}
+		munmap(memory, size);
+	}
+
+	TEST_METHOD(6) {
+		// attach() rejects files that aren't request rings.
+		init();
+		FileDescriptor fd(open("/tmp", O_RDONLY));
+		try {
+			RequestRing::attach(fd, producer->getNotifyFd());
+			fail("IOException expected");
+		} catch (const IOException &) {
+			// Pass.
+		}
+	}
+
+	TEST_METHOD(7) {
+		// The producer can't resize the ring under the consumer's mapping,
+		// and attach() rejects files whose size isn't sealed.
+		init();
+		off_t size = 256 + RequestRing::DEFAULT_CAPACITY;
+		ensure_equals("(1)", ftruncate(producer->getMemoryFd(), size / 2), -1);
+		ensure_equals("(2)", errno, EPERM);
+		ensure_equals("(3)", ftruncate(producer->getMemoryFd(), size * 2), -1);
+		ensure_equals("(4)", errno, EPERM);
+
+		char path[] = "/tmp/request_ring_test.XXXXXX";
+		FileDescriptor fd(mkstemp(path));
+		unlink(path);
+		ensure("(5)", ftruncate(fd, size) == 0);
+		try {
+			RequestRing::attach(fd, producer->getNotifyFd());
+			fail("IOException expected");
+		} catch (const IOException &) {
+			// Pass.
+		}
+	}
+}
@@ -741,5 +741,61 @@ namespace tut {
 		ensure("(2)", data.find("transaction 2\n") == string::npos);
 	}
 	
+	TEST_METHOD(31) {
+		// A batching Logger holds on to its messages until the transaction
+		// is closed, and then sends them along with the closeTransaction command.
+		SystemTime::forceAll(YESTERDAY);
+		factory->setBatching(1024 * 1024, 60 * 1000000);
+		
+		LoggerPtr log = factory->newTransaction("foobar");
+		ensure("(1)", log->isBatching());
+		log->message("message 1");
+		
+		SystemTime::forceAll(TODAY);
+		LoggerPtr log2 = factory2->continueTransaction(log->getTxnId(),
+			log->getGroupName(), log->getCategory());
+		log2->message("message 2");
+		log2->flushToDiskAfterClose(true);
+		log2.reset();
+		
+		log->flushToDiskAfterClose(true);
+		log.reset();
+		
+		string data = readDumpFile();
+		ensure("(2)", data.find(timestampString(YESTERDAY) + " 0 ATTACH\n") != string::npos);
+		ensure("(3)", data.find(timestampString(TODAY) + " 2 message 2\n") != string::npos);
+		ensure("(4)", data.find(timestampString(YESTERDAY) + " 4 message 1\n") != string::npos);
+		ensure("(5)", data.find(timestampString(TODAY) + " 5 DETACH\n") != string::npos);
+	}
+	
+	TEST_METHOD(32) {
+		// A batching Logger sends its messages as soon as the batch
+		// grows beyond the size threshold or becomes too old.
+		SystemTime::forceAll(YESTERDAY);
+		factory->setBatching(1, 60 * 1000000);
+		factory2->setBatching(1024 * 1024, 0);
+		
+		// The messages are sent over different connections, so give
+		// the server some time to process each one in order.
+		LoggerPtr log = factory->newTransaction("foobar");
+		log->message("message 1");
+		usleep(20000);
+		LoggerPtr log2 = factory2->continueTransaction(log->getTxnId(),
+			log->getGroupName(), log->getCategory());
+		log2->message("message 2");
+		usleep(20000);
+		log->message("message 3");
+		usleep(20000);
+		log2->flushToDiskAfterClose(true);
+		log2.reset();
+		log->flushToDiskAfterClose(true);
+		log.reset();
+		
+		string data = readDumpFile();
+		ensure("(1)", data.find(" 1 message 1\n") != string::npos);
+		ensure("(2)", data.find(" 3 message 2\n") != string::npos);
+		ensure("(3)", data.find(" 4 message 3\n") != string::npos);
+	}
+	
 	/************************************/
 }
@@ -1,5 +1,6 @@
 require File.expand_path(File.dirname(__FILE__) + "/spec_helper")
 require 'support/nginx_controller'
+require 'phusion_passenger/admin_tools/server_instance'
 require 'integration_tests/mycook_spec'
 require 'integration_tests/cgi_environment_spec'
 require 'integration_tests/hello_world_rack_spec'
@@ -116,6 +117,15 @@ describe "Phusion Passenger for Nginx" do
 				server[:root]        = "#{@stub.full_app_root}/public"
 				server[:passenger_max_requests] = 3
 			end
+			@nginx.add_server do |server|
+				server[:server_name] = "3.passenger.test"
+				server[:root]        = "#{@stub.full_app_root}/public"
+				server << %q{
+					passenger_set_cgi_param PASSENGER_APP_GROUP_NAME group_$arg_group;
+					location / {
+					}
+				}
+			end
 			@nginx.start
 		end
 		
@@ -274,6 +284,26 @@ describe "Phusion Passenger for Nginx" do
 			get("/pid").should == pid
 			get("/pid").should_not == pid
 		end
+		
+		it "honors PASSENGER_* CGI params that a location inherits from its server block" do
+			@server = "http://3.passenger.test:#{@nginx.port}/"
+			pid = get("/pid?group=a")
+			get("/pid?group=a").should == pid
+			get("/pid?group=b").should_not == pid
+		end
+		
+		it "keeps serving requests with the same application process after passenger-config --hot-restart" do
+			pid = get("/pid")
+			instance = PhusionPassenger::AdminTools::ServerInstance.list.first
+			helper_agent_pid = instance.helper_agent_pid
+			
+			system("#{PhusionPassenger.bin_dir}/passenger-config", "--hot-restart").should be_true
+			eventually(15) do
+				instance.helper_agent_pid != helper_agent_pid
+			end
+			
+			get("/pid").should == pid
+		end
 	end
 	
 	describe "oob work" do
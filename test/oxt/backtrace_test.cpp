@@ -84,5 +84,65 @@ namespace tut {
 		foo_thread.join();
 		bar_thread.join();
 	}
+	
+	static string recurse(unsigned int depth) {
+		TRACE_POINT_WITH_NAME("recurse");
+		if (depth == 0) {
+			return tracable_exception().backtrace();
+		} else {
+			return recurse(depth - 1);
+		}
+	}
+	
+	TEST_METHOD(3) {
+		// Trace points beyond the maximum depth are not recorded, and
+		// don't corrupt the backtrace.
+		string backtrace = recurse(OXT_MAX_BACKTRACE_DEPTH * 2);
+		string::size_type pos = 0;
+		unsigned int count = 0;
+		while ((pos = backtrace.find("'recurse'", pos)) != string::npos) {
+			count++;
+			pos++;
+		}
+		ensure(count > 0);
+		ensure(count <= OXT_MAX_BACKTRACE_DEPTH);
+		
+		try {
+			TRACE_POINT_WITH_NAME("after_recursion");
+			throw tracable_exception();
+		} catch (const tracable_exception &e) {
+			ensure(e.backtrace().find("after_recursion") != string::npos);
+			ensure(e.backtrace().find("recurse") == string::npos);
+		}
+	}
+	
+	static void push_and_pop(CounterPtr child_counter) {
+		TRACE_POINT_WITH_NAME("push_and_pop");
+		child_counter->increment();
+		while (true) {
+			boost::this_thread::interruption_point();
+			TRACE_POINT_WITH_NAME("inner1");
+			{
+				TRACE_POINT_WITH_NAME("inner2");
+			}
+		}
+	}
+	
+	TEST_METHOD(4) {
+		// Reading the backtrace of a thread that is constantly pushing and
+		// popping trace points works.
+		CounterPtr child_counter = Counter::create_ptr();
+		oxt::thread thr(boost::bind(push_and_pop, child_counter));
+		child_counter->wait_until(1);
+		
+		for (int i = 0; i < 1000; i++) {
+			string backtrace = thr.backtrace();
+			ensure(backtrace, backtrace.find("push_and_pop") != string::npos);
+			ensure(backtrace, backtrace.find("inner2") == string::npos
+				|| backtrace.find("inner1") != string::npos);
+		}
+		
+		thr.interrupt_and_join();
+	}
 }
 
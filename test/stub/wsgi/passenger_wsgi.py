@@ -91,6 +91,9 @@ def application(env, start_response):
 				written += len(data)
 		start_response(status, [('Content-Type', 'text/plain')])
 		return body()
+	elif path == '/custom_date':
+		start_response(status, [('Content-Type', 'text/plain'), ('DATE', env['HTTP_X_DATE'])])
+		return [str('ok')]
 	elif path == '/oobw':
 		start_response(status, [('Content-Type', 'text/plain'), ('X-Passenger-Request-OOB-Work', 'true')])
 		return [str(os.getpid())]